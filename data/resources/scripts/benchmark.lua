@@ -29,8 +29,10 @@
 --    tick() - invoke at monotonic rates,
 --             return true (pass) or false (fail)
 --
---    report(min, max, avg, stddev) - called before increment_function,
---         default output is print to a csv style format
+--    report(min, max, avg, stddev, unif_set, unif_skip) - called before
+--         increment_function, default output is print to a csv style
+--         format. unif_set / unif_skip are the shader uniform uploads
+--         issued / skipped as redundant since the benchmark started.
 --
 --    destroy() - reset global states, delete possible list of vobjects
 --
@@ -69,14 +71,15 @@ local function calc_avg(frames)
 end
 
 local function bench_tick(tbl)
-	local tckcnt, ticks, framecnt, frames, costcnt, cost = benchmark_data();
+	local tckcnt, ticks, framecnt, frames, costcnt, cost,
+		gccnt, gctime, unif_set, unif_skip = benchmark_data();
 
 	if (framecnt > tbl.min) then
 		local avg, min, max, stddev = calc_avg(frames);
 		avg = 1000.0 / avg;
 
 		if (avg > tbl.thresh) then
-			tbl.rep(tbl.count, min, max, avg, stddev);
+			tbl.rep(tbl.count, min, max, avg, stddev, unif_set, unif_skip);
 			tbl.last_avg = avg;
 			tbl.count = tbl.count + 1;
 
@@ -102,8 +105,9 @@ local function bench_tick(tbl)
 	end
 end
 
-local function default_rep(count, min, max, avg, stddev)
-	print(string.format("%d;%d;%d;%d;%d", count, min, max, avg, stddev));
+local function default_rep(count, min, max, avg, stddev, unif_set, unif_skip)
+	print(string.format("%d;%d;%d;%d;%d;%d;%d", count, min, max, avg, stddev,
+		unif_set, unif_skip));
 end
 
 local function bench_destr(tbl)
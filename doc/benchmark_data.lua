@@ -1,7 +1,13 @@
 -- benchmark_data
 -- @short: Retrieve gathered benchmarking values.
--- @outargs: nticks, tickcosttbl, framecount, frametimetbl, costcount, framecosttbl
+-- @outargs: nticks, tickcosttbl, framecount, frametimetbl, costcount, framecosttbl, gccount, gctimetbl, unif_issued, unif_skipped
+-- @note: gctimetbl is in microseconds spent on engine- driven garbage
+-- collection per frame, see ref:system_gcbudget.
+-- @note: unif_issued is the number of shader uniform uploads sent to the
+-- graphics layer since the last ref:benchmark_enable call, and
+-- unif_skipped the number that were dropped as the program already
+-- had the same value.
 -- @group: system
 -- @cfunction: getbenchvals
--- @related: benchmark_enable, benchmark_timestamp
+-- @related: benchmark_enable, benchmark_timestamp, system_gcbudget
 
@@ -0,0 +1,37 @@
+-- benchmark_trace
+-- @short: Control hot-path tracing or export the recorded trace.
+-- @inargs: bool:state, *int:entries*
+-- @inargs: string:dstres
+-- @outargs: bool:ok
+-- @longdescr: When tracing is active, the engine records nanosecond
+-- resolution timing zones for the hot paths (lua callbacks, video tick,
+-- frameserver polling, texture uploads, display synch) into per-thread
+-- ring buffers. Calling with a boolean *state* starts or stops recording,
+-- the optional *entries* argument sets the number of zones kept per thread
+-- for rings that have not been allocated yet. Starting discards zones
+-- recorded before. Calling with a string writes the current contents of
+-- all rings to *dstres* in the APPL_TEMP namespace as Chrome trace event
+-- JSON, viewable in chrome://tracing or ui.perfetto.dev. The export can be
+-- done while tracing is still active.
+-- @note: Setting ARCAN_TRACE=file in the environment starts tracing at
+-- launch, and writes to file on SIGRTMIN+2 and on exit.
+-- @note: Frameservers launched with ARCAN_SHMIF_TRACE=prefix set record the
+-- client side of the synchronization into prefix.pid.json, using the same
+-- clock so the traceEvents can be merged with the engine trace.
+-- @group: system
+-- @cfunction: benchtrace
+-- @related: benchmark_enable, benchmark_data
+function main()
+#ifdef MAIN
+	benchmark_trace(true);
+	counter = 0;
+#endif
+end
+
+function main_clock_pulse()
+	counter = counter + 1;
+	if (counter == 100) then
+		benchmark_trace("trace.json");
+		return shutdown();
+	end
+end
@@ -29,6 +29,11 @@
 -- trans_rotate (float, 0.0 .. 1.0), obj_input_sz (vec2, orig w/h)
 -- obj_output_sz (vec2, current w/h), obj_storage_sz (vec2, texture
 -- storage w/h).
+-- @note: For GLSL versions with uniform blocks (GLES3 or GL3.1+), a shader
+-- can declare layout(std140) uniform arcan_env { mat4 projection;
+-- float fract_timestamp; int timestamp; }; instead of the individual
+-- uniforms. The block is shared between all shaders and only updated
+-- when one of the values change.
 -- @group: vidsys
 -- @related: shader_uniform, image_shader
 -- @cfunction: buildshader
@@ -0,0 +1,38 @@
+-- launch_prespawn
+-- @short: Keep a pool of prespawned frameservers for faster launches.
+-- @inargs: string:archetype, *int:size*
+-- @outargs: nil or tbl:stats
+-- @longdescr: Launching a frameserver (ref:launch_avfeed, ref:launch_decode,
+-- ...) normally allocates the shared memory segment and forks and executes
+-- the frameserver binary on every call, which adds noticeable delay before
+-- the first frame arrives. With a *size* set, the engine keeps up to *size*
+-- frameservers of the specified *archetype* (one of the modes in the
+-- FRAMESERVER_MODES global) started and waiting, and the next launch of that
+-- archetype picks one of those and only has to hand over its arguments.
+-- The pool is refilled from the main loop when there is time to spare
+-- before the next frame. Setting *size* to 0 drops all waiting frameservers
+-- of the archetype but keeps the statistics. The returned table contains
+-- the current *size*, number of *ready* frameservers, the number of *warm*
+-- (pooled) and *cold* launches of the archetype and their mean
+-- launch-to-first-frame time in milliseconds as *warm_ms* and *cold_ms*.
+-- Calling without a *size* only returns the statistics, or nil if the
+-- archetype has never been configured.
+-- @note: The environment variable ARCAN_FRAMESERVER_POOL=decode:2,terminal:1
+-- configures pools at startup.
+-- @note: Prespawned frameservers are dropped and started again on appl
+-- switches as they inherit the namespaces of the appl at launch.
+-- @group: targetcontrol
+-- @cfunction: launchprespawn
+-- @related: launch_avfeed, launch_decode
+function main()
+#ifdef MAIN
+	launch_prespawn("decode", 2);
+	launch_decode("test.mkv", function(source, status) end);
+	local stats = launch_prespawn("decode");
+	print(stats.ready, stats.warm, stats.cold);
+#endif
+
+#ifdef ERROR
+	launch_prespawn("no_such_archetype", 2);
+#endif
+end
@@ -5,6 +5,13 @@
 -- @longdescr: Launch a new frameserver in networking server mode. The *callback*
 -- argument will be used as an event trigger for conveying all client related events.
 -- For the contents of such triggers, see the notes.
+-- @note: Completed state transfers are reported as a "transfer" event with
+-- the fields *id*, *direction* ("in" or "out"), *bytes*, *wire* (bytes that
+-- actually crossed the network), *chunks*, *cached* (chunks the peer already
+-- had), *ms*, *ratio* (wire / bytes) and *rate* (bytes per second).
+-- @note: State is sent as deduplicated, optionally LZ compressed, chunks when
+-- both ends support it. The standalone frameserver accepts the *nodelta* and
+-- *nolz* arguments (ARCAN_ARG) to disable either.
 -- @group: network
 -- @cfunction: net_listen
 -- @flags: experimental
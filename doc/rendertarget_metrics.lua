@@ -0,0 +1,28 @@
+-- rendertarget_metrics
+-- @short: Retrieve readback statistics for a rendertarget
+-- @inargs: rtvid
+-- @outargs: tbl
+-- @longdescr: Readbacks (as requested through ref:define_recordtarget,
+-- ref:define_calctarget or ref:stepframe_target) are queued in a small ring
+-- of transfer buffers so that a slow consumer does not stall rendering.
+-- This function returns a table with the fields *readback_completed*
+-- (number of delivered frames), *readback_dropped* (number of requests
+-- that were discarded because the ring was full), *readback_latency*
+-- (moving average, in milliseconds, between request and delivery) and
+-- *readback_pending* (transfers currently in flight).
+-- @group: targetcontrol
+-- @cfunction: rendertarget_metrics
+-- @related: define_recordtarget, define_calctarget
+function main()
+#ifdef MAIN
+	local rt = alloc_surface(320, 200);
+	define_calctarget(rt, {}, RENDERTARGET_DETACH, RENDERTARGET_NOSCALE, -1,
+		function() end);
+	local tbl = rendertarget_metrics(rt);
+	print(tbl.readback_completed, tbl.readback_dropped, tbl.readback_latency);
+#endif
+
+#ifdef ERROR1
+	rendertarget_metrics(BADID);
+#endif
+end
@@ -0,0 +1,23 @@
+-- rescan_resources
+-- @short: Drop the cached view of one or more resource namespaces.
+-- @inargs: *domain*
+-- @outargs:
+-- @longdescr: Resource lookups (ref:resource, ref:glob_resource and all
+-- functions that take a resource name) are answered from an in-memory index
+-- of the namespace directories when the platform can track changes to them.
+-- Directories are read the first time a lookup passes through them and are
+-- dropped from the index as soon as their contents change, so this function
+-- is normally not needed. It can be used to force the index to be rebuilt
+-- from scratch for the namespaces in *domain* (can be ORed, default is all),
+-- e.g. after symlinks have been retargeted.
+-- @note: Valid constants for domain are APPL_RESOURCE, APPL_TEMP_RESOURCE,
+-- SHARED_RESOURCE, SYS_APPL_RESOURCE, SYS_FONT_RESOURCE, APPL_STATE_RESOURCE.
+-- @group: resource
+-- @cfunction: rescanresources
+-- @related: resource, glob_resource, resource_stats
+function main()
+#ifdef MAIN
+	rescan_resources(SHARED_RESOURCE);
+	print(resource("images/icon.png"));
+#endif
+end
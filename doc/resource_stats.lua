@@ -0,0 +1,22 @@
+-- resource_stats
+-- @short: Retrieve counters for the resource lookup index.
+-- @inargs:
+-- @outargs: tbl
+-- @longdescr: Returns a table with the number of resource lookups that were
+-- answered from the in-memory namespace index (*hits*), the number that
+-- needed one or more directories to be read first (*misses*) and the number
+-- that had to go to the filesystem (*uncached*), along with the number of
+-- directories that have been read into the index (*dirs*). On platforms
+-- without change notification all lookups are counted as *uncached*.
+-- @group: resource
+-- @cfunction: resourcestats
+-- @related: rescan_resources, resource
+function main()
+#ifdef MAIN
+	for i=1,100 do
+		resource("fonts/default.ttf");
+	end
+	local stats = resource_stats();
+	print(stats.hits, stats.misses, stats.uncached, stats.dirs);
+#endif
+end
@@ -0,0 +1,31 @@
+-- system_gcbudget
+-- @short: Get or set the per-frame time budget for Lua garbage collection.
+-- @inargs: *budget*
+-- @outargs: prevbudget
+-- @longdescr: By default, the engine stops the automatic Lua garbage
+-- collector and instead runs incremental collection steps in the idle time
+-- that remains between finishing script and event processing and the next
+-- expected frame synchronization. This prevents full collection cycles from
+-- landing in the middle of a frame. The *budget* argument (in milliseconds,
+-- fractions are permitted) caps how much time per frame that may be spent on
+-- such collection. A budget of 0 returns control to the automatic collector.
+-- The function always returns the previous budget.
+-- @note: If the heap grows much faster than the budget allows it to be
+-- collected, the current collection cycle will be completed regardless of
+-- frame timing.
+-- @note: Time spent collecting per frame is reported as the last two
+-- return values of ref:benchmark_data.
+-- @note: Negative budgets are a terminal state transition.
+-- @group: system
+-- @cfunction: gcbudget
+-- @related: benchmark_data
+function main()
+#ifdef MAIN
+	local prev = system_gcbudget(0.5);
+	print("previous budget: " .. prev .. " ms");
+#endif
+
+#ifdef ERROR
+	system_gcbudget(-1);
+#endif
+end
@@ -24,6 +24,11 @@
 -- barrier alltogether, it should be used sparringly and only with verified
 -- and trusted code.
 --
+-- @note: Compiled .lua scripts are cached in the .luacache folder of the
+-- appl state store and reused until the source changes. Nothing is cached if
+-- the state store is not writable or overlaps the temp or shared namespaces,
+-- set the ARCAN_LUA_NOCACHE environment variable to always parse from source.
+--
 -- @note: The namespace mapping can be changed compile- time by setting
 -- CAREFUL_USERMASK and MODULE_USERMASK for the arcan_lua.c source file.
 -- @group: system
@@ -0,0 +1,58 @@
+-- target_multicast
+-- @short: Share the frames of one frameserver with several output segments.
+-- @inargs: vid:source, *vid:subscriber*, *int:mode*
+-- @outargs: bool or nil or tbl:stats
+-- @longdescr: Mirroring one source to several consumers, e.g. recording,
+-- streaming and remoting the same rendertarget, normally costs one
+-- rendertarget, one readback and one copy per consumer. With target_multicast,
+-- the frames of *source* are instead copied once into a pool of frame slots
+-- that is shared, read-only, with every *subscriber*. If *source* is a
+-- recordtarget (ref:define_recordtarget) its readbacks are shared, and it
+-- becomes part of the group itself. Otherwise the buffers that the client
+-- of *source* commits are shared as they are received.
+-- The *mode* decides what happens when a subscriber is still busy with the
+-- previous frame as a new one arrives: with MULTICAST_DROP (default) that
+-- subscriber misses the frame, with MULTICAST_BLOCK the frame is held back
+-- for the entire group until the subscriber has caught up. MULTICAST_DETACH
+-- removes *subscriber* from the group, and with *subscriber* set to *source*
+-- the group is dissolved. These variants return true or false depending on
+-- if the operation succeeded.
+-- Without a *subscriber*, a table with the number of *subscribers*, pool
+-- *slots*, *published* frames and frames held back (*stalled*) is returned,
+-- or nil if *source* has no multicast group.
+-- @note: Subscribers that are recordtargets have their own readbacks
+-- suspended while subscribed, so they can be defined with an empty set of
+-- sources. The readback setting is restored on detach.
+-- @note: Frames are only delivered to subscribers with the same dimensions
+-- as the source, others count them as dropped. Frame delivery to each
+-- subscriber is reported through the normal frame status events if
+-- ref:target_verbose is set.
+-- @note: Only output segments (e.g. recordtargets) can be subscribers,
+-- attaching any other kind of frameserver returns false.
+-- @note: A subscriber can only be part of one group and can't be the source
+-- of a group of its own. A group holds at most 16 subscribers.
+-- @group: targetcontrol
+-- @cfunction: targetmulticast
+-- @related: define_recordtarget, target_verbose
+function main()
+#ifdef MAIN
+	local buf = alloc_surface(VRESW, VRESH);
+	local img = color_surface(64, 64, 255, 0, 0);
+	show_image(img);
+
+	define_recordtarget(buf, "test.mkv", "", {img}, {},
+		RENDERTARGET_DETACH, RENDERTARGET_NOSCALE, -1, function(s, st) end);
+
+	local vnc = alloc_surface(VRESW, VRESH);
+	define_recordtarget(vnc, "", "protocol=vnc", {null_surface(1, 1)}, {},
+		RENDERTARGET_DETACH, RENDERTARGET_NOSCALE, -1, function(s, st) end);
+
+	target_multicast(buf, vnc, MULTICAST_DROP);
+	local stats = target_multicast(buf);
+	print(stats.subscribers, stats.published);
+#endif
+
+#ifdef ERROR
+	target_multicast(BADID, BADID);
+#endif
+end
@@ -998,7 +998,7 @@ static inline bool step_transform(arcan_aobj* obj)
 		obj->gain = obj->transform->d_gain;
 		struct arcan_achain* ct = obj->transform;
 		obj->transform = obj->transform->next;
-		free(ct);
+		arcan_mem_free(ct);
 	}
 
 	return true;
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ * Description: audio format conversion and mixing, see arcan_audio_mix.h
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "arcan_audio_mix.h"
+
+#if defined(ARCAN_AUDIO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define AMIX_SSE2
+#endif
+
+#define S16_SCALE 32767.0f
+
+void arcan_amix_s16tof(const int16_t* src, float* dst,
+	size_t n, float lgain, float rgain)
+{
+	size_t i = 0;
+
+#ifdef AMIX_SSE2
+/* gain vector follows the L/R interleaving, n is kept even by callers but
+ * the scalar tail handles any remainder */
+	__m128 gv = _mm_setr_ps(
+		lgain / S16_SCALE, rgain / S16_SCALE, lgain / S16_SCALE, rgain / S16_SCALE);
+
+	for (; i + 8 <= n; i += 8){
+		__m128i in = _mm_loadu_si128((const __m128i*)&src[i]);
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+		_mm_storeu_ps(&dst[i], _mm_mul_ps(_mm_cvtepi32_ps(lo), gv));
+		_mm_storeu_ps(&dst[i+4], _mm_mul_ps(_mm_cvtepi32_ps(hi), gv));
+	}
+#endif
+
+	for (; i < n; i++)
+		dst[i] = (i % 2 ? rgain : lgain) * ((float)src[i] / S16_SCALE);
+}
+
+void arcan_amix_ftos16(const float* src, int16_t* dst, size_t n)
+{
+	size_t i = 0;
+
+#ifdef AMIX_SSE2
+	__m128 sv = _mm_set1_ps(S16_SCALE);
+	__m128 maxv = _mm_set1_ps(32767.0f);
+	__m128 minv = _mm_set1_ps(-32768.0f);
+
+	for (; i + 8 <= n; i += 8){
+		__m128 a = _mm_mul_ps(_mm_loadu_ps(&src[i]), sv);
+		__m128 b = _mm_mul_ps(_mm_loadu_ps(&src[i+4]), sv);
+		a = _mm_max_ps(_mm_min_ps(a, maxv), minv);
+		b = _mm_max_ps(_mm_min_ps(b, maxv), minv);
+		_mm_storeu_si128((__m128i*)&dst[i],
+			_mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b)));
+	}
+#endif
+
+	for (; i < n; i++){
+		float val = src[i];
+		dst[i] = val >= 1.0f ? 32767 : (val < -1.0f ? -32768 : val * S16_SCALE);
+	}
+}
+
+void arcan_amix_blend(float* dst, const float* src, size_t n)
+{
+	size_t i = 0;
+
+#ifdef AMIX_SSE2
+	for (; i + 4 <= n; i += 4){
+		__m128 a = _mm_loadu_ps(&dst[i]);
+		__m128 b = _mm_loadu_ps(&src[i]);
+		_mm_storeu_ps(&dst[i], _mm_sub_ps(_mm_add_ps(a, b), _mm_mul_ps(a, b)));
+	}
+#endif
+
+	for (; i < n; i++)
+		dst[i] = dst[i] + src[i] - dst[i] * src[i];
+}
+
+void arcan_amix_accum_s16(float* dst, const int16_t* src, size_t n, float gain)
+{
+	size_t i = 0;
+	float sf = gain / S16_SCALE;
+
+#ifdef AMIX_SSE2
+	__m128 gv = _mm_set1_ps(sf);
+
+	for (; i + 8 <= n; i += 8){
+		__m128i in = _mm_loadu_si128((const __m128i*)&src[i]);
+		__m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16));
+		__m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16));
+		_mm_storeu_ps(&dst[i], _mm_add_ps(_mm_loadu_ps(&dst[i]), _mm_mul_ps(lo, gv)));
+		_mm_storeu_ps(&dst[i+4],
+			_mm_add_ps(_mm_loadu_ps(&dst[i+4]), _mm_mul_ps(hi, gv)));
+	}
+#endif
+
+	for (; i < n; i++)
+		dst[i] += (float)src[i] * sf;
+}
+
+void arcan_amix_gain_s16(int16_t* buf, size_t n, float lgain, float rgain)
+{
+	size_t i = 0;
+
+#ifdef AMIX_SSE2
+	__m128 gv = _mm_setr_ps(lgain, rgain, lgain, rgain);
+	__m128 maxv = _mm_set1_ps(32767.0f);
+	__m128 minv = _mm_set1_ps(-32768.0f);
+
+	for (; i + 8 <= n; i += 8){
+		__m128i in = _mm_loadu_si128((const __m128i*)&buf[i]);
+		__m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16));
+		__m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16));
+		lo = _mm_max_ps(_mm_min_ps(_mm_mul_ps(lo, gv), maxv), minv);
+		hi = _mm_max_ps(_mm_min_ps(_mm_mul_ps(hi, gv), maxv), minv);
+		_mm_storeu_si128((__m128i*)&buf[i],
+			_mm_packs_epi32(_mm_cvttps_epi32(lo), _mm_cvttps_epi32(hi)));
+	}
+#endif
+
+	for (; i < n; i++){
+		float val = (float)buf[i] * (i % 2 ? rgain : lgain);
+		buf[i] = val >= 32767.0f ? 32767 : (val <= -32768.0f ? -32768 : val);
+	}
+}
+
+size_t arcan_amix_ring_push(struct arcan_amix_ring* ring,
+	const int16_t* src, size_t n, float lgain, float rgain)
+{
+	size_t space = ARCAN_AMIX_RINGSZ - ring->count;
+	if (n > space)
+		n = space;
+	n &= ~(size_t)1;
+
+/* write position wraps, split into at most two contiguous spans */
+	size_t wpos = (ring->ofs + ring->count) % ARCAN_AMIX_RINGSZ;
+	size_t span = ARCAN_AMIX_RINGSZ - wpos;
+	if (span > n)
+		span = n;
+
+	arcan_amix_s16tof(src, &ring->buf[wpos], span, lgain, rgain);
+	if (n > span)
+		arcan_amix_s16tof(&src[span], ring->buf, n - span, lgain, rgain);
+
+	ring->count += n;
+	return n;
+}
+
+void arcan_amix_ring_pop(struct arcan_amix_ring* ring,
+	float* dst, size_t n, bool first)
+{
+	if (n > ring->count)
+		n = ring->count;
+
+	size_t span = ARCAN_AMIX_RINGSZ - ring->ofs;
+	if (span > n)
+		span = n;
+
+	if (first){
+		memcpy(dst, &ring->buf[ring->ofs], span * sizeof(float));
+		memcpy(&dst[span], ring->buf, (n - span) * sizeof(float));
+	}
+	else {
+		arcan_amix_blend(dst, &ring->buf[ring->ofs], span);
+		arcan_amix_blend(&dst[span], ring->buf, n - span);
+	}
+
+	ring->ofs = (ring->ofs + n) % ARCAN_AMIX_RINGSZ;
+	ring->count -= n;
+}
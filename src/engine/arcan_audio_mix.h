@@ -0,0 +1,74 @@
+/*
+ * Copyright 2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ * Description: sample format conversion and mixing primitives shared by
+ * the frameserver audio mixer (recording) and the audio subsystem. All
+ * buffers are interleaved stereo and sample counts are in samples, not
+ * frames. The implementation uses SSE2 when built with ARCAN_AUDIO_SIMD.
+ */
+
+#ifndef _HAVE_ARCAN_AUDIO_MIX
+#define _HAVE_ARCAN_AUDIO_MIX
+
+#ifndef ARCAN_AMIX_RINGSZ
+#define ARCAN_AMIX_RINGSZ 4096
+#endif
+
+/*
+ * Per-source intermediate buffer, samples are stored as float with the
+ * source gain already applied. Reading and writing is always done in
+ * whole frames so that even ring positions are always the left channel.
+ */
+struct arcan_amix_ring {
+	float buf[ARCAN_AMIX_RINGSZ];
+	size_t ofs;
+	size_t count;
+};
+
+/*
+ * Convert [n] signed 16-bit samples to float in the -1..1 range,
+ * multiplying left (even) samples with [lgain] and right (odd) with [rgain].
+ */
+void arcan_amix_s16tof(const int16_t* src, float* dst,
+	size_t n, float lgain, float rgain);
+
+/*
+ * Convert [n] float samples to signed 16-bit, clipping to -1..1.
+ * [dst] does not need to be aligned.
+ */
+void arcan_amix_ftos16(const float* src, int16_t* dst, size_t n);
+
+/*
+ * Blend [n] samples from [src] into [dst] using (A + B - A * B).
+ */
+void arcan_amix_blend(float* dst, const float* src, size_t n);
+
+/*
+ * Convert [n] signed 16-bit samples to float, multiply with [gain] and add
+ * to [dst]. Used for summing playback voices before the final clip.
+ */
+void arcan_amix_accum_s16(float* dst, const int16_t* src, size_t n, float gain);
+
+/*
+ * Apply a (left, right) gain to [n] signed 16-bit samples in place,
+ * saturating on overflow.
+ */
+void arcan_amix_gain_s16(int16_t* buf, size_t n, float lgain, float rgain);
+
+/*
+ * Convert and append at most [n] samples from [src] to [ring], returns
+ * the number of samples that were consumed. Samples that do not fit are
+ * dropped by the caller.
+ */
+size_t arcan_amix_ring_push(struct arcan_amix_ring* ring,
+	const int16_t* src, size_t n, float lgain, float rgain);
+
+/*
+ * Consume [n] samples (n <= ring->count) from the [ring] and blend
+ * into [dst], or if [first] is set, copy into [dst].
+ */
+void arcan_amix_ring_pop(struct arcan_amix_ring* ring,
+	float* dst, size_t n, bool first);
+
+#endif
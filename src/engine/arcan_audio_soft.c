@@ -0,0 +1,1317 @@
+/*
+ * Copyright 2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ * Description: software audio mixer, selected with -DAUDIO_PLATFORM=soft
+ * as an alternative to the OpenAL based arcan_audio.c. Implements the
+ * same arcan_audio.h interface.
+ *
+ * Structure:
+ *  - aobjs, feeds, transforms and monitors are managed on the main thread
+ *    just like in the OpenAL version.
+ *  - each playing aobj gets a voice. Streaming voices have a single-
+ *    producer (main thread) / single-consumer (mixer) ring of s16 stereo
+ *    frames at the output samplerate. Sources with other samplerates are
+ *    converted with the speex resampler when buffered.
+ *  - a dedicated (realtime- priority if permitted) mixer thread sums all
+ *    active voices with their gain every period and writes to a sink.
+ *    Nothing in the mixer thread takes locks or allocates.
+ *  - voice ownership is handed back and forth with an atomic state, the
+ *    main thread reaps voices that the mixer has finished with in _tick.
+ *
+ * Sinks are picked with the ARCAN_AUDIO_SINK environment variable:
+ *  null          - discard (but keep realtime pacing)
+ *  wav:/path     - write a 16-bit stereo RIFF/WAVE file (headless testing)
+ *  oss[:/dev/dsp] - OSS compatible device (default where available)
+ *
+ * Frameserver shm buffers are still drained from the main thread (through
+ * the feed callback in arcan_audio_refresh) as the segment lifecycle and
+ * its SIGBUS guard belong to that thread. The rings decouple this from
+ * output, so underruns are no longer tied to the render loop.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <assert.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+
+#if defined(__linux__)
+#include <linux/soundcard.h>
+#define HAVE_OSS
+#elif defined(__FreeBSD__) || defined(__OpenBSD__)
+#include <sys/soundcard.h>
+#define HAVE_OSS
+#endif
+
+#include "arcan_math.h"
+#include "arcan_general.h"
+#include "arcan_shmif.h"
+#include "arcan_video.h"
+#include "arcan_audio.h"
+#include "arcan_audioint.h"
+#include "arcan_audio_mix.h"
+#include "arcan_event.h"
+
+#include "util/resampler/speex_resampler.h"
+
+#ifndef CONST_MAX_ASAMPLESZ
+#define CONST_MAX_ASAMPLESZ 1048756
+#endif
+
+/* number of simultaneously mixed streams and sample instances */
+#ifndef ARCAN_AUDIO_VOICES
+#define ARCAN_AUDIO_VOICES 64
+#endif
+
+/* frames per stream ring, power of two and large enough for a full
+ * frameserver audio buffer */
+#ifndef ARCAN_AUDIO_RINGSZ
+#define ARCAN_AUDIO_RINGSZ 32768
+#endif
+
+/* frames per mix period, 256 @ 48kHz = 5.3ms */
+#ifndef ARCAN_AUDIO_PERIOD
+#define ARCAN_AUDIO_PERIOD 256
+#endif
+
+/* resampler quality for sources that don't match the output rate */
+#ifndef ARCAN_RESAMPLER_QUALITY
+#define ARCAN_RESAMPLER_QUALITY SPEEX_RESAMPLER_QUALITY_DEFAULT
+#endif
+
+/* don't drain more from a feed when the ring has less free space than this */
+#define RING_LOWMARK (ARCAN_AUDIO_RINGSZ / 2)
+
+#define OUT_CHANNELS 2
+
+enum voice_state {
+	VOICE_FREE = 0,
+	VOICE_ACTIVE,
+	VOICE_DRAIN,
+	VOICE_DONE
+};
+
+struct sample_buf {
+	int16_t* data;
+	size_t frames;
+	unsigned refc;
+};
+
+struct voice {
+	_Atomic int state;
+	_Atomic bool paused;
+	_Atomic float gain;
+
+/* stream voice, head is written by the main thread, tail by the mixer */
+	int16_t* ring;
+	_Atomic size_t head;
+	_Atomic size_t tail;
+
+/* sample voice, immutable while the voice is active */
+	struct sample_buf* sample;
+	size_t sample_pos;
+
+/* main thread only */
+	SpeexResamplerState* resampler;
+	unsigned in_rate;
+};
+
+struct arcan_asink {
+	const char* name;
+	bool (*open)(struct arcan_asink*, const char* arg);
+	bool (*write)(struct arcan_asink*, const int16_t* buf, size_t frames);
+	void (*close)(struct arcan_asink*);
+
+/* write blocks at device rate, otherwise the mixer paces itself */
+	bool paced;
+	int fd;
+	size_t written;
+};
+
+struct arcan_acontext {
+	arcan_aobj* first;
+	bool setup;
+	bool al_active;
+
+	arcan_aobj_id lastid;
+	float def_gain;
+	arcan_tickv atick_counter;
+
+	arcan_monafunc_cb globalhook;
+	void* global_hooktag;
+
+/* mixer thread state */
+	struct voice voices[ARCAN_AUDIO_VOICES];
+	struct arcan_asink* sink;
+	pthread_t mixthread;
+	_Atomic bool alive;
+	_Atomic bool muted;
+
+/* main thread conversion scratch */
+	int16_t* scratch;
+	size_t scratch_sz;
+};
+
+static struct arcan_acontext _current_acontext = {
+	.def_gain = 1.0
+};
+static struct arcan_acontext* current_acontext = &_current_acontext;
+
+static arcan_aobj* arcan_audio_getobj(arcan_aobj_id);
+static arcan_errc audio_free(arcan_aobj_id);
+
+/*
+ * Sinks
+ */
+static bool null_open(struct arcan_asink* sink, const char* arg)
+{
+	return true;
+}
+
+static bool null_write(struct arcan_asink* sink,
+	const int16_t* buf, size_t frames)
+{
+	sink->written += frames;
+	return true;
+}
+
+static void null_close(struct arcan_asink* sink)
+{
+}
+
+static void wav_header(uint8_t* dst, size_t nb)
+{
+	uint32_t rate = ARCAN_SHMIF_SAMPLERATE;
+	uint32_t brate = rate * OUT_CHANNELS * sizeof(int16_t);
+	uint32_t sz = nb + 36;
+	uint32_t dsz = nb;
+	uint32_t fmtsz = 16;
+	uint16_t fmt = 1, nch = OUT_CHANNELS, align = OUT_CHANNELS * 2, bps = 16;
+
+	memcpy(&dst[0], "RIFF", 4);
+	memcpy(&dst[4], &sz, 4);
+	memcpy(&dst[8], "WAVEfmt ", 8);
+	memcpy(&dst[16], &fmtsz, 4);
+	memcpy(&dst[20], &fmt, 2);
+	memcpy(&dst[22], &nch, 2);
+	memcpy(&dst[24], &rate, 4);
+	memcpy(&dst[28], &brate, 4);
+	memcpy(&dst[32], &align, 2);
+	memcpy(&dst[34], &bps, 2);
+	memcpy(&dst[36], "data", 4);
+	memcpy(&dst[40], &dsz, 4);
+}
+
+static bool wav_open(struct arcan_asink* sink, const char* arg)
+{
+	if (!arg || !arg[0]){
+		arcan_warning("audio(wav) sink: missing path argument (wav:/path)\n");
+		return false;
+	}
+
+	sink->fd = open(arg, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (-1 == sink->fd){
+		arcan_warning("audio(wav) sink: couldn't open %s\n", arg);
+		return false;
+	}
+
+/* header is rewritten with the final sizes on close */
+	uint8_t hdr[44];
+	wav_header(hdr, 0);
+	if (write(sink->fd, hdr, sizeof(hdr)) != sizeof(hdr)){
+		close(sink->fd);
+		sink->fd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+static bool wav_write(struct arcan_asink* sink,
+	const int16_t* buf, size_t frames)
+{
+	size_t nb = frames * OUT_CHANNELS * sizeof(int16_t);
+	const uint8_t* src = (const uint8_t*) buf;
+
+	while (nb){
+		ssize_t nw = write(sink->fd, src, nb);
+		if (nw == -1){
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return false;
+		}
+		nb -= nw;
+		src += nw;
+	}
+
+	sink->written += frames;
+	return true;
+}
+
+static void wav_close(struct arcan_asink* sink)
+{
+	if (-1 == sink->fd)
+		return;
+
+	uint8_t hdr[44];
+	wav_header(hdr, sink->written * OUT_CHANNELS * sizeof(int16_t));
+	if (-1 == pwrite(sink->fd, hdr, sizeof(hdr), 0))
+		arcan_warning("audio(wav) sink: couldn't update header\n");
+
+	close(sink->fd);
+	sink->fd = -1;
+}
+
+#ifdef HAVE_OSS
+static bool oss_open(struct arcan_asink* sink, const char* arg)
+{
+	const char* dev = arg && arg[0] ? arg : "/dev/dsp";
+
+	sink->fd = open(dev, O_WRONLY | O_CLOEXEC);
+	if (-1 == sink->fd)
+		return false;
+
+/* keep the device buffer small, 4 fragments of one period each */
+	int frag = (4 << 16) | 10;
+	int fmt = AFMT_S16_LE;
+	int nch = OUT_CHANNELS;
+	int rate = ARCAN_SHMIF_SAMPLERATE;
+
+	ioctl(sink->fd, SNDCTL_DSP_SETFRAGMENT, &frag);
+
+	if (-1 == ioctl(sink->fd, SNDCTL_DSP_SETFMT, &fmt) || fmt != AFMT_S16_LE ||
+		-1 == ioctl(sink->fd, SNDCTL_DSP_CHANNELS, &nch) || nch != OUT_CHANNELS ||
+		-1 == ioctl(sink->fd, SNDCTL_DSP_SPEED, &rate)){
+		arcan_warning("audio(oss) sink: %s rejected s16/stereo/%d\n",
+			dev, ARCAN_SHMIF_SAMPLERATE);
+		close(sink->fd);
+		sink->fd = -1;
+		return false;
+	}
+
+	if (rate != ARCAN_SHMIF_SAMPLERATE)
+		arcan_warning("audio(oss) sink: device rate is %d, expected %d\n",
+			rate, ARCAN_SHMIF_SAMPLERATE);
+
+	return true;
+}
+
+static void oss_close(struct arcan_asink* sink)
+{
+	if (-1 != sink->fd)
+		close(sink->fd);
+	sink->fd = -1;
+}
+#endif
+
+static struct arcan_asink sinks[] = {
+#ifdef HAVE_OSS
+	{
+		.name = "oss", .open = oss_open, .write = wav_write,
+		.close = oss_close, .paced = true, .fd = -1
+	},
+#endif
+	{
+		.name = "null", .open = null_open, .write = null_write,
+		.close = null_close, .fd = -1
+	},
+	{
+		.name = "wav", .open = wav_open, .write = wav_write,
+		.close = wav_close, .fd = -1
+	}
+};
+
+static struct arcan_asink* sink_open(const char* spec)
+{
+	for (size_t i = 0; i < sizeof(sinks) / sizeof(sinks[0]); i++){
+		size_t len = strlen(sinks[i].name);
+
+		if (spec && (strncmp(spec, sinks[i].name, len) != 0 ||
+			(spec[len] != '\0' && spec[len] != ':')))
+			continue;
+
+		const char* arg = spec && spec[len] == ':' ? &spec[len+1] : NULL;
+		sinks[i].written = 0;
+		if (sinks[i].open(&sinks[i], arg))
+			return &sinks[i];
+
+		if (spec)
+			break;
+	}
+
+	return NULL;
+}
+
+/*
+ * Mixer thread
+ */
+static inline void sleep_until(struct timespec* ts)
+{
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL) == EINTR)
+		;
+}
+
+static size_t mix_voice(struct voice* v, float* acc, size_t frames)
+{
+	float gain = atomic_load_explicit(&v->gain, memory_order_relaxed);
+
+	if (v->sample){
+		size_t left = v->sample->frames - v->sample_pos;
+		size_t nf = left > frames ? frames : left;
+		arcan_amix_accum_s16(acc,
+			&v->sample->data[v->sample_pos * OUT_CHANNELS], nf * OUT_CHANNELS, gain);
+		v->sample_pos += nf;
+		return left - nf;
+	}
+
+	size_t tail = atomic_load_explicit(&v->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&v->head, memory_order_acquire);
+	size_t nf = head - tail > frames ? frames : head - tail;
+
+	size_t pos = tail & (ARCAN_AUDIO_RINGSZ - 1);
+	size_t span = ARCAN_AUDIO_RINGSZ - pos;
+	if (span > nf)
+		span = nf;
+
+	arcan_amix_accum_s16(acc, &v->ring[pos * OUT_CHANNELS],
+		span * OUT_CHANNELS, gain);
+	arcan_amix_accum_s16(&acc[span * OUT_CHANNELS], v->ring,
+		(nf - span) * OUT_CHANNELS, gain);
+
+	atomic_store_explicit(&v->tail, tail + nf, memory_order_release);
+	return 1;
+}
+
+static void* mixer_thread(void* arg)
+{
+	struct arcan_acontext* ctx = arg;
+	float acc[ARCAN_AUDIO_PERIOD * OUT_CHANNELS];
+	int16_t out[ARCAN_AUDIO_PERIOD * OUT_CHANNELS];
+
+	struct sched_param sp = {
+		.sched_priority = sched_get_priority_min(SCHED_FIFO)
+	};
+	pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+
+	const long period_ns =
+		(long)ARCAN_AUDIO_PERIOD * 1000000000l / ARCAN_SHMIF_SAMPLERATE;
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (atomic_load_explicit(&ctx->alive, memory_order_relaxed)){
+		memset(acc, '\0', sizeof(acc));
+		bool muted = atomic_load_explicit(&ctx->muted, memory_order_relaxed);
+
+		for (size_t i = 0; i < ARCAN_AUDIO_VOICES; i++){
+			struct voice* v = &ctx->voices[i];
+			int state = atomic_load_explicit(&v->state, memory_order_acquire);
+
+			if (state == VOICE_DRAIN){
+				atomic_store_explicit(&v->state, VOICE_DONE, memory_order_release);
+				continue;
+			}
+
+			if (state != VOICE_ACTIVE || muted ||
+				atomic_load_explicit(&v->paused, memory_order_relaxed))
+				continue;
+
+/* one-shot samples hand themselves back when exhausted */
+			if (0 == mix_voice(v, acc, ARCAN_AUDIO_PERIOD)){
+				int exp = VOICE_ACTIVE;
+				atomic_compare_exchange_strong(&v->state, &exp, VOICE_DONE);
+			}
+		}
+
+		arcan_amix_ftos16(acc, out, ARCAN_AUDIO_PERIOD * OUT_CHANNELS);
+		ctx->sink->write(ctx->sink, out, ARCAN_AUDIO_PERIOD);
+
+		if (!ctx->sink->paced){
+			next.tv_nsec += period_ns;
+			if (next.tv_nsec >= 1000000000l){
+				next.tv_nsec -= 1000000000l;
+				next.tv_sec++;
+			}
+			sleep_until(&next);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Voice management, main thread only
+ */
+static ssize_t voice_alloc(struct sample_buf* sample, float gain)
+{
+	for (size_t i = 0; i < ARCAN_AUDIO_VOICES; i++){
+		struct voice* v = &current_acontext->voices[i];
+		if (atomic_load_explicit(&v->state, memory_order_acquire) != VOICE_FREE)
+			continue;
+
+		if (!sample && !v->ring){
+			v->ring = arcan_alloc_mem(
+				ARCAN_AUDIO_RINGSZ * OUT_CHANNELS * sizeof(int16_t),
+				ARCAN_MEM_ABUFFER, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_SIMD);
+			if (!v->ring)
+				return -1;
+		}
+
+		v->sample = sample;
+		v->sample_pos = 0;
+		if (sample)
+			sample->refc++;
+
+		atomic_store_explicit(&v->head, 0, memory_order_relaxed);
+		atomic_store_explicit(&v->tail, 0, memory_order_relaxed);
+		atomic_store_explicit(&v->gain, gain, memory_order_relaxed);
+		atomic_store_explicit(&v->paused, false, memory_order_relaxed);
+		atomic_store_explicit(&v->state, VOICE_ACTIVE, memory_order_release);
+
+		return i;
+	}
+
+	return -1;
+}
+
+static void voice_release(unsigned ind)
+{
+	struct voice* v = &current_acontext->voices[ind];
+	int exp = VOICE_ACTIVE;
+	atomic_compare_exchange_strong(&v->state, &exp, VOICE_DRAIN);
+}
+
+static void sample_unref(struct sample_buf* buf)
+{
+	if (!buf || --buf->refc > 0)
+		return;
+
+	arcan_mem_free(buf->data);
+	arcan_mem_free(buf);
+}
+
+/* if the mixer thread isn't running, drained voices won't be acknowledged */
+static void reap_voices(bool force)
+{
+	for (size_t i = 0; i < ARCAN_AUDIO_VOICES; i++){
+		struct voice* v = &current_acontext->voices[i];
+		int state = atomic_load_explicit(&v->state, memory_order_acquire);
+
+		if (state == VOICE_DONE || (force && state != VOICE_FREE)){
+			sample_unref(v->sample);
+			v->sample = NULL;
+
+			if (v->resampler){
+				speex_resampler_destroy(v->resampler);
+				v->resampler = NULL;
+			}
+
+			atomic_store_explicit(&v->state, VOICE_FREE, memory_order_release);
+		}
+	}
+}
+
+static inline struct voice* aobj_voice(arcan_aobj* aobj)
+{
+	if (aobj->alid == 0)
+		return NULL;
+
+	return &current_acontext->voices[aobj->alid - 1];
+}
+
+static void sync_gain(arcan_aobj* aobj)
+{
+	if (aobj->gproxy){
+		aobj->gproxy(aobj->gain, aobj->tag);
+		return;
+	}
+
+	struct voice* v = aobj_voice(aobj);
+	if (v)
+		atomic_store_explicit(&v->gain, aobj->gain, memory_order_relaxed);
+}
+
+static int16_t* get_scratch(size_t nb)
+{
+	if (current_acontext->scratch_sz < nb){
+		int16_t* buf = arcan_mem_grow(current_acontext->scratch,
+			current_acontext->scratch_sz, nb, ARCAN_MEM_NONFATAL);
+		if (!buf)
+			return NULL;
+
+		current_acontext->scratch = buf;
+		current_acontext->scratch_sz = nb;
+	}
+
+	return current_acontext->scratch;
+}
+
+/*
+ * Convert [buf] (s16, [channels], [rate]) to s16 stereo at the output rate,
+ * returns the number of output frames, *out points into [buf] or scratch.
+ */
+static size_t convert_input(SpeexResamplerState** rs, unsigned* rs_rate,
+	int16_t* buf, size_t frames, unsigned channels, unsigned rate,
+	int16_t** out)
+{
+	*out = buf;
+
+	if (channels == 1){
+		int16_t* dst = get_scratch(frames * 2 * sizeof(int16_t));
+		if (!dst)
+			return 0;
+
+/* backwards so that this works if buf already is the scratch */
+		for (ssize_t i = frames - 1; i >= 0; i--){
+			dst[i * 2 + 0] = buf[i];
+			dst[i * 2 + 1] = buf[i];
+		}
+		*out = buf = dst;
+	}
+
+	if (rate == ARCAN_SHMIF_SAMPLERATE || rate == 0)
+		return frames;
+
+	if (!*rs || *rs_rate != rate){
+		int err;
+		if (*rs)
+			speex_resampler_destroy(*rs);
+
+		*rs = speex_resampler_init(OUT_CHANNELS,
+			rate, ARCAN_SHMIF_SAMPLERATE, ARCAN_RESAMPLER_QUALITY, &err);
+		*rs_rate = rate;
+		if (!*rs)
+			return 0;
+	}
+
+	spx_uint32_t in_len = frames;
+	spx_uint32_t out_len = (uint64_t)frames * ARCAN_SHMIF_SAMPLERATE / rate + 16;
+
+/* the conversion input might be in scratch, place output past it */
+	size_t in_sz = buf == current_acontext->scratch ?
+		frames * OUT_CHANNELS * sizeof(int16_t) : 0;
+	uint8_t* base = (uint8_t*) get_scratch(
+		in_sz + out_len * OUT_CHANNELS * sizeof(int16_t));
+	if (!base)
+		return 0;
+
+	if (in_sz)
+		buf = (int16_t*) base;
+	int16_t* dst = (int16_t*)(base + in_sz);
+
+	speex_resampler_process_interleaved_int(*rs, buf, &in_len, dst, &out_len);
+	*out = dst;
+
+	return out_len;
+}
+
+void arcan_audio_buffer(arcan_aobj* aobj, ssize_t buffer, void* audbuf,
+	size_t abufs, unsigned int channels, unsigned int samplerate, void* tag)
+{
+	if (aobj->monitor)
+		aobj->monitor(aobj->id, audbuf, abufs, channels,
+			samplerate, aobj->monitortag);
+
+	if (current_acontext->globalhook)
+		current_acontext->globalhook(aobj->id, audbuf, abufs, channels,
+			samplerate, current_acontext->global_hooktag);
+
+	if (aobj->gproxy || !current_acontext->setup || channels == 0 || channels > 2)
+		return;
+
+	if (aobj->alid == 0){
+		ssize_t ind = voice_alloc(NULL, aobj->gain);
+		if (-1 == ind)
+			return;
+		aobj->alid = ind + 1;
+	}
+
+	aobj->last_used = current_acontext->atick_counter;
+	struct voice* v = aobj_voice(aobj);
+
+	int16_t* src;
+	size_t frames = convert_input(&v->resampler, &v->in_rate, audbuf,
+		abufs / (channels * sizeof(int16_t)), channels, samplerate, &src);
+
+	size_t head = atomic_load_explicit(&v->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&v->tail, memory_order_acquire);
+	size_t space = ARCAN_AUDIO_RINGSZ - (head - tail);
+
+/* overflow means the feed is running faster than playback, drop the rest */
+	if (frames > space)
+		frames = space;
+
+	size_t pos = head & (ARCAN_AUDIO_RINGSZ - 1);
+	size_t span = ARCAN_AUDIO_RINGSZ - pos;
+	if (span > frames)
+		span = frames;
+
+	memcpy(&v->ring[pos * OUT_CHANNELS], src,
+		span * OUT_CHANNELS * sizeof(int16_t));
+	memcpy(v->ring, &src[span * OUT_CHANNELS],
+		(frames - span) * OUT_CHANNELS * sizeof(int16_t));
+
+	atomic_store_explicit(&v->head, head + frames, memory_order_release);
+	aobj->used = head + frames - tail > 0;
+}
+
+static size_t ring_space(arcan_aobj* aobj)
+{
+	struct voice* v = aobj_voice(aobj);
+	if (!v)
+		return ARCAN_AUDIO_RINGSZ;
+
+	size_t head = atomic_load_explicit(&v->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&v->tail, memory_order_acquire);
+	aobj->used = head != tail;
+
+	return ARCAN_AUDIO_RINGSZ - (head - tail);
+}
+
+/*
+ * WAVE decoding, same constraints as the OpenAL version but the result is
+ * converted to s16 stereo at the output samplerate so the mixer can
+ * use it directly.
+ */
+static struct sample_buf* load_wave(const char* fname)
+{
+	struct sample_buf* res = NULL;
+
+	data_source inres = arcan_open_resource(fname);
+	if (inres.fd == BADFD)
+		return NULL;
+
+	map_region inmem = arcan_map_resource(&inres, false);
+	if (inmem.ptr == NULL){
+		arcan_release_resource(&inres);
+		return NULL;
+	}
+
+	if (inmem.sz < 44 && (arcan_warning("load_wave() -- file too small\n"), true))
+		goto cleanup;
+
+	if (memcmp(inmem.ptr + 0, "RIFF", 4) != 0 &&
+		(arcan_warning("load_wave() -- missing RIFF header identifier\n"), true))
+		goto cleanup;
+
+	if (memcmp(inmem.ptr + 8, "WAVE", 4) != 0 &&
+		(arcan_warning("load_wave() -- missing WAVE format identifier\n"), true))
+		goto cleanup;
+
+	uint16_t kv = 0x1234;
+	bool le = (*(char*)&kv) == 0x34;
+	if (!le && (arcan_warning(
+		"load_wave(BE) -- big endian swap unimplemented\n"), true))
+	goto cleanup;
+
+	int16_t  fmt;
+	int16_t  nch;
+	uint16_t bits_ps;
+	uint32_t smplrte;
+	int32_t  nofs;
+
+	if (memcmp(inmem.ptr + 12, "fmt ", 4) != 0 &&
+		(arcan_warning("load_wave() -- missing format chuck ID\n"), true))
+		goto cleanup;
+
+	memcpy(&fmt,     inmem.ptr + 20, 2);
+	memcpy(&nch,     inmem.ptr + 22, 2);
+	memcpy(&smplrte, inmem.ptr + 24, 4);
+	memcpy(&bits_ps, inmem.ptr + 34, 2);
+	memcpy(&nofs,    inmem.ptr + 16, 4);
+	nofs += 20;
+
+	if (fmt != 0x001 && (arcan_warning(
+		"load_wave() -- unsupported encoding (%d),only PCM accepted.\n", fmt), true))
+		goto cleanup;
+
+	if (nch != 1 && nch != 2 && (arcan_warning(
+		"load_wave() -- unexpected number of channels (%d).\n", nch), true))
+		goto cleanup;
+
+	if (bits_ps != 8 && bits_ps != 16 && (arcan_warning(
+		"load_wave() -- unsupported bitdepth (%d)\n", bits_ps), true))
+		goto cleanup;
+
+	if (smplrte == 0 && (arcan_warning(
+		"load_wave() -- invalid samplerate\n"), true))
+		goto cleanup;
+
+	if ((nofs < 0 || nofs + 8 > inmem.sz ||
+		memcmp(inmem.ptr + nofs, "data", 4) != 0) &&
+		(arcan_warning("load_wave() -- data chunk not found\n"), true))
+		goto cleanup;
+
+	int32_t nb;
+	memcpy(&nb, inmem.ptr + nofs + 4, 4);
+	if (nb > CONST_MAX_ASAMPLESZ){
+		arcan_warning("load_wave() -- sample exceeds compile time limit "
+			" (CONST_MAX_ASAMPLESZ %d), truncating.\n", CONST_MAX_ASAMPLESZ);
+		nb = CONST_MAX_ASAMPLESZ;
+	}
+
+	if ((nb < 0 || nb > (inmem.sz - nofs - 8)) && (arcan_warning(
+	 "load wave() -- total sample size is larger than the mapped input.\n"), true))
+		goto cleanup;
+
+	size_t frames = nb / ((bits_ps / 8) * nch);
+	int16_t* pcm = arcan_alloc_mem(frames * nch * sizeof(int16_t),
+		ARCAN_MEM_ABUFFER, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_NATURAL);
+	if (!pcm)
+		goto cleanup;
+
+	const uint8_t* data = (const uint8_t*) inmem.ptr + nofs + 8;
+	if (bits_ps == 8){
+		for (size_t i = 0; i < frames * nch; i++)
+			pcm[i] = ((int16_t)data[i] - 128) << 8;
+	}
+	else
+		memcpy(pcm, data, frames * nch * sizeof(int16_t));
+
+	SpeexResamplerState* rs = NULL;
+	unsigned rs_rate = 0;
+	int16_t* conv;
+	size_t nf = convert_input(&rs, &rs_rate, pcm, frames, nch, smplrte, &conv);
+	if (rs)
+		speex_resampler_destroy(rs);
+
+	res = arcan_alloc_mem(sizeof(struct sample_buf),
+		ARCAN_MEM_ATAG, ARCAN_MEM_BZERO, ARCAN_MEMALIGN_NATURAL);
+	res->refc = 1;
+	res->frames = nf;
+
+	if (conv == pcm)
+		res->data = pcm;
+	else {
+		res->data = arcan_alloc_mem(nf * OUT_CHANNELS * sizeof(int16_t),
+			ARCAN_MEM_ABUFFER, 0, ARCAN_MEMALIGN_NATURAL);
+		memcpy(res->data, conv, nf * OUT_CHANNELS * sizeof(int16_t));
+		arcan_mem_free(pcm);
+	}
+
+cleanup:
+	arcan_release_map(inmem);
+	arcan_release_resource(&inres);
+
+	return res;
+}
+
+/*
+ * aobj management, mirrors arcan_audio.c
+ */
+static arcan_aobj_id arcan_audio_alloc(arcan_aobj** dst)
+{
+	if (dst)
+		*dst = NULL;
+
+	arcan_aobj* newcell = arcan_alloc_mem(sizeof(arcan_aobj), ARCAN_MEM_ATAG,
+		ARCAN_MEM_BZERO, ARCAN_MEMALIGN_NATURAL);
+
+	newcell->gain = current_acontext->def_gain;
+
+/* unlikely event of wrap-around */
+	newcell->id = current_acontext->lastid++;
+	if (newcell->id == ARCAN_EID)
+		newcell->id = 1;
+
+	if (dst)
+		*dst = newcell;
+
+	if (current_acontext->first){
+		arcan_aobj* current = current_acontext->first;
+		while(current && current->next)
+			current = current->next;
+
+		current->next = newcell;
+	}
+	else
+		current_acontext->first = newcell;
+
+	return newcell->id;
+}
+
+static arcan_aobj* arcan_audio_getobj(arcan_aobj_id id)
+{
+	arcan_aobj* current = current_acontext->first;
+
+	while (current){
+		if (current->id == id)
+			return current;
+
+		current = current->next;
+	}
+
+	return NULL;
+}
+
+static void aobj_cleanup(arcan_aobj* obj)
+{
+	if (obj->alid)
+		voice_release(obj->alid - 1);
+	obj->alid = 0;
+
+	sample_unref((struct sample_buf*) obj->samplebuf);
+	obj->samplebuf = NULL;
+
+	obj->next = (void*) 0xdeadbeef;
+	obj->tag = (void*) 0xdeadbeef;
+	obj->feed = NULL;
+	arcan_mem_free(obj);
+}
+
+arcan_errc arcan_audio_alterfeed(arcan_aobj_id id, arcan_afunc_cb cb)
+{
+	arcan_aobj* obj = arcan_audio_getobj(id);
+
+	if (!obj)
+		return ARCAN_ERRC_NO_SUCH_OBJECT;
+
+	if (!cb)
+		return ARCAN_ERRC_BAD_ARGUMENT;
+
+	obj->feed = cb;
+	return ARCAN_OK;
+}
+
+static arcan_errc audio_free(arcan_aobj_id id)
+{
+	arcan_aobj* current = current_acontext->first;
+	arcan_aobj** owner = &(current_acontext->first);
+
+	while(current && current->id != id){
+		owner = &(current->next);
+		current = current->next;
+	}
+
+	if (!current)
+		return ARCAN_ERRC_NO_SUCH_OBJECT;
+
+	*owner = current->next;
+	aobj_cleanup(current);
+
+	return ARCAN_OK;
+}
+
+arcan_errc arcan_audio_setup(bool nosound)
+{
+	if (current_acontext->setup)
+		return ARCAN_ERRC_NOAUDIO;
+
+	const char* spec = nosound ? "null" : getenv("ARCAN_AUDIO_SINK");
+	current_acontext->sink = sink_open(spec);
+
+	if (!current_acontext->sink && spec){
+		arcan_warning("arcan_audio_setup(), couldn't open sink (%s), "
+			"falling back to default\n", spec);
+		current_acontext->sink = sink_open(NULL);
+	}
+
+	if (!current_acontext->sink)
+		return ARCAN_ERRC_NOAUDIO;
+
+	atomic_store(&current_acontext->alive, true);
+	atomic_store(&current_acontext->muted, false);
+
+	if (0 != pthread_create(&current_acontext->mixthread,
+		NULL, mixer_thread, current_acontext)){
+		current_acontext->sink->close(current_acontext->sink);
+		current_acontext->sink = NULL;
+		return ARCAN_ERRC_NOAUDIO;
+	}
+
+	if (nosound)
+		arcan_warning("arcan_audio_init(nosound)\n");
+
+	current_acontext->setup = true;
+	current_acontext->al_active = true;
+
+/* just give a slightly "random" base so that
+ * user scripts don't get locked into hard-coded ids .. */
+	current_acontext->lastid = rand() % 32768;
+
+	return ARCAN_OK;
+}
+
+arcan_errc arcan_audio_shutdown()
+{
+	if (!current_acontext->setup)
+		return ARCAN_OK;
+
+	atomic_store(&current_acontext->alive, false);
+	pthread_join(current_acontext->mixthread, NULL);
+
+	current_acontext->sink->close(current_acontext->sink);
+	current_acontext->sink = NULL;
+
+	reap_voices(true);
+	current_acontext->setup = false;
+	current_acontext->al_active = false;
+
+	return ARCAN_OK;
+}
+
+arcan_errc arcan_audio_play(arcan_aobj_id id, bool gain_override, float gain)
+{
+	arcan_aobj* aobj = arcan_audio_getobj(id);
+
+	if (!aobj)
+		return ARCAN_ERRC_NO_SUCH_OBJECT;
+
+	if (aobj->kind == AOBJ_SAMPLE){
+		if (aobj->samplebuf && current_acontext->setup &&
+			-1 == voice_alloc((struct sample_buf*) aobj->samplebuf,
+				gain_override ? gain : aobj->gain))
+			arcan_warning("arcan_audio_play(), out of voices\n");
+	}
+	else if (aobj->active == false){
+		struct voice* v = aobj_voice(aobj);
+		if (v)
+			atomic_store(&v->paused, false);
+		aobj->active = true;
+	}
+
+	return ARCAN_OK;
+}
+
+arcan_aobj_id arcan_audio_load_sample(const char* fname,
+	float gain, arcan_errc* err)
+{
+	if (fname == NULL)
+		return ARCAN_EID;
+
+	struct sample_buf* buf = load_wave(fname);
+	if (!buf){
+		if (err) *err = ARCAN_ERRC_BAD_RESOURCE;
+		return ARCAN_EID;
+	}
+
+	arcan_aobj* aobj;
+	arcan_aobj_id rid = arcan_audio_alloc(&aobj);
+
+	aobj->kind = AOBJ_SAMPLE;
+	aobj->gain = gain;
+	aobj->samplebuf = (uint16_t*) buf;
+	aobj->used = 1;
+
+	if (err) *err = ARCAN_OK;
+
+	return rid;
+}
+
+arcan_errc arcan_audio_hookfeed(arcan_aobj_id id, void* tag,
+	arcan_monafunc_cb hookfun, void** oldtag)
+{
+	arcan_aobj* aobj = arcan_audio_getobj(id);
+	if (!aobj)
+		return ARCAN_ERRC_NO_SUCH_OBJECT;
+
+	if (oldtag)
+		*oldtag = aobj->monitortag ? aobj->monitortag : NULL;
+
+	aobj->monitor = hookfun;
+	aobj->monitortag = tag;
+
+	return ARCAN_OK;
+}
+
+arcan_aobj_id arcan_audio_feed(arcan_afunc_cb feed, void* tag, arcan_errc* errc)
+{
+	arcan_aobj* aobj;
+	arcan_aobj_id rid = arcan_audio_alloc(&aobj);
+
+/* voice is allocated when we first get data */
+	aobj->streaming = true;
+	aobj->tag = tag;
+	aobj->feed = feed;
+	aobj->gain = 1.0;
+	aobj->kind = AOBJ_STREAM;
+
+	if (errc) *errc = ARCAN_OK;
+	return rid;
+}
+
+/* there is no external state that can get out of synch */
+arcan_errc arcan_audio_rebuild(arcan_aobj_id id)
+{
+	return arcan_audio_getobj(id) ? ARCAN_OK : ARCAN_ERRC_NO_SUCH_OBJECT;
+}
+
+enum aobj_kind arcan_audio_kind(arcan_aobj_id id)
+{
+	arcan_aobj* aobj = arcan_audio_getobj(id);
+	return aobj ? aobj->kind : AOBJ_INVALID;
+}
+
+arcan_errc arcan_audio_suspend()
+{
+	atomic_store(&current_acontext->muted, true);
+	current_acontext->al_active = false;
+	return ARCAN_OK;
+}
+
+arcan_errc arcan_audio_resume()
+{
+	atomic_store(&current_acontext->muted, false);
+	current_acontext->al_active = true;
+	return ARCAN_OK;
+}
+
+arcan_errc arcan_audio_pause(arcan_aobj_id id)
+{
+	arcan_aobj* dobj = arcan_audio_getobj(id);
+	if (!dobj)
+		return ARCAN_ERRC_NO_SUCH_OBJECT;
+
+	struct voice* v = aobj_voice(dobj);
+	if (v)
+		atomic_store(&v->paused, true);
+	dobj->active = false;
+
+	return ARCAN_OK;
+}
+
+arcan_errc arcan_audio_stop(arcan_aobj_id id)
+{
+	arcan_aobj* dobj = arcan_audio_getobj(id);
+	if (!dobj)
+		return ARCAN_ERRC_NO_SUCH_OBJECT;
+
+	dobj->kind = AOBJ_INVALID;
+	dobj->feed = NULL;
+
+	audio_free(id);
+
+	arcan_event newevent = {
+		.category = EVENT_AUDIO,
+		.aud.kind = EVENT_AUDIO_OBJECT_GONE,
+		.aud.source = id
+	};
+
+	arcan_event_enqueue(arcan_event_defaultctx(), &newevent);
+	return ARCAN_OK;
+}
+
+static inline void reset_chain(arcan_aobj* dobj)
+{
+	struct arcan_achain* current = dobj->transform;
+	struct arcan_achain* next;
+
+	while (current) {
+		next = current->next;
+		arcan_mem_free(current);
+		current = next;
+	}
+
+	dobj->transform = NULL;
+}
+
+arcan_errc arcan_audio_setgain(arcan_aobj_id id, float gain, uint16_t time)
+{
+	if (id == ARCAN_EID){
+		current_acontext->def_gain = gain;
+		return ARCAN_OK;
+	}
+
+	arcan_aobj* dobj = arcan_audio_getobj(id);
+
+	if (!dobj)
+		return ARCAN_ERRC_NO_SUCH_OBJECT;
+
+/* immediately */
+	if (time == 0){
+		reset_chain(dobj);
+		dobj->gain = gain;
+		sync_gain(dobj);
+	}
+	else{
+		struct arcan_achain** dptr = &dobj->transform;
+
+		while(*dptr){
+			dptr = &(*dptr)->next;
+		}
+
+		*dptr = arcan_alloc_mem(sizeof(struct arcan_achain),
+			ARCAN_MEM_ATAG, 0, ARCAN_MEMALIGN_NATURAL);
+
+		(*dptr)->next = NULL;
+		(*dptr)->t_gain = time;
+		(*dptr)->d_gain = gain;
+	}
+
+	return ARCAN_OK;
+}
+
+int arcan_audio_findstreambufslot(arcan_aobj_id id)
+{
+	return arcan_audio_getobj(id) ? 0 : -1;
+}
+
+/*
+ * Drain the feed as long as there is room in the ring. Each call hands
+ * over at most one buffer and releases it (cont = false) so the source
+ * can continue producing.
+ */
+static void astream_refill(arcan_aobj* current)
+{
+	if (!current->feed)
+		return;
+
+	for (size_t i = 0; i < ARCAN_ASTREAMBUF_LIMIT; i++){
+		if (ring_space(current) < RING_LOWMARK)
+			return;
+
+		arcan_errc rv = current->feed(current, current->id, 0, false, current->tag);
+		if (rv == ARCAN_ERRC_NOTREADY)
+			return;
+
+		if (rv != ARCAN_OK){
+			arcan_event newevent = {
+				.category = EVENT_AUDIO,
+				.aud.kind = EVENT_AUDIO_PLAYBACK_FINISHED,
+				.aud.source = current->id
+			};
+			arcan_event_enqueue(arcan_event_defaultctx(), &newevent);
+			return;
+		}
+	}
+}
+
+void arcan_aid_refresh(arcan_aobj_id aid)
+{
+	struct arcan_aobj* obj = arcan_audio_getobj(aid);
+	if (obj)
+		astream_refill(obj);
+}
+
+/* capture devices are not supported by the software mixer */
+char** arcan_audio_capturelist()
+{
+	static char* empty[] = {NULL};
+	return empty;
+}
+
+arcan_aobj_id arcan_audio_capturefeed(const char* dev)
+{
+	arcan_warning("arcan_audio_capturefeed() - "
+		"capture is not supported in the soft audio platform\n");
+	return ARCAN_EID;
+}
+
+size_t arcan_audio_refresh()
+{
+	if (!current_acontext->setup || !current_acontext->al_active)
+		return 0;
+
+	arcan_aobj* current = current_acontext->first;
+	size_t rv = 0;
+
+	while(current){
+		if (
+			current->kind == AOBJ_STREAM      ||
+			current->kind == AOBJ_FRAMESTREAM ||
+			current->kind == AOBJ_CAPTUREFEED
+		)
+			astream_refill(current);
+
+		if (current->used)
+			rv++;
+
+		current = current->next;
+	}
+
+	return rv;
+}
+
+static inline bool step_transform(arcan_aobj* obj)
+{
+	if (obj->transform == NULL)
+		return false;
+
+	obj->gain += (obj->transform->d_gain - obj->gain) /
+		(float) obj->transform->t_gain;
+
+	obj->transform->t_gain--;
+	if (obj->transform->t_gain == 0){
+		obj->gain = obj->transform->d_gain;
+		struct arcan_achain* ct = obj->transform;
+		obj->transform = obj->transform->next;
+		arcan_mem_free(ct);
+	}
+
+	return true;
+}
+
+void arcan_audio_tick(uint8_t ntt)
+{
+	if (!current_acontext->setup)
+		return;
+
+	reap_voices(false);
+
+	if (!current_acontext->al_active)
+		return;
+
+	arcan_audio_refresh();
+
+/* update time-dependent transformations, the mixer picks up the new
+ * gain at the next period */
+	while (ntt-- > 0) {
+		arcan_aobj* current = current_acontext->first;
+
+		while (current){
+			if (step_transform(current))
+				sync_gain(current);
+
+			current = current->next;
+		}
+
+		current_acontext->atick_counter++;
+	}
+}
+
+/*
+ * very inefficient, but the set of IDs to delete is reasonably small
+ */
+void arcan_audio_purge(arcan_aobj_id* ids, size_t nids)
+{
+	arcan_aobj* current = _current_acontext.first;
+	arcan_aobj** previous = &_current_acontext.first;
+
+	while(current){
+		bool match = false;
+
+		for (size_t i = 0; i < nids; i++){
+			if (ids[i] == current->id){
+				match = true;
+				break;
+			}
+		}
+
+		arcan_aobj* next = current->next;
+		if (!match){
+			(*previous) = next;
+			if (current->feed)
+				current->feed(current, current->id, -1, false, current->tag);
+
+			aobj_cleanup(current);
+		}
+		else {
+			previous = &current->next;
+		}
+
+		current = next;
+	}
+}
@@ -21,6 +21,7 @@
 #include <math.h>
 #include <assert.h>
 #include <signal.h>
+#include <pthread.h>
 
 /*
  * fixed limit of allowed events in queue before we need to do something more
@@ -60,11 +61,49 @@ static int64_t epoch;
  * cleanly based on a certain keybinding */
 static int panic_keysym = -1, panic_keymod = -1;
 
-/* special cases, only enabled if the correct
- * environment has been set */
-static FILE* record_out;
-static map_region playback_in;
-static size_t playback_ofs;
+/*
+ * special cases, only enabled if the correct environment has been set.
+ * Recordings are written by a background thread from a pair of buffers
+ * that are swapped when full (or every few seconds), so the event path
+ * only pays for packing and a memcpy.
+ */
+#ifndef EVREC_BUFSZ
+#define EVREC_BUFSZ 65536
+#endif
+
+#define EVREC_VERSION 1
+#define EVREC_FLUSH_TICKS 100
+
+static struct {
+	int fd;
+	bool failed, shutdown;
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint8_t* buf[2];
+	uint8_t active;
+	size_t used, pending;
+	int32_t last_tick, last_flush;
+} recorder = {.fd = -1};
+
+static bool fixed_clock;
+
+static struct {
+	map_region map;
+	size_t ofs;
+	bool active, pending, fixed;
+	int32_t tick;
+	arcan_event next;
+} playback;
+
+arcan_benchdata benchdata = {0};
+
+/* frame statistics for the replayed run, histogram has 1ms bins */
+static struct {
+	unsigned hist[256], max, count, costcount;
+	unsigned long long sum, costsum;
+	int32_t start_tick;
+} replay_stats;
 
 static void pack_rec_event(const struct arcan_event* const outev);
 
@@ -209,8 +248,8 @@ int arcan_event_enqueue(arcan_evctx* ctx, const struct arcan_event* const src)
 		return arcan_event_enqueue(ctx, &ev);
 	}
 
-	if (ctx->local && src->category == EVENT_IO)
-			pack_rec_event(src);
+	if (ctx->local)
+		pack_rec_event(src);
 
 	ctx->eventbuf[(*ctx->back) % ctx->eventbuf_sz] = *src;
 	*ctx->back = (*ctx->back + 1) % ctx->eventbuf_sz;
@@ -329,132 +368,393 @@ void arcan_event_queuetransfer(arcan_evctx* dstqueue, arcan_evctx* srcqueue,
 		arcan_sem_post(srcqueue->synch.handle);
 }
 
-static long unpack_rec_event(char* bytep, size_t sz, arcan_event* tv,
-	int32_t* tickv)
+/*
+ * Recording format, all integers are LEB128 style varints, signed ones are
+ * zigzag encoded:
+ *
+ * header: "AEVR" version tick_ms sizeof(arcan_event)
+ * record: dtick category [payload]
+ *
+ * [dtick] is the number of engine ticks since the previous record and the
+ * payload is typed for EVENT_IO. Frameserver originated categories are kept
+ * as the raw event with trailing zeroes stripped, these depend on the build
+ * (hence the event size in the header) and are only for inspection, as the
+ * frameservers themselves recreate them during replay. Category 0 marks the
+ * end of the recording.
+ */
+static size_t put_varint(uint8_t* dst, uint64_t v)
 {
-	size_t nb = sizeof(int32_t) * 11;
+	size_t n = 0;
+	while (v >= 0x80){
+		dst[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	dst[n++] = v;
+	return n;
+}
+
+static size_t put_zigzag(uint8_t* dst, int64_t v)
+{
+	return put_varint(dst, ((uint64_t) v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static bool get_varint(const uint8_t* buf, size_t sz, size_t* ofs, uint64_t* v)
+{
+	*v = 0;
+	for (size_t shift = 0; shift < 64 && *ofs < sz; shift += 7){
+		uint8_t ch = buf[(*ofs)++];
+		*v |= (uint64_t)(ch & 0x7f) << shift;
+		if (!(ch & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static bool get_zigzag(const uint8_t* buf, size_t sz, size_t* ofs, int64_t* v)
+{
+	uint64_t uv;
+	if (!get_varint(buf, sz, ofs, &uv))
+		return false;
+	*v = (int64_t)(uv >> 1) ^ -(int64_t)(uv & 1);
+	return true;
+}
 
-	if (sz < nb)
+static size_t pack_io(uint8_t* dst, const arcan_ioevent* io)
+{
+	size_t n = 0;
+	n += put_varint(&dst[n], io->kind);
+	n += put_varint(&dst[n], io->devkind);
+	n += put_varint(&dst[n], io->datatype);
+	n += put_varint(&dst[n], io->devid);
+	n += put_varint(&dst[n], io->subid);
+	n += put_varint(&dst[n], io->flags);
+
+	size_t ll = strnlen(io->label, COUNT_OF(io->label));
+	n += put_varint(&dst[n], ll);
+	memcpy(&dst[n], io->label, ll);
+	n += ll;
+
+	const arcan_ioevent_data* in = &io->input;
+	if (io->kind == EVENT_IO_STATUS){
+		n += put_varint(&dst[n], in->status.action);
+		n += put_varint(&dst[n], in->status.devkind);
+		n += put_varint(&dst[n], in->status.devref);
+		n += put_varint(&dst[n], in->status.domain);
+		return n;
+	}
+
+	switch (io->datatype){
+	case EVENT_IDATATYPE_DIGITAL:
+		n += put_varint(&dst[n], in->digital.active);
+	break;
+	case EVENT_IDATATYPE_ANALOG:{
+		size_t nv = in->analog.nvalues > COUNT_OF(in->analog.axisval) ?
+			COUNT_OF(in->analog.axisval) : in->analog.nvalues;
+		n += put_zigzag(&dst[n], in->analog.gotrel);
+		n += put_varint(&dst[n], in->analog.idcount);
+		n += put_varint(&dst[n], nv);
+		for (size_t i = 0; i < nv; i++)
+			n += put_zigzag(&dst[n], in->analog.axisval[i]);
+	}
+	break;
+	case EVENT_IDATATYPE_TOUCH:{
+		uint32_t pressure, size;
+		memcpy(&pressure, &in->touch.pressure, sizeof(uint32_t));
+		memcpy(&size, &in->touch.size, sizeof(uint32_t));
+		n += put_varint(&dst[n], in->touch.active);
+		n += put_zigzag(&dst[n], in->touch.x);
+		n += put_zigzag(&dst[n], in->touch.y);
+		n += put_varint(&dst[n], pressure);
+		n += put_varint(&dst[n], size);
+	}
+	break;
+	case EVENT_IDATATYPE_TRANSLATED:{
+		size_t ul = strnlen((char*)in->translated.utf8, COUNT_OF(in->translated.utf8));
+		n += put_varint(&dst[n], in->translated.active);
+		n += put_varint(&dst[n], in->translated.modifiers);
+		n += put_varint(&dst[n], in->translated.keysym);
+		n += put_varint(&dst[n], in->translated.scancode);
+		n += put_varint(&dst[n], ul);
+		memcpy(&dst[n], in->translated.utf8, ul);
+		n += ul;
+	}
+	break;
+	default:
+	break;
+	}
+
+	return n;
+}
+
+#define GETV(DST) { uint64_t v; if (!get_varint(buf, sz, &ofs, &v)) return -1;\
+	DST = v; }
+#define GETZ(DST) { int64_t v; if (!get_zigzag(buf, sz, &ofs, &v)) return -1;\
+	DST = v; }
+
+static long unpack_io(const uint8_t* buf, size_t sz, arcan_ioevent* io)
+{
+	size_t ofs = 0, ll;
+	GETV(io->kind);
+	GETV(io->devkind);
+	GETV(io->datatype);
+	GETV(io->devid);
+	GETV(io->subid);
+	GETV(io->flags);
+
+	GETV(ll);
+	if (ll > COUNT_OF(io->label) || sz - ofs < ll)
 		return -1;
+	memcpy(io->label, &buf[ofs], ll);
+	ofs += ll;
+
+	arcan_ioevent_data* out = &io->input;
+	if (io->kind == EVENT_IO_STATUS){
+		GETV(out->status.action);
+		GETV(out->status.devkind);
+		GETV(out->status.devref);
+		GETV(out->status.domain);
+		return ofs;
+	}
 
-	int32_t buf[11];
-	memcpy(buf, bytep, nb);
-	*tickv = buf[0];
-
-	tv->category = EVENT_IO;
-	tv->io.kind = buf[1];
-	tv->io.devid = buf[2];
-	tv->io.subid = buf[3];
-
-	switch (buf[1]){
-	case EVENT_IO_TOUCH:
-		tv->io.input.touch.pressure = buf[4];
-		tv->io.input.touch.size = buf[5];
-		tv->io.input.touch.x = buf[6];
-		tv->io.input.touch.y = buf[7];
+	switch (io->datatype){
+	case EVENT_IDATATYPE_DIGITAL:
+		GETV(out->digital.active);
 	break;
-	case EVENT_IO_AXIS_MOVE:
-		tv->io.input.analog.gotrel = buf[4];
-		if (buf[5] < sizeof(buf) / sizeof(buf[0]) - 6){
-			for (size_t i = 0; i < buf[5]; i++)
-				tv->io.input.analog.axisval[i] = buf[6+i];
-			tv->io.input.analog.nvalues = buf[5];
-		}
-		else
-			buf[5] = 0;
+	case EVENT_IDATATYPE_ANALOG:
+		GETZ(out->analog.gotrel);
+		GETV(out->analog.idcount);
+		GETV(out->analog.nvalues);
+		if (out->analog.nvalues > COUNT_OF(out->analog.axisval))
+			return -1;
+		for (size_t i = 0; i < out->analog.nvalues; i++)
+			GETZ(out->analog.axisval[i]);
 	break;
-	case EVENT_IO_BUTTON:
-		if (buf[4] == EVENT_IDEVKIND_KEYBOARD){
-			tv->io.devkind = EVENT_IDEVKIND_KEYBOARD;
-			tv->io.input.translated.active = buf[5];
-			tv->io.input.translated.scancode = buf[6];
-			tv->io.input.translated.keysym = buf[7];
-			tv->io.input.translated.modifiers = buf[8];
-		}
-		else if (buf[4] == EVENT_IDEVKIND_MOUSE||buf[4] == EVENT_IDEVKIND_GAMEDEV){
-			tv->io.devkind = buf[4];
-			tv->io.devid = buf[2];
-			tv->io.subid = buf[3];
-			tv->io.input.digital.active = buf[5];
-		}
-		else
+	case EVENT_IDATATYPE_TOUCH:{
+		uint32_t pressure, size;
+		GETV(out->touch.active);
+		GETZ(out->touch.x);
+		GETZ(out->touch.y);
+		GETV(pressure);
+		GETV(size);
+		memcpy(&out->touch.pressure, &pressure, sizeof(uint32_t));
+		memcpy(&out->touch.size, &size, sizeof(uint32_t));
+	}
+	break;
+	case EVENT_IDATATYPE_TRANSLATED:{
+		size_t ul;
+		GETV(out->translated.active);
+		GETV(out->translated.modifiers);
+		GETV(out->translated.keysym);
+		GETV(out->translated.scancode);
+		GETV(ul);
+		if (ul > COUNT_OF(out->translated.utf8) || sz - ofs < ul)
 			return -1;
-	case EVENT_IO_STATUS:
-		if (buf[4] == EVENT_IDEVKIND_STATUS){
-			tv->io.devkind = EVENT_IDEVKIND_STATUS;
-			tv->io.input.status.action = buf[5];
-		}
+		memcpy(out->translated.utf8, &buf[ofs], ul);
+		ofs += ul;
+	}
+	break;
+	default:
 	break;
 	}
 
-	return nb;
+	return ofs;
 }
 
 /*
- * no heavy serialization effort here, the format is intended
- * for debugging and testing. shmif- event serialization should
- * be used for other purposes.
+ * Unpack the next record into [tv], [dtick] is set to the tick delta. Events
+ * that should not be injected get category 0 and -1 is returned on a broken
+ * or truncated record.
  */
+static long unpack_rec_event(const uint8_t* buf, size_t sz,
+	arcan_event* tv, int32_t* dtick, bool* end)
+{
+	size_t ofs = 0, len, category;
+	*tv = (arcan_event){0};
+	GETV(*dtick);
+	GETV(category);
+	*end = category == 0;
+
+	if (category == EVENT_IO){
+		long rv = unpack_io(&buf[ofs], sz - ofs, &tv->io);
+		if (-1 == rv)
+			return -1;
+		tv->category = EVENT_IO;
+		ofs += rv;
+	}
+	else if (category){
+		GETV(len);
+		if (sz - ofs < len)
+			return -1;
+		ofs += len;
+	}
+
+	return ofs;
+}
+
+#undef GETV
+#undef GETZ
+
+static void* evrec_writer(void* arg)
+{
+	pthread_mutex_lock(&recorder.lock);
+	for(;;){
+		while (!recorder.pending && !recorder.shutdown)
+			pthread_cond_wait(&recorder.cond, &recorder.lock);
+
+		if (!recorder.pending)
+			break;
+
+/* the inactive buffer is ours until pending is cleared */
+		uint8_t* buf = recorder.buf[!recorder.active];
+		size_t nb = recorder.pending;
+		pthread_mutex_unlock(&recorder.lock);
+
+		bool ok = true;
+		while (nb && ok){
+			ssize_t nw = write(recorder.fd, buf, nb);
+			if (nw > 0){
+				buf += nw;
+				nb -= nw;
+			}
+			else
+				ok = nw == -1 && (errno == EINTR || errno == EAGAIN);
+		}
+
+		pthread_mutex_lock(&recorder.lock);
+		recorder.pending = 0;
+		recorder.failed |= !ok;
+		pthread_cond_broadcast(&recorder.cond);
+	}
+	pthread_mutex_unlock(&recorder.lock);
+
+	return NULL;
+}
+
+static void evrec_handoff()
+{
+	if (!recorder.used)
+		return;
+
+	pthread_mutex_lock(&recorder.lock);
+	while (recorder.pending)
+		pthread_cond_wait(&recorder.cond, &recorder.lock);
+
+	recorder.pending = recorder.used;
+	recorder.active = !recorder.active;
+	recorder.used = 0;
+	pthread_cond_broadcast(&recorder.cond);
+	pthread_mutex_unlock(&recorder.lock);
+
+	recorder.last_flush = default_evctx.c_ticks;
+}
+
+static void evrec_append(const uint8_t* data, size_t nb)
+{
+	if (recorder.used + nb > EVREC_BUFSZ)
+		evrec_handoff();
+
+	memcpy(&recorder.buf[recorder.active][recorder.used], data, nb);
+	recorder.used += nb;
+}
+
+static void evrec_close()
+{
+	if (-1 == recorder.fd)
+		return;
+
+	uint8_t rec[16];
+	size_t n = put_varint(rec, default_evctx.c_ticks - recorder.last_tick);
+	n += put_varint(&rec[n], 0);
+	evrec_append(rec, n);
+	evrec_handoff();
+
+	pthread_mutex_lock(&recorder.lock);
+	recorder.shutdown = true;
+	pthread_cond_broadcast(&recorder.cond);
+	pthread_mutex_unlock(&recorder.lock);
+	pthread_join(recorder.writer, NULL);
+
+	if (recorder.failed)
+		arcan_warning("event recording: write failed, recording truncated\n");
+
+	close(recorder.fd);
+	recorder.fd = -1;
+	arcan_mem_free(recorder.buf[0]);
+	arcan_mem_free(recorder.buf[1]);
+	pthread_mutex_destroy(&recorder.lock);
+	pthread_cond_destroy(&recorder.cond);
+}
+
+static void evrec_open(const char* fn)
+{
+	recorder.fd = open(fn, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0600);
+	if (-1 == recorder.fd){
+		arcan_warning("ARCAN_EVENT_RECORD=%s, couldn't open file "
+			"for recording.\n", fn);
+		return;
+	}
+
+	recorder.buf[0] = arcan_alloc_mem(EVREC_BUFSZ,
+		ARCAN_MEM_BINDING, 0, ARCAN_MEMALIGN_PAGE);
+	recorder.buf[1] = arcan_alloc_mem(EVREC_BUFSZ,
+		ARCAN_MEM_BINDING, 0, ARCAN_MEMALIGN_PAGE);
+	recorder.active = 0;
+	recorder.used = recorder.pending = 0;
+	recorder.failed = recorder.shutdown = false;
+	recorder.last_tick = recorder.last_flush = default_evctx.c_ticks;
+	pthread_mutex_init(&recorder.lock, NULL);
+	pthread_cond_init(&recorder.cond, NULL);
+
+	if (0 != pthread_create(&recorder.writer, NULL, evrec_writer, NULL)){
+		arcan_warning("ARCAN_EVENT_RECORD=%s, couldn't spawn writer.\n", fn);
+		close(recorder.fd);
+		recorder.fd = -1;
+		arcan_mem_free(recorder.buf[0]);
+		arcan_mem_free(recorder.buf[1]);
+		return;
+	}
+
+	uint8_t hdr[32] = {'A', 'E', 'V', 'R'};
+	size_t n = 4;
+	n += put_varint(&hdr[n], EVREC_VERSION);
+	n += put_varint(&hdr[n], ARCAN_TIMER_TICK);
+	n += put_varint(&hdr[n], sizeof(arcan_event));
+	evrec_append(hdr, n);
+}
+
 static void pack_rec_event(const struct arcan_event* const outev)
 {
-	if (!record_out)
+	if (-1 == recorder.fd)
 		return;
 
-	if (outev->category != EVENT_IO)
+	if (outev->category != EVENT_IO && outev->category != EVENT_EXTERNAL &&
+		outev->category != EVENT_FSRV && outev->category != EVENT_NET)
 		return;
 
-/* since this is a testing thing, we are not particularly considerate
- * in regards to compact representation */
-	int32_t ioarr[11] = {0};
-	ioarr[0] = arcan_frametime();
-	size_t nmemb = sizeof(ioarr) / sizeof(ioarr[0]);
-	ioarr[1] = outev->io.kind;
-	ioarr[2] = outev->io.devid;
-	ioarr[3] = outev->io.subid;
-
-	switch(outev->io.kind){
-	case EVENT_IO_TOUCH:
-		ioarr[4] = outev->io.input.touch.pressure;
-		ioarr[5] = outev->io.input.touch.size;
-		ioarr[6] = outev->io.input.touch.x;
-		ioarr[7] = outev->io.input.touch.y;
-	break;
-	case EVENT_IO_AXIS_MOVE:
-		ioarr[4] = outev->io.input.analog.gotrel;
-		for (size_t i = 0; i < nmemb - 6 &&
-			i < outev->io.input.analog.nvalues; i++){
-			ioarr[6+i] = outev->io.input.analog.axisval[i];
-			ioarr[5]++;
-		}
-	break;
-	case EVENT_IO_BUTTON:
-		if (outev->io.devkind == EVENT_IDEVKIND_KEYBOARD){
-			ioarr[4] = outev->io.devkind;
-			ioarr[5] = outev->io.input.translated.active;
-			ioarr[6] = outev->io.input.translated.scancode;
-			ioarr[7] = outev->io.input.translated.keysym;
-			ioarr[8] = outev->io.input.translated.modifiers;
-		}
-		else if (outev->io.devkind == EVENT_IDEVKIND_MOUSE ||
-			outev->io.devkind == EVENT_IDEVKIND_GAMEDEV){
-			ioarr[4] = outev->io.devkind;
-			ioarr[5] = outev->io.input.digital.active;
-		}
-		else
-			return;
-	break;
-	case EVENT_IO_STATUS:
-		if (outev->io.devkind == EVENT_IDEVKIND_STATUS){
-			ioarr[4] = outev->io.input.status.action;
-		}
-	break;
-	default:
-	break;
+	uint8_t rec[sizeof(arcan_event) + 128];
+	int32_t tick = default_evctx.c_ticks;
+	size_t n = put_varint(rec,
+		tick > recorder.last_tick ? tick - recorder.last_tick : 0);
+	n += put_varint(&rec[n], outev->category);
+	recorder.last_tick = tick;
+
+	if (outev->category == EVENT_IO)
+		n += pack_io(&rec[n], &outev->io);
+	else {
+		const uint8_t* raw = (const uint8_t*) outev;
+		size_t len = sizeof(arcan_event);
+		while (len && !raw[len-1])
+			len--;
+		n += put_varint(&rec[n], len);
+		memcpy(&rec[n], raw, len);
+		n += len;
 	}
 
-	if (1 != fwrite(ioarr, sizeof(int32_t) * nmemb, 1, record_out)){
-		fclose(record_out);
-		record_out = NULL;
+	evrec_append(rec, n);
+
+	if (recorder.failed){
+		arcan_warning("event recording: write failed, recording stopped\n");
+		evrec_close();
 	}
 }
 
@@ -477,35 +777,129 @@ bool arcan_event_blacklisted(const char* idstr)
 	return rv;
 }
 
-static void inject_scheduled(arcan_evctx* ctx)
+static void replay_stop(arcan_evctx* ctx)
 {
-	if (!playback_in.ptr)
-		return;
+	arcan_release_map(playback.map);
+	memset(&playback.map, '\0', sizeof(playback.map));
+	playback.pending = false;
 
-	static arcan_event next_ev;
-	static int32_t tickv = -1; /* -1 if no pending events */
+/* with the clock driven by the recording, the recording is the run */
+	if (playback.fixed)
+		arcan_event_enqueue(ctx, &(arcan_event){
+			.category = EVENT_SYSTEM,
+			.sys.kind = EVENT_SYSTEM_EXIT,
+			.sys.errcode = EXIT_SUCCESS
+		});
+}
 
-step:
-	if (tickv != -1){
-		if (tickv <= arcan_frametime()){
-			arcan_event_enqueue(ctx, &next_ev);
-			tickv = -1;
+static void inject_scheduled(arcan_evctx* ctx)
+{
+	while (playback.map.ptr){
+		if (playback.pending){
+			if (playback.tick > ctx->c_ticks)
+				return;
+
+			playback.pending = false;
+			if (playback.next.category)
+				arcan_event_enqueue(ctx, &playback.next);
 		}
-		else
+
+		int32_t dtick;
+		bool end;
+		long rv = unpack_rec_event((uint8_t*) &playback.map.ptr[playback.ofs],
+			playback.map.sz - playback.ofs, &playback.next, &dtick, &end);
+
+		if (-1 == rv || end){
+			replay_stop(ctx);
 			return;
+		}
+
+		playback.ofs += rv;
+		playback.tick += dtick;
+		playback.pending = true;
+	}
+}
+
+static void replay_open(const char* fn)
+{
+	data_source source = arcan_open_resource(fn);
+	playback.map = arcan_map_resource(&source, false);
+	arcan_release_resource(&source);
+	if (!playback.map.ptr){
+		arcan_warning("ARCAN_EVENT_REPLAY=%s, couldn't map file.\n", fn);
+		return;
+	}
+
+	const uint8_t* buf = (uint8_t*) playback.map.ptr;
+	size_t sz = playback.map.sz;
+	size_t ofs = 4;
+	uint64_t version, tick, evsz;
+
+	if (sz < 4 || memcmp(buf, "AEVR", 4) != 0 ||
+		!get_varint(buf, sz, &ofs, &version) ||
+		!get_varint(buf, sz, &ofs, &tick) ||
+		!get_varint(buf, sz, &ofs, &evsz) || version != EVREC_VERSION){
+		arcan_warning("ARCAN_EVENT_REPLAY=%s, unknown or unsupported "
+			"recording format.\n", fn);
+		arcan_release_map(playback.map);
+		memset(&playback.map, '\0', sizeof(playback.map));
+		return;
 	}
 
-	ssize_t rv = unpack_rec_event(&playback_in.ptr[playback_ofs],
-		playback_in.sz - playback_ofs, &next_ev, &tickv);
+	if (tick != ARCAN_TIMER_TICK)
+		arcan_warning("ARCAN_EVENT_REPLAY=%s, recorded with a %d ms tick, "
+			"running with %d ms.\n", fn, (int) tick, ARCAN_TIMER_TICK);
+
+	playback.ofs = ofs;
+	playback.tick = default_evctx.c_ticks;
+	playback.pending = false;
+	playback.active = true;
+	playback.fixed = getenv("ARCAN_EVENT_REPLAY_REALTIME") == NULL;
+	fixed_clock |= playback.fixed;
+
+/* the frame statistics are needed for the summary */
+	memset(&replay_stats, '\0', sizeof(replay_stats));
+	replay_stats.start_tick = default_evctx.c_ticks;
+	benchdata.bench_enabled = true;
+}
 
-	if (-1 == rv){
-		arcan_release_map(playback_in);
-		memset(&playback_in, '\0', sizeof(playback_in));
+/*
+ * One line per run in the same format as the benchmark tools:
+ * replay:ticks:frames:mean_ms:p50_ms:p95_ms:max_ms:mean_cost_ms
+ */
+static void replay_summary()
+{
+	if (!playback.active)
 		return;
+	playback.active = false;
+
+	unsigned p50 = 0, p95 = 0, acc = 0;
+	bool got_p50 = false;
+	for (size_t i = 0; i < COUNT_OF(replay_stats.hist); i++){
+		acc += replay_stats.hist[i];
+		if (!got_p50 && acc * 2 >= replay_stats.count){
+			p50 = i;
+			got_p50 = true;
+		}
+		if (acc * 20 >= replay_stats.count * 19){
+			p95 = i;
+			break;
+		}
 	}
 
-	playback_ofs += rv;
-	goto step;
+	printf("replay:%d:%u:%.3f:%u:%u:%u:%.3f\n",
+		(int)(default_evctx.c_ticks - replay_stats.start_tick),
+		replay_stats.count, replay_stats.count ?
+			(double) replay_stats.sum / replay_stats.count : 0.0,
+		p50, p95, replay_stats.max, replay_stats.costcount ?
+			(double) replay_stats.costsum / replay_stats.costcount : 0.0
+	);
+	fflush(stdout);
+}
+
+void arcan_event_fixedclock(bool state)
+{
+	fixed_clock = state;
 }
 
 int64_t arcan_frametime()
@@ -525,6 +919,18 @@ float arcan_event_process(arcan_evctx* ctx, arcan_tick_cb cb)
 	inject_scheduled(ctx);
 	platform_event_process(ctx);
 
+	if (-1 != recorder.fd &&
+		ctx->c_ticks - recorder.last_flush > EVREC_FLUSH_TICKS)
+		evrec_handoff();
+
+/* deterministic replay / benchmark, every pass here is exactly one tick */
+	if (fixed_clock){
+		ctx->c_ticks++;
+		cb(1);
+		arcan_bench_register_tick(1);
+		return 0.0;
+	}
+
 	if (delta > ARCAN_TIMER_TICK){
 		int nticks = delta / ARCAN_TIMER_TICK;
 		if (nticks > ARCAN_TICK_THRESHOLD){
@@ -541,8 +947,6 @@ float arcan_event_process(arcan_evctx* ctx, arcan_tick_cb cb)
 	return (float)delta / (float)ARCAN_TIMER_TICK;
 }
 
-arcan_benchdata benchdata = {0};
-
 /*
  * keep the time tracking separate from the other
  * timekeeping parts, discard non-monotonic values
@@ -575,12 +979,24 @@ void arcan_event_purge()
 	platform_event_reset(&default_evctx);
 }
 
+void arcan_bench_register_draws(unsigned draws)
+{
+	benchdata.lastdraws = draws;
+}
+
 void arcan_bench_register_cost(unsigned cost)
 {
+	benchdata.lastcost = cost;
 	benchdata.framecost[(unsigned)benchdata.costofs] = cost;
+	benchdata.drawcalls[(unsigned)benchdata.costofs] = benchdata.lastdraws;
 	if (benchdata.bench_enabled == false)
 		return;
 
+	if (playback.active){
+		replay_stats.costsum += cost;
+		replay_stats.costcount++;
+	}
+
 	benchdata.costcount++;
 	benchdata.costofs = (benchdata.costofs + 1) %
 		(sizeof(benchdata.framecost) / sizeof(benchdata.framecost[0]));
@@ -596,6 +1012,14 @@ void arcan_bench_register_frame()
 	if (lastframe > 0 && ftime > lastframe){
 		unsigned delta = ftime - lastframe;
 		benchdata.frametime[(unsigned)benchdata.frameofs] = delta;
+		if (playback.active){
+			replay_stats.hist[delta < COUNT_OF(replay_stats.hist) ?
+				delta : COUNT_OF(replay_stats.hist) - 1]++;
+			replay_stats.sum += delta;
+			replay_stats.count++;
+			if (delta > replay_stats.max)
+				replay_stats.max = delta;
+		}
 		benchdata.framecount++;
 		benchdata.frameofs = (benchdata.frameofs + 1) %
 			(sizeof(benchdata.frametime) / sizeof(benchdata.frametime[0]));
@@ -604,21 +1028,31 @@ void arcan_bench_register_frame()
 	lastframe = ftime;
 }
 
+void arcan_bench_register_gc(unsigned us)
+{
+	if (benchdata.bench_enabled == false)
+		return;
+
+	benchdata.gctime[(unsigned)benchdata.gcofs] = us;
+	benchdata.gccount++;
+	benchdata.gcofs = (benchdata.gcofs + 1) %
+		(sizeof(benchdata.gctime) / sizeof(benchdata.gctime[0]));
+}
+
 extern void platform_event_deinit(arcan_evctx* ctx);
 void arcan_event_deinit(arcan_evctx* ctx)
 {
 	platform_event_deinit(ctx);
 
-	if (record_out){
-		fclose(record_out);
-		record_out = NULL;
-	}
+	evrec_close();
+	replay_summary();
 
-	if (playback_in.ptr){
-		arcan_release_map(playback_in);
-		memset(&playback_in, '\0', sizeof(playback_in));
-		playback_ofs = 0;
+	if (playback.map.ptr){
+		arcan_release_map(playback.map);
+		memset(&playback.map, '\0', sizeof(playback.map));
 	}
+	playback.fixed = false;
+	fixed_clock = false;
 
 	eventfront = eventback = 0;
 }
@@ -717,18 +1151,11 @@ void arcan_event_init(arcan_evctx* ctx, arcan_event_handler drain)
 	}
 
 	const char* fn;
-	if ((fn = getenv("ARCAN_EVENT_RECORD"))){
-		record_out = fopen(fn, "w+");
-		if (!record_out)
-			arcan_warning("ARCAN_EVENT_RECORD=%s, couldn't open file "
-				"for recording.\n", fn);
-	}
+	if ((fn = getenv("ARCAN_EVENT_RECORD")) && -1 == recorder.fd)
+		evrec_open(fn);
 
-	if ((fn = getenv("ARCAN_EVENT_REPLAY"))){
-		data_source source = arcan_open_resource(fn);
-		playback_in = arcan_map_resource(&source, false);
-		arcan_release_resource(&source);
-	}
+	if ((fn = getenv("ARCAN_EVENT_REPLAY")) && !playback.active)
+		replay_open(fn);
 
 	ctx->drain = drain;
 	platform_event_init(ctx);
@@ -69,6 +69,13 @@ int arcan_event_enqueue(struct arcan_evctx*, const struct arcan_event* const);
 /* global clock, milisecond resolution relative to epoch set during start */
 int64_t arcan_frametime();
 
+/*
+ * Decouple the tick clock from the wall clock, every call to
+ * arcan_event_process will then advance exactly one tick. Used for
+ * deterministic replay and the benchmark mode.
+ */
+void arcan_event_fixedclock(bool);
+
 /*
  * Masking functions should only be needed for very special edge cases,
  * e.g. recovering from a scripting environment failure.
@@ -19,6 +19,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
 
 #include "arcan_math.h"
 #include "arcan_general.h"
@@ -34,6 +35,7 @@
 
 #include "arcan_event.h"
 #include "arcan_img.h"
+#include "arcan_trace.h"
 
 /*
  * implementation defined for out-of-order execution
@@ -61,6 +63,58 @@ static inline void emit_droppedframe(arcan_frameserver* src,
  */
 static void tick_control(arcan_frameserver*, bool);
 bool arcan_frameserver_resize(arcan_frameserver*);
+static void mcast_publish(arcan_frameserver*,
+	const shmif_pixel* buf, size_t w, size_t h);
+
+/*
+ * Recent display synchs, a frame uploaded after synch [n] is on screen with
+ * synch [n+1], so the history only needs to cover how long a frameserver can
+ * go without being polled.
+ */
+#define SYNCH_HISTORY 4
+static struct {
+	unsigned long long ts[SYNCH_HISTORY];
+	unsigned long long gen;
+	unsigned interval;
+} synch;
+
+void arcan_frameserver_synch(unsigned long long ts, unsigned interval)
+{
+	synch.gen++;
+	synch.ts[synch.gen % SYNCH_HISTORY] = ts;
+	synch.interval = interval;
+}
+
+static void publish_timing(arcan_frameserver* tgt)
+{
+	struct arcan_shmif_page* page = tgt->shm.ptr;
+	unsigned long long last = synch.ts[synch.gen % SYNCH_HISTORY];
+	bool present = tgt->present.pending && tgt->present.gen < synch.gen;
+
+	if (!synch.gen || (page->timing.vsynch == last && !present))
+		return;
+
+/* the client can only hurt itself by touching the seqlock word */
+	uint32_t seq = atomic_load_explicit(
+		&page->timing.seq, memory_order_relaxed) & ~1;
+	atomic_store_explicit(&page->timing.seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	page->timing.interval = synch.interval;
+	page->timing.vsynch = last;
+
+	if (present){
+		if (synch.gen - tgt->present.gen < SYNCH_HISTORY){
+			page->timing.present =
+				synch.ts[(tgt->present.gen + 1) % SYNCH_HISTORY];
+			page->timing.present_vpts = tgt->present.vpts;
+			page->timing.presented++;
+		}
+		tgt->present.pending = false;
+	}
+
+	atomic_store_explicit(&page->timing.seq, seq + 2, memory_order_release);
+}
 
 static void autoclock_frame(arcan_frameserver* tgt)
 {
@@ -103,6 +157,12 @@ arcan_errc arcan_frameserver_free(arcan_frameserver* src)
 	if (!src->flags.alive)
 		return ARCAN_ERRC_UNACCEPTED_STATE;
 
+/* dissolve / leave multicast groups while the segment is still around */
+	if (src->mcast)
+		arcan_frameserver_multicast_detach(src, NULL);
+	if (src->mcast_src)
+		arcan_frameserver_multicast_detach(src->mcast_src, src);
+
 /* unhook audio monitors */
 	arcan_aobj_id* base = src->alocks;
 	while (base && *base){
@@ -284,6 +344,10 @@ static void push_buffer(arcan_frameserver* src,
 		explicit = true;
 	}
 
+/* subscribers get the committed buffer as is, before any upload conversion */
+	if (src->mcast && !(src->vstream.handle && !src->vstream.dead))
+		mcast_publish(src, buf, src->desc.width, src->desc.height);
+
 	if (src->vstream.handle && !src->vstream.dead){
 		stream.handle = src->vstream.handle;
 		store->vinf.text.stride = src->vstream.stride;
@@ -450,6 +514,8 @@ enum arcan_ffunc_rv arcan_frameserver_vdirect FFUNC_HEAD
 			goto no_out;
 		}
 
+		publish_timing(tgt);
+
 		if (tgt->playstate != ARCAN_PLAYING)
 			goto no_out;
 
@@ -482,9 +548,17 @@ enum arcan_ffunc_rv arcan_frameserver_vdirect FFUNC_HEAD
 		struct storage_info_t* dst_store = vobj->frameset ?
 			vobj->frameset->frames[vobj->frameset->index].frame : vobj->vstore;
 		struct arcan_shmif_region dirty = atomic_load(&shmpage->dirty);
+		TRACE_ZONE(ts);
 		push_buffer(tgt, dst_store,
 			shmpage->hints & SHMIF_RHINT_SUBREGION ? &dirty : NULL);
+		TRACE_ZONE_END(ts, "agp", "upload");
 		dst_store->vinf.text.vpts = shmpage->vpts;
+		tgt->present.pending = true;
+		tgt->present.gen = synch.gen;
+		tgt->present.vpts = shmpage->vpts;
+
+		if (tgt->launch.archetype)
+			arcan_frameserver_pool_firstframe(tgt);
 
 /* for some connections, we want additional statistics */
 		if (tgt->desc.callback_framestate)
@@ -581,6 +655,341 @@ leave:
 	return FRV_NOFRAME;
 }
 
+/*
+ * Hand the current video frame (in vbufs[0] or in [slot] of the multicast
+ * group it is subscribed to) along with any buffered audio to an avfeed.
+ *
+ * It is possible that we deliver more videoframes than we can legitimately
+ * encode in the target framerate, it is up to the frameserver to determine
+ * when to drop and when to double frames
+ */
+static void avfeed_deliver(arcan_frameserver* dst, int slot)
+{
+	if (dst->ofs_audb){
+		memcpy(dst->abufs[0], dst->audb, dst->ofs_audb);
+		dst->shm.ptr->abufused[0] = dst->ofs_audb;
+		dst->ofs_audb = 0;
+	}
+
+	arcan_event ev  = {
+		.tgt.kind = TARGET_COMMAND_STEPFRAME,
+		.category = EVENT_TARGET,
+		.tgt.ioevs[0].iv = dst->vfcount++,
+		.tgt.ioevs[2].iv = slot + 1
+	};
+
+	dst->shm.ptr->vready = true;
+	arcan_frameserver_pushevent(dst, &ev);
+
+	if (dst->desc.callback_framestate)
+		emit_deliveredframe(dst, 0, dst->desc.framecount++);
+}
+
+/*
+ * Multicast group, one pool of frame slots shared read-only with all the
+ * subscribers. Each subscriber holds at most one slot at a time, so with one
+ * more slot than there are subscribers there is always one free to write to.
+ */
+#ifndef FSRV_MCAST_LIMIT
+#define FSRV_MCAST_LIMIT 16
+#endif
+
+struct mcast_sub {
+	arcan_frameserver* fsrv;
+	enum arcan_frameserver_mcast_policy policy;
+	int slot;
+
+/* readback setting of the subscriber's own rendertarget, suspended while
+ * subscribed as the frames come from the group instead */
+	int readback;
+};
+
+struct arcan_frameserver_mcast {
+	struct mcast_sub subs[FSRV_MCAST_LIMIT];
+	size_t n_subs;
+
+	file_handle fd;
+	uint8_t* pool;
+	size_t pool_sz, slot_sz, n_slots;
+	size_t w, h;
+	unsigned refs[FSRV_MCAST_LIMIT + 1];
+	size_t last;
+
+	unsigned long long published, stalled;
+};
+
+static void mcast_announce(struct arcan_frameserver_mcast* grp,
+	arcan_frameserver* dst)
+{
+	arcan_event ev = {
+		.category = EVENT_TARGET,
+		.tgt.kind = TARGET_COMMAND_MULTICAST,
+		.tgt.ioevs[1].iv = grp->n_slots,
+		.tgt.ioevs[2].iv = grp->slot_sz,
+		.tgt.ioevs[3].iv = grp->w,
+		.tgt.ioevs[4].iv = grp->h
+	};
+
+	arcan_frameserver_pushfd(dst, &ev, grp->fd);
+}
+
+static void mcast_droppool(struct arcan_frameserver_mcast* grp)
+{
+	if (grp->pool)
+		munmap(grp->pool, grp->pool_sz);
+
+	if (BADFD != grp->fd)
+		close(grp->fd);
+
+	grp->pool = NULL;
+	grp->fd = BADFD;
+	grp->pool_sz = grp->n_slots = 0;
+}
+
+/*
+ * (Re-)allocate the pool if the frame dimensions changed or it has too few
+ * slots. Subscribers map the new pool when they get the announcement and the
+ * old one lives on in their mapping for as long as they need it, so frames in
+ * flight are not disturbed, they just no longer count against any slot.
+ */
+static bool mcast_pool(struct arcan_frameserver_mcast* grp, size_t w, size_t h)
+{
+	size_t n_slots = grp->n_subs + 1;
+	if (grp->pool && grp->w == w && grp->h == h && grp->n_slots >= n_slots)
+		return true;
+
+	size_t pagesz = sysconf(_SC_PAGESIZE);
+	size_t slot_sz = w * h * sizeof(shmif_pixel);
+	slot_sz = (slot_sz + pagesz - 1) / pagesz * pagesz;
+
+	void* pool;
+	file_handle fd = arcan_frameserver_sharedbuf(slot_sz * n_slots, &pool);
+	if (BADFD == fd){
+		arcan_warning("frameserver_multicast(), couldn't allocate %zu slots "
+			"of %zu*%zu\n", n_slots, w, h);
+		return false;
+	}
+
+	mcast_droppool(grp);
+	grp->fd = fd;
+	grp->pool = pool;
+	grp->pool_sz = slot_sz * n_slots;
+	grp->slot_sz = slot_sz;
+	grp->n_slots = n_slots;
+	grp->w = w;
+	grp->h = h;
+	memset(grp->refs, '\0', sizeof(grp->refs));
+
+	for (size_t i = 0; i < grp->n_subs; i++){
+		grp->subs[i].slot = -1;
+		mcast_announce(grp, grp->subs[i].fsrv);
+	}
+
+	return true;
+}
+
+static void mcast_publish(arcan_frameserver* src,
+	const shmif_pixel* buf, size_t w, size_t h)
+{
+	struct arcan_frameserver_mcast* grp = src->mcast;
+	bool block = false;
+
+/* collect acknowledgements, anyone still busy with a frame in blocking mode
+ * means the frame is held back for everyone */
+	for (size_t i = 0; i < grp->n_subs; i++){
+		struct mcast_sub* sub = &grp->subs[i];
+		bool busy = sub->fsrv->shm.ptr && sub->fsrv->shm.ptr->vready;
+
+		if (!busy && -1 != sub->slot){
+			grp->refs[sub->slot]--;
+			sub->slot = -1;
+		}
+
+		block |= busy && sub->policy == FSRV_MCAST_BLOCK;
+	}
+
+	if (block){
+		grp->stalled++;
+		for (size_t i = 0; i < grp->n_subs; i++){
+			arcan_frameserver* dst = grp->subs[i].fsrv;
+			if (dst->desc.callback_framestate)
+				emit_droppedframe(dst, 0, dst->desc.dropcount++);
+		}
+		return;
+	}
+
+	if (!mcast_pool(grp, w, h))
+		return;
+
+/* round-robin rather than first free, so a subscriber that reads the frame
+ * in place after acknowledging it (vnc) gets as long as possible with it */
+	size_t slot = grp->last;
+	for (size_t i = 0; i < grp->n_slots; i++){
+		slot = (slot + 1) % grp->n_slots;
+		if (!grp->refs[slot])
+			break;
+	}
+
+	if (grp->refs[slot])
+		return;
+	grp->last = slot;
+
+	memcpy(grp->pool + slot * grp->slot_sz, buf, w * h * sizeof(shmif_pixel));
+	grp->published++;
+
+	for (size_t i = 0; i < grp->n_subs; i++){
+		struct mcast_sub* sub = &grp->subs[i];
+		arcan_frameserver* dst = sub->fsrv;
+
+		if (!dst->shm.ptr || dst->shm.ptr->vready ||
+			dst->desc.width != w || dst->desc.height != h){
+			if (dst->desc.callback_framestate)
+				emit_droppedframe(dst, 0, dst->desc.dropcount++);
+			continue;
+		}
+
+		sub->slot = slot;
+		grp->refs[slot]++;
+		avfeed_deliver(dst, slot);
+	}
+}
+
+static struct rendertarget* mcast_rt(arcan_frameserver* fsrv)
+{
+	arcan_vobject* vobj = arcan_video_getobject(fsrv->vid);
+	return vobj ? arcan_vint_findrt(vobj) : NULL;
+}
+
+static void mcast_add(struct arcan_frameserver_mcast* grp,
+	arcan_frameserver* src, arcan_frameserver* dst,
+	enum arcan_frameserver_mcast_policy policy)
+{
+	struct mcast_sub* sub = &grp->subs[grp->n_subs++];
+	*sub = (struct mcast_sub){
+		.fsrv = dst,
+		.policy = policy,
+		.slot = -1
+	};
+	dst->mcast_src = src;
+
+/* the source keeps its readbacks, they are what feeds the group */
+	struct rendertarget* rtgt = mcast_rt(dst);
+	if (rtgt && dst != src){
+		sub->readback = rtgt->readback;
+		rtgt->readback = 0;
+	}
+
+	if (grp->pool)
+		mcast_announce(grp, dst);
+}
+
+arcan_errc arcan_frameserver_multicast_attach(arcan_frameserver* src,
+	arcan_frameserver* dst, enum arcan_frameserver_mcast_policy policy)
+{
+	if (!src || !dst || src == dst)
+		return ARCAN_ERRC_BAD_ARGUMENT;
+
+/* no chaining, subscribers can't be sources and vice versa */
+	if (dst->mcast_src || dst->mcast ||
+		(src->mcast_src && src->mcast_src != src))
+		return ARCAN_ERRC_UNACCEPTED_STATE;
+
+/* only output segments, for anything else vready and STEPFRAME belong to the
+ * client side of the video protocol */
+	arcan_vobject* dvobj = arcan_video_getobject(dst->vid);
+	if (!dvobj || dvobj->feed.ffunc != FFUNC_AVFEED)
+		return ARCAN_ERRC_UNACCEPTED_STATE;
+
+	struct arcan_frameserver_mcast* grp = src->mcast;
+	if (!grp){
+		arcan_vobject* vobj = arcan_video_getobject(src->vid);
+		if (!vobj)
+			return ARCAN_ERRC_NO_SUCH_OBJECT;
+
+		grp = arcan_alloc_mem(sizeof(struct arcan_frameserver_mcast),
+			ARCAN_MEM_VSTRUCT, ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL,
+			ARCAN_MEMALIGN_NATURAL);
+		if (!grp)
+			return ARCAN_ERRC_OUT_OF_SPACE;
+
+		grp->fd = BADFD;
+		src->mcast = grp;
+
+/* a recordtarget is a consumer of its own readbacks, it gets them through
+ * the group as well, with the same drop behavior as before */
+		if (vobj->feed.ffunc == FFUNC_AVFEED)
+			mcast_add(grp, src, src, FSRV_MCAST_DROP);
+	}
+
+	if (grp->n_subs == FSRV_MCAST_LIMIT)
+		return ARCAN_ERRC_OUT_OF_SPACE;
+
+	mcast_add(grp, src, dst, policy);
+	return ARCAN_OK;
+}
+
+arcan_errc arcan_frameserver_multicast_detach(
+	arcan_frameserver* src, arcan_frameserver* dst)
+{
+	struct arcan_frameserver_mcast* grp = src ? src->mcast : NULL;
+	if (!grp)
+		return ARCAN_ERRC_NO_SUCH_OBJECT;
+
+/* a recordtarget leaving its own group is the same as dissolving it */
+	if (dst == src)
+		dst = NULL;
+
+	for (size_t i = 0; i < grp->n_subs;){
+		struct mcast_sub* sub = &grp->subs[i];
+		if (dst && sub->fsrv != dst){
+			i++;
+			continue;
+		}
+
+		if (-1 != sub->slot)
+			grp->refs[sub->slot]--;
+
+		struct rendertarget* rtgt = mcast_rt(sub->fsrv);
+		if (rtgt && sub->fsrv != src){
+			rtgt->readback = sub->readback;
+			rtgt->readcnt = abs(sub->readback);
+		}
+
+		sub->fsrv->mcast_src = NULL;
+		memmove(sub, sub + 1, (grp->n_subs - i - 1) * sizeof(struct mcast_sub));
+		grp->n_subs--;
+	}
+
+/* only the source itself left, it goes back to the plain readback path */
+	if (grp->n_subs == 1 && grp->subs[0].fsrv == src){
+		src->mcast_src = NULL;
+		grp->n_subs = 0;
+	}
+
+	if (grp->n_subs == 0){
+		mcast_droppool(grp);
+		arcan_mem_free(grp);
+		src->mcast = NULL;
+	}
+
+	return ARCAN_OK;
+}
+
+bool arcan_frameserver_multicast_stat(
+	arcan_frameserver* src, struct arcan_frameserver_mcast_stat* dst)
+{
+	if (!src || !src->mcast)
+		return false;
+
+	*dst = (struct arcan_frameserver_mcast_stat){
+		.subscribers = src->mcast->n_subs,
+		.slots = src->mcast->n_slots,
+		.published = src->mcast->published,
+		.stalled = src->mcast->stalled
+	};
+	return true;
+}
+
 enum arcan_ffunc_rv arcan_frameserver_avfeedframe FFUNC_HEAD
 {
 	assert(state.ptr);
@@ -613,30 +1022,12 @@ enum arcan_ffunc_rv arcan_frameserver_avfeedframe FFUNC_HEAD
  * format. Audio will keep on buffering until overflow.
  */
 	else if (cmd == FFUNC_READBACK){
-		if (src->shm.ptr && !src->shm.ptr->vready){
-			memcpy(src->vbufs[0], buf, buf_sz);
-			if (src->ofs_audb){
-				memcpy(src->abufs[0], src->audb, src->ofs_audb);
-				src->shm.ptr->abufused[0] = src->ofs_audb;
-				src->ofs_audb = 0;
-			}
+		if (src->mcast)
+			mcast_publish(src, buf, width, height);
 
-/*
- * it is possible that we deliver more videoframes than we can legitimately
- * encode in the target framerate, it is up to the frameserver to determine
- * when to drop and when to double frames
- */
-			arcan_event ev  = {
-				.tgt.kind = TARGET_COMMAND_STEPFRAME,
-				.category = EVENT_TARGET,
-				.tgt.ioevs[0] = src->vfcount++
-			};
-
-			src->shm.ptr->vready = true;
-			arcan_frameserver_pushevent(src, &ev);
-
-			if (src->desc.callback_framestate)
-				emit_deliveredframe(src, 0, src->desc.framecount++);
+		else if (src->shm.ptr && !src->shm.ptr->vready){
+			memcpy(src->vbufs[0], buf, buf_sz);
+			avfeed_deliver(src, -1);
 		}
 		else {
 			if (src->desc.callback_framestate)
@@ -651,6 +1042,10 @@ no_out:
 	return FRV_NOFRAME;
 }
 
+#ifndef AMIX_CHUNK
+#define AMIX_CHUNK 512
+#endif
+
 /* assumptions:
  * buf_sz doesn't contain partial samples (% (bytes per sample * channels))
  * dst->amixer inaud is allocated and allocation count matches n_aids */
@@ -658,7 +1053,7 @@ static void feed_amixer(arcan_frameserver* dst, arcan_aobj_id srcid,
 	int16_t* buf, int nsamples)
 {
 /* formats; nsamples (samples in, 2 samples / frame)
- * cur->inbuf; samples converted to float with gain, 2 samples / frame)
+ * cur->ring; samples converted to float with gain, 2 samples / frame)
  * dst->outbuf; SINT16, in bytes, ofset in bytes */
 	size_t minv = INT_MAX;
 
@@ -667,19 +1062,12 @@ static void feed_amixer(arcan_frameserver* dst, arcan_aobj_id srcid,
 	for (int i = 0; i < dst->amixer.n_aids; i++){
 		struct frameserver_audsrc* cur = dst->amixer.inaud + i;
 
-		if (cur->src_aid == srcid){
-			int ulim = sizeof(cur->inbuf) / sizeof(float);
-			int count = 0;
+		if (cur->src_aid == srcid)
+			arcan_amix_ring_push(&cur->ring, buf, nsamples,
+				cur->l_gain, cur->r_gain);
 
-			while (nsamples-- && cur->inofs < ulim){
-				float val = *buf++;
-				cur->inbuf[cur->inofs++] =
-					(count++ % 2 ? cur->l_gain : cur->r_gain) * (val / 32767.0f);
-			}
-		}
-
-		if (cur->inofs < minv)
-			minv = cur->inofs;
+		if (cur->ring.count < minv)
+			minv = cur->ring.count;
 	}
 
 /*
@@ -687,38 +1075,27 @@ static void feed_amixer(arcan_frameserver* dst, arcan_aobj_id srcid,
  * samples together and store in dst->outb Formulae used:
  * A = float(sampleA) * gainA.
  * B = float(sampleB) * gainB. Z = A + B - A * B
+ * This is done in fixed chunks that stay in cache, consuming the rings.
  */
-		if (minv != INT_MAX && minv > 512 && dst->sz_audb - dst->ofs_audb > 0){
-/* clamp */
-			if (dst->ofs_audb + minv * sizeof(uint16_t) > dst->sz_audb)
-				minv = (dst->sz_audb - dst->ofs_audb) / sizeof(uint16_t);
+	if (minv == INT_MAX || minv <= 512 || dst->sz_audb <= dst->ofs_audb)
+		return;
 
-			for (int sc = 0; sc < minv; sc++){
-				float work_sample = 0;
+	if (dst->ofs_audb + minv * sizeof(int16_t) > dst->sz_audb)
+		minv = (dst->sz_audb - dst->ofs_audb) / sizeof(int16_t);
+	minv &= ~(size_t)1;
+
+	float work[AMIX_CHUNK];
+	while (minv){
+		size_t nw = minv > AMIX_CHUNK ? AMIX_CHUNK : minv;
+
+		for (int i = 0; i < dst->amixer.n_aids; i++)
+			arcan_amix_ring_pop(&dst->amixer.inaud[i].ring, work, nw, i == 0);
 
-			for (int i = 0; i < dst->amixer.n_aids; i++){
-				work_sample += dst->amixer.inaud[i].inbuf[sc] - (work_sample *
-					dst->amixer.inaud[i].inbuf[sc]);
-			}
 /* clip output */
-			int16_t sample_conv = work_sample >= 1.0 ? 32767.0 :
-				(work_sample < -1.0 ? -32768 : work_sample * 32767);
-			memcpy(&dst->audb[dst->ofs_audb], &sample_conv, sizeof(int16_t));
-			dst->ofs_audb += sizeof(int16_t);
-		}
-/* 2b. Reset intermediate buffers, slide if needed. */
-		for (int j = 0; j < dst->amixer.n_aids; j++){
-			struct frameserver_audsrc* cur = dst->amixer.inaud + j;
-			if (cur->inofs > minv){
-				memmove(cur->inbuf, &cur->inbuf[minv], (cur->inofs - minv) *
-					sizeof(float));
-				cur->inofs -= minv;
-			}
-			else
-				cur->inofs = 0;
-		}
+		arcan_amix_ftos16(work, (int16_t*) &dst->audb[dst->ofs_audb], nw);
+		dst->ofs_audb += nw * sizeof(int16_t);
+		minv -= nw;
 	}
-
 }
 
 void arcan_frameserver_update_mixweight(arcan_frameserver* dst,
@@ -747,7 +1124,6 @@ void arcan_frameserver_avfeed_mixer(arcan_frameserver* dst, int n_sources,
 	for (int i = 0; i < n_sources; i++){
 		dst->amixer.inaud[i].l_gain  = 1.0;
 		dst->amixer.inaud[i].r_gain  = 1.0;
-		dst->amixer.inaud[i].inofs   = 0;
 		dst->amixer.inaud[i].src_aid = *sources++;
 	}
 
@@ -10,13 +10,16 @@
 #define FSRV_MAX_VBUFC ARCAN_SHMIF_VBUFC_LIM
 #define FSRV_MAX_ABUFC ARCAN_SHMIF_ABUFC_LIM
 
+#include "arcan_audio_mix.h"
+
 /*
  * The following functions are implemented in the platform layer;
  * arcan_frameserver_validchild,
  * arcan_frameserver_killchild,
  * arcan_frameserver_dropshared,
  * arcan_frameserver_pushfd,
- * arcan_frameserver_spawn_server
+ * arcan_frameserver_spawn_server,
+ * arcan_frameserver_sharedbuf
  */
 
 enum arcan_playstate {
@@ -59,8 +62,7 @@ struct arcan_frameserver_meta {
 };
 
 struct frameserver_audsrc {
-	float inbuf[4096];
-	off_t inofs;
+	struct arcan_amix_ring ring;
 	arcan_aobj_id src_aid;
 	float l_gain;
 	float r_gain;
@@ -125,6 +127,13 @@ struct arcan_frameserver {
 	int64_t launchedtime;
 	unsigned vfcount;
 
+/* launch-to-first-frame tracking for the prespawn pool, archetype is the
+ * pool slot + 1 (0, not tracked) and is cleared on the first frame */
+	struct {
+		unsigned archetype;
+		bool warm;
+	} launch;
+
 	uint32_t cookie;
 
 /* state tracking for accelerated buffer sharing, populated by handle
@@ -136,6 +145,19 @@ struct arcan_frameserver {
 		int format;
 	} vstream;
 
+/* multicast group this frameserver is the source of, and the source of the
+ * group it is subscribed to (if any), see arcan_frameserver_multicast_attach */
+	struct arcan_frameserver_mcast* mcast;
+	struct arcan_frameserver* mcast_src;
+
+/* synch generation during which the last client frame was uploaded, its
+ * present time is published into the page once the following synch is known */
+	struct {
+		unsigned long long gen;
+		uint64_t vpts;
+		bool pending;
+	} present;
+
 /* temporary buffer for aligning queue/dequeue events in audio, can/should
  * be scrapped after the 0.6 audio refactor */
 	size_t sz_audb;
@@ -198,6 +220,54 @@ struct frameserver_envp {
 arcan_errc arcan_frameserver_spawn_server(arcan_frameserver* dst,
 	struct frameserver_envp*);
 
+/*
+ * Prespawn pool for builtin frameservers. Each configured archetype (mode
+ * string, e.g. "decode" or "terminal") keeps up to [size] frameservers that
+ * have their segment allocated and their process started, but that are
+ * blocked on the control socket waiting for arguments. spawn_server hands
+ * one of these out when available instead of doing a cold fork/exec.
+ *
+ * _pool sets the size of the pool for an archetype (0 keeps the latency
+ * statistics but drops all entries), returns false if the archetype isn't
+ * among the allowed ones or all slots are used.
+ *
+ * _pool_step starts at most one missing entry, this is intended to be
+ * called from the main loop when there is time to spare.
+ *
+ * _pool_flush drops all prespawned entries (e.g. on appl switch, as the
+ * environment is bound at launch), if [reset] all configuration is lost.
+ */
+#define FSRV_POOL_LIMIT 8
+#define FSRV_POOL_MAXSZ 16
+
+struct arcan_frameserver_poolstat {
+	size_t size, ready;
+
+/* number of launches and accumulated launch-to-first-frame (ms) */
+	size_t warm, cold;
+	unsigned long long warm_ms, cold_ms;
+};
+
+bool arcan_frameserver_pool(const char* archetype, size_t size);
+void arcan_frameserver_pool_step();
+void arcan_frameserver_pool_flush(bool reset);
+bool arcan_frameserver_pool_stat(
+	const char* archetype, struct arcan_frameserver_poolstat* dst);
+
+/*
+ * Called by the feed- function when the first frame has been received,
+ * records the launch latency if the frameserver is tracked by the pool.
+ */
+void arcan_frameserver_pool_firstframe(arcan_frameserver*);
+
+/*
+ * Called from the main loop after each display synch with the timestamp of
+ * the synch and the current estimate of the synch interval (both in
+ * microseconds). The values are forwarded to the clients through the timing
+ * block of the shared page the next time each frameserver is polled.
+ */
+void arcan_frameserver_synch(unsigned long long ts, unsigned interval);
+
 /*
  * Setup a frameserver that is idle until an external party connects
  * through a listening socket, then behaves as an avfeed- style
@@ -227,6 +297,55 @@ arcan_errc arcan_frameserver_resume(arcan_frameserver*);
  */
 arcan_errc arcan_frameserver_pushfd(arcan_frameserver*, arcan_event*, int fd);
 
+/*
+ * Allocate [sz] bytes of anonymous shared memory that can be passed on to
+ * other processes, mapped read/write into [dst]. Where possible (memfd) the
+ * descriptor is sealed so that no new writable mappings can be made and the
+ * size is fixed. Returns BADFD on failure.
+ */
+file_handle arcan_frameserver_sharedbuf(size_t sz, void** dst);
+
+/*
+ * Multicast, share the frames from one source with a number of subscriber
+ * segments (avfeed- style, e.g. encode for recording and vnc for remoting)
+ * through a pool of frame slots that every subscriber maps read-only. This
+ * means one readback (or one client buffer) and one copy into the pool,
+ * regardless of the number of subscribers.
+ *
+ * If [src] is a recordtarget, its readbacks are published and [src] itself
+ * is added to the group. Otherwise the buffers that the client of [src]
+ * commits are published as they are uploaded.
+ *
+ * A slot is referenced by each subscriber it is delivered to, and released
+ * when the subscriber acknowledges it (clears vready, same as for frames in
+ * its own segment). A subscriber that is still busy when the next frame is
+ * published either misses that frame (FSRV_MCAST_DROP) or holds it back for
+ * the entire group (FSRV_MCAST_BLOCK), as the engine itself can't wait. The
+ * frame counters and framestatus events of each subscriber track delivered
+ * and dropped frames. Subscribers with different dimensions than the source
+ * are skipped. _attach fails (ARCAN_ERRC_UNACCEPTED_STATE) for a [dst] that
+ * isn't fed through FFUNC_AVFEED (output segments and recordtargets).
+ *
+ * _detach with a NULL [dst] dissolves the entire group, it is also dissolved
+ * when [src] is freed and subscribers are detached when they are freed.
+ */
+enum arcan_frameserver_mcast_policy {
+	FSRV_MCAST_DROP = 0,
+	FSRV_MCAST_BLOCK = 1
+};
+
+struct arcan_frameserver_mcast_stat {
+	size_t subscribers, slots;
+	unsigned long long published, stalled;
+};
+
+arcan_errc arcan_frameserver_multicast_attach(arcan_frameserver* src,
+	arcan_frameserver* dst, enum arcan_frameserver_mcast_policy);
+arcan_errc arcan_frameserver_multicast_detach(
+	arcan_frameserver* src, arcan_frameserver* dst);
+bool arcan_frameserver_multicast_stat(
+	arcan_frameserver* src, struct arcan_frameserver_mcast_stat* dst);
+
 /*
  * Allocate a new frameserver segment, bind it to the same process
  * and communicate the necessary IPC arguments (key etc.) using
@@ -114,6 +114,16 @@ typedef struct {
 
 	unsigned framecost[64], costcount;
 	char costofs;
+
+/* objects processed (i.e. draw calls) per refresh, indexed as framecost */
+	unsigned drawcalls[64];
+
+/* most recent refresh, kept up to date even when bench_enabled is off */
+	unsigned lastcost, lastdraws;
+
+/* microseconds spent in engine- driven Lua garbage collection per frame */
+	unsigned gctime[64], gccount;
+	char gcofs;
 } arcan_benchdata;
 
 /*
@@ -147,7 +157,9 @@ void arcan_state_dump(const char* prefix, const char* key, const char* src);
  */
 void arcan_bench_register_tick(unsigned);
 void arcan_bench_register_cost(unsigned);
+void arcan_bench_register_draws(unsigned);
 void arcan_bench_register_frame();
+void arcan_bench_register_gc(unsigned);
 
 /*
  * LEGACY/REDESIGN
@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <string.h>
 
@@ -22,7 +23,8 @@
 	ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_PAGE))
 
 #define STBI_FREE(ptr) (arcan_mem_free(ptr))
-#define STBI_REALLOC(p,sz) realloc(p,sz)
+#define STBI_REALLOC_SIZED(p,oldsz,newsz) \
+	(arcan_mem_grow(p, oldsz, newsz, ARCAN_MEM_NONFATAL))
 
 #define STBI_ONLY_PNG
 #define STBI_ONLY_JPEG
@@ -143,14 +145,18 @@ arcan_errc arcan_pkm_raw(const uint8_t* inbuf, size_t inbuf_sz,
 	int height  = (inbuf[14] << 8) | inbuf[15];
 
 /* strip header */
-	*outbuf = arcan_mem_alloc(inbuf_sz - 16,
-		ARCAN_MEM_VBUFFER, ARCAN_MEMALIGN_PAGE);
+	*outbuf = arcan_alloc_mem(inbuf_sz - 16,
+		ARCAN_MEM_VBUFFER, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_PAGE);
+	if (!*outbuf)
+		return ARCAN_ERRC_OUT_OF_SPACE;
 
 	memcpy(*outbuf, inbuf + 16, inbuf_sz - 16);
 	meta->compressed = true;
 	meta->pwidth = pwidth;
 	meta->pheight = pheight;
 	meta->c_size = (pwidth * pheight) >> 1;
+	meta->txcomp = TXCOMP_ETC1;
+	meta->levels = 1;
  	*outw = width;
 	*outh = height;
 
@@ -202,6 +208,106 @@ arcan_errc arcan_dds_raw(const uint8_t* inbuf, size_t inbuf_sz,
 #endif
 }
 
+#ifndef KTX_MAX_DIM
+#define KTX_MAX_DIM 16384
+#endif
+
+static const uint8_t ktx_ident[12] = {
+	0xab, 'K', 'T', 'X', ' ', '1', '1', 0xbb, '\r', '\n', 0x1a, '\n'
+};
+
+static const struct {
+	uint32_t glfmt;
+	enum agp_txcomp fmt;
+} ktx_formats[] = {
+	{0x8d64, TXCOMP_ETC1},
+	{0x9274, TXCOMP_ETC2_RGB},
+	{0x9278, TXCOMP_ETC2_RGBA},
+	{0x83f0, TXCOMP_BC1},
+	{0x83f1, TXCOMP_BC1},
+	{0x83f3, TXCOMP_BC3},
+	{0x8e8c, TXCOMP_BC7}
+};
+
+arcan_errc arcan_ktx_raw(const uint8_t* inbuf, size_t inbuf_sz,
+	uint32_t** outbuf, size_t* outw, size_t* outh, struct arcan_img_meta* meta)
+{
+	uint32_t hdr[13];
+	if (inbuf_sz < sizeof(ktx_ident) + sizeof(hdr) ||
+		memcmp(inbuf, ktx_ident, sizeof(ktx_ident)) != 0)
+		return ARCAN_ERRC_BAD_RESOURCE;
+
+	memcpy(hdr, &inbuf[sizeof(ktx_ident)], sizeof(hdr));
+
+/* only native endian files, the tool writes those */
+	if (hdr[0] != 0x04030201)
+		return ARCAN_ERRC_UNSUPPORTED_FORMAT;
+
+	enum agp_txcomp fmt = TXCOMP_NONE;
+	for (size_t i = 0; i < COUNT_OF(ktx_formats); i++)
+		if (ktx_formats[i].glfmt == hdr[4]){
+			fmt = ktx_formats[i].fmt;
+			break;
+		}
+
+	size_t w = hdr[6], h = hdr[7], nlevels = hdr[11] ? hdr[11] : 1;
+	if (fmt == TXCOMP_NONE || hdr[1] != 0 || hdr[9] > 1 || hdr[10] != 1 ||
+		!w || !h || w > KTX_MAX_DIM || h > KTX_MAX_DIM || nlevels > 16)
+		return ARCAN_ERRC_UNSUPPORTED_FORMAT;
+
+/* first pass, validate level sizes and sum up */
+	size_t start = sizeof(ktx_ident) + sizeof(hdr) + hdr[12];
+	size_t ofs = start, total = 0, lw = w, lh = h;
+	for (size_t i = 0; i < nlevels; i++){
+		uint32_t sz;
+		if (ofs + 4 > inbuf_sz)
+			return ARCAN_ERRC_BAD_RESOURCE;
+		memcpy(&sz, &inbuf[ofs], 4);
+		if (sz != agp_txcomp_size(fmt, lw, lh) || ofs + 4 + sz > inbuf_sz)
+			return ARCAN_ERRC_BAD_RESOURCE;
+		ofs += 4 + ((sz + 3) & ~3);
+		total += sz;
+		lw = lw > 1 ? lw >> 1 : 1;
+		lh = lh > 1 ? lh >> 1 : 1;
+	}
+
+	uint8_t* dst = arcan_alloc_mem(total,
+		ARCAN_MEM_VBUFFER, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_PAGE);
+	if (!dst)
+		return ARCAN_ERRC_OUT_OF_SPACE;
+
+	ofs = start;
+	for (size_t i = 0, dofs = 0; i < nlevels; i++){
+		uint32_t sz;
+		memcpy(&sz, &inbuf[ofs], 4);
+		memcpy(&dst[dofs], &inbuf[ofs + 4], sz);
+		dofs += sz;
+		ofs += 4 + ((sz + 3) & ~3);
+	}
+
+	*outbuf = (uint32_t*) dst;
+	*outw = w;
+	*outh = h;
+	meta->compressed = true;
+	meta->mipmapped = nlevels > 1;
+	meta->c_size = total;
+	meta->txcomp = fmt;
+	meta->levels = nlevels;
+
+	return ARCAN_OK;
+}
+
+/* the decoder state lives on the stack, so unlike the image loaders this
+ * doesn't need to hold img_sync */
+ssize_t arcan_zlib_inflate(
+	char* dst, size_t dst_sz, const char* src, size_t src_sz)
+{
+	if (dst_sz > INT_MAX || src_sz > INT_MAX)
+		return -1;
+
+	return stbi_zlib_decode_buffer(dst, dst_sz, src, src_sz);
+}
+
 pthread_mutex_t img_sync;
 void arcan_img_init()
 {
@@ -256,6 +362,10 @@ pthread_mutex_unlock(&img_sync);
 			return arcan_pkm_raw((uint8_t*)inbuf, inbuf_sz,
 				outbuf, outw, outh, meta);
 		}
+		else if (strcasecmp(hint + (len - 3), "KTX") == 0){
+			return arcan_ktx_raw((uint8_t*)inbuf, inbuf_sz,
+				outbuf, outw, outh, meta);
+		}
 		else if (strcasecmp(hint + (len - 3), "DDS") == 0){
 			return arcan_dds_raw((uint8_t*)inbuf, inbuf_sz,
 				outbuf, outw, outh, meta);
@@ -12,6 +12,10 @@ struct arcan_img_meta {
 	bool mipmapped;
 	int pwidth, pheight;
 	size_t c_size;
+
+/* KTX, (enum agp_txcomp) and number of levels packed in outbuf */
+	int txcomp;
+	size_t levels;
 };
 
 void arcan_img_init();
@@ -28,6 +32,14 @@ arcan_errc arcan_img_decode(const char* hint, char* inbuf, size_t inbuf_sz,
 	struct arcan_img_meta* outm, bool vflip
 );
 
+/*
+ * Unpack the mip levels of a KTX (v1) container with one of the formats in
+ * enum agp_txcomp into [outbuf], back to back and without the size fields.
+ * This is the format written by tools/arcan_txconv.c.
+ */
+arcan_errc arcan_ktx_raw(const uint8_t* inbuf, size_t inbuf_sz,
+	uint32_t** outbuf, size_t* outw, size_t* outh, struct arcan_img_meta* meta);
+
 /*
  * take the contents of [inbuf] and unpack/[vflip],
  * then encode as PNG and write to [dst].
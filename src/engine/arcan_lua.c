@@ -170,6 +170,7 @@ typedef int acoord;
 
 #include "arcan_img.h"
 #include "arcan_ttf.h"
+#include "arcan_trace.h"
 
 /* these take some explaining:
  * to enforce that actual constants are used in LUA scripts and not magic
@@ -217,6 +218,18 @@ typedef int acoord;
 #define CONST_FRAMESERVER_OUTPUT 42
 #endif
 
+#ifndef CONST_MULTICAST_DROP
+#define CONST_MULTICAST_DROP 51
+#endif
+
+#ifndef CONST_MULTICAST_BLOCK
+#define CONST_MULTICAST_BLOCK 52
+#endif
+
+#ifndef CONST_MULTICAST_DETACH
+#define CONST_MULTICAST_DETACH 53
+#endif
+
 #ifndef CONST_DEVICE_INDIRECT
 #define CONST_DEVICE_INDIRECT 1
 #endif
@@ -237,6 +250,28 @@ typedef int acoord;
 #define LAUNCH_INTERNAL 1
 #endif
 
+/*
+ * default time (in microseconds) per frame that the engine may spend on
+ * stepping the Lua garbage collector, 0 leaves the collector in automatic
+ * mode (see system_gcbudget)
+ */
+#ifndef ARCAN_LUA_GCBUDGET
+#define ARCAN_LUA_GCBUDGET 2000
+#endif
+
+/*
+ * heap growth (in percent of the heap size after the last completed cycle)
+ * before a new collection cycle is started, and the point where collection
+ * will run to completion regardless of the remaining frame budget
+ */
+#ifndef ARCAN_LUA_GCPAUSE
+#define ARCAN_LUA_GCPAUSE 150
+#endif
+
+#ifndef ARCAN_LUA_GCPRESSURE
+#define ARCAN_LUA_GCPRESSURE 300
+#endif
+
 /*
  * disable support for all builtin frameservers
  * which removes most (launch_target and target_alloc remain)
@@ -314,7 +349,17 @@ static struct {
 
 	const char* last_crash_source;
 
+/* engine- driven garbage collection, budget is in microseconds and
+ * base is the heap size (KiB) after the last completed cycle */
+	size_t gc_budget;
+	size_t gc_base;
+	bool gc_active;
+
 	lua_State* last_ctx;
+
+/* compiled chunk cache, see alua_loadresource */
+	size_t bc_hits;
+	size_t bc_misses;
 } luactx = {0};
 
 extern char* _n_strdup(const char* instr, const char* alt);
@@ -331,16 +376,50 @@ static inline char* colon_escape(char* in)
 	return in;
 }
 
+/* lua_dump into a growing buffer */
+struct bc_buf {
+	char* buf;
+	size_t sz, cap;
+};
+
+static int bc_writer(lua_State* ctx, const void* p, size_t sz, void* tag)
+{
+	struct bc_buf* out = tag;
+	if (out->sz + sz > out->cap){
+		size_t ncap = (out->sz + sz) * 2;
+		char* nb = realloc(out->buf, ncap);
+		if (!nb)
+			return 1;
+		out->buf = nb;
+		out->cap = ncap;
+	}
+
+	memcpy(&out->buf[out->sz], p, sz);
+	out->sz += sz;
+	return 0;
+}
+
 /*
  * Nil out whatever functions / tables the build- system defined that we should
  * not have. Should possibly replace this with a function that maps a warning
  * about the banned function.
  */
 #include "arcan_bootstrap.h"
+static struct bc_buf bootstrap_bc;
+
 static void luaL_nil_banned(struct arcan_luactx* ctx)
 {
-	int rv = luaL_loadbuffer(ctx, (const char*) arcan_bootstrap_lua,
-		arcan_bootstrap_lua_len, "bootstrap");
+/* this runs for every new VM and on crash recovery, so only parse once */
+	int rv;
+	if (bootstrap_bc.sz)
+		rv = luaL_loadbuffer(ctx,
+			bootstrap_bc.buf, bootstrap_bc.sz, "bootstrap");
+	else {
+		rv = luaL_loadbuffer(ctx, (const char*) arcan_bootstrap_lua,
+			arcan_bootstrap_lua_len, "bootstrap");
+		if (0 == rv && 0 != lua_dump(ctx, bc_writer, &bootstrap_bc))
+			bootstrap_bc.sz = 0;
+	}
 
 	if (0 != rv){
 		arcan_warning("BROKEN BUILD: bootstrap code couldn't be parsed\n");
@@ -737,28 +816,228 @@ static inline char* findresource(const char* arg, enum arcan_namespaces space)
 	return res;
 }
 
-static int alua_doresolve(lua_State* ctx, const char* inp)
+/*
+ * Compiled scripts are cached in .luacache in the appl state store, one
+ * file per resolved script path. An entry is only used if it was produced by
+ * the same engine build and the source (or for packed appls, the archive) has
+ * the same inode, size and mtime as when it was compiled. The VM has to trust
+ * the bytecode it loads, so caching is skipped if the state store is covered
+ * by a namespace that scripts can write to (appl-temp, shared) or if it isn't
+ * writable. Set ARCAN_LUA_NOCACHE to always parse.
+ */
+#define BC_MAGIC "ARCANLBC"
+#define BC_TAG LUA_RELEASE " " ARCAN_BUILDVERSION
+#define BC_LIMIT (64 * 1024 * 1024)
+
+struct bc_header {
+	char magic[8];
+	uint32_t tag_len;
+	uint32_t path_len;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime;
+	int64_t mtime_ns;
+	uint64_t ofs;
+	uint64_t bc_len;
+};
+
+static char* bc_cachepath(const char* fname)
+{
+	if (getenv("ARCAN_LUA_NOCACHE"))
+		return NULL;
+
+	char* dir = arcan_expand_resource(".luacache", RESOURCE_APPL_STATE);
+	if (!dir)
+		return NULL;
+
+/* state falls back to shared when there is no state base, and the temp store
+ * can be the appl directory itself, don't cache into either */
+	int spaces[] = {RESOURCE_APPL_TEMP, RESOURCE_APPL_SHARED};
+	for (size_t i = 0; i < COUNT_OF(spaces); i++){
+		const char* path = arcan_fetch_namespace(spaces[i]);
+		if (path && strncmp(dir, path, strlen(path)) == 0){
+			arcan_mem_free(dir);
+			return NULL;
+		}
+	}
+
+/* read-only or missing state store, just run uncached */
+	if ((-1 == mkdir(dir, S_IRWXU) && errno != EEXIST) ||
+		-1 == access(dir, W_OK)){
+		arcan_mem_free(dir);
+		return NULL;
+	}
+
+/* FNV-1a of the resolved path, the full path is checked on load */
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const char* cur = fname; *cur; cur++)
+		hash = (hash ^ (uint8_t)*cur) * 0x100000001b3ull;
+
+	size_t len = strlen(dir) + sizeof("/0123456789abcdef.luac");
+	char* res = malloc(len);
+	if (res)
+		snprintf(res, len, "%s/%016"PRIx64".luac", dir, hash);
+	arcan_mem_free(dir);
+
+	return res;
+}
+
+static void bc_key(struct bc_header* hdr, const char* fname, data_source* src)
 {
-	data_source source = arcan_open_resource(inp);
+	struct stat buf = {0};
+	fstat(src->fd, &buf);
+
+	*hdr = (struct bc_header){
+		.tag_len = sizeof(BC_TAG) - 1,
+		.path_len = strlen(fname),
+		.ino = buf.st_ino,
+		.size = buf.st_size,
+		.mtime = buf.st_mtime,
+		.ofs = src->start
+	};
+	memcpy(hdr->magic, BC_MAGIC, 8);
+
+#ifdef __LINUX
+	hdr->mtime_ns = buf.st_mtim.tv_nsec;
+#endif
+}
+
+static bool bc_load(lua_State* ctx, const char* cpath,
+	struct bc_header* key, const char* fname, const char* chunkname)
+{
+	struct bc_header hdr;
+	FILE* fin = fopen(cpath, "re");
+	if (!fin)
+		return false;
+
+	bool rv = false;
+	if (1 != fread(&hdr, sizeof(hdr), 1, fin) ||
+		memcmp(&hdr, key, offsetof(struct bc_header, bc_len)) != 0 ||
+		hdr.bc_len > BC_LIMIT){
+		fclose(fin);
+		return false;
+	}
+
+	size_t meta = hdr.tag_len + hdr.path_len;
+	char* buf = malloc(meta + hdr.bc_len);
+
+	if (buf && 1 == fread(buf, meta + hdr.bc_len, 1, fin) &&
+		memcmp(buf, BC_TAG, hdr.tag_len) == 0 &&
+		memcmp(&buf[hdr.tag_len], fname, hdr.path_len) == 0){
+		if (0 == luaL_loadbuffer(ctx, &buf[meta], hdr.bc_len, chunkname))
+			rv = true;
+		else
+			lua_pop(ctx, 1);
+	}
+
+	free(buf);
+	fclose(fin);
+	return rv;
+}
+
+/* dump the function at the top of the stack, replace the entry atomically as
+ * another instance might be loading from it */
+static void bc_store(lua_State* ctx,
+	const char* cpath, struct bc_header* key, const char* fname)
+{
+	struct bc_buf out = {0};
+	if (0 != lua_dump(ctx, bc_writer, &out) || !out.sz){
+		free(out.buf);
+		return;
+	}
+
+	key->bc_len = out.sz;
+
+	size_t len = strlen(cpath) + sizeof(".XXXXXX");
+	char tmp[len];
+	snprintf(tmp, len, "%s.XXXXXX", cpath);
+
+	int fd = mkstemp(tmp);
+	if (-1 == fd){
+		free(out.buf);
+		return;
+	}
+
+	FILE* fout = fdopen(fd, "w");
+	bool ok = fout &&
+		1 == fwrite(key, sizeof(struct bc_header), 1, fout) &&
+		1 == fwrite(BC_TAG, key->tag_len, 1, fout) &&
+		1 == fwrite(fname, key->path_len, 1, fout) &&
+		1 == fwrite(out.buf, out.sz, 1, fout);
+
+	if (fout)
+		ok = 0 == fclose(fout) && ok;
+	else
+		close(fd);
+
+	if (!ok || -1 == rename(tmp, cpath))
+		unlink(tmp);
+
+	free(out.buf);
+}
+
+/*
+ * Load (but don't run) a script from a resolved resource path, this goes
+ * through the resource layer rather than luaL_loadfile so that scripts
+ * in packed appls work, chunkname matches what loadfile would have used.
+ */
+static int alua_loadresource(lua_State* ctx, const char* fname)
+{
+	data_source source = arcan_open_resource(fname);
 	if (source.fd == BADFD)
-		return -1;
+		return LUA_ERRFILE;
+
+	size_t len = strlen(fname) + 2;
+	char chunkname[len];
+	snprintf(chunkname, len, "@%s", fname);
+
+	struct bc_header key;
+	char* cpath = bc_cachepath(fname);
+	if (cpath){
+		bc_key(&key, fname, &source);
+		if (bc_load(ctx, cpath, &key, fname, chunkname)){
+			luactx.bc_hits++;
+			free(cpath);
+			arcan_release_resource(&source);
+			return 0;
+		}
+	}
 
 	map_region map = arcan_map_resource(&source, false);
 	if (!map.ptr){
+		free(cpath);
 		arcan_release_resource(&source);
-		return -1;
+		return LUA_ERRFILE;
 	}
 
-	int rv = luaL_loadbuffer(ctx, map.ptr, map.sz, inp);
-	if (0 == rv)
-		rv = lua_pcall(ctx, 0, LUA_MULTRET, 0);
+	int rv = luaL_loadbuffer(ctx, map.ptr, map.sz, chunkname);
+	if (0 == rv && cpath){
+		luactx.bc_misses++;
+		bc_store(ctx, cpath, &key, fname);
+	}
 
+	free(cpath);
 	arcan_release_map(map);
 	arcan_release_resource(&source);
 
 	return rv;
 }
 
+void arcan_lua_cachestats(size_t* hits, size_t* misses)
+{
+	*hits = luactx.bc_hits;
+	*misses = luactx.bc_misses;
+}
+
+static int alua_doresolve(lua_State* ctx, const char* inp)
+{
+	int rv = alua_loadresource(ctx, inp);
+	if (0 == rv)
+		rv = lua_pcall(ctx, 0, LUA_MULTRET, 0);
+
+	return rv;
+}
+
 void arcan_lua_tick(lua_State* ctx, size_t nticks, size_t global)
 {
 	arcan_lua_setglobalint(ctx, "CLOCK", global);
@@ -770,6 +1049,60 @@ void arcan_lua_tick(lua_State* ctx, size_t nticks, size_t global)
 	}
 }
 
+static void set_gcbudget(lua_State* ctx, size_t budget)
+{
+	luactx.gc_budget = budget;
+	luactx.gc_active = false;
+	luactx.gc_base = lua_gc(ctx, LUA_GCCOUNT, 0);
+
+	if (budget)
+		lua_gc(ctx, LUA_GCSTOP, 0);
+	else
+		lua_gc(ctx, LUA_GCRESTART, 0);
+}
+
+size_t arcan_lua_gcstep(lua_State* ctx, size_t left)
+{
+	if (!ctx || !luactx.gc_budget)
+		return 0;
+
+	size_t kb = lua_gc(ctx, LUA_GCCOUNT, 0);
+	size_t base = luactx.gc_base ? luactx.gc_base : 1;
+
+/* heap hasn't grown enough to warrant a new cycle */
+	if (!luactx.gc_active){
+		if (kb * 100 < base * ARCAN_LUA_GCPAUSE)
+			return 0;
+		luactx.gc_active = true;
+	}
+
+/* if we fall too far behind, finish the cycle even if it will cost us a
+ * frame - the alternative is running out of memory */
+	bool pressure = kb * 100 > base * ARCAN_LUA_GCPRESSURE;
+	if (left > luactx.gc_budget)
+		left = luactx.gc_budget;
+
+	if (!left && !pressure)
+		return 0;
+
+	unsigned long long start = arcan_timemicros();
+	unsigned long long now = start;
+
+	do {
+		if (lua_gc(ctx, LUA_GCSTEP, 0)){
+			luactx.gc_active = false;
+			luactx.gc_base = lua_gc(ctx, LUA_GCCOUNT, 0);
+			break;
+		}
+		now = arcan_timemicros();
+	} while (pressure || now - start < left);
+
+/* with 5.1, a step will re-arm the automatic collector */
+	lua_gc(ctx, LUA_GCSTOP, 0);
+
+	return arcan_timemicros() - start;
+}
+
 char* arcan_lua_main(lua_State* ctx, const char* inp, bool file)
 {
 /* since we prefix scriptname to functions that we look-up,
@@ -2437,7 +2770,7 @@ static int rendertext(lua_State* ctx)
 	}
 
 	if (lineheights)
-		free(lineheights);
+		arcan_mem_free(lineheights);
 
 	arcan_vobject* vobj = arcan_video_getobject(id);
 	if (vobj){
@@ -2932,7 +3265,7 @@ static int systemload(lua_State* ctx)
 	int res = 0;
 
 	if (fname){
-		int rv = luaL_loadfile(ctx, fname);
+		int rv = alua_loadresource(ctx, fname);
 		if (rv == 0)
 			res = 1;
 		else if (dieonfail)
@@ -3050,7 +3383,7 @@ static int launchavfeed(lua_State* ctx)
 		lua_pushaid(ctx, mvctx->aid);
 	}
 	else {
-		free(mvctx);
+		arcan_mem_free(mvctx);
 		lua_pushvid(ctx, ARCAN_EID);
 		lua_pushvid(ctx, ARCAN_EID);
 	}
@@ -3061,6 +3394,37 @@ static int launchavfeed(lua_State* ctx)
 	LUA_ETRACE("launch_avfeed", NULL, 2);
 }
 
+static int launchprespawn(lua_State* ctx)
+{
+	LUA_TRACE("launch_prespawn");
+
+	const char* mode = luaL_checkstring(ctx, 1);
+	struct arcan_frameserver_poolstat stat;
+
+	if (lua_type(ctx, 2) == LUA_TNUMBER){
+		int size = luaL_checknumber(ctx, 2);
+		if (size < 0 || !arcan_frameserver_pool(mode, size)){
+			arcan_warning("launch_prespawn(), couldn't set pool for archetype "
+				"(%s), allowed are (%s)\n", mode, arcan_frameserver_atypes());
+			LUA_ETRACE("launch_prespawn", "invalid archetype", 0);
+		}
+	}
+
+	if (!arcan_frameserver_pool_stat(mode, &stat))
+		LUA_ETRACE("launch_prespawn", "no pool", 0);
+
+	lua_newtable(ctx);
+	int top = lua_gettop(ctx);
+	tblnum(ctx, "size", stat.size, top);
+	tblnum(ctx, "ready", stat.ready, top);
+	tblnum(ctx, "warm", stat.warm, top);
+	tblnum(ctx, "cold", stat.cold, top);
+	tblnum(ctx, "warm_ms", stat.warm ? (double)stat.warm_ms / stat.warm : 0, top);
+	tblnum(ctx, "cold_ms", stat.cold ? (double)stat.cold_ms / stat.cold : 0, top);
+
+	LUA_ETRACE("launch_prespawn", NULL, 1);
+}
+
 static int loadmovie(lua_State* ctx)
 {
 	LUA_TRACE("load_movie");
@@ -3954,6 +4318,21 @@ void arcan_lua_pushevent(lua_State* ctx, arcan_event* ev)
 				}
 				break;
 
+				case EVENT_NET_TRANSFER:
+					tblstr(ctx, "kind", "transfer", top);
+					tblnum(ctx, "id", ev->net.connid, top);
+					tblstr(ctx, "direction", ev->net.xfer.incoming ? "in" : "out", top);
+					tblnum(ctx, "bytes", ev->net.xfer.raw, top);
+					tblnum(ctx, "wire", ev->net.xfer.wire, top);
+					tblnum(ctx, "chunks", ev->net.xfer.chunks, top);
+					tblnum(ctx, "cached", ev->net.xfer.cached, top);
+					tblnum(ctx, "ms", ev->net.xfer.ms, top);
+					tblnum(ctx, "ratio", ev->net.xfer.raw ?
+						(double) ev->net.xfer.wire / (double) ev->net.xfer.raw : 1.0, top);
+					tblnum(ctx, "rate", ev->net.xfer.ms ? (double) ev->net.xfer.raw *
+						1000.0 / (double) ev->net.xfer.ms : 0.0, top);
+				break;
+
 				case EVENT_NET_INPUTEVENT:
 					arcan_warning("pushevent(net_inputevent_not_handled )\n");
 				break;
@@ -5160,7 +5539,8 @@ static int videodispgamma(lua_State* ctx)
 		values /= 3;
 		lua_pushboolean(ctx, platform_video_set_display_gamma(id,
 			values, &ramps[0 * values], &ramps[1 * values], &ramps[2 * values]));
-			LUA_ETRACE("video_displaygamma", NULL, 1);
+		arcan_mem_free(ramps);
+		LUA_ETRACE("video_displaygamma", NULL, 1);
 	}
 /* get */
 	else {
@@ -5787,6 +6167,7 @@ lua_State* arcan_lua_alloc()
 	if (res){
 		luaL_openlibs(res);
 		arcan_lua_pushglobalconsts(res);
+		set_gcbudget(res, ARCAN_LUA_GCBUDGET);
 	}
 
 	luactx.last_ctx = res;
@@ -5949,6 +6330,33 @@ static int resource(lua_State* ctx)
 	LUA_ETRACE("resource", NULL, 2);
 }
 
+static int rescanresources(lua_State* ctx)
+{
+	LUA_TRACE("rescan_resources");
+
+	int mask = luaL_optinteger(ctx, 1, RESOURCE_SYS_ENDM * 2 - 1);
+	arcan_rescache_flush(mask);
+
+	LUA_ETRACE("rescan_resources", NULL, 0);
+}
+
+static int resourcestats(lua_State* ctx)
+{
+	LUA_TRACE("resource_stats");
+
+	struct arcan_rescache_stat stat;
+	arcan_rescache_stat(&stat);
+
+	lua_newtable(ctx);
+	int top = lua_gettop(ctx);
+	tblnum(ctx, "hits", stat.hits, top);
+	tblnum(ctx, "misses", stat.misses, top);
+	tblnum(ctx, "uncached", stat.uncached, top);
+	tblnum(ctx, "dirs", stat.dirs, top);
+
+	LUA_ETRACE("resource_stats", NULL, 1);
+}
+
 static int screencoord(lua_State* ctx)
 {
 	LUA_TRACE("image_screen_coordinates");
@@ -6111,9 +6519,9 @@ static int targetfonthint(lua_State* ctx)
 			arcan_video_fontdefaults(&fd, NULL, NULL);
 		}
 		else{
-			char* fname = arcan_expand_resource(instr, RESOURCE_SYS_FONT);
-			if (arcan_isfile(fname))
-			fd = open(fname, O_RDONLY | O_CLOEXEC);
+			char* fname = arcan_find_resource(instr, RESOURCE_SYS_FONT, ARES_FILE);
+			if (fname)
+				fd = arcan_resource_fd(fname);
 			arcan_mem_free(fname);
 			if (BADFD == fd){
 				lua_pushboolean(ctx, false);
@@ -6293,6 +6701,59 @@ static int targetgraph(lua_State* ctx)
 	LUA_ETRACE("target_graphmode", NULL, 0);
 }
 
+static int targetmulticast(lua_State* ctx)
+{
+	LUA_TRACE("target_multicast");
+
+	arcan_vobject* vobj;
+	luaL_checkvid(ctx, 1, &vobj);
+	if (vobj->feed.state.tag != ARCAN_TAG_FRAMESERV)
+		arcan_fatal("target_multicast(), source must be a valid frameserver\n");
+	arcan_frameserver* src = vobj->feed.state.ptr;
+
+	if (lua_type(ctx, 2) == LUA_TNUMBER){
+		arcan_vobject* dvobj;
+		luaL_checkvid(ctx, 2, &dvobj);
+		if (dvobj->feed.state.tag != ARCAN_TAG_FRAMESERV)
+			arcan_fatal("target_multicast(), subscriber must be a valid "
+				"frameserver\n");
+		arcan_frameserver* dst = dvobj->feed.state.ptr;
+
+		int mode = luaL_optnumber(ctx, 3, CONST_MULTICAST_DROP);
+		arcan_errc rv;
+
+		switch (mode){
+		case CONST_MULTICAST_DROP:
+			rv = arcan_frameserver_multicast_attach(src, dst, FSRV_MCAST_DROP);
+		break;
+		case CONST_MULTICAST_BLOCK:
+			rv = arcan_frameserver_multicast_attach(src, dst, FSRV_MCAST_BLOCK);
+		break;
+		case CONST_MULTICAST_DETACH:
+			rv = arcan_frameserver_multicast_detach(src, dst);
+		break;
+		default:
+			arcan_fatal("target_multicast(), unknown mode (%d)\n", mode);
+		}
+
+		lua_pushboolean(ctx, rv == ARCAN_OK);
+		LUA_ETRACE("target_multicast", NULL, 1);
+	}
+
+	struct arcan_frameserver_mcast_stat stat;
+	if (!arcan_frameserver_multicast_stat(src, &stat))
+		LUA_ETRACE("target_multicast", "no group", 0);
+
+	lua_newtable(ctx);
+	int top = lua_gettop(ctx);
+	tblnum(ctx, "subscribers", stat.subscribers, top);
+	tblnum(ctx, "slots", stat.slots, top);
+	tblnum(ctx, "published", stat.published, top);
+	tblnum(ctx, "stalled", stat.stalled, top);
+
+	LUA_ETRACE("target_multicast", NULL, 1);
+}
+
 static int targetcoreopt(lua_State* ctx)
 {
 	LUA_TRACE("target_coreopt");
@@ -6575,10 +7036,9 @@ static int targetstepframe(lua_State* ctx)
 
 /* cascade / repeat call protection */
 	if (rtgt){
-		if (!FL_TEST(rtgt, TGTFL_READING)){
-			agp_request_readback(rtgt->color->vstore);
+		if (!FL_TEST(rtgt, TGTFL_READING) &&
+			agp_request_readback(rtgt->color->vstore))
 			FL_SET(rtgt, TGTFL_READING);
-		}
 
 /* for rendertargets, we don't want to rely on the synchronous flag
  * for this behavior, so better to use as an argument */
@@ -6980,6 +7440,28 @@ static int rendertarget_vids(lua_State* ctx)
 	LUA_ETRACE("rendertarget_vids", NULL, 1);
 }
 
+static int rendertarget_metrics(lua_State* ctx)
+{
+	LUA_TRACE("rendertarget_metrics");
+	arcan_vobject* vobj;
+	arcan_vobj_id vid = luaL_checkvid(ctx, 1, &vobj);
+	struct rendertarget* rtgt = arcan_vint_findrt(vobj);
+
+	if (!rtgt)
+		arcan_fatal("rendertarget_metrics(), specified vid "
+			"does not reference a rendertarget");
+
+	lua_newtable(ctx);
+	int top = lua_gettop(ctx);
+	tblnum(ctx, "readback_completed", rtgt->readback_done, top);
+	tblnum(ctx, "readback_dropped", rtgt->readback_drop, top);
+	tblnum(ctx, "readback_latency", rtgt->readback_latency, top);
+	tblnum(ctx, "readback_pending",
+		agp_readback_pending(rtgt->color->vstore), top);
+
+	LUA_ETRACE("rendertarget_metrics", NULL, 1);
+}
+
 static int rendernoclear(lua_State* ctx)
 {
 	LUA_TRACE("rendertarget_noclear");
@@ -7299,7 +7781,7 @@ static int procimage_get(lua_State* ctx)
 enum arcan_ffunc_rv arcan_lua_proctarget FFUNC_HEAD
 {
 	if (cmd == FFUNC_DESTROY){
-		free(state.ptr);
+		arcan_mem_free(state.ptr);
 		return 0;
 	}
 
@@ -7533,7 +8015,7 @@ static int spawn_recfsrv(lua_State* ctx,
 	arcan_video_alterfeed(did, FFUNC_AVFEED, fftag);
 
 	if (!fsrv_ok||arcan_frameserver_spawn_server(mvctx, &args) != ARCAN_OK){
-		free(mvctx);
+		arcan_mem_free(mvctx);
 		return 0;
 	}
 
@@ -7943,7 +8425,7 @@ static int recordset(lua_State* ctx)
 				!= AOBJ_CAPTUREFEED){
 				arcan_warning("recordset(%d), unsupported AID source type,"
 					" only STREAMs currently supported. Audio recording disabled.\n");
-				free(aidlocks);
+				arcan_mem_free(aidlocks);
 				aidlocks = NULL;
 				naids = 0;
 				char* ol = arcan_alloc_mem(strlen(argl) + strlen(":noaudio=true") + 1,
@@ -8005,8 +8487,13 @@ static int togglebench(lua_State* ctx)
 	memset(benchdata.ticktime, '\0', sizeof(benchdata.ticktime));
 	memset(benchdata.frametime, '\0', sizeof(benchdata.frametime));
 	memset(benchdata.framecost, '\0', sizeof(benchdata.framecost));
+	memset(benchdata.drawcalls, '\0', sizeof(benchdata.drawcalls));
+	memset(benchdata.gctime, '\0', sizeof(benchdata.gctime));
 	benchdata.tickofs = benchdata.frameofs = benchdata.costofs = 0;
+	benchdata.gcofs = 0;
 	benchdata.framecount = benchdata.tickcount = benchdata.costcount = 0;
+	benchdata.gccount = 0;
+	agp_shader_counters(NULL, NULL, true);
 
 	LUA_ETRACE("benchmark_enable", NULL, 0);
 }
@@ -8057,7 +8544,44 @@ static int getbenchvals(lua_State* ctx)
 		i = (i + 1) % bench_sz;
 	}
 
-	LUA_ETRACE("benchmark_data", NULL, 6);
+	bench_sz = COUNT_OF(benchdata.gctime);
+	i = (benchdata.gcofs + 1) % bench_sz;
+	lua_pushnumber(ctx, benchdata.gccount);
+	lua_newtable(ctx);
+	top = lua_gettop(ctx);
+	count = 0;
+
+	while (i != benchdata.gcofs){
+		lua_pushnumber(ctx, count++);
+		lua_pushnumber(ctx, benchdata.gctime[i]);
+		lua_rawset(ctx, top);
+		i = (i + 1) % bench_sz;
+	}
+
+/* uniform uploads since benchmark_enable, issued and skipped as redundant */
+	size_t unif_issued, unif_skipped;
+	agp_shader_counters(&unif_issued, &unif_skipped, false);
+	lua_pushnumber(ctx, unif_issued);
+	lua_pushnumber(ctx, unif_skipped);
+
+	LUA_ETRACE("benchmark_data", NULL, 10);
+}
+
+static int gcbudget(lua_State* ctx)
+{
+	LUA_TRACE("system_gcbudget");
+	float prev = (float)luactx.gc_budget / 1000.0;
+
+	if (lua_type(ctx, 1) == LUA_TNUMBER){
+		float ms = lua_tonumber(ctx, 1);
+		if (ms < 0)
+			arcan_fatal("system_gcbudget(), invalid budget (%f), "
+				"expected >= 0\n", ms);
+		set_gcbudget(ctx, ms * 1000.0);
+	}
+
+	lua_pushnumber(ctx, prev);
+	LUA_ETRACE("system_gcbudget", NULL, 1);
 }
 
 static int timestamp(lua_State* ctx)
@@ -8082,6 +8606,36 @@ static int timestamp(lua_State* ctx)
 	LUA_ETRACE("benchmark_timestamp", NULL, 1);
 }
 
+static int benchtrace(lua_State* ctx)
+{
+	LUA_TRACE("benchmark_trace");
+
+	if (lua_type(ctx, 1) == LUA_TSTRING){
+		const char* instr = lua_tostring(ctx, 1);
+		char* fname = arcan_expand_resource(instr, RESOURCE_APPL_TEMP);
+		FILE* fout = fname ? fopen(fname, "w") : NULL;
+
+		if (!fout)
+			arcan_warning("benchmark_trace(), "
+				"couldn't open (%s) for writing.\n", instr);
+
+		lua_pushboolean(ctx, arcan_trace_export(fout));
+		if (fout)
+			fclose(fout);
+		arcan_mem_free(fname);
+
+		LUA_ETRACE("benchmark_trace", NULL, 1);
+	}
+
+	if (lua_toboolean(ctx, 1))
+		arcan_trace_start(luaL_optnumber(ctx, 2, 0));
+	else
+		arcan_trace_stop();
+
+	lua_pushboolean(ctx, true);
+	LUA_ETRACE("benchmark_trace", NULL, 1);
+}
+
 static int decodemod(lua_State* ctx)
 {
 	LUA_TRACE("decode_modifiers");
@@ -8888,7 +9442,7 @@ static int net_open(lua_State* ctx)
 
 	lua_launch_fsrv(ctx, &args, ref);
 
-	free(instr);
+	arcan_mem_free(instr);
 	free(workstr);
 
 	LUA_ETRACE("net_open", NULL, 1);
@@ -9150,7 +9704,7 @@ static int setdefaultfont(lua_State* ctx)
 		LUA_ETRACE("system_defaultfont", "couldn't find font in namespace", 1);
 	}
 
-	int fd = open(fn, O_RDONLY);
+	int fd = arcan_resource_fd(fn);
 	free(fn);
 	if (BADFD == fd){
 		lua_pushboolean(ctx, false);
@@ -9260,6 +9814,8 @@ arcan_errc arcan_lua_exposefuncs(lua_State* ctx, unsigned char debugfuncs)
 static const luaL_Reg resfuns[] = {
 {"resource",          resource        },
 {"glob_resource",     globresource    },
+{"rescan_resources",  rescanresources },
+{"resource_stats",    resourcestats   },
 {"zap_resource",      zapresource     },
 {"open_nonblock",     opennonblock    },
 {"open_rawresource",  rawresource     },
@@ -9315,6 +9871,7 @@ static const luaL_Reg tgtfuns[] = {
 {"target_synchronous",         targetsynchronous        },
 {"target_flags",               targetflags              },
 {"target_graphmode",           targetgraph              },
+{"target_multicast",           targetmulticast          },
 {"target_displayhint",         targetdisphint           },
 {"target_devicehint",          targetdevhint            },
 {"target_fonthint",            targetfonthint           },
@@ -9330,6 +9887,7 @@ static const luaL_Reg tgtfuns[] = {
 {"define_arcantarget",         arcanset                 },
 {"rendertarget_forceupdate",   rendertargetforce        },
 {"rendertarget_vids",          rendertarget_vids        },
+{"rendertarget_metrics",       rendertarget_metrics     },
 {"recordtarget_gain",          recordgain               },
 {"rendertarget_detach",        renderdetach             },
 {"rendertarget_attach",        renderattach             },
@@ -9337,6 +9895,7 @@ static const luaL_Reg tgtfuns[] = {
 {"load_movie",                 loadmovie                },
 {"launch_decode",              loadmovie                },
 {"launch_avfeed",              launchavfeed             },
+{"launch_prespawn",            launchprespawn           },
 {NULL, NULL}
 };
 #undef EXT_MAPTBL_TARGETCONTROL
@@ -9501,6 +10060,8 @@ static const luaL_Reg sysfuns[] = {
 {"benchmark_enable",    togglebench      },
 {"benchmark_timestamp", timestamp        },
 {"benchmark_data",      getbenchvals     },
+{"benchmark_trace",     benchtrace       },
+{"system_gcbudget",     gcbudget         },
 {"system_identstr",     getidentstr      },
 {"system_defaultfont",  setdefaultfont   },
 #ifdef _DEBUG
@@ -9625,6 +10186,9 @@ void arcan_lua_pushglobalconsts(lua_State* ctx){
 {"FRAMESET_DETACH", FRAMESET_DETACH},
 {"FRAMESERVER_INPUT", CONST_FRAMESERVER_INPUT},
 {"FRAMESERVER_OUTPUT", CONST_FRAMESERVER_OUTPUT},
+{"MULTICAST_DROP", CONST_MULTICAST_DROP},
+{"MULTICAST_BLOCK", CONST_MULTICAST_BLOCK},
+{"MULTICAST_DETACH", CONST_MULTICAST_DETACH},
 {"BLEND_NONE", BLEND_NONE},
 {"BLEND_ADD", BLEND_ADD},
 {"BLEND_MULTIPLY", BLEND_MULTIPLY},
@@ -10272,6 +10836,7 @@ table.insert(ctx.rtargets, rtgt);\n\
 		size_t bsz = COUNT_OF(benchdata.ticktime);
 		size_t fsz = COUNT_OF(benchdata.frametime);
 		size_t csz = COUNT_OF(benchdata.framecost);
+		size_t gsz = COUNT_OF(benchdata.gctime);
 
 		int i = (benchdata.tickofs + 1) % bsz;
 		fprintf(dst, "\nrestbl.benchmark = {};\nrestbl.benchmark.ticks = {");
@@ -10291,12 +10856,37 @@ table.insert(ctx.rtargets, rtgt);\n\
 			fprintf(dst, "%d,", benchdata.framecost[i]);
 			i = (i + 1) % csz;
 		}
+		fprintf(dst, "};\nrestbl.benchmark.gctime = {");
+		i = (benchdata.gcofs + 1) % gsz;
+		while (i != benchdata.gcofs){
+			fprintf(dst, "%d,", benchdata.gctime[i]);
+			i = (i + 1) % gsz;
+		}
 		fprintf(dst, "};\n");
 
 		memset(benchdata.ticktime, '\0', sizeof(benchdata.ticktime));
 		memset(benchdata.frametime, '\0', sizeof(benchdata.frametime));
 		memset(benchdata.framecost, '\0', sizeof(benchdata.framecost));
+		memset(benchdata.gctime, '\0', sizeof(benchdata.gctime));
 		benchdata.tickofs = benchdata.frameofs = benchdata.costofs = 0;
+		benchdata.gcofs = 0;
+	}
+
+	static const char* memtypes[] = {
+		"", "vbuffer", "vstruct", "extstruct", "abuffer", "stringbuf",
+		"vtag", "atag", "binding", "modeldata", "threadctx"
+	};
+
+	fprintf(dst, "\nrestbl.memory = {};\n");
+	for (size_t i = 1; i < ARCAN_MEM_ENDMARKER && i < COUNT_OF(memtypes); i++){
+		struct arcan_memstats st;
+		if (!arcan_mem_stats(i, &st))
+			continue;
+
+		fprintf(dst, "restbl.memory.%s = {alloc = %zu, free = %zu, "
+			"in_use = %zu, high = %zu, reserved = %zu, temp_overdue = %zu, "
+			"temp_live = %zu};\n", memtypes[i], st.alloc_cnt, st.free_cnt,
+			st.in_use, st.high_water, st.reserved, st.temp_overdue, st.temp_live);
 	}
 
 /* foreach context, footer */
@@ -10321,7 +10911,7 @@ void arcan_lua_stategrab(lua_State* ctx, char* dstfun, int src)
 	if (!statebuf){
 		statebuf_sz = 1024;
 		statebuf = arcan_alloc_mem(statebuf_sz, ARCAN_MEM_STRINGBUF,
-			ARCAN_MEM_TEMPORARY | ARCAN_MEM_BZERO, ARCAN_MEMALIGN_NATURAL);
+			ARCAN_MEM_BZERO, ARCAN_MEMALIGN_NATURAL);
 
 		inpoll.fd = src;
 		inpoll.events = POLLIN;
@@ -10372,12 +10962,12 @@ void arcan_lua_stategrab(lua_State* ctx, char* dstfun, int src)
 		}
 
 		if (statebuf_ofs == statebuf_sz - 1){
-			statebuf_sz <<= 1;
-			char* newp = realloc(statebuf, statebuf_sz);
-			if (newp)
+			char* newp = arcan_mem_grow(statebuf, statebuf_sz, statebuf_sz << 1,
+				ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL);
+			if (newp){
 				statebuf = newp;
-			else
-				statebuf_sz >>= 1;
+				statebuf_sz <<= 1;
+			}
 		}
 
 	}
@@ -33,6 +33,15 @@ void arcan_lua_cbdrop();
 void arcan_lua_shutdown(struct arcan_luactx*);
 void arcan_lua_tick(struct arcan_luactx*, size_t, size_t);
 
+/* step the garbage collector for at most [left] microseconds (further capped
+ * by the script- controlled budget), unless the heap has grown so large that
+ * the current cycle needs to be finished. Returns the time spent in us. */
+size_t arcan_lua_gcstep(struct arcan_luactx*, size_t left);
+
+/* number of scripts loaded from the compiled chunk cache (hits) and
+ * parsed from source then added to the cache (misses) */
+void arcan_lua_cachestats(size_t* hits, size_t* misses);
+
 /* add a set of wrapper functions exposing arcan_video and friends
  * to the Lua state, debugfuncs corresponds to desired debug level / behavior */
 arcan_errc arcan_lua_exposefuncs(struct arcan_luactx* dst,
@@ -48,6 +48,30 @@
 #include "arcan_led.h"
 #include "arcan_db.h"
 #include "arcan_videoint.h"
+#include "arcan_trace.h"
+
+/*
+ * Benchmark mode (-k), one sample per presented frame, written out as JSON
+ * when the appl shuts down, see bench_finish.
+ */
+#ifndef BENCH_TICK_LIMIT
+#define BENCH_TICK_LIMIT 100000
+#endif
+
+/*
+ * Trace dump request (with ARCAN_TRACE set), SIGUSR1/SIGUSR2 are taken by the
+ * VT switching in the evdev/freebsd platforms and SIGRTMIN+0/1 by the clock
+ * fuzzing in arcan_event.c
+ */
+#define TRACE_DUMP_SIGNAL (SIGRTMIN+2)
+
+struct bench_sample {
+	uint32_t tick;
+	float frame_ms, cost_ms, tick_ms;
+	unsigned draws, objects;
+};
+
+extern arcan_benchdata benchdata;
 
 struct {
 	bool in_monitor;
@@ -59,7 +83,25 @@ struct {
 
 	struct arcan_luactx* lua;
 	uint64_t tick_count;
-} settings = {0};
+
+/* smoothed estimate of the time between two synchs (us), used to
+ * figure out how much idle time there is left before the next frame */
+	unsigned long long last_synch;
+	unsigned frame_estimate;
+
+	const char* bench_out, (* bench_base);
+	struct bench_sample* bench;
+	size_t bench_count, bench_cap;
+	unsigned long long bench_tick_us;
+	bool bench_truncated;
+
+/* process start to the end of the first synch, for tracking the cost of
+ * loading the appl (see ARCAN_LUA_NOCACHE) */
+	unsigned long long start_us;
+	float startup_ms;
+} settings = {
+	.frame_estimate = 16666
+};
 
 struct arcan_dbh* dbhandle;
 
@@ -98,6 +140,8 @@ static const struct option longopts[] = {
 	{ "monitor",      required_argument, NULL, 'M'},
 	{ "monitor-out",  required_argument, NULL, 'O'},
 	{ "version",      no_argument,       NULL, 'V'},
+	{ "benchmark",    required_argument, NULL, 'k'},
+	{ "baseline",     required_argument, NULL, 'K'},
 	{ NULL,           no_argument,       NULL,  0 }
 };
 
@@ -132,7 +176,7 @@ static void vplatform_usage()
 
 static void usage()
 {
-printf("Usage: arcan [-whfmWMOqspBtHbdgaSV] applname "
+printf("Usage: arcan [-whfmWMOqspBtHbdgaSVkK] applname "
 	"[appl specific arguments]\n\n"
 "-w\t--width       \tdesired initial canvas width (auto: 0)\n"
 "-h\t--height      \tdesired initial canvas height (auto: 0)\n"
@@ -155,7 +199,9 @@ printf("Usage: arcan [-whfmWMOqspBtHbdgaSV] applname "
 "-d\t--database    \tsqlite database (default: arcandb.sqlite)\n"
 "-g\t--debug       \ttoggle debug output (events, coredumps, etc.)\n"
 "-S\t--nosound     \tdisable audio output\n"
-"-V\t--version     \tdisplay a version string then exit\n\n");
+"-V\t--version     \tdisplay a version string then exit\n"
+"-k\t--benchmark   \tfixed tick clock, no pacing, write frame stats as JSON\n"
+"-K\t--baseline    \tcompare benchmark against JSON from an earlier run\n\n");
 
 	const char** cur = platform_video_synchopts();
 	if (*cur){
@@ -172,10 +218,26 @@ printf("Usage: arcan [-whfmWMOqspBtHbdgaSV] applname "
 
 	vplatform_usage();
 
+	printf("Tracing environment variables:\n");
+	printf("\tARCAN_TRACE=file - record hot-path zones, write a Chrome trace "
+		"to file on signal %d (SIGRTMIN+2) and on exit\n", TRACE_DUMP_SIGNAL);
+	printf("\tARCAN_SHMIF_TRACE=prefix - frameservers write their own zones to "
+		"prefix.pid.json\n\n");
+
+	printf("Scripting environment variables:\n");
+	printf("\tARCAN_LUA_NOCACHE=1 - always parse appl scripts, don't use the "
+		"compiled script cache in the appl state store\n\n");
+
+	printf("Frameserver environment variables:\n");
+	printf("\tARCAN_FRAMESERVER_POOL=mode:n,... - keep n prespawned frameservers "
+		"of each listed archetype, e.g. decode:2,terminal:1\n\n");
+
 /* built-in envopts for _event.c, should really be moved there */
 	printf("Input platform environment variables:\n");
-	printf("\tARCAN_EVENT_RECORD=file - record input-layer events to file\n");
-	printf("\tARCAN_EVENT_REPLAY=file - playback previous input recording\n");
+	printf("\tARCAN_EVENT_RECORD=file - record input and frameserver events to file\n");
+	printf("\tARCAN_EVENT_REPLAY=file - replay a recording on a fixed tick clock, "
+		"exit when done and print frame statistics\n");
+	printf("\tARCAN_EVENT_REPLAY_REALTIME=1 - replay against the wall clock\n");
 	printf("\tARCAN_EVENT_SHUTDOWN=keysym:modifiers "
 		"- press to inject shutdown event\n");
 	cur = platform_input_envopts();
@@ -219,15 +281,96 @@ static void override_resspaces(const char* respath)
 	arcan_override_namespace(font_dir, RESOURCE_SYS_FONT);
 }
 
+static volatile sig_atomic_t trace_dump;
+static void sig_tracedump(int sig)
+{
+	trace_dump = 1;
+}
+
+static void trace_write(const char* fn)
+{
+	FILE* fout = fopen(fn, "w");
+	if (!fout || !arcan_trace_export(fout))
+		arcan_warning("couldn't write trace to (%s)\n", fn);
+	if (fout)
+		fclose(fout);
+}
+
 static void preframe()
 {
+	TRACE_ZONE(ts);
 	arcan_lua_callvoidfun(settings.lua, "preframe_pulse", false, NULL);
+	TRACE_ZONE_END(ts, "lua", "preframe_pulse");
+}
+
+static void bench_sample(unsigned long long frame_us)
+{
+	if (settings.bench_count == settings.bench_cap){
+		size_t ncap = settings.bench_cap ? settings.bench_cap * 2 : 4096;
+		struct bench_sample* nb =
+			realloc(settings.bench, ncap * sizeof(struct bench_sample));
+		if (!nb)
+			return;
+		settings.bench = nb;
+		settings.bench_cap = ncap;
+	}
+
+	unsigned used = 0;
+	arcan_video_contextusage(&used);
+
+	settings.bench[settings.bench_count++] = (struct bench_sample){
+		.tick = settings.tick_count,
+		.frame_ms = (float) frame_us / 1000.0,
+		.cost_ms = benchdata.lastcost,
+		.tick_ms = (float) settings.bench_tick_us / 1000.0,
+		.draws = benchdata.lastdraws,
+		.objects = used
+	};
+	settings.bench_tick_us = 0;
 }
 
 static void postframe()
 {
+	TRACE_ZONE(ts);
 	arcan_lua_callvoidfun(settings.lua, "postframe_pulse", false, NULL);
+	TRACE_ZONE_END(ts, "lua", "postframe_pulse");
 	arcan_bench_register_frame();
+
+	unsigned long long now = arcan_timemicros();
+	if (!settings.startup_ms)
+		settings.startup_ms = (float)(now - settings.start_us) / 1000.0;
+
+	if (settings.last_synch && now > settings.last_synch){
+		unsigned delta = CAP(now - settings.last_synch, 1000, 100000);
+		settings.frame_estimate = (settings.frame_estimate * 7 + delta) / 8;
+
+		if (settings.bench_out)
+			bench_sample(now - settings.last_synch);
+	}
+	settings.last_synch = now;
+	arcan_frameserver_synch(now, settings.frame_estimate);
+}
+
+/*
+ * Spend whatever time is left until the next estimated synch on collecting
+ * Lua garbage rather than having the collector kick in at some random point
+ * in the middle of a script callback. A quarter of the frame interval is
+ * kept in reserve for the actual rendering.
+ */
+static void idle_gc()
+{
+	unsigned long long now = arcan_timemicros();
+	unsigned long long deadline = settings.last_synch +
+		settings.frame_estimate - (settings.frame_estimate >> 2);
+
+/* refill the frameserver prespawn pool before handing the rest to the GC */
+	if (deadline > now){
+		arcan_frameserver_pool_step();
+		now = arcan_timemicros();
+	}
+
+	arcan_bench_register_gc(
+		arcan_lua_gcstep(settings.lua, deadline > now ? deadline - now : 0));
 }
 
 static void process_event(arcan_event* ev, int drain)
@@ -239,13 +382,16 @@ static void process_event(arcan_event* ev, int drain)
 
 static void on_clock_pulse(int nticks)
 {
+	unsigned long long bench_ts = settings.bench_out ? arcan_timemicros() : 0;
 	settings.tick_count += nticks;
 /* priority is always in maintaining logical clock and event processing */
 	unsigned njobs;
 
 /* start with lua as it is likely to incur changes
  * to what is supposed to be drawn */
+	TRACE_ZONE(ts);
 	arcan_lua_tick(settings.lua, nticks, settings.tick_count);
+	TRACE_ZONE_END(ts, "lua", "clock_pulse");
 
 	arcan_video_tick(nticks, &njobs);
 	arcan_audio_tick(nticks);
@@ -271,6 +417,211 @@ static void on_clock_pulse(int nticks)
 
 		if (settings.in_monitor)
 			arcan_lua_stategrab(settings.lua, "sample", settings.mon_infd);
+
+	if (settings.bench_out){
+		settings.bench_tick_us += arcan_timemicros() - bench_ts;
+
+/* suites stop by themselves at the saturation point, this is a safeguard */
+		if (settings.tick_count > BENCH_TICK_LIMIT && !settings.bench_truncated){
+			arcan_warning("benchmark: tick limit reached, stopping\n");
+			settings.bench_truncated = true;
+			arcan_event_enqueue(arcan_event_defaultctx(), &(arcan_event){
+				.category = EVENT_SYSTEM,
+				.sys.kind = EVENT_SYSTEM_EXIT,
+				.sys.errcode = EXIT_SUCCESS
+			});
+		}
+	}
+}
+
+static int cmp_float(const void* a, const void* b)
+{
+	float fa = *(const float*) a, fb = *(const float*) b;
+	return fa < fb ? -1 : fa > fb;
+}
+
+enum {
+	BENCH_FRAMES = 0,
+	BENCH_TICKS,
+	BENCH_FRAME_MEAN,
+	BENCH_FRAME_P50,
+	BENCH_FRAME_P95,
+	BENCH_FRAME_MAX,
+	BENCH_COST_MEAN,
+	BENCH_TICK_MEAN,
+	BENCH_DRAWS_MEAN,
+	BENCH_OBJECTS_MAX,
+	BENCH_SUMMARY_LIM
+};
+
+static const char* bench_keys[] = {
+	"frames", "ticks", "frame_ms_mean", "frame_ms_p50", "frame_ms_p95",
+	"frame_ms_max", "cost_ms_mean", "tick_ms_mean", "draws_mean", "objects_max"
+};
+
+/* metrics checked against the baseline, +1 if a higher value is better */
+static const struct {
+	int ind;
+	int sign;
+} bench_checks[] = {
+	{BENCH_OBJECTS_MAX, 1},
+	{BENCH_COST_MEAN, -1},
+	{BENCH_TICK_MEAN, -1},
+	{BENCH_FRAME_P95, -1}
+};
+
+static void bench_summarize(double* out)
+{
+	size_t n = settings.bench_count;
+	memset(out, '\0', sizeof(double) * BENCH_SUMMARY_LIM);
+	out[BENCH_FRAMES] = n;
+	if (!n)
+		return;
+
+	float* sorted = malloc(sizeof(float) * n);
+	for (size_t i = 0; i < n; i++){
+		struct bench_sample* s = &settings.bench[i];
+		if (sorted)
+			sorted[i] = s->frame_ms;
+		out[BENCH_FRAME_MEAN] += s->frame_ms;
+		out[BENCH_COST_MEAN] += s->cost_ms;
+		out[BENCH_TICK_MEAN] += s->tick_ms;
+		out[BENCH_DRAWS_MEAN] += s->draws;
+		if (s->objects > out[BENCH_OBJECTS_MAX])
+			out[BENCH_OBJECTS_MAX] = s->objects;
+	}
+
+	out[BENCH_TICKS] = settings.bench[n-1].tick - settings.bench[0].tick + 1;
+	out[BENCH_FRAME_MEAN] /= n;
+	out[BENCH_COST_MEAN] /= n;
+	out[BENCH_TICK_MEAN] /= n;
+	out[BENCH_DRAWS_MEAN] /= n;
+
+	if (sorted){
+		qsort(sorted, n, sizeof(float), cmp_float);
+		out[BENCH_FRAME_P50] = sorted[n / 2];
+		out[BENCH_FRAME_P95] = sorted[(n * 95) / 100];
+		out[BENCH_FRAME_MAX] = sorted[n - 1];
+		free(sorted);
+	}
+}
+
+static char* bench_readbase(const char* fn)
+{
+	FILE* fin = fopen(fn, "r");
+	if (!fin)
+		return NULL;
+
+	char* buf = NULL;
+	long sz;
+	if (0 == fseek(fin, 0, SEEK_END) && (sz = ftell(fin)) > 0 &&
+		0 == fseek(fin, 0, SEEK_SET) && (buf = malloc(sz + 1))){
+		if (1 != fread(buf, sz, 1, fin)){
+			free(buf);
+			buf = NULL;
+		}
+		else
+			buf[sz] = '\0';
+	}
+
+	fclose(fin);
+	return buf;
+}
+
+/*
+ * Write the collected samples and summary, and if a baseline is provided,
+ * flag every checked metric that is more than ARCAN_BENCH_TOLERANCE percent
+ * (default 10) worse than in the baseline. Regressions turn the exit code
+ * into a failure so that the run can be used as a gate.
+ */
+static int bench_finish(int exit_code)
+{
+	double sum[BENCH_SUMMARY_LIM], base[BENCH_SUMMARY_LIM];
+	bool regressed[COUNT_OF(bench_checks)] = {false};
+	bool any = false;
+	bench_summarize(sum);
+
+	if (settings.bench_base){
+		char* buf = bench_readbase(settings.bench_base);
+		const char* tolstr = getenv("ARCAN_BENCH_TOLERANCE");
+		double tol = (tolstr ? strtod(tolstr, NULL) : 10.0) / 100.0;
+
+		if (!buf)
+			arcan_warning("benchmark: couldn't read baseline (%s)\n",
+				settings.bench_base);
+
+		for (size_t i = 0; buf && i < COUNT_OF(bench_checks); i++){
+			int ind = bench_checks[i].ind;
+			char pat[32];
+			snprintf(pat, COUNT_OF(pat), "\"%s\":", bench_keys[ind]);
+			const char* pos = strstr(buf, pat);
+			if (!pos)
+				continue;
+
+			base[ind] = strtod(pos + strlen(pat), NULL);
+			double lim = base[ind] * (1.0 - bench_checks[i].sign * tol);
+			if ((bench_checks[i].sign > 0 && sum[ind] < lim) ||
+				(bench_checks[i].sign < 0 && sum[ind] > lim)){
+				arcan_warning("benchmark: regression in %s, %.3f (baseline %.3f)\n",
+					bench_keys[ind], sum[ind], base[ind]);
+				regressed[i] = any = true;
+			}
+		}
+		free(buf);
+	}
+
+	FILE* fout = strcmp(settings.bench_out, "-") == 0 ?
+		stdout : fopen(settings.bench_out, "w");
+	if (!fout){
+		arcan_warning("benchmark: couldn't open (%s) for writing\n",
+			settings.bench_out);
+		return any ? EXIT_FAILURE : exit_code;
+	}
+
+	fprintf(fout, "{\n\"version\":1,\n\"appl\":\"%s\",\n\"build\":\"%s\",\n"
+		"\"agp\":\"%s\",\n\"tick_ms\":%d,\n\"truncated\":%s,\n",
+		arcan_appl_id() ? arcan_appl_id() : "", ARCAN_BUILDVERSION, agp_ident(),
+		ARCAN_TIMER_TICK, settings.bench_truncated ? "true" : "false");
+
+	size_t bc_hits, bc_misses;
+	arcan_lua_cachestats(&bc_hits, &bc_misses);
+	fprintf(fout, "\"startup_ms\":%.3f,\n\"lua_cache\":{\"enabled\":%s,"
+		"\"hits\":%zu,\"misses\":%zu},\n\"summary\":{", settings.startup_ms,
+		getenv("ARCAN_LUA_NOCACHE") ? "false" : "true", bc_hits, bc_misses);
+
+	for (size_t i = 0; i < BENCH_SUMMARY_LIM; i++)
+		fprintf(fout, "%s\"%s\":%.3f", i ? "," : "", bench_keys[i], sum[i]);
+
+	fprintf(fout, "},\n\"regressions\":[");
+	bool first = true;
+	for (size_t i = 0; i < COUNT_OF(bench_checks); i++){
+		if (!regressed[i])
+			continue;
+		int ind = bench_checks[i].ind;
+		fprintf(fout, "%s{\"metric\":\"%s\",\"baseline\":%.3f,\"current\":%.3f}",
+			first ? "" : ",", bench_keys[ind], base[ind], sum[ind]);
+		first = false;
+	}
+
+	fprintf(fout, "],\n\"columns\":[\"tick\",\"frame_ms\",\"cost_ms\","
+		"\"tick_ms\",\"draws\",\"objects\"],\n\"frames\":[");
+	for (size_t i = 0; i < settings.bench_count; i++){
+		struct bench_sample* s = &settings.bench[i];
+		fprintf(fout, "%s\n[%"PRIu32",%.3f,%.0f,%.3f,%u,%u]", i ? "," : "",
+			s->tick, s->frame_ms, s->cost_ms, s->tick_ms, s->draws, s->objects);
+	}
+	fprintf(fout, "\n]\n}\n");
+
+	if (fout != stdout)
+		fclose(fout);
+	else
+		fflush(stdout);
+
+	free(settings.bench);
+	settings.bench = NULL;
+	settings.bench_count = settings.bench_cap = 0;
+
+	return any ? EXIT_FAILURE : exit_code;
 }
 
 static void flush_events()
@@ -310,11 +661,13 @@ static void appl_user_warning(const char* name, const char* err_msg)
 
 int MAIN_REDIR(int argc, char* argv[])
 {
+	settings.start_us = arcan_timemicros();
 	settings.in_monitor = getenv("ARCAN_MONITOR_FD") != NULL;
 	bool windowed = false;
 	bool fullscreen = false;
 	bool conservative = false;
 	bool nosound = false;
+	bool synchset = false;
 
 	unsigned char debuglevel = 0;
 
@@ -335,12 +688,15 @@ int MAIN_REDIR(int argc, char* argv[])
 	char* dbfname = NULL;
 	int ch;
 
+/* activate the typed pools before anything is allocated through them */
+	arcan_mem_init();
+
 	srand( time(0) );
 /* VIDs all have a randomized base to provoke crashes in poorly written scripts,
  * only -g will make their base and sequence repeatable */
 
 	while ((ch = getopt_long(argc, argv,
-		"w:h:mx:y:fsW:d:Sq:a:p:b:B:M:O:t:H:g1:2:V", longopts, NULL)) >= 0){
+		"w:h:mx:y:fsW:d:Sq:a:p:b:B:M:O:t:H:g1:2:Vk:K:", longopts, NULL)) >= 0){
 	switch (ch) {
 	case '?' :
 		usage();
@@ -351,7 +707,7 @@ int MAIN_REDIR(int argc, char* argv[])
 	case 'm' : conservative = true; break;
 	case 'f' : fullscreen = true; break;
 	case 's' : windowed = true; break;
-	case 'W' : platform_video_setsynch(optarg); break;
+	case 'W' : platform_video_setsynch(optarg); synchset = true; break;
 	case 'd' : dbfname = strdup(optarg); break;
 	case 'S' : nosound = true; break;
 	case 'q' : settings.timedump = strtol(optarg, NULL, 10); break;
@@ -364,6 +720,8 @@ int MAIN_REDIR(int argc, char* argv[])
 		exit(EXIT_SUCCESS);
 	break;
 	case 'H' : hookscript = strdup( optarg ); break;
+	case 'k' : settings.bench_out = strdup(optarg); break;
+	case 'K' : settings.bench_base = strdup(optarg); break;
 	case 'M' : settings.monitor_counter = settings.monitor =
 		abs( (int)strtol(optarg, NULL, 10) ); break;
 	case 'O' : monitor_arg = strdup( optarg ); break;
@@ -450,7 +808,6 @@ int MAIN_REDIR(int argc, char* argv[])
 		settings.mon_infd = strtol( getenv("ARCAN_MONITOR_FD"), NULL, 10);
 	}
 	else if (settings.monitor > 0){
-		extern arcan_benchdata benchdata;
 		benchdata.bench_enabled = true;
 
 		if (strncmp(monitor_arg, "LOG:", 4) == 0){
@@ -503,6 +860,32 @@ int MAIN_REDIR(int argc, char* argv[])
 	sigaction(SIGPIPE, &(struct sigaction){
 		.sa_handler = SIG_IGN, .sa_flags = 0}, 0);
 
+/* tracing can also be toggled from the scripting layer, this is for
+ * catching startup and for grabbing a trace from a running instance */
+	const char* tracefn = getenv("ARCAN_TRACE");
+	if (tracefn){
+		arcan_trace_start(0);
+		sigaction(TRACE_DUMP_SIGNAL, &(struct sigaction){
+			.sa_handler = sig_tracedump, .sa_flags = SA_RESTART}, 0);
+	}
+
+/* archetype:count,archetype:count, the pool fills from the main loop */
+	const char* poolstr = getenv("ARCAN_FRAMESERVER_POOL");
+	if (poolstr){
+		char* work = strdup(poolstr);
+		char* saveptr;
+		for (char* tok = strtok_r(work, ",", &saveptr); tok;
+			tok = strtok_r(NULL, ",", &saveptr)){
+			char* cnt = strchr(tok, ':');
+			if (cnt)
+				*cnt++ = '\0';
+			if (!arcan_frameserver_pool(tok, cnt ? strtoul(cnt, NULL, 10) : 1))
+				arcan_warning("ARCAN_FRAMESERVER_POOL, "
+					"rejected archetype (%s)\n", tok);
+		}
+		free(work);
+	}
+
 /* fallback to whatever is the platform database- storepath */
 	if (dbfname || (dbfname = platform_dbstore_path()))
 		dbhandle = arcan_db_open(dbfname, arcan_appl_id());
@@ -617,6 +1000,10 @@ int MAIN_REDIR(int argc, char* argv[])
 	int jumpcode = setjmp(arcanmain_recover_state);
 	int saved, truncated;
 
+/* prespawned frameservers carry the namespaces of the previous appl */
+	if (jumpcode)
+		arcan_frameserver_pool_flush(false);
+
 	if (jumpcode == 1 || jumpcode == 2){
 		arcan_db_close(&dbhandle);
 
@@ -718,6 +1105,16 @@ int MAIN_REDIR(int argc, char* argv[])
 	bool done = false;
 	int exit_code = EXIT_FAILURE;
 
+/* measure the cost of every frame rather than keeping up with a display,
+ * the 'processing' strategy is what the headless platform uses for that */
+	if (settings.bench_out){
+		benchdata.bench_enabled = true;
+		arcan_video_display.ignore_dirty = true;
+		arcan_event_fixedclock(true);
+		if (!synchset)
+			platform_video_setsynch("processing");
+	}
+
 /* Main loop, this is slated for restructuring so that scheduling and
  * synchronization happens in a more thought out manner, that can prioritize
  * certain objects and run some tasks when the displays and rendering is
@@ -725,14 +1122,34 @@ int MAIN_REDIR(int argc, char* argv[])
 	for(;;){
 		arcan_video_pollfeed();
 		arcan_audio_refresh();
+
+		TRACE_ZONE(ts);
 		float frag = arcan_event_process(evctx, on_clock_pulse);
+		TRACE_ZONE_END(ts, "event", "process");
+
 		if (!arcan_event_feed(evctx, process_event, &exit_code))
 			break;
+		idle_gc();
+
+		TRACE_ZONE(sts);
 		platform_video_synch(settings.tick_count, frag, preframe, postframe);
+		TRACE_ZONE_END(sts, "video", "synch");
+
+		if (trace_dump){
+			trace_dump = 0;
+			trace_write(tracefn);
+		}
 	}
 
+	if (settings.bench_out)
+		exit_code = bench_finish(exit_code);
+
+	if (tracefn)
+		trace_write(tracefn);
+
 	free(hookscript);
 	arcan_lua_callvoidfun(settings.lua, "shutdown", false, NULL);
+	arcan_frameserver_pool_flush(true);
 	arcan_led_shutdown();
 	arcan_event_deinit(evctx);
 	arcan_video_shutdown();
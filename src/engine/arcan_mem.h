@@ -227,6 +227,30 @@ void arcan_mem_unlock(void*);
  */
 void arcan_mem_tick();
 
+/*
+ * Accumulated per-type allocator statistics, sizes are in bytes and
+ * include slab rounding. (reserved) is memory mapped by the pools for
+ * the type (slab chunks, huge-page buffers), (temp_overdue) is the number
+ * of ARCAN_MEM_TEMPORARY blocks found alive at a tick and (temp_live) the
+ * current number of such blocks.
+ */
+struct arcan_memstats {
+	size_t alloc_cnt;
+	size_t free_cnt;
+	size_t in_use;
+	size_t high_water;
+	size_t reserved;
+	size_t temp_overdue;
+	size_t temp_live;
+};
+
+/*
+ * implemented in <platform>/mem.c
+ * fill out [out] with the statistics for the specified type, returns
+ * false if the type is invalid or the allocator does not track usage.
+ */
+bool arcan_mem_stats(enum arcan_memtypes, struct arcan_memstats* out);
+
 /*
  * implemented in <platform>/mem.c
  * aggregates a mem_alloc and a mem_copy from a source buffer.
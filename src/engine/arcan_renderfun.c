@@ -202,7 +202,7 @@ static struct font_entry* grab_font(const char* fname, size_t size)
 	}
 /* special case, set default slot to loaded font */
 	else if (!font_cache[0].identifier){
-		int fd = open(fname, O_RDONLY);
+		int fd = arcan_resource_fd(fname);
 		if (BADFD == fd)
 			return NULL;
 
@@ -256,10 +256,13 @@ static struct font_entry* grab_font(const char* fname, size_t size)
 		newch.count = count;
 	}
 	else {
-		newch.data[0] = TTF_OpenFont(fname, size);
+		int fd = arcan_resource_fd(fname);
+		newch.data[0] = TTF_OpenFontFD(fd, size);
 		newch.fd[0] = BADFD;
 		if (newch.data[0])
 			newch.count = 1;
+		if (BADFD != fd)
+			close(fd);
 	}
 
 	if (newch.count == 0){
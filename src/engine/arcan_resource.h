@@ -10,6 +10,7 @@ typedef struct {
 	char* ptr;
 	size_t sz;
 	bool mmap;
+	bool shared;
 } map_region;
 
 typedef struct {
@@ -120,4 +121,100 @@ int fmt_open(int flags, mode_t mode, const char* fmt, ...);
 unsigned arcan_glob(char* basename, enum arcan_namespaces,
 	void (*cb)(char*, void*), void* tag);
 
+/*
+ * implemented in <platform>/rescache.c
+ * in-memory index of the namespace directory trees, used by namespace.c and
+ * glob.c. Lookup <label> relative to the root of the single namespace <space>,
+ * returns ARES_FILE or ARES_FOLDER if it exists, 0 if it is known not to
+ * exist (or is of some other type) and -1 if the index can't answer and the
+ * caller should ask the filesystem.
+ */
+int arcan_rescache_lookup(enum arcan_namespaces space, const char* label);
+
+/*
+ * implemented in <platform>/rescache.c
+ * match <pattern> (* ? [] wildcards in the last path component only) in the
+ * single namespace <space>, invoke <cb(name, tag)> for each match in sorted
+ * order. Returns number of matches or -1 if the caller should use glob(3).
+ */
+int arcan_rescache_glob(enum arcan_namespaces space, const char* pattern,
+	void (*cb)(char*, void*), void* tag);
+
+/*
+ * implemented in <platform>/rescache.c
+ * drop the index for the namespaces in the <spaces> mask, they will be
+ * rebuilt as they are used. Called when a namespace is remapped.
+ */
+void arcan_rescache_flush(enum arcan_namespaces spaces);
+
+struct arcan_rescache_stat {
+	size_t hits;
+	size_t misses;
+	size_t uncached;
+	size_t dirs;
+};
+
+/*
+ * implemented in <platform>/rescache.c
+ * fetch counters for lookups answered from the index (hits), lookups that
+ * needed a directory to be read (misses) and lookups that had to fall back to
+ * the filesystem (uncached), along with the number of directories read.
+ */
+void arcan_rescache_stat(struct arcan_rescache_stat* dst);
+
+/*
+ * implemented in <platform>/resource_io.c
+ * return a descriptor to a file with only the contents of the resource <name>
+ * at offset 0, for consumers that need a plain file (fonts, frameservers).
+ * Resources inside an archive are copied into an anonymous file, others are
+ * simply opened. Returns BADFD on failure.
+ */
+file_handle arcan_resource_fd(const char* name);
+
+struct arcan_archive;
+
+/*
+ * implemented in <platform>/archive.c
+ * Packed appl archives (.fap, tools/arcan_applpack.c). Mounting is done by
+ * namespace.c when a namespace is set to a <path> that is an archive, or a
+ * directory inside an already mounted one, and returns NULL otherwise. Each
+ * mount is referenced until the matching unmount.
+ */
+struct arcan_archive* arcan_archive_mount(const char* path);
+void arcan_archive_unmount(struct arcan_archive*);
+
+/*
+ * implemented in <platform>/archive.c
+ * check if <path> is in a mounted archive, returns ARES_FILE / ARES_FOLDER,
+ * 0 if the archive doesn't have it or -1 if no archive covers <path>.
+ */
+int arcan_archive_lookup(const char* path);
+
+/*
+ * implemented in <platform>/archive.c
+ * glob(3) equivalent for a <pattern> inside a mounted archive, invokes <cb>
+ * with the basename of each match. Returns the number of matches or -1 if no
+ * archive covers <pattern>.
+ */
+int arcan_archive_glob(const char* pattern,
+	void (*cb)(char*, void*), void* tag);
+
+/*
+ * implemented in <platform>/archive.c
+ * used by arcan_open_resource, arcan_map_resource and arcan_release_map.
+ * These return false if the path / region doesn't belong to an archive, and
+ * the caller should continue as normal.
+ */
+bool arcan_archive_open(const char* path, data_source* dst);
+bool arcan_archive_map(data_source* src, bool wr, map_region* dst);
+bool arcan_archive_release(map_region* region);
+
+/*
+ * implemented in engine/arcan_img.c (with the stb_image decoder)
+ * inflate the zlib stream in <src> into <dst>, returns the number of bytes
+ * written or -1 on failure.
+ */
+ssize_t arcan_zlib_inflate(
+	char* dst, size_t dst_sz, const char* src, size_t src_sz);
+
 #endif
@@ -0,0 +1,152 @@
+/*
+ * Copyright 2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arcan_trace.h"
+
+#ifndef TRACE_DEFAULT_RING
+#define TRACE_DEFAULT_RING 65536
+#endif
+
+struct trace_entry {
+	const char* sys, (* zone);
+	uint64_t start, end;
+};
+
+/*
+ * One ring per recording thread, single producer. The owner writes the slot
+ * then publishes it by bumping [head], an exporter snapshots and re-checks
+ * [head] afterwards to discard slots that may have been overwritten while
+ * copying. Rings are never freed, as the exporter may race with thread exit.
+ */
+struct trace_ring {
+	struct trace_ring* next;
+	unsigned tid;
+	size_t mask;
+	_Atomic uint64_t head;
+	struct trace_entry ents[];
+};
+
+volatile bool arcan_trace_enabled;
+
+static _Atomic(struct trace_ring*) rings;
+static _Atomic unsigned ring_tids;
+static size_t ring_sz = TRACE_DEFAULT_RING;
+static uint64_t epoch;
+static __thread struct trace_ring* local;
+
+uint64_t arcan_trace_now()
+{
+	struct timespec tp;
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (uint64_t) tp.tv_sec * 1000000000ull + tp.tv_nsec;
+}
+
+static struct trace_ring* ring_alloc()
+{
+	size_t n = ring_sz;
+	struct trace_ring* res =
+		malloc(sizeof(struct trace_ring) + n * sizeof(struct trace_entry));
+	if (!res)
+		return NULL;
+
+	res->mask = n - 1;
+	res->tid = atomic_fetch_add(&ring_tids, 1) + 1;
+	atomic_init(&res->head, 0);
+
+	struct trace_ring* cur = atomic_load(&rings);
+	do {
+		res->next = cur;
+	} while (!atomic_compare_exchange_weak(&rings, &cur, res));
+
+	return res;
+}
+
+void arcan_trace_zone(const char* sys,
+	const char* zone, uint64_t start, uint64_t end)
+{
+	if (!local && !(local = ring_alloc()))
+		return;
+
+	uint64_t ind = atomic_load_explicit(&local->head, memory_order_relaxed);
+	local->ents[ind & local->mask] = (struct trace_entry){
+		.sys = sys, .zone = zone, .start = start, .end = end
+	};
+	atomic_store_explicit(&local->head, ind + 1, memory_order_release);
+}
+
+void arcan_trace_start(size_t n)
+{
+/* only applies to rings that haven't been allocated yet */
+	if (n){
+		size_t sz = 64;
+		while (sz < n && sz < (1 << 24))
+			sz <<= 1;
+		ring_sz = sz;
+	}
+
+	epoch = arcan_trace_now();
+	arcan_trace_enabled = true;
+}
+
+void arcan_trace_stop()
+{
+	arcan_trace_enabled = false;
+}
+
+bool arcan_trace_export(FILE* dst)
+{
+	if (!dst)
+		return false;
+
+	pid_t pid = getpid();
+	fprintf(dst, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+		"\"args\":{\"name\":\"arcan\"}}", (int) pid);
+
+	for (struct trace_ring* cur = atomic_load(&rings); cur; cur = cur->next){
+		size_t sz = cur->mask + 1;
+		struct trace_entry* snap = malloc(sz * sizeof(struct trace_entry));
+		if (!snap)
+			continue;
+
+		uint64_t head = atomic_load_explicit(&cur->head, memory_order_acquire);
+		uint64_t first = head > sz ? head - sz : 0;
+		for (uint64_t i = first; i < head; i++)
+			snap[i & cur->mask] = cur->ents[i & cur->mask];
+
+/* slot [head2 & mask] may be in the middle of being written */
+		uint64_t head2 = atomic_load_explicit(&cur->head, memory_order_acquire);
+		if (head2 + 1 > first + sz)
+			first = head2 + 1 - sz;
+
+		for (uint64_t i = first; i < head; i++){
+			struct trace_entry* ent = &snap[i & cur->mask];
+			if (ent->start < epoch || ent->end < ent->start)
+				continue;
+
+			fprintf(dst, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+				"\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+				ent->zone, ent->sys, (double) ent->start / 1000.0,
+				(double)(ent->end - ent->start) / 1000.0, (int) pid, cur->tid);
+		}
+
+		free(snap);
+	}
+
+	fprintf(dst, "\n]}\n");
+	fflush(dst);
+	return !ferror(dst);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ * Description: Hot-path tracing. Scoped zones with nanosecond timestamps are
+ * recorded into per-thread lock-free rings and can be exported in the Chrome
+ * trace event format (chrome://tracing, ui.perfetto.dev). When tracing is not
+ * active, a zone costs a branch on a global flag.
+ *
+ * TRACE_ZONE(ts);
+ *  ... work ...
+ * TRACE_ZONE_END(ts, "video", "tick");
+ *
+ * Subsystem and zone names are stored by reference and must be literals.
+ * Frameservers record their side of the shmif synchronization separately when
+ * ARCAN_SHMIF_TRACE is set, see arcan_shmif_control.c.
+ */
+#ifndef _HAVE_ARCAN_TRACE
+#define _HAVE_ARCAN_TRACE
+
+extern volatile bool arcan_trace_enabled;
+
+/* CLOCK_MONOTONIC, in nanoseconds */
+uint64_t arcan_trace_now();
+
+void arcan_trace_zone(const char* sys,
+	const char* zone, uint64_t start, uint64_t end);
+
+#define TRACE_ZONE(X) uint64_t X = arcan_trace_enabled ? arcan_trace_now() : 0
+#define TRACE_ZONE_END(X, S, Z) do { if (X)\
+	arcan_trace_zone(S, Z, X, arcan_trace_now()); } while(0)
+
+/*
+ * Start recording, [n] is the number of zones kept per thread and is rounded
+ * up to a power of two (0 for the default). Zones recorded before the latest
+ * start are dropped from exports.
+ */
+void arcan_trace_start(size_t n);
+void arcan_trace_stop();
+
+/*
+ * Write the contents of all rings as a Chrome trace JSON document, safe to
+ * call while other threads are still recording. Returns false on IO errors.
+ */
+bool arcan_trace_export(FILE* dst);
+
+#endif
@@ -46,6 +46,7 @@
 #include "arcan_videoint.h"
 #include "arcan_3dbase.h"
 #include "arcan_img.h"
+#include "arcan_trace.h"
 
 #ifndef offsetof
 #define offsetof(type, member) ((size_t)((char*)&(*(type*)0).member\
@@ -340,7 +341,8 @@ static void reallocate_gl_context(struct arcan_video_context* context)
 /* for conservative memory management mode we need to reallocate
  * static resources. getimage will strdup the source so to avoid leaking,
  * copy and free */
-			if (arcan_video_display.conservative &&
+			if ((arcan_video_display.conservative ||
+				current->vstore->vinf.text.txcomp) &&
 				(char)current->feed.state.tag == ARCAN_TAG_IMAGE){
 					char* fname = strdup( current->vstore->vinf.text.source );
 					arcan_mem_free(current->vstore->vinf.text.source);
@@ -1514,45 +1516,127 @@ static uint16_t nexthigher(uint16_t k)
 	return k+1;
 }
 
-arcan_errc arcan_vint_getimage(const char* fname, arcan_vobject* dst,
-	img_cons forced, bool asynchsrc)
+static arcan_errc decode_resource(const char* fname, uint32_t** buf,
+	size_t* inw, size_t* inh, struct arcan_img_meta* meta, bool flip)
 {
-/*
- * with asynchsynch, it's likely that we get a storm of requests and we'd
- * likely suffer thrashing, so limit this.  also, look into using
- * pthread_setschedparam and switch to pthreads exclusively
- */
-	arcan_sem_wait(asynchsynch);
-
-	size_t inw, inh;
-
 /* try- open */
 	data_source inres = arcan_open_resource(fname);
-	if (inres.fd == BADFD){
-		arcan_sem_post(asynchsynch);
+	if (inres.fd == BADFD)
 		return ARCAN_ERRC_BAD_RESOURCE;
-	}
 
 /* mmap (preferred) or buffer (mmap not working / useful due to alignment) */
 	map_region inmem = arcan_map_resource(&inres, false);
 	if (inmem.ptr == NULL){
-		arcan_sem_post(asynchsynch);
 		arcan_release_resource(&inres);
 		return ARCAN_ERRC_BAD_RESOURCE;
 	}
 
+	arcan_errc rv = arcan_img_decode(fname,
+		inmem.ptr, inmem.sz, buf, inw, inh, meta, flip);
+
+	arcan_release_map(inmem);
+	arcan_release_resource(&inres);
+	return rv;
+}
+
+/*
+ * Pre-transcoded versions (tools/arcan_txconv.c) are kept in a .txcache
+ * directory next to the source as <name>.ktx. These are only used if they
+ * are not older than the source and the load doesn't need any scaling or
+ * flipping, which can't be done on the compressed blocks.
+ */
+static char* txcache_lookup(const char* fname,
+	img_cons forced, struct storage_info_t* vs)
+{
+	if (forced.w || forced.h || vs->imageproc == IMAGEPROC_FLIPH ||
+		vs->scale == ARCAN_VIMAGE_SCALEPOW2)
+		return NULL;
+
+	const char* base = strrchr(fname, '/');
+	int dlen = base ? base - fname + 1 : 0;
+	base = base ? base + 1 : fname;
+
+	size_t len = dlen + strlen(base) + sizeof(".txcache/.ktx");
+	char* path = arcan_alloc_mem(len,
+		ARCAN_MEM_STRINGBUF, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_NATURAL);
+	if (!path)
+		return NULL;
+	snprintf(path, len, "%.*s.txcache/%s.ktx", dlen, fname, base);
+
+	struct stat src, cache;
+	if (stat(path, &cache) || stat(fname, &src) ||
+		cache.st_mtime < src.st_mtime){
+		arcan_mem_free(path);
+		return NULL;
+	}
+
+	return path;
+}
+
+arcan_errc arcan_vint_getimage(const char* fname, arcan_vobject* dst,
+	img_cons forced, bool asynchsrc)
+{
+/*
+ * with asynchsynch, it's likely that we get a storm of requests and we'd
+ * likely suffer thrashing, so limit this.  also, look into using
+ * pthread_setschedparam and switch to pthreads exclusively
+ */
+	arcan_sem_wait(asynchsynch);
+
+	size_t inw, inh;
 	struct arcan_img_meta meta = {0};
 	uint32_t* ch_imgbuf = NULL;
+	bool flip = dst->vstore->imageproc == IMAGEPROC_FLIPH;
+	arcan_errc rv = ARCAN_ERRC_BAD_RESOURCE;
+
+/* the cache may have been built for another GPU, fall back to the source */
+	char* cached = txcache_lookup(fname, forced, dst->vstore);
+	if (cached){
+		rv = decode_resource(cached, &ch_imgbuf, &inw, &inh, &meta, flip);
+		if (ARCAN_OK == rv && !agp_txcomp_supported(meta.txcomp)){
+			arcan_mem_free(ch_imgbuf);
+			ch_imgbuf = NULL;
+			rv = ARCAN_ERRC_UNSUPPORTED_FORMAT;
+		}
+		arcan_mem_free(cached);
+	}
 
-	arcan_errc rv = arcan_img_decode(fname, inmem.ptr, inmem.sz,
-		&ch_imgbuf, &inw, &inh, &meta, dst->vstore->imageproc == IMAGEPROC_FLIPH);
+	if (ARCAN_OK != rv){
+		meta = (struct arcan_img_meta){0};
+		rv = decode_resource(fname, &ch_imgbuf, &inw, &inh, &meta, flip);
 
-	arcan_release_map(inmem);
-	arcan_release_resource(&inres);
+/* a .ktx/.pkm loaded directly has no source to fall back to */
+		if (ARCAN_OK == rv && meta.compressed &&
+			meta.txcomp && !agp_txcomp_supported(meta.txcomp)){
+			arcan_mem_free(ch_imgbuf);
+			ch_imgbuf = NULL;
+			rv = ARCAN_ERRC_UNSUPPORTED_FORMAT;
+		}
+	}
 
 	if (ARCAN_OK != rv)
 		goto done;
 
+/* need to keep the identification string in order to rebuild
+ * on a forced push/pop */
+	struct storage_info_t* dstframe = dst->vstore;
+	dstframe->vinf.text.txcomp = TXCOMP_NONE;
+	dstframe->vinf.text.levels = 0;
+
+/* no decode or repack, just forward the blocks */
+	if (meta.compressed && meta.txcomp){
+		if (!asynchsrc)
+			dst->feed.state.tag = ARCAN_TAG_IMAGE;
+		dst->origw = dstframe->w = inw;
+		dst->origh = dstframe->h = inh;
+		dstframe->vinf.text.source = strdup(fname);
+		dstframe->vinf.text.raw = (av_pixel*) ch_imgbuf;
+		dstframe->vinf.text.s_raw = meta.c_size;
+		dstframe->vinf.text.txcomp = meta.txcomp;
+		dstframe->vinf.text.levels = meta.levels;
+		goto push_comp;
+	}
+
 	av_pixel* imgbuf = arcan_img_repack(ch_imgbuf, inw, inh);
 	if (!imgbuf){
 		rv = ARCAN_ERRC_OUT_OF_SPACE;
@@ -1574,16 +1658,9 @@ arcan_errc arcan_vint_getimage(const char* fname, arcan_vobject* dst,
 	if (!asynchsrc)
 		dst->feed.state.tag = ARCAN_TAG_IMAGE;
 
-/* need to keep the identification string in order to rebuild
- * on a forced push/pop */
-	struct storage_info_t* dstframe = dst->vstore;
 	dstframe->vinf.text.source = strdup(fname);
-
 	enum arcan_vimage_mode desm = dst->vstore->scale;
 
-	if (meta.compressed)
-		goto push_comp;
-
 /* the user requested specific dimensions, or we are in a mode where
  * we should manually enfore a stretch to the nearest power of two */
 	if (desm == ARCAN_VIMAGE_SCALEPOW2){
@@ -3708,13 +3785,19 @@ static inline bool process_counter(struct rendertarget* tgt,
 	return false;
 }
 
+/*
+ * readbacks are queued in the AGP layer, so a slow consumer only costs
+ * dropped requests when that queue is full rather than a pipeline stall
+ */
 static inline void process_readback(struct rendertarget* tgt, float fract)
 {
-	if (!FL_TEST(tgt, TGTFL_READING) && process_counter(tgt,
-		&tgt->readcnt, tgt->readback, fract)){
-		agp_request_readback(tgt->color->vstore);
+	if (!process_counter(tgt, &tgt->readcnt, tgt->readback, fract))
+		return;
+
+	if (agp_request_readback(tgt->color->vstore))
 		FL_SET(tgt, TGTFL_READING);
-	}
+	else
+		tgt->readback_drop++;
 }
 
 /*
@@ -3772,6 +3855,7 @@ unsigned arcan_video_tick(unsigned steps, unsigned* njobs)
 
 	unsigned now = arcan_frametime();
 	uint32_t tsd = arcan_video_display.c_ticks;
+	TRACE_ZONE(ts);
 
 #ifdef SHADER_TIME_PERIOD
 	tsd = tsd % SHADER_TIME_PERIOD;
@@ -3803,6 +3887,7 @@ unsigned arcan_video_tick(unsigned steps, unsigned* njobs)
 		steps = steps - 1;
 	} while (steps);
 
+	TRACE_ZONE_END(ts, "video", "tick");
 	return arcan_frametime() - now;
 }
 
@@ -4194,6 +4279,7 @@ void arcan_video_pollfeed()
  * referenced in many different pipelines and hierarchies */
 	static int vcookie = 1;
 	vcookie++;
+	TRACE_ZONE(ts);
 
  for (off_t ind = 0; ind < current_context->n_rtargets; ind++)
 		arcan_vint_pollreadback(&current_context->rtargets[ind]);
@@ -4203,6 +4289,7 @@ void arcan_video_pollfeed()
 		poll_list(current_context->rtargets[i].first, vcookie);
 
 	poll_list(current_context->stdoutp.first, vcookie);
+	TRACE_ZONE_END(ts, "video", "pollfeed");
 }
 
 static inline void populate_stencil(struct rendertarget* tgt,
@@ -4574,7 +4661,7 @@ void arcan_vint_pollreadback(struct rendertarget* tgt)
 	struct asynch_readback_meta rbb = agp_poll_readback(vobj->vstore);
 
 	if (rbb.ptr == NULL)
-		return;
+		goto out;
 
 	if (!vobj->feed.ffunc)
 		tgt->readback = 0;
@@ -4586,15 +4673,24 @@ void arcan_vint_pollreadback(struct rendertarget* tgt)
 	}
 
 	rbb.release(rbb.tag);
-	FL_CLEAR(tgt, TGTFL_READING);
+
+	unsigned long long now = arcan_timemillis();
+	float lat = now > rbb.ts ? now - rbb.ts : 0;
+	tgt->readback_latency = tgt->readback_done ?
+		0.9 * tgt->readback_latency + 0.1 * lat : lat;
+	tgt->readback_done++;
+
+out:
+	if (0 == agp_readback_pending(vobj->vstore))
+		FL_CLEAR(tgt, TGTFL_READING);
 }
 
-static size_t steptgt(float fract, struct rendertarget* tgt)
+static size_t steptgt(float fract, struct rendertarget* tgt, size_t* drawc)
 {
 	size_t transfc = 0;
 	if (tgt->refresh < 0 && process_counter(tgt,
 		&tgt->refreshcnt, tgt->refresh, fract)){
-		process_rendertarget(tgt, fract);
+		*drawc += process_rendertarget(tgt, fract);
 		transfc = tgt->transfc;
 		tgt->dirtyc = 0;
 /* may need to readback even if we havn't updated as it may
@@ -4607,7 +4703,8 @@ static size_t steptgt(float fract, struct rendertarget* tgt)
 unsigned arcan_vint_refresh(float fract, size_t* ndirty)
 {
 	long long int pre = arcan_timemillis();
-	size_t transfc = 0;
+	size_t transfc = 0, drawc = 0;
+	TRACE_ZONE(ts);
 
 /* we track last interp. state in order to handle forcerefresh */
 	arcan_video_display.c_lerp = fract;
@@ -4620,13 +4717,15 @@ unsigned arcan_vint_refresh(float fract, size_t* ndirty)
 	for (size_t ind = 0; ind < current_context->n_rtargets; ind++){
 		struct rendertarget* tgt = &current_context->rtargets[ind];
 		tgt->dirtyc += arcan_video_display.dirty;
-		transfc += steptgt(fract, tgt);
+		transfc += steptgt(fract, tgt, &drawc);
 	}
 
 	current_context->stdoutp.dirtyc += arcan_video_display.dirty;
-	transfc += steptgt(fract, &current_context->stdoutp);
+	transfc += steptgt(fract, &current_context->stdoutp, &drawc);
 	*ndirty = arcan_video_display.dirty;
 	arcan_video_display.dirty = transfc;
+	arcan_bench_register_draws(drawc);
+	TRACE_ZONE_END(ts, "video", "refresh");
 
 	long long int post = arcan_timemillis();
 	return post - pre;
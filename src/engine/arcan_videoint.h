@@ -58,6 +58,12 @@ struct rendertarget {
 	int readback;
 	int readcnt;
 
+/* readback statistics: delivered, dropped as the AGP queue was full and
+ * average request-to-delivery time in milliseconds */
+	size_t readback_done;
+	size_t readback_drop;
+	float readback_latency;
+
 /* for for controlling refresh, same mechanism as with readback */
 	int refresh;
 	int refreshcnt;
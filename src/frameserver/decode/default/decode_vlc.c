@@ -256,9 +256,31 @@ static void* video_lock(void* ctx, void** planes)
 	return *planes = decctx.shmcont.vidp;
 }
 
+/*
+ * vlc already paces frames against its own clock, so blocking until the
+ * parent has picked the frame up only delays vlc on the next one. When frames
+ * arrive at a lower rate than the display refreshes, each is picked up at the
+ * next deadline before the next one is written, and the wait can be skipped.
+ */
 static void video_display(void* ctx, void* picture)
 {
-	arcan_shmif_signalV();
+	static long long last, period;
+	struct arcan_shmif_timing timing;
+
+	long long now = arcan_timemicros();
+	if (last && now > last)
+		period = period ? (period * 7 + (now - last)) / 8 : now - last;
+	last = now;
+
+	if (arcan_shmif_timing(&decctx.shmcont, &timing) &&
+		period > timing.interval + (timing.interval >> 2) &&
+		!atomic_load(&decctx.shmcont.addr->vready)){
+/* drain any post left from the previous non-blocking signal */
+		arcan_sem_trywait(decctx.shmcont.vsem);
+		arcan_shmif_signal(&decctx.shmcont, SHMIF_SIGVID | SHMIF_SIGBLK_NONE);
+	}
+	else
+		arcan_shmif_signalV();
 }
 
 static void push_streamstatus()
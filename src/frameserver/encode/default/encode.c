@@ -58,6 +58,9 @@ static struct {
 	int bpp;
 	uint8_t* encvbuf;
 
+/* current frame, vidp or a slot in the multicast pool */
+	shmif_pixel* vframe;
+
 /* set to ~twice the size of a full frame, larger than that and
  * we have terrible "compression" on our hands */
 	size_t encvbuf_sz;
@@ -325,7 +328,7 @@ forceencode:
 
 static int encode_video(bool flush)
 {
-	uint8_t* srcpl[4] = {(uint8_t*)recctx.shmcont.vidp, NULL, NULL, NULL};
+	uint8_t* srcpl[4] = {(uint8_t*)recctx.vframe, NULL, NULL, NULL};
 	int srcstr[4] = {recctx.shmcont.addr->w * recctx.bpp};
 
 /* the main problem here is that the source material may encompass many
@@ -759,6 +762,10 @@ int afsrv_encode(struct arcan_shmif_cont* cont, struct arg_arr* args)
 					(ARCAN_SHMIF_SAMPLERATE / 1000.0) * ev.tgt.ioevs[0].iv;
 			break;
 
+			case TARGET_COMMAND_MULTICAST:
+				arcan_shmif_multicast(&recctx.shmcont, &ev);
+			break;
+
 			case TARGET_COMMAND_STEPFRAME:
 				if (!firstframe){
 					firstframe = true;
@@ -767,6 +774,12 @@ int afsrv_encode(struct arcan_shmif_cont* cont, struct arg_arr* args)
 
 				while(!recctx.shmcont.addr->vready){
 				}
+
+				recctx.vframe = arcan_shmif_multicast(&recctx.shmcont, &ev);
+				if (!recctx.vframe){
+					recctx.shmcont.addr->vready = false;
+					break;
+				}
 				arcan_frameserver_stepframe();
 			break;
 
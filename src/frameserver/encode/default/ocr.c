@@ -75,9 +75,20 @@ void ocr_serv_run(struct arg_arr* args, struct arcan_shmif_cont cont)
 	while(arcan_shmif_wait(&cont, &ev) != 0){
 		if (ev.category == EVENT_TARGET){
 			switch (ev.tgt.kind){
+			case TARGET_COMMAND_MULTICAST:
+				arcan_shmif_multicast(&cont, &ev);
+			break;
 			case TARGET_COMMAND_STEPFRAME:{
-				TessBaseAPISetImage(handle, (const unsigned char*) cont.vidp,
-					cont.w, cont.h, sizeof(shmif_pixel), cont.stride);
+				shmif_pixel* vframe = arcan_shmif_multicast(&cont, &ev);
+				if (vframe)
+					TessBaseAPISetImage(handle, (const unsigned char*) vframe,
+						cont.w, cont.h, sizeof(shmif_pixel), cont.stride);
+
+/* SetImage keeps its own copy, so the frame can be released right away */
+				cont.addr->vready = false;
+				if (!vframe)
+					continue;
+
 				char* text = TessBaseAPIGetUTF8Text(handle);
 				size_t len;
 				if (!text || (len = strlen(text)) == 0)
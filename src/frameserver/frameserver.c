@@ -13,6 +13,7 @@
 #include <errno.h>
 #include <assert.h>
 #include <dirent.h>
+#include <poll.h>
 
 #include <sys/types.h>
 #include <sys/mman.h>
@@ -179,6 +180,60 @@ int launch_mode(const char* modestr,
 	return fptr(con.addr ? &con : NULL, arg);
 }
 
+static bool pool_read(int fd, void* dst, size_t n)
+{
+	uint8_t* buf = dst;
+
+	while (n){
+		struct pollfd pfd = {.fd = fd, .events = POLLIN};
+		if (-1 == poll(&pfd, 1, -1) && errno != EINTR)
+			return false;
+
+		ssize_t nr = read(fd, buf, n);
+		if (0 == nr || (-1 == nr && errno != EAGAIN && errno != EINTR))
+			return false;
+
+		if (nr > 0){
+			buf += nr;
+			n -= nr;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Prespawned (pooled) frameservers are started without arguments and block
+ * on the control socket until the parent hands them out, then the arguments
+ * arrive as [uint32_t length][string] before any other use of the socket and
+ * we continue as if they had been set in the environment from the start.
+ */
+static bool pool_wait()
+{
+	const char* fdstr = getenv("ARCAN_SOCKIN_FD");
+	uint32_t len;
+
+	if (!fdstr)
+		return false;
+
+	int fd = strtoul(fdstr, NULL, 10);
+	if (!pool_read(fd, &len, sizeof(len)) || len > 65536)
+		return false;
+
+	char* buf = malloc(len + 1);
+	if (!buf || !pool_read(fd, buf, len)){
+		free(buf);
+		return false;
+	}
+	buf[len] = '\0';
+
+	setenv("ARCAN_ARG", buf, 1);
+	unsetenv("ARCAN_FRAMESERVER_POOLED");
+	free(buf);
+
+	return true;
+}
+
 int main(int argc, char** argv)
 {
 #ifdef DEFAULT_FSRV_MODE
@@ -241,6 +296,10 @@ int main(int argc, char** argv)
 		}
 	}
 
+/* parent closed the socket or went away while we were in the pool */
+	if (getenv("ARCAN_FRAMESERVER_POOLED") && !pool_wait())
+		return EXIT_FAILURE;
+
 /*
  * These are enabled based on build-system toggles,
  * a global define, FRAMESERVER_MODESTRING includes a space
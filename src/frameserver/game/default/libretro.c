@@ -1490,11 +1490,25 @@ static inline bool retro_sync()
 		return true;
 	}
 
-/* more than half a frame behind? skip */
 	if ( retro.skipmode != TARGET_SKIP_AUTO)
 		return true;
 
-	if (left < -0.5 * retro.mspf){
+/* with presentation feedback, the frame is stale if its successor can be
+ * produced in time for the same deadline, that one will be shown instead,
+ * otherwise fall back to skipping when more than half a frame behind */
+	struct arcan_shmif_timing timing;
+	bool stale;
+	if (arcan_shmif_timing(&retro.shmcont, &timing)){
+		long long now_us = timestamp * 1000;
+		long long next_us = (retro.basetime +
+			floor((double)(retro.vframecount + 1) * retro.mspf)) * 1000;
+		stale = left < 0 && (next_us > now_us ? next_us : now_us) +
+			retro.framecost * 1000 <= (long long) timing.deadline;
+	}
+	else
+		stale = left < -0.5 * retro.mspf;
+
+	if (stale){
 		if (retro.sync_data)
 			retro.sync_data->mark_drop(retro.sync_data, timestamp);
 		LOG("frameskip: at(%lld), next: (%lld), "
@@ -1513,6 +1527,32 @@ static inline bool retro_sync()
 	return true;
 }
 
+/*
+ * Move the time that retro_sync would otherwise sleep after running the core
+ * to before it, so that input is sampled as late as possible. The frame can't
+ * be picked up before the first parent deadline after the emulated clock
+ * wants it anyway, so aim to have it ready just before that deadline.
+ */
+static void retro_jit_wait()
+{
+	struct arcan_shmif_timing timing;
+	if (!arcan_shmif_timing(&retro.shmcont, &timing))
+		return;
+
+	long long now = arcan_timemicros();
+	long long due = (retro.basetime +
+		floor((double)(retro.vframecount + 1) * retro.mspf)) * 1000;
+	long long at = timing.deadline;
+	if (due > at)
+		at += (due - at + timing.interval - 1) / timing.interval * timing.interval;
+
+	long long slack = at - now -
+		(retro.framecost + retro.transfercost + retro.prewake) * 1000;
+
+	if (slack >= 1000 && slack <= timing.interval)
+		arcan_timesleep(slack / 1000);
+}
+
 /*
  * used for debugging / testing synchronization during various levels of harsh
  * synchronization costs
@@ -1934,6 +1974,9 @@ int	afsrv_game(struct arcan_shmif_cont* cont, struct arg_arr* args)
 
 		testcounter = 0;
 
+		if (retro.skipmode == TARGET_SKIP_AUTO)
+			retro_jit_wait();
+
 /* add jitter, jitterstep, framecost etc. are used for debugging /
  * testing by adding delays at various key synchronization points */
 		start = arcan_timemillis();
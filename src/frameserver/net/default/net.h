@@ -25,23 +25,35 @@
 #define DEFAULT_CONNECTION_PORT 6680
 #endif
 
-/* should be >= 64k */
+/* initial size of the per-connection rings, the incoming one grows to fit
+ * the largest frame (64k + header) on demand, keeping these small lets a
+ * process hold thousands of mostly idle connections */
 #ifndef DEFAULT_INBUF_SZ
-#define DEFAULT_INBUF_SZ 65536
+#define DEFAULT_INBUF_SZ 8192
 #endif
 
-/* should be >= 64k */
 #ifndef DEFAULT_OUTBUF_SZ
-#define DEFAULT_OUTBUF_SZ 65536
+#define DEFAULT_OUTBUF_SZ 8192
+#endif
+
+/* the outgoing ring grows up to this size, a peer that doesn't drain
+ * beyond it is disconnected */
+#ifndef DEFAULT_OUTBUF_LIMIT
+#define DEFAULT_OUTBUF_LIMIT (1024 * 1024)
 #endif
 
 #ifndef DEFAULT_CONNECTION_CAP
-#define DEFAULT_CONNECTION_CAP 64
+#define DEFAULT_CONNECTION_CAP 4096
+#endif
+
+/* hard limit for the 'limit' argument, connection ids are 16-bit */
+#ifndef NET_CONNECTION_LIMIT
+#define NET_CONNECTION_LIMIT 32767
 #endif
 
 /* only effective for state transfer over the TCP channel,
  * additional state data won't be pushed until buffer
- * status is below SATCAP * OUTBUF_SZ */
+ * status is below SATCAP * OUTBUF_LIMIT */
 #ifndef DEFAULT_OUTBUF_SATCAP
 #define DEFAULT_OUTBUF_SATCAP 0.5
 #endif
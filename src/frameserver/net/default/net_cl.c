@@ -30,11 +30,14 @@ static struct {
 /* SHM-API interface */
 	struct arcan_shmif_cont shmcont;
 
-	apr_socket_t* evsock;
+	int evfd;
 	uint8_t* vidp, (* audp);
 
 	apr_pool_t* mempool;
-	apr_pollset_t* pollset;
+	struct net_evloop* loop;
+
+/* output queued while processing a wakeup, flushed before the next wait */
+	struct conn_state* flushq;
 
 	file_handle tmphandle;
 
@@ -60,25 +63,36 @@ static ssize_t queueout_data(struct conn_state* conn)
 /* flush FD into outbuf at header ofset */
 	}
 	else if (conn->state_out.state == STATE_IMG){
-		ntc = ntc > 32 * 1024 ? 32 * 1024 : ntc;
-		conn->state_out.ofs += ntc;
+		char* vidp = (char*) conn->state_out.shmcont.vidp;
 
 		if (ntc == 0){
-			if (!conn->pack(&clctx.conn, TAG_STATE_EOB,
-				0, (char*) conn->state_out.shmcont.vidp))
+			if (!conn->pack(conn, TAG_STATE_EOB, 0, vidp))
 				return -1;
+
+			net_report_xfer(conn, false);
+			conn->state_out.state = STATE_NONE;
+			return 0;
 		}
 
-		if (!conn->pack(&clctx.conn, TAG_STATE_DATABLOCK,
-			ntc, (char*) conn->state_out.shmcont.vidp + conn->state_out.ofs))
+/* chunked / deduplicated against what the peer already has */
+		ssize_t nw = net_pack_state(conn, vidp + conn->state_out.ofs, ntc);
+		if (-1 == nw)
 			return -1;
+
+		conn->state_out.ofs += nw;
+		ntc = nw;
 	}
 
 /* ignore for now */
 	return ntc;
 }
 
-static bool client_inevq_process(apr_socket_t* outconn)
+static void client_flush_fail(struct conn_state* conn)
+{
+	conn->connstate = CONN_DISCONNECTING;
+}
+
+static bool client_inevq_process()
 {
 	arcan_event ev;
 	uint16_t msgsz = sizeof(ev.net.message) / sizeof(ev.net.message[0]);
@@ -196,7 +210,8 @@ static bool host_discover(const char* reqhost,
 
 	size_t dst_sz;
 	reqmsg = net_pack_discover(true,
-		clctx.public_key, clctx.name, (char*)magic, "", 0, &dst_sz);
+		clctx.public_key, clctx.name, (char*)magic, "", 0,
+		net_local_caps, &dst_sz);
 
 	apr_status_t rv;
 	apr_sockaddr_t* addr;
@@ -240,9 +255,11 @@ retry_partial:
 		if (rv != APR_SUCCESS)
 			goto done;
 
+/* the caps are only advisory here, the connection negotiates its own */
 		char* repmsg, (* name), (* cookie);
+		uint8_t caps;
 		if (ntr != NET_HEADER_SIZE || !(repmsg = net_unpack_discover(
-			repbuf, false, pkey, &name, &cookie, outhost, outport))){
+			repbuf, false, pkey, &name, &cookie, outhost, outport, &caps))){
 			goto retry_partial;
 		}
 
@@ -309,9 +326,9 @@ int afsrv_netcl(struct arcan_shmif_cont* con, struct arg_arr* args)
 	const char* host = NULL;
 	arg_lookup(args, "host", 0, &host);
 
-	struct arcan_shmif_cont shmcont = *con;
+	clctx.shmcont = *con;
 
-	if (!shmcont.addr){
+	if (!clctx.shmcont.addr){
 		LOG("(net-cl) couldn't setup shared memory connection\n");
 		return EXIT_FAILURE;
 	}
@@ -338,6 +355,12 @@ int afsrv_netcl(struct arcan_shmif_cont* con, struct arg_arr* args)
 
 	arg_lookup(args, "reqkey", 0, &reqkey);
 
+	if (arg_lookup(args, "nodelta", 0, NULL))
+		net_local_caps &= ~NET_CAP_DELTA;
+
+	if (arg_lookup(args, "nolz", 0, NULL))
+		net_local_caps &= ~NET_CAP_LZ;
+
 	if (host && strcmp(host, ":discovery") == 0){
 		host_discover(host, reqkey, true, &hoststr, &outport, &hostkey);
 		return EXIT_SUCCESS;
@@ -382,52 +405,33 @@ int afsrv_netcl(struct arcan_shmif_cont* con, struct arg_arr* args)
 	arcan_shmif_enqueue(&clctx.shmcont, &ev);
 
 /*
- * setup a pollset for incoming / outgoing and for event notification,
+ * setup an event loop for incoming / outgoing and for event notification,
  * we'll use a signaling socket to be able to have the shared memory
  * event-queue poll and monitored in the operation as we're waiting
  * on incoming / outgoing
  */
-	int sockin_fd = con->epipe;
-
-	if (apr_os_sock_put(
-		&clctx.evsock, &sockin_fd, clctx.mempool) != APR_SUCCESS){
-		LOG("(net) -- Couldn't convert FD socket to APR, giving up.\n");
+	int sockfd;
+	apr_os_sock_get(&sockfd, sock);
+	net_socket_setup(sockfd, true);
+	clctx.evfd = con->epipe;
+
+	clctx.loop = net_evloop_create(2);
+	if (!clctx.loop){
+		LOG("(net) -- couldn't create event loop. Giving up.\n");
 		return EXIT_FAILURE;
 	}
 
-	apr_pollfd_t pfd = {
-		.p = clctx.mempool,
-		.desc.s = sock,
-		.desc_type = APR_POLL_SOCKET,
-		.reqevents = APR_POLLIN | APR_POLLHUP | APR_POLLERR | APR_POLLNVAL,
-		.rtnevents = 0,
-		.client_data = &sock
-	};
-	clctx.conn.poll_state = pfd;
-
-	apr_pollfd_t epfd = {
-		.p = clctx.mempool,
-		.desc.s = clctx.evsock,
-		.desc_type = APR_POLL_SOCKET,
-		.reqevents = APR_POLLIN,
-		.rtnevents = 0,
-		.client_data = &clctx.evsock
-	};
-
-	int timeout = -1;
+/* setup client connection context, this rather awkward structure
+ * is to be able to re-use a lot of the server-side code */
+	net_setup_cell(&clctx.conn, &clctx.shmcont, clctx.loop);
+	clctx.conn.flushq = &clctx.flushq;
 
-	if (apr_pollset_create(&clctx.pollset, 1, clctx.mempool, 0) != APR_SUCCESS){
-		LOG("(net) -- couldn't allocate pollset. Giving up.\n");
+	if (!net_open_cell(&clctx.conn, sockfd) ||
+		!net_evloop_add(clctx.loop, clctx.evfd, NET_EV_IN, &clctx.evfd)){
+		LOG("(net) -- couldn't setup connection. Giving up.\n");
 		return EXIT_FAILURE;
 	}
 
-	apr_pollset_add(clctx.pollset, &epfd);
-	apr_pollset_add(clctx.pollset, &clctx.conn.poll_state);
-
-/* setup client connection context, this rather awkward structure
- * is to be able to re-use a lot of the server-side code */
-	net_setup_cell(&clctx.conn, &clctx.shmcont, clctx.pollset);
-	clctx.conn.inout = sock;
 	clctx.conn.decode = net_hl_decode;
 	clctx.conn.pack = net_pack_basic;
 	clctx.conn.buffer = net_buffer_basic;
@@ -436,27 +440,39 @@ int afsrv_netcl(struct arcan_shmif_cont* con, struct arg_arr* args)
 	clctx.conn.flushout = net_flushout_default;
 	clctx.conn.queueout = net_queueout_default;
 	clctx.conn.connstate = CONN_CONNECTED;
+	net_pack_caps(&clctx.conn);
+
+	static arcan_event dev = {
+		.category = EVENT_NET,
+		.net.kind = EVENT_NET_DISCONNECTED
+	};
 
 /* main client loop */
 	while (true){
 		if (clctx.conn.blocked){
-			if (!client_inevq_process(sock))
+			if (!client_inevq_process())
 				break;
 			continue;
 		}
 
-		ssize_t q_sz = queueout_data(&clctx.conn);
-		if (-1 == q_sz)
-			break;
-		else if (q_sz > 0)
-			continue;
+/* only push more state data while the outgoing ring is below the
+ * saturation cap, the rest is paced by POLLOUT */
+		ssize_t q_sz = 0;
+		if (net_ring_used(&clctx.conn.out) <
+			DEFAULT_OUTBUF_SATCAP * DEFAULT_OUTBUF_LIMIT){
+			q_sz = queueout_data(&clctx.conn);
+			if (-1 == q_sz)
+				break;
+		}
 
-		const apr_pollfd_t* ret_pfd;
-		apr_int32_t pnum;
-		apr_status_t status = apr_pollset_poll(
-			clctx.pollset, timeout, &pnum, &ret_pfd);
+		net_flush_queued(&clctx.flushq, client_flush_fail);
+		if (clctx.conn.connstate == CONN_DISCONNECTING)
+			goto disconnect;
 
-		if (status != APR_SUCCESS && status != APR_EINTR && status != APR_TIMEUP){
+		struct net_ev evs[2];
+		int nev = net_evloop_wait(clctx.loop, evs, 2, q_sz > 0 ? 0 : -1);
+
+		if (-1 == nev){
 			LOG("(net-cl) -- broken poll, giving up.\n");
 			break;
 		}
@@ -465,41 +481,45 @@ int afsrv_netcl(struct arcan_shmif_cont* con, struct arg_arr* args)
  * client socket: check if it's still alive and buffer / parse
  * event socket: process event-loop
  */
-		for (int i = 0; i < pnum; i++){
-			if (ret_pfd[i].client_data == &sock){
-				static arcan_event ev = {
-					.category = EVENT_NET,
-					.net.kind = EVENT_NET_DISCONNECTED
-				};
-
-				if (ret_pfd[i].rtnevents & (APR_POLLHUP | APR_POLLERR | APR_POLLNVAL)){
+		for (int i = 0; i < nev; i++){
+			if (evs[i].tag == &clctx.conn){
+				bool res = true;
+
+				if (evs[i].mask & NET_EV_ERR){
 					LOG("(net-cl) -- poll on socket failed, shutting down.\n");
 				}
 
-				if (ret_pfd[i].rtnevents & APR_POLLOUT)
-					clctx.conn.flushout(&clctx.conn);
+				if (evs[i].mask & NET_EV_OUT)
+					res = clctx.conn.flushout(&clctx.conn);
 
-				if (clctx.conn.buffer(&clctx.conn))
+				if (res && (evs[i].mask & (NET_EV_IN | NET_EV_ERR)))
+					res = clctx.conn.buffer(&clctx.conn);
+
+				if (res)
 					continue;
 
-				arcan_shmif_enqueue(&clctx.shmcont, &ev);
-				apr_socket_close(clctx.conn.inout);
-				goto giveup;
+				goto disconnect;
 			}
 
 /* we're not really concerned with the data on the socket,
  * it's just used as a pollable indicator */
 			char flushb[256];
-			apr_size_t szv = sizeof(flushb);
-			apr_socket_recv(clctx.evsock, flushb, &szv);
+			recv(clctx.evfd, flushb, sizeof(flushb), MSG_DONTWAIT);
 
-			if (!client_inevq_process(sock))
-				break;
+			if (!client_inevq_process())
+				goto giveup;
 		}
 	}
 
+	goto giveup;
+
+disconnect:
+	arcan_shmif_enqueue(&clctx.shmcont, &dev);
+
 giveup:
-    LOG("(net-cl) -- shutting down client session.\n");
+	LOG("(net-cl) -- shutting down client session.\n");
+	net_close_cell(&clctx.conn);
+	net_evloop_destroy(clctx.loop);
 	return EXIT_SUCCESS;
 }
 
@@ -0,0 +1,310 @@
+/*
+ * Networking Reference Frameserver Archetype, state transfer encoding
+ * Copyright 2014-2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "net_delta.h"
+
+static uint64_t gear[256];
+static bool gear_ready;
+
+/* splitmix64, the table only needs to be well mixed, not secret */
+static void gear_init()
+{
+	uint64_t x = 0x6172636e6e657400ULL;
+	for (size_t i = 0; i < 256; i++){
+		uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		gear[i] = z ^ (z >> 31);
+	}
+	gear_ready = true;
+}
+
+size_t net_delta_cut(const uint8_t* buf, size_t len)
+{
+	if (!gear_ready)
+		gear_init();
+
+	if (len <= NET_DELTA_MIN)
+		return len;
+
+	size_t lim = len > NET_DELTA_MAX ? NET_DELTA_MAX : len;
+	uint64_t h = 0;
+
+	for (size_t i = NET_DELTA_MIN; i < lim; i++){
+		h = (h << 1) + gear[buf[i]];
+		if (!(h & NET_DELTA_MASK))
+			return i + 1;
+	}
+
+	return lim;
+}
+
+static inline uint64_t rotl(uint64_t v, int n)
+{
+	return (v << n) | (v >> (64 - n));
+}
+
+static inline uint64_t fmix(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+void net_delta_hash(const uint8_t* buf, size_t len, uint64_t id[2])
+{
+	uint64_t a = 0x9e3779b97f4a7c15ULL ^ len;
+	uint64_t b = 0xc2b2ae3d27d4eb4fULL + len;
+	size_t i = 0;
+
+	for (; i + 8 <= len; i += 8){
+		uint64_t v;
+		memcpy(&v, &buf[i], 8);
+		a = rotl(a ^ v, 31) * 0x87c37b91114253d5ULL;
+		b = rotl(b + v, 27) * 0x4cf5ad432745937fULL;
+	}
+
+	uint64_t v = 0;
+	for (size_t j = 0; i < len; i++, j += 8)
+		v |= (uint64_t)buf[i] << j;
+
+	a = fmix(a ^ v);
+	b = fmix(b + v + a);
+	id[0] = a;
+	id[1] = b;
+}
+
+int net_delta_tx_find(struct net_delta_tx* tx, const uint64_t id[2])
+{
+	for (size_t i = 0; i < NET_DELTA_SLOTS; i++)
+		if (tx->stamp[i] && tx->id[i][0] == id[0] && tx->id[i][1] == id[1]){
+			tx->stamp[i] = ++tx->clock;
+			return i;
+		}
+
+	return -1;
+}
+
+int net_delta_tx_insert(struct net_delta_tx* tx, const uint64_t id[2])
+{
+	size_t dst = 0;
+
+/* empty slots have stamp 0 so they are picked before any used one */
+	for (size_t i = 1; i < NET_DELTA_SLOTS; i++)
+		if (tx->stamp[i] < tx->stamp[dst])
+			dst = i;
+
+/* on the (theoretical) clock wrap, forget everything rather than having
+ * the eviction order go wrong, the receiver is just told to overwrite */
+	if (tx->clock == UINT32_MAX){
+		memset(tx->stamp, '\0', sizeof(tx->stamp));
+		tx->clock = 0;
+	}
+
+	tx->id[dst][0] = id[0];
+	tx->id[dst][1] = id[1];
+	tx->stamp[dst] = ++tx->clock;
+	return dst;
+}
+
+char* net_delta_rx_slot(struct net_delta_rx* rx, unsigned slot, size_t len)
+{
+	if (slot >= NET_DELTA_SLOTS || len > NET_DELTA_MAX)
+		return NULL;
+
+	if (rx->cap[slot] < len || !rx->data[slot]){
+		char* nbuf = realloc(rx->data[slot], len ? len : 1);
+		if (!nbuf)
+			return NULL;
+		rx->data[slot] = nbuf;
+		rx->cap[slot] = len;
+	}
+
+	rx->len[slot] = len;
+	return rx->data[slot];
+}
+
+void net_delta_rx_free(struct net_delta_rx* rx)
+{
+	for (size_t i = 0; i < NET_DELTA_SLOTS; i++)
+		free(rx->data[i]);
+
+	memset(rx, '\0', sizeof(struct net_delta_rx));
+}
+
+#define LZ_HASHLOG 12
+#define LZ_MINMATCH 4
+
+/* same end-of-block rules as LZ4, the last match starts at least 12 bytes
+ * from the end and the last 5 bytes are always literals */
+#define LZ_MFLIMIT 12
+#define LZ_LASTLITERALS 5
+
+static inline uint32_t read32(const uint8_t* src)
+{
+	uint32_t v;
+	memcpy(&v, src, 4);
+	return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - LZ_HASHLOG);
+}
+
+static size_t put_len(uint8_t* dst, size_t n)
+{
+	size_t ofs = 0;
+	while (n >= 255){
+		dst[ofs++] = 255;
+		n -= 255;
+	}
+	dst[ofs++] = n;
+	return ofs;
+}
+
+static bool emit(uint8_t* dst, size_t cap, size_t* op,
+	const uint8_t* lit, size_t n_lit, size_t ofs, size_t mlen)
+{
+/* worst case size of the sequence */
+	size_t need = 1 + n_lit / 255 + 1 + n_lit + 2 + mlen / 255 + 1;
+	if (*op + need > cap)
+		return false;
+
+	uint8_t* tok = &dst[(*op)++];
+	*tok = (n_lit >= 15 ? 15 : n_lit) << 4;
+	if (n_lit >= 15)
+		*op += put_len(&dst[*op], n_lit - 15);
+
+	memcpy(&dst[*op], lit, n_lit);
+	*op += n_lit;
+
+/* final sequence, literals only */
+	if (!mlen)
+		return true;
+
+	dst[(*op)++] = ofs;
+	dst[(*op)++] = ofs >> 8;
+
+	mlen -= LZ_MINMATCH;
+	*tok |= mlen >= 15 ? 15 : mlen;
+	if (mlen >= 15)
+		*op += put_len(&dst[*op], mlen - 15);
+
+	return true;
+}
+
+size_t net_lz_compress(const uint8_t* src, size_t len, uint8_t* dst, size_t cap)
+{
+	uint32_t table[1 << LZ_HASHLOG] = {0};
+	size_t ip = 0, anchor = 0, op = 0;
+
+	if (len > LZ_MFLIMIT){
+		size_t mflimit = len - LZ_MFLIMIT;
+		size_t matchlimit = len - LZ_LASTLITERALS;
+
+		while (ip < mflimit){
+			uint32_t seq = read32(&src[ip]);
+			uint32_t h = lz_hash(seq);
+			size_t ref = table[h];
+			table[h] = ip;
+
+			if (ref >= ip || ip - ref > 65535 || read32(&src[ref]) != seq){
+/* step faster through data that doesn't compress */
+				ip += 1 + ((ip - anchor) >> 6);
+				continue;
+			}
+
+			size_t mlen = LZ_MINMATCH;
+			while (ip + mlen < matchlimit && src[ref + mlen] == src[ip + mlen])
+				mlen++;
+
+			if (!emit(dst, cap, &op, &src[anchor], ip - anchor, ip - ref, mlen))
+				return 0;
+
+			ip += mlen;
+			anchor = ip;
+		}
+	}
+
+	if (!emit(dst, cap, &op, &src[anchor], len - anchor, 0, 0))
+		return 0;
+
+	return op;
+}
+
+static bool get_len(const uint8_t* src, size_t len, size_t* ip, size_t* n)
+{
+	uint8_t b;
+	do {
+		if (*ip >= len)
+			return false;
+		b = src[(*ip)++];
+		*n += b;
+	} while (b == 255);
+
+	return true;
+}
+
+ssize_t net_lz_decompress(const uint8_t* src,
+	size_t len, uint8_t* dst, size_t cap)
+{
+	size_t ip = 0, op = 0;
+
+	while (ip < len){
+		uint8_t tok = src[ip++];
+
+		size_t n_lit = tok >> 4;
+		if (n_lit == 15 && !get_len(src, len, &ip, &n_lit))
+			return -1;
+
+		if (n_lit > len - ip || n_lit > cap - op)
+			return -1;
+
+		memcpy(&dst[op], &src[ip], n_lit);
+		ip += n_lit;
+		op += n_lit;
+
+/* the last sequence has no match part */
+		if (ip == len)
+			break;
+
+		if (len - ip < 2)
+			return -1;
+
+		size_t ofs = src[ip] | (src[ip + 1] << 8);
+		ip += 2;
+		if (!ofs || ofs > op)
+			return -1;
+
+		size_t mlen = tok & 15;
+		if (mlen == 15 && !get_len(src, len, &ip, &mlen))
+			return -1;
+		mlen += LZ_MINMATCH;
+
+		if (mlen > cap - op)
+			return -1;
+
+/* may overlap (ofs < mlen) for runs, so bytewise */
+		uint8_t* out = &dst[op];
+		const uint8_t* ref = &dst[op - ofs];
+		for (size_t i = 0; i < mlen; i++)
+			out[i] = ref[i];
+		op += mlen;
+	}
+
+	return op;
+}
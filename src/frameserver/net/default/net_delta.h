@@ -0,0 +1,67 @@
+/*
+ * Networking Reference Frameserver Archetype, state transfer encoding
+ * Copyright 2014-2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ */
+
+#ifndef HAVE_ARCAN_FRAMESERVER_NETDELTA
+#define HAVE_ARCAN_FRAMESERVER_NETDELTA
+
+/*
+ * State blocks are cut into content-defined chunks (gear rolling hash, so an
+ * insertion or change only affects the chunks around it) and every chunk is
+ * either sent (raw or LZ compressed) into a slot of the per-peer cache, or
+ * referenced by slot if the peer already has it. The sender owns the slot
+ * assignment and eviction, the receiver just stores what it is told, so the
+ * two sides can't disagree about cache contents.
+ */
+#ifndef NET_DELTA_SLOTS
+#define NET_DELTA_SLOTS 512
+#endif
+
+#define NET_DELTA_MIN 2048
+#define NET_DELTA_MAX 32768
+
+/* boundary when the low bits of the rolling hash are zero, ~8k average */
+#define NET_DELTA_MASK 0x1fffULL
+
+struct net_delta_tx {
+	uint64_t id[NET_DELTA_SLOTS][2];
+	uint32_t stamp[NET_DELTA_SLOTS];
+	uint32_t clock;
+};
+
+struct net_delta_rx {
+	char* data[NET_DELTA_SLOTS];
+	uint16_t len[NET_DELTA_SLOTS];
+	uint16_t cap[NET_DELTA_SLOTS];
+};
+
+/* length of the chunk starting at buf, [MIN..MAX] or len if shorter */
+size_t net_delta_cut(const uint8_t* buf, size_t len);
+
+/* 128-bit content identity, not cryptographic */
+void net_delta_hash(const uint8_t* buf, size_t len, uint64_t id[2]);
+
+/* slot holding id (and mark it as recently used) or -1 */
+int net_delta_tx_find(struct net_delta_tx*, const uint64_t id[2]);
+
+/* assign id to a free or the least recently used slot */
+int net_delta_tx_insert(struct net_delta_tx*, const uint64_t id[2]);
+
+/* (re-)size the receiving slot for len bytes, NULL on bad slot/alloc */
+char* net_delta_rx_slot(struct net_delta_rx*, unsigned slot, size_t len);
+
+void net_delta_rx_free(struct net_delta_rx*);
+
+/*
+ * LZ4-style block compression (token, literals, 16-bit offset, match).
+ * compress returns the output size or 0 if it didn't fit in cap,
+ * decompress returns the output size or -1 on malformed input.
+ */
+size_t net_lz_compress(const uint8_t* src, size_t len, uint8_t* dst, size_t cap);
+ssize_t net_lz_decompress(const uint8_t* src,
+	size_t len, uint8_t* dst, size_t cap);
+
+#endif
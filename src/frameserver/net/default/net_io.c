@@ -0,0 +1,523 @@
+/*
+ * Networking Reference Frameserver Archetype, I/O primitives
+ * Copyright 2014-2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ * Notes:
+ *
+ * Ring buffers and readiness multiplexing for the net frameserver, kept free
+ * from APR and shmif so that the same code can be exercised on its own (see
+ * tests/benchmark/netload).
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifdef __LINUX
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include "net_io.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* first attempt at linearizing a frame that straddles the end of the ring,
+ * doubled until the validator is satisfied or we run out of data */
+#ifndef NET_STRADDLE_STEP
+#define NET_STRADDLE_STEP 4096
+#endif
+
+/* the frameserver is single threaded, one scratch buffer is enough */
+static struct {
+	char* buf;
+	size_t sz;
+} scratch;
+
+bool net_ring_alloc(struct net_ring* ring, size_t sz)
+{
+	size_t pot = 1;
+	while (pot < sz)
+		pot <<= 1;
+
+	ring->buf = malloc(pot);
+	if (!ring->buf){
+		*ring = (struct net_ring){0};
+		return false;
+	}
+
+	ring->sz = pot;
+	ring->mask = pot - 1;
+	ring->rd = ring->wr = 0;
+	return true;
+}
+
+void net_ring_free(struct net_ring* ring)
+{
+	free(ring->buf);
+	*ring = (struct net_ring){0};
+}
+
+static void linearize(struct net_ring* ring, char* dst, size_t n)
+{
+	size_t ofs = ring->rd & ring->mask;
+	size_t first = ring->sz - ofs;
+	if (first > n)
+		first = n;
+
+	memcpy(dst, &ring->buf[ofs], first);
+	memcpy(dst + first, ring->buf, n - first);
+}
+
+bool net_ring_grow(struct net_ring* ring, size_t lim)
+{
+	size_t nsz = ring->sz << 1;
+	if (nsz > lim)
+		return false;
+
+	char* nbuf = malloc(nsz);
+	if (!nbuf)
+		return false;
+
+	size_t used = net_ring_used(ring);
+	linearize(ring, nbuf, used);
+	free(ring->buf);
+
+	ring->buf = nbuf;
+	ring->sz = nsz;
+	ring->mask = nsz - 1;
+	ring->rd = 0;
+	ring->wr = used;
+	return true;
+}
+
+void net_ring_put(struct net_ring* ring, const char* buf, size_t sz)
+{
+	size_t ofs = ring->wr & ring->mask;
+	size_t first = ring->sz - ofs;
+	if (first > sz)
+		first = sz;
+
+	memcpy(&ring->buf[ofs], buf, first);
+	memcpy(ring->buf, buf + first, sz - first);
+	ring->wr += sz;
+}
+
+/* fill iov with the (up to two) regions starting at counter pos */
+static int ring_iov(struct net_ring* ring,
+	size_t pos, size_t n, struct iovec iov[2])
+{
+	size_t ofs = pos & ring->mask;
+	size_t first = ring->sz - ofs;
+	if (first > n)
+		first = n;
+
+	iov[0].iov_base = &ring->buf[ofs];
+	iov[0].iov_len = first;
+	if (first == n)
+		return 1;
+
+	iov[1].iov_base = ring->buf;
+	iov[1].iov_len = n - first;
+	return 2;
+}
+
+ssize_t net_ring_recv(struct net_ring* ring, int fd, bool* again)
+{
+	size_t space = net_ring_free_space(ring);
+	struct iovec iov[2];
+	struct msghdr msg = {.msg_iov = iov};
+
+	*again = false;
+	if (!space){
+		*again = true;
+		return -1;
+	}
+
+	msg.msg_iovlen = ring_iov(ring, ring->wr, space, iov);
+
+	ssize_t nr;
+	while ((nr = recvmsg(fd, &msg, 0)) == -1 && errno == EINTR);
+
+	if (-1 == nr){
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			*again = true;
+		return -1;
+	}
+
+/* short read, the socket buffer has been drained */
+	if (nr < space)
+		*again = true;
+
+	ring->wr += nr;
+	return nr;
+}
+
+ssize_t net_ring_send(struct net_ring* ring, int fd)
+{
+	struct iovec iov[2];
+	struct msghdr msg = {.msg_iov = iov};
+
+	while (net_ring_used(ring)){
+		msg.msg_iovlen = ring_iov(ring, ring->rd, net_ring_used(ring), iov);
+
+		ssize_t nw = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (-1 == nw){
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -1;
+		}
+
+		ring->rd += nw;
+	}
+
+	if (!net_ring_used(ring))
+		ring->rd = ring->wr = 0;
+
+	return net_ring_used(ring);
+}
+
+static bool scratch_reserve(size_t sz)
+{
+	if (scratch.sz >= sz)
+		return true;
+
+	char* nbuf = realloc(scratch.buf, sz);
+	if (!nbuf)
+		return false;
+
+	scratch.buf = nbuf;
+	scratch.sz = sz;
+	return true;
+}
+
+ssize_t net_ring_frames(struct net_ring* ring, size_t hdr_sz,
+	bool (*validator)(void* tag, size_t len, char* buf, size_t* consumed),
+	void* tag, bool* starved)
+{
+	ssize_t count = 0;
+	*starved = false;
+
+	while (net_ring_used(ring) >= hdr_sz){
+		size_t used = net_ring_used(ring);
+		size_t ofs = ring->rd & ring->mask;
+		size_t tail = ring->sz - ofs;
+		size_t consumed = 0;
+
+/* common case, validate straight from the ring */
+		if (tail >= hdr_sz){
+			size_t len = used < tail ? used : tail;
+			if (!validator(tag, len, &ring->buf[ofs], &consumed))
+				return -1;
+
+			if (consumed){
+				ring->rd += consumed;
+				count++;
+				continue;
+			}
+
+			if (len == used)
+				break;
+		}
+
+/* the pending frame wraps around, copy it out in growing steps */
+		size_t n = tail + hdr_sz + NET_STRADDLE_STEP;
+		while (!consumed){
+			if (n > used)
+				n = used;
+
+			if (!scratch_reserve(n))
+				return -1;
+
+			linearize(ring, scratch.buf, n);
+			if (!validator(tag, n, scratch.buf, &consumed))
+				return -1;
+
+			if (!consumed && n == used)
+				break;
+			n <<= 1;
+		}
+
+		if (!consumed)
+			break;
+
+		ring->rd += consumed;
+		count++;
+	}
+
+	if (net_ring_used(ring) && !net_ring_free_space(ring))
+		*starved = true;
+
+	if (!net_ring_used(ring))
+		ring->rd = ring->wr = 0;
+
+	return count;
+}
+
+struct net_evloop {
+#ifdef __LINUX
+	int epfd;
+	struct epoll_event* evs;
+	size_t evs_sz;
+#else
+	struct pollfd* fds;
+	void** tags;
+	size_t n, cap, rot;
+#endif
+};
+
+#ifdef __LINUX
+static uint32_t to_native(int mask)
+{
+	return ((mask & NET_EV_IN) ? EPOLLIN : 0) |
+		((mask & NET_EV_OUT) ? EPOLLOUT : 0);
+}
+
+struct net_evloop* net_evloop_create(size_t hint)
+{
+	struct net_evloop* res = malloc(sizeof(struct net_evloop));
+	if (!res)
+		return NULL;
+
+	res->evs = NULL;
+	res->evs_sz = 0;
+	res->epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (-1 == res->epfd){
+		free(res);
+		return NULL;
+	}
+
+	return res;
+}
+
+void net_evloop_destroy(struct net_evloop* loop)
+{
+	if (!loop)
+		return;
+
+	close(loop->epfd);
+	free(loop->evs);
+	free(loop);
+}
+
+bool net_evloop_add(struct net_evloop* loop, int fd, int mask, void* tag)
+{
+	struct epoll_event ev = {.events = to_native(mask), .data.ptr = tag};
+	return epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+bool net_evloop_mod(struct net_evloop* loop, int fd, int mask, void* tag)
+{
+	struct epoll_event ev = {.events = to_native(mask), .data.ptr = tag};
+	return epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void net_evloop_del(struct net_evloop* loop, int fd)
+{
+	struct epoll_event ev = {0};
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int net_evloop_wait(struct net_evloop* loop,
+	struct net_ev* evs, int n_ev, int timeout)
+{
+	if (loop->evs_sz < n_ev){
+		struct epoll_event* nevs =
+			realloc(loop->evs, sizeof(struct epoll_event) * n_ev);
+		if (!nevs)
+			return -1;
+		loop->evs = nevs;
+		loop->evs_sz = n_ev;
+	}
+
+	int nr = epoll_wait(loop->epfd, loop->evs, n_ev, timeout);
+	if (-1 == nr)
+		return errno == EINTR ? 0 : -1;
+
+	for (int i = 0; i < nr; i++){
+		uint32_t rev = loop->evs[i].events;
+		evs[i].tag = loop->evs[i].data.ptr;
+		evs[i].mask = ((rev & EPOLLIN) ? NET_EV_IN : 0) |
+			((rev & EPOLLOUT) ? NET_EV_OUT : 0) |
+			((rev & (EPOLLERR | EPOLLHUP)) ? NET_EV_ERR : 0);
+	}
+
+	return nr;
+}
+
+#else
+static short to_native(int mask)
+{
+	return ((mask & NET_EV_IN) ? POLLIN : 0) |
+		((mask & NET_EV_OUT) ? POLLOUT : 0);
+}
+
+struct net_evloop* net_evloop_create(size_t hint)
+{
+	struct net_evloop* res = malloc(sizeof(struct net_evloop));
+	if (!res)
+		return NULL;
+
+	hint = hint ? hint : 8;
+	res->fds = malloc(sizeof(struct pollfd) * hint);
+	res->tags = malloc(sizeof(void*) * hint);
+	res->n = res->rot = 0;
+	res->cap = hint;
+
+	if (!res->fds || !res->tags){
+		free(res->fds);
+		free(res->tags);
+		free(res);
+		return NULL;
+	}
+
+	return res;
+}
+
+void net_evloop_destroy(struct net_evloop* loop)
+{
+	if (!loop)
+		return;
+
+	free(loop->fds);
+	free(loop->tags);
+	free(loop);
+}
+
+static ssize_t find_fd(struct net_evloop* loop, int fd)
+{
+	for (size_t i = 0; i < loop->n; i++)
+		if (loop->fds[i].fd == fd)
+			return i;
+
+	return -1;
+}
+
+bool net_evloop_add(struct net_evloop* loop, int fd, int mask, void* tag)
+{
+	if (loop->n == loop->cap){
+		size_t ncap = loop->cap << 1;
+		struct pollfd* nfds = realloc(loop->fds, sizeof(struct pollfd) * ncap);
+		if (!nfds)
+			return false;
+		loop->fds = nfds;
+
+		void** ntags = realloc(loop->tags, sizeof(void*) * ncap);
+		if (!ntags)
+			return false;
+		loop->tags = ntags;
+		loop->cap = ncap;
+	}
+
+	loop->fds[loop->n] = (struct pollfd){.fd = fd, .events = to_native(mask)};
+	loop->tags[loop->n] = tag;
+	loop->n++;
+	return true;
+}
+
+bool net_evloop_mod(struct net_evloop* loop, int fd, int mask, void* tag)
+{
+	ssize_t i = find_fd(loop, fd);
+	if (-1 == i)
+		return false;
+
+	loop->fds[i].events = to_native(mask);
+	loop->tags[i] = tag;
+	return true;
+}
+
+void net_evloop_del(struct net_evloop* loop, int fd)
+{
+	ssize_t i = find_fd(loop, fd);
+	if (-1 == i)
+		return;
+
+	loop->n--;
+	loop->fds[i] = loop->fds[loop->n];
+	loop->tags[i] = loop->tags[loop->n];
+}
+
+int net_evloop_wait(struct net_evloop* loop,
+	struct net_ev* evs, int n_ev, int timeout)
+{
+	int nr = poll(loop->fds, loop->n, timeout);
+	if (-1 == nr)
+		return errno == EINTR ? 0 : -1;
+
+/* rotate the starting point so a burst larger than n_ev can't starve the
+ * descriptors at the end of the set */
+	int count = 0;
+	size_t n = loop->n;
+	for (size_t j = 0; j < n && nr > 0 && count < n_ev; j++){
+		size_t i = (loop->rot + j) % n;
+		short rev = loop->fds[i].revents;
+		if (!rev)
+			continue;
+
+		nr--;
+		evs[count].tag = loop->tags[i];
+		evs[count].mask = ((rev & POLLIN) ? NET_EV_IN : 0) |
+			((rev & POLLOUT) ? NET_EV_OUT : 0) |
+			((rev & (POLLERR | POLLHUP | POLLNVAL)) ? NET_EV_ERR : 0);
+		count++;
+		loop->rot = i + 1;
+	}
+
+	return count;
+}
+#endif
+
+void net_socket_setup(int fd, bool tcp)
+{
+	int flags = fcntl(fd, F_GETFL);
+	if (-1 != flags)
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+	flags = fcntl(fd, F_GETFD);
+	if (-1 != flags)
+		fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+
+/* output is already batched per wakeup, don't let nagle add to that */
+	if (tcp){
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(int));
+	}
+}
+
+int net_socket_accept(int fd)
+{
+	int rv;
+
+#ifdef __LINUX
+	while ((rv = accept4(fd, NULL, NULL,
+		SOCK_NONBLOCK | SOCK_CLOEXEC)) == -1 && errno == EINTR);
+
+	if (-1 != rv){
+		int one = 1;
+		setsockopt(rv, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(int));
+	}
+#else
+	while ((rv = accept(fd, NULL, NULL)) == -1 && errno == EINTR);
+
+	if (-1 != rv)
+		net_socket_setup(rv, true);
+#endif
+
+	return rv;
+}
@@ -0,0 +1,102 @@
+/*
+ * Networking Reference Frameserver Archetype, I/O primitives
+ * Copyright 2014-2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ */
+
+#ifndef HAVE_ARCAN_FRAMESERVER_NETIO
+#define HAVE_ARCAN_FRAMESERVER_NETIO
+
+/*
+ * Byte ring used for both the incoming and the outgoing side of a connection.
+ * Size is always a power of two, rd/wr are free-running counters that are
+ * masked on access, so used = wr - rd holds even after they wrap around.
+ * Reads and writes go through recvmsg/sendmsg with one iovec per contiguous
+ * region, and frames are handed out as pointers into the ring; only a frame
+ * that straddles the end of the buffer is copied (once) to be contiguous.
+ */
+struct net_ring {
+	char* buf;
+	size_t sz, mask;
+	size_t rd, wr;
+};
+
+bool net_ring_alloc(struct net_ring*, size_t sz);
+void net_ring_free(struct net_ring*);
+
+/* double the ring (up to lim) and linearize the contents */
+bool net_ring_grow(struct net_ring*, size_t lim);
+
+static inline size_t net_ring_used(struct net_ring* ring)
+{
+	return ring->wr - ring->rd;
+}
+
+static inline size_t net_ring_free_space(struct net_ring* ring)
+{
+	return ring->sz - (ring->wr - ring->rd);
+}
+
+/* copy buf into the ring, caller checks free space */
+void net_ring_put(struct net_ring*, const char* buf, size_t sz);
+
+/*
+ * Receive as much as fits into the ring with one recvmsg.
+ * Returns the number of bytes read, 0 on orderly shutdown, -1 on error
+ * and sets *again if the socket had nothing (more) to give.
+ */
+ssize_t net_ring_recv(struct net_ring*, int fd, bool* again);
+
+/*
+ * Send as much of the ring as the socket accepts, returns the number of bytes
+ * left in the ring, or -1 on error.
+ */
+ssize_t net_ring_send(struct net_ring*, int fd);
+
+/*
+ * Hand every complete frame in the ring to validator (same contract as the
+ * conn_state validator: false on protocol error, consumed = 0 when more data
+ * is needed). Returns the number of frames consumed or -1 on error, and sets
+ * *starved if the ring is full but the pending frame still doesn't fit.
+ */
+ssize_t net_ring_frames(struct net_ring*, size_t hdr_sz,
+	bool (*validator)(void* tag, size_t len, char* buf, size_t* consumed),
+	void* tag, bool* starved);
+
+/*
+ * Readiness multiplexer, epoll on linux and poll(2) elsewhere. Descriptors
+ * are level triggered and tagged with an opaque pointer, wait fills in up to
+ * n_ev (tag, mask) pairs.
+ */
+enum net_evmask {
+	NET_EV_IN  = 1,
+	NET_EV_OUT = 2,
+	NET_EV_ERR = 4
+};
+
+struct net_ev {
+	void* tag;
+	int mask;
+};
+
+struct net_evloop;
+
+struct net_evloop* net_evloop_create(size_t hint);
+void net_evloop_destroy(struct net_evloop*);
+
+bool net_evloop_add(struct net_evloop*, int fd, int mask, void* tag);
+bool net_evloop_mod(struct net_evloop*, int fd, int mask, void* tag);
+void net_evloop_del(struct net_evloop*, int fd);
+
+/* timeout in ms, -1 to block, returns number of events or -1 on error */
+int net_evloop_wait(struct net_evloop*,
+	struct net_ev* evs, int n_ev, int timeout);
+
+/* non-blocking, close-on-exec, no-delay setup for accepted/connected fds */
+void net_socket_setup(int fd, bool tcp);
+
+/* accept4 where available, the new fd is already setup */
+int net_socket_accept(int fd);
+
+#endif
@@ -14,6 +14,23 @@
 #define FRAME_HEADER_SIZE 3
 #endif
 
+uint8_t net_local_caps = NET_CAP_DELTA | NET_CAP_LZ;
+
+/* upper bound for the number of cache references in one CHUNKREF frame */
+#ifndef NET_DELTA_REFS
+#define NET_DELTA_REFS 1024
+#endif
+
+/* slot(2) encoding(1) raw length(2) */
+#define CHUNK_HEADER_SIZE 5
+
+/* smallest power of two that fits a maximum size frame */
+#define INBUF_LIMIT (2 * 65536)
+
+#ifndef NET_READ_BATCH
+#define NET_READ_BATCH 8
+#endif
+
 static bool err_catch_dispatch(struct conn_state* self, enum net_tags tag,
 	size_t len, char* value)
 {
@@ -139,9 +156,14 @@ sock_failure:
 }
 
 void net_setup_cell(struct conn_state* conn,
-	struct arcan_shmif_cont* cont, apr_pollset_t* pollset)
+	struct arcan_shmif_cont* cont, struct net_evloop* loop)
 {
-	conn->inout     = NULL;
+	conn->fd        = -1;
+	conn->shmcont   = cont;
+	conn->loop      = loop;
+	conn->evmask    = 0;
+	conn->connstate = CONN_OFFLINE;
+	conn->blocked   = false;
 	conn->dispatch  = err_catch_dispatch;
 	conn->validator = err_catch_valid;
 	conn->flushout  = err_catch_flush;
@@ -149,31 +171,59 @@ void net_setup_cell(struct conn_state* conn,
 	conn->decode    = err_catch_decode;
 	conn->buffer    = err_catch_buffer;
 	conn->pack      = err_catch_pack;
-	conn->pollset   = pollset;
-	conn->buf_sz    = DEFAULT_INBUF_SZ;
-	conn->outbuf_sz = DEFAULT_OUTBUF_SZ;
-	conn->buf_ofs   = 0;
-
-	if (conn->inbuffer)
-		memset(conn->inbuffer, '\0', conn->buf_sz);
-	else
-		conn->inbuffer = malloc(conn->buf_sz);
 
-	if (conn->outbuffer)
-		memset(conn->outbuffer, '\0', conn->outbuf_sz);
-	else
-		conn->outbuffer = malloc(conn->outbuf_sz);
-
-	if (!conn->inbuffer)
-		conn->buf_sz = 0;
+	net_ring_free(&conn->in);
+	net_ring_free(&conn->out);
 
-	if (!conn->outbuffer)
-		conn->outbuf_sz = 0;
+	conn->peer_caps = 0;
+	free(conn->delta_tx);
+	conn->delta_tx = NULL;
+	if (conn->delta_rx){
+		net_delta_rx_free(conn->delta_rx);
+		free(conn->delta_rx);
+		conn->delta_rx = NULL;
+	}
+	memset(&conn->xfer_in, '\0', sizeof(struct net_xfer_stats));
+	memset(&conn->xfer_out, '\0', sizeof(struct net_xfer_stats));
 
 	if (conn->state_in.fd)
 		close(conn->state_in.fd);
 }
 
+bool net_open_cell(struct conn_state* conn, int fd)
+{
+	if (!net_ring_alloc(&conn->in, DEFAULT_INBUF_SZ) ||
+		!net_ring_alloc(&conn->out, DEFAULT_OUTBUF_SZ)){
+		LOG("(net) couldn't allocate connection buffers.\n");
+		goto fail;
+	}
+
+	if (conn->loop && !net_evloop_add(conn->loop, fd, NET_EV_IN, conn)){
+		LOG("(net) couldn't add connection to event loop.\n");
+		goto fail;
+	}
+
+	conn->fd = fd;
+	conn->evmask = NET_EV_IN;
+	return true;
+
+fail:
+	net_ring_free(&conn->in);
+	net_ring_free(&conn->out);
+	return false;
+}
+
+void net_close_cell(struct conn_state* conn)
+{
+	if (-1 != conn->fd){
+		if (conn->loop)
+			net_evloop_del(conn->loop, conn->fd);
+		close(conn->fd);
+	}
+
+	net_setup_cell(conn, conn->shmcont, conn->loop);
+}
+
 void net_newseg(struct conn_state* conn, int kind, char* key)
 {
 	if (!conn){
@@ -204,67 +254,168 @@ fail:
 	LOG("(net) segment setup failed, notifying parent.\n");
 }
 
-#include <assert.h>
-bool net_buffer_basic(struct conn_state* self)
+static bool ring_validator(void* tag,
+	size_t len, char* buf, size_t* consumed)
 {
-	size_t consumed = 0;
-	apr_size_t nr = self->buf_sz - self->buf_ofs;
-	assert(self->buf_ofs >= 0);
-
-/* consume full buffer, shouldn't occur in normal operations
- * but if we populate the buffer in beforehand to test other stages
- * it might */
-	if (nr == 0 &&
-		!self->validator(self, self->buf_sz, self->inbuffer, &consumed))
-		return false;
+	struct conn_state* self = tag;
+	return self->validator(self, len, buf, consumed);
+}
 
-	if (consumed)
-		goto slide;
+/*
+ * Read until the socket is drained (or for at most NET_READ_BATCH rounds so
+ * one busy peer can't starve the others) and run every complete frame in
+ * the ring through validator -> dispatch, straight from the ring buffer.
+ * A wakeup with many small frames is one recvmsg followed by a run of
+ * shmif events rather than a recv and a memmove per frame.
+ */
+bool net_buffer_basic(struct conn_state* self)
+{
+	for (size_t i = 0; i < NET_READ_BATCH; i++){
+		bool again, starved;
+		ssize_t nr = net_ring_recv(&self->in, self->fd, &again);
 
-	apr_status_t sv = apr_socket_recv(self->inout,
-		&self->inbuffer[self->buf_ofs], &nr);
+		if (0 == nr){
+			LOG("(net) EOF detected, giving up.\n");
+			return false;
+		}
 
-	if (APR_STATUS_IS_EOF(sv)){
-		LOG("(net) EOF detected, giving up.\n");
-		return false;
-	}
+		if (-1 == nr && !again){
+			LOG("(net) Error reading from socket\n");
+			return false;
+		}
 
-	if (sv != APR_SUCCESS){
-		LOG("(net) Error reading from socket\n");
-		return false;
-	}
+		if (-1 == net_ring_frames(&self->in,
+			FRAME_HEADER_SIZE, ring_validator, self, &starved))
+			return false;
 
-	self->buf_ofs += nr;
-	if (self->buf_ofs > FRAME_HEADER_SIZE){
-		if (self->validator(self, self->buf_sz, self->inbuffer, &consumed))
-			goto slide;
-		else
+/* the pending frame is larger than the ring */
+		if (starved && !net_ring_grow(&self->in, INBUF_LIMIT)){
+			LOG("(net) frame exceeds incoming buffer limit.\n");
 			return false;
-	}
-	else
-		return true;
+		}
 
-slide:
-/* buffer more */
-/* slide or reset */
-	if (consumed == self->buf_sz){
-		self->buf_ofs = 0;
-		printf("reset\n");
-	}
-	else {
-		memmove(self->inbuffer, &self->inbuffer[consumed], self->buf_sz - consumed);
-		self->buf_ofs -= consumed;
+		if (again && !starved)
+			break;
 	}
+
 	return true;
 }
 
 static void flushvid(struct conn_state* self)
 {
-	arcan_shmif_signal(self->shmcont, SHMIF_SIGVID);
-	arcan_shmif_drop(self->shmcont);
+	arcan_shmif_signal(&self->state_in.shmcont, SHMIF_SIGVID);
+	arcan_shmif_drop(&self->state_in.shmcont);
 	self->state_in.state = STATE_NONE;
 	self->state_in.ofs = 0;
 	self->state_in.lim = 0;
+	net_report_xfer(self, true);
+}
+
+/* append a block of decoded state data to the incoming transfer */
+static bool state_append(struct conn_state* self, char* val, size_t len)
+{
+/* silent drop */
+	if (self->state_in.state == STATE_NONE){
+		return true;
+	}
+/* streaming, no limit */
+	else if (self->state_in.state == STATE_DATA){
+		while(len > 0){
+			ssize_t nw = write(self->state_in.fd, val, len);
+			if (nw == -1){
+				if (errno == EAGAIN || errno == EINTR)
+					continue;
+				return false;
+			}
+
+			len -= nw;
+			val += nw;
+		}
+	}
+	else if (self->state_in.state == STATE_IMG){
+		ssize_t ub = self->state_in.lim - self->state_in.ofs;
+		size_t ntw = ub > len ? len : ub;
+	 	memcpy(self->state_in.shmcont.vidp + self->state_in.ofs, val, ntw);
+		self->state_in.ofs += ntw;
+		if (self->state_in.ofs == self->state_in.lim)
+			flushvid(self);
+	}
+
+	return true;
+}
+
+static void xfer_account(struct net_xfer_stats* st,
+	size_t raw, size_t wire, size_t chunks, size_t cached)
+{
+	if (!st->start)
+		st->start = arcan_timemillis();
+
+	st->raw += raw;
+	st->wire += wire + FRAME_HEADER_SIZE;
+	st->chunks += chunks;
+	st->cached += cached;
+}
+
+/* new chunk: store in the slot the sender picked, then append */
+static bool decode_chunk(struct conn_state* self, size_t len, char* val)
+{
+	if (len < CHUNK_HEADER_SIZE)
+		return false;
+
+	unsigned slot = (uint8_t)val[0] | ((uint8_t)val[1] << 8);
+	uint8_t enc = val[2];
+	size_t raw = (uint8_t)val[3] | ((uint8_t)val[4] << 8);
+
+	if (!self->delta_rx && !(self->delta_rx =
+		calloc(1, sizeof(struct net_delta_rx))))
+		return false;
+
+	char* dst = net_delta_rx_slot(self->delta_rx, slot, raw);
+	if (!dst)
+		return false;
+
+	len -= CHUNK_HEADER_SIZE;
+	val += CHUNK_HEADER_SIZE;
+
+	if (enc == STATE_RAWBLOCK){
+		if (len != raw)
+			return false;
+		memcpy(dst, val, raw);
+	}
+	else if (enc == STATE_LZBLOCK){
+		if (net_lz_decompress((uint8_t*) val, len, (uint8_t*) dst, raw) != raw)
+			return false;
+	}
+	else
+		return false;
+
+	xfer_account(&self->xfer_in, raw, len + CHUNK_HEADER_SIZE, 1, 0);
+	return state_append(self, dst, raw);
+}
+
+/* run of chunks the receiver already has */
+static bool decode_chunkref(struct conn_state* self, size_t len, char* val)
+{
+	if (len % 2 || !self->delta_rx)
+		return false;
+
+	xfer_account(&self->xfer_in, 0, len, 0, 0);
+
+	for (size_t i = 0; i < len; i += 2){
+		unsigned slot = (uint8_t)val[i] | ((uint8_t)val[i + 1] << 8);
+		if (slot >= NET_DELTA_SLOTS || !self->delta_rx->data[slot])
+			return false;
+
+		size_t raw = self->delta_rx->len[slot];
+		self->xfer_in.raw += raw;
+		self->xfer_in.chunks++;
+		self->xfer_in.cached++;
+
+		if (!state_append(self, self->delta_rx->data[slot], raw))
+			return false;
+	}
+
+	return true;
 }
 
 bool net_hl_decode(struct conn_state* self,
@@ -326,36 +477,21 @@ bool net_hl_decode(struct conn_state* self,
 		else if (self->state_in.state == STATE_DATA){
 			close(self->state_in.fd);
 			self->state_in.fd = BADFD;
+			net_report_xfer(self, true);
 		}
 	break;
 
 	case TAG_STATE_DATABLOCK:
-/* silent drop */
-		if (self->state_in.state == STATE_NONE){
-			return true;
-		}
-/* streaming, no limit */
-		else if (self->state_in.state == STATE_DATA){
-			while(len > 0){
-				size_t nw = write(self->state_in.fd, val, len);
-				if (nw == -1 && (errno != EAGAIN || errno != EINTR))
-					break;
-				else
-					continue;
+		xfer_account(&self->xfer_in, len, len, 0, 0);
+		return state_append(self, val, len);
+	break;
 
-				len -= nw;
-				val += nw;
-			}
-		}
-		else if (self->state_in.state == STATE_IMG){
-			ssize_t ub = self->state_in.lim - self->state_in.ofs;
-			size_t ntw = ub > len ? len : ub;
-		 	memcpy(self->state_in.shmcont.vidp + self->state_in.ofs, val, ntw);
-			self->state_in.ofs += ntw;
-			if (self->state_in.ofs == self->state_in.lim)
-				flushvid(self);
-		}
-		return true;
+	case TAG_STATE_CHUNK:
+		return decode_chunk(self, len, val);
+	break;
+
+	case TAG_STATE_CHUNKREF:
+		return decode_chunkref(self, len, val);
 	break;
 
 	case TAG_STATE_DATAOBJ:
@@ -396,7 +532,7 @@ static uint32_t version_magic(bool req)
 }
 
 char* net_unpack_discover(char* inb, bool req, char** pk,
-	char** name, char** cookie, char** host, int* port)
+	char** name, char** cookie, char** host, int* port, uint8_t* caps)
 {
 	uint32_t mv;
 	memcpy(&mv, inb, sizeof(uint32_t));
@@ -424,6 +560,10 @@ char* net_unpack_discover(char* inb, bool req, char** pk,
 	memcpy(*host, &inb[NET_IDENT_SIZE +
 		NET_COOKIE_SIZE + NET_NAME_SIZE + NET_KEY_SIZE], NET_ADDR_SIZE);
 
+/* packets from builds before the field was added have zero here */
+	*caps = inb[NET_IDENT_SIZE + NET_COOKIE_SIZE +
+		NET_NAME_SIZE + NET_KEY_SIZE + NET_ADDR_SIZE];
+
 /* parse host and extract port */
 	char* ofp = *host + NET_ADDR_SIZE;
 	*port = 0;
@@ -443,8 +583,8 @@ char* net_unpack_discover(char* inb, bool req, char** pk,
 	return res;
 }
 
-char* net_pack_discover(bool req,
-	char* key, char* name, char* cookie, char* host, int port, size_t* d_sz)
+char* net_pack_discover(bool req, char* key, char* name,
+	char* cookie, char* host, int port, uint8_t caps, size_t* d_sz)
 {
 	if (!key || !name || !cookie || !host || strlen(host) > NET_ADDR_SIZE - 5)
 		return NULL;
@@ -460,6 +600,7 @@ char* net_pack_discover(bool req,
 	char* ofs_key = &res[NET_IDENT_SIZE + NET_COOKIE_SIZE + NET_NAME_SIZE];
 	char* ofs_host = &res[NET_IDENT_SIZE + NET_COOKIE_SIZE +
 		NET_NAME_SIZE + NET_KEY_SIZE];
+	char* ofs_caps = ofs_host + NET_ADDR_SIZE;
 
 /* set fields */
 	memcpy(res, &mv, sizeof(uint32_t));
@@ -467,6 +608,7 @@ char* net_pack_discover(bool req,
 	strncpy(ofs_name, name, NET_NAME_SIZE);
 	memcpy(ofs_key, key, NET_KEY_SIZE);
  	snprintf(ofs_host, NET_ADDR_SIZE, "%s:%d", host, port);
+	*ofs_caps = caps;
 
 	printf("discover(out): key[%s], port[%d], cookie[%d, %d, %d, %d], host[%s]\n",
 		ofs_key, port, ofs_cookie[0], ofs_cookie[1], ofs_cookie[2], ofs_cookie[3], ofs_host);
@@ -478,28 +620,149 @@ char* net_pack_discover(bool req,
 bool net_pack_basic(struct conn_state* state,
 	enum net_tags tag, size_t sz, char* buf)
 {
-	size_t left = state->outbuf_sz - state->outbuf_ofs;
+	size_t need = sz + FRAME_HEADER_SIZE;
+
+	if (sz > 0xffff){
+		LOG("(net) packed buffer size would exceed frame limit.\n");
+		return false;
+	}
+
+	if (!state->out.buf)
+		return false;
 
-	if (sz + FRAME_HEADER_SIZE > state->outbuf_sz){
-		LOG("(net) packed buffer size would exceed build-time limit.\n");
+/* push what we have first, then grow until the peer is considered stuck */
+	if (net_ring_free_space(&state->out) < need && !state->flushout(state)){
+		LOG("(net) buffer management failure in pack-out/flush.\n");
 		return false;
 	}
 
-	if (left < sz + FRAME_HEADER_SIZE){
-		if (!state->flushout(state)){
-			LOG("(net) buffer management failure in pack-out/flush.\n");
+	while (net_ring_free_space(&state->out) < need)
+		if (!net_ring_grow(&state->out, DEFAULT_OUTBUF_LIMIT)){
+			LOG("(net) outgoing buffer limit reached, peer isn't draining.\n");
 			return false;
 		}
+
+	char hdr[FRAME_HEADER_SIZE] = {tag, (uint8_t) sz, (uint8_t) (sz >> 8)};
+	net_ring_put(&state->out, hdr, FRAME_HEADER_SIZE);
+	net_ring_put(&state->out, buf, sz);
+
+	return state->queueout(state, need, buf);
+}
+
+bool net_pack_caps(struct conn_state* state)
+{
+	char caps = net_local_caps;
+	return state->pack(state, TAG_NETCAPS, 1, &caps);
+}
+
+/* a new chunk, LZ compressed when the peer accepts it and it pays off */
+static bool pack_chunk(struct conn_state* state,
+	unsigned slot, const uint8_t* buf, size_t len)
+{
+	static uint8_t frame[CHUNK_HEADER_SIZE + NET_DELTA_MAX];
+	size_t clen = 0;
+
+	frame[0] = slot;
+	frame[1] = slot >> 8;
+	frame[3] = len;
+	frame[4] = len >> 8;
+
+	if ((state->peer_caps & net_local_caps & NET_CAP_LZ))
+		clen = net_lz_compress(buf, len,
+			&frame[CHUNK_HEADER_SIZE], len - (len >> 4));
+
+	if (clen){
+		frame[2] = STATE_LZBLOCK;
+	}
+	else {
+		frame[2] = STATE_RAWBLOCK;
+		memcpy(&frame[CHUNK_HEADER_SIZE], buf, len);
+		clen = len;
+	}
+
+	xfer_account(&state->xfer_out, len, clen + CHUNK_HEADER_SIZE, 1, 0);
+	return state->pack(state, TAG_STATE_CHUNK,
+		clen + CHUNK_HEADER_SIZE, (char*) frame);
+}
+
+ssize_t net_pack_state(struct conn_state* state, char* buf, size_t len)
+{
+	const uint8_t* src = (const uint8_t*) buf;
+
+	if (!len)
+		return 0;
+
+/* peer doesn't do delta, fall back to plain blocks */
+	if (!(state->peer_caps & net_local_caps & NET_CAP_DELTA)){
+		size_t ntc = len > NET_DELTA_MAX ? NET_DELTA_MAX : len;
+		xfer_account(&state->xfer_out, ntc, ntc, 0, 0);
+		return state->pack(state, TAG_STATE_DATABLOCK, ntc, buf) ? ntc : -1;
 	}
 
-	state->outbuffer[state->outbuf_ofs + 0] = tag;
-	state->outbuffer[state->outbuf_ofs + 1] = (uint8_t) sz;
-	state->outbuffer[state->outbuf_ofs + 2] = (uint8_t) (sz >> 8);
+	if (!state->delta_tx && !(state->delta_tx =
+		calloc(1, sizeof(struct net_delta_tx))))
+		return -1;
+
+/* collect a run of chunks the peer already has into one reference frame,
+ * stop at the first one it doesn't and send that on its own */
+	uint8_t refs[NET_DELTA_REFS * 2];
+	size_t n_refs = 0, consumed = 0, raw = 0;
+
+	while (consumed < len && n_refs < NET_DELTA_REFS){
+		size_t clen = net_delta_cut(&src[consumed], len - consumed);
+		uint64_t id[2];
+		net_delta_hash(&src[consumed], clen, id);
+
+		int slot = net_delta_tx_find(state->delta_tx, id);
+		if (-1 == slot){
+			if (n_refs)
+				break;
+
+			slot = net_delta_tx_insert(state->delta_tx, id);
+			return pack_chunk(state, slot, &src[consumed], clen) ? clen : -1;
+		}
+
+		refs[n_refs * 2 + 0] = slot;
+		refs[n_refs * 2 + 1] = slot >> 8;
+		n_refs++;
+		consumed += clen;
+		raw += clen;
+	}
+
+	xfer_account(&state->xfer_out, raw, n_refs * 2, n_refs, n_refs);
+	if (!state->pack(state, TAG_STATE_CHUNKREF, n_refs * 2, (char*) refs))
+		return -1;
+
+	return consumed;
+}
+
+void net_report_xfer(struct conn_state* state, bool incoming)
+{
+	struct net_xfer_stats* st = incoming ? &state->xfer_in : &state->xfer_out;
+	if (!st->start)
+		return;
+
+	arcan_event ev = {
+		.category = EVENT_NET,
+		.net.kind = EVENT_NET_TRANSFER,
+		.net.connid = state->slot,
+		.net.xfer = {
+			.raw = st->raw > UINT32_MAX ? UINT32_MAX : st->raw,
+			.wire = st->wire > UINT32_MAX ? UINT32_MAX : st->wire,
+			.chunks = st->chunks,
+			.cached = st->cached,
+			.ms = arcan_timemillis() - st->start,
+			.incoming = incoming
+		}
+	};
 
-	memcpy(state->outbuffer + state->outbuf_ofs + FRAME_HEADER_SIZE, buf, sz);
-	state->outbuf_ofs += FRAME_HEADER_SIZE + sz;
+	LOG("(net), transfer (%s) %"PRIu64" bytes in %"PRIu32" ms, "
+		"%"PRIu64" on the wire, %"PRIu32"/%"PRIu32" chunks cached\n",
+		incoming ? "in" : "out", st->raw, ev.net.xfer.ms,
+		st->wire, st->cached, st->chunks);
 
-	return state->queueout(state, state->outbuf_ofs, state->outbuffer);
+	arcan_shmif_enqueue(state->shmcont, &ev);
+	memset(st, '\0', sizeof(struct net_xfer_stats));
 }
 
 bool net_dispatch_tlv(struct conn_state* self, enum net_tags tag,
@@ -511,8 +774,11 @@ bool net_dispatch_tlv(struct conn_state* self, enum net_tags tag,
 	switch(tag){
 	case TAG_NETMSG:
 		newev.net.kind = EVENT_NET_CUSTOMMSG;
-		snprintf(newev.net.message,
-			sizeof(newev.net.message) / sizeof(newev.net.message[0]), "%s", value);
+		newev.net.connid = self->slot;
+/* value points into the receive ring and isn't terminated */
+		if (len > sizeof(newev.net.message) - 1)
+			len = sizeof(newev.net.message) - 1;
+		memcpy(newev.net.message, value, len);
 		arcan_shmif_enqueue(self->shmcont, &newev);
 	break;
 
@@ -520,6 +786,17 @@ bool net_dispatch_tlv(struct conn_state* self, enum net_tags tag,
 /* need to implement proper serialization of event structure first */
 	break;
 
+/* sent by both ends on connect, unknown bits are ignored so that a newer
+ * peer can announce more than we understand */
+	case TAG_NETCAPS:
+		if (len < 1)
+			return false;
+		self->peer_caps = (uint8_t)value[0] & (NET_CAP_DELTA | NET_CAP_LZ);
+		LOG("(net), peer capabilities: %s%s\n",
+			self->peer_caps & NET_CAP_DELTA ? "delta " : "",
+			self->peer_caps & NET_CAP_LZ ? "lz" : "");
+	break;
+
 /*
  * For ping / pong, we discard everything above the timestamp,
  * it can be padded with noise to make side-channel analysis more difficult
@@ -562,55 +839,57 @@ bool net_dispatch_tlv(struct conn_state* self, enum net_tags tag,
 
 bool net_flushout_default(struct conn_state* self)
 {
-	apr_size_t nts = self->outbuf_ofs;
-	if (nts == 0){
-		static bool flush_warn = false;
-
-/* don't terminate on this issue, as there might be a platform/pollset
- * combination where this is broken yet will only yield higher CPU usage */
-		if (!flush_warn){
-			LOG("(net-srv) -- flush requested on empty conn_state, "
-				"possibly broken poll.\n");
-			flush_warn = true;
-		}
+	if (-1 == self->fd)
+		return false;
 
-		return true;
+	ssize_t left = net_ring_send(&self->out, self->fd);
+	if (-1 == left){
+		LOG("(net) -- send failed, %s\n", strerror(errno));
+		return false;
 	}
 
-	apr_status_t sv = apr_socket_send(self->inout, self->outbuffer, &nts);
-
-	if (nts > 0){
-		if (self->outbuf_ofs - nts == 0){
-			self->outbuf_ofs = 0;
-/* disable POLLOUT until more data has been queued
- * (also check for a 'refill' function) */
-		apr_pollset_remove(self->pollset, &self->poll_state);
-			self->poll_state.reqevents  = APR_POLLIN | APR_POLLHUP | APR_POLLERR;
-			self->poll_state.rtnevents  = 0;
-			apr_pollset_add(self->pollset,&self->poll_state);
-		} else {
-/* partial write, slide */
-			memmove(self->outbuffer, &self->outbuffer[nts], self->outbuf_ofs - nts);
-			self->outbuf_ofs -= nts;
-		}
-	} else {
-		char errbuf[64];
-		apr_strerror(sv, errbuf, sizeof(errbuf));
-		LOG("(net-srv) -- send failed, %s\n", errbuf);
+/* only ask for POLLOUT while there is something left to send */
+	int mask = NET_EV_IN | (left > 0 ? NET_EV_OUT : 0);
+	if (self->loop && mask != self->evmask){
+		net_evloop_mod(self->loop, self->fd, mask, self);
+		self->evmask = mask;
 	}
 
-	return (sv == APR_SUCCESS) && !APR_STATUS_IS_EOF(sv);
+	return true;
 }
 
 /*
- * By default, this hook doesn't do anything else.
- * If we have intermediate write buffers, additional packaging
- * reordering strategies, other output services etc.
- * this is the place to introduce them.
+ * Defer the flush to the end of the current wakeup when the session has a
+ * flush queue, otherwise flush right away. If we have intermediate write
+ * buffers, additional packaging reordering strategies, other output
+ * services etc. this is the place to introduce them.
  */
 bool net_queueout_default(struct conn_state* self, size_t buf_sz, char* buf)
 {
-	return self->flushout(self);
+	if (!self->flushq)
+		return self->flushout(self);
+
+	if (!self->flushq_pending){
+		self->flushq_pending = true;
+		self->flushq_next = *self->flushq;
+		*self->flushq = self;
+	}
+
+	return true;
+}
+
+void net_flush_queued(struct conn_state** flushq,
+	void (*fail)(struct conn_state*))
+{
+	while (*flushq){
+		struct conn_state* conn = *flushq;
+		*flushq = conn->flushq_next;
+		conn->flushq_next = NULL;
+		conn->flushq_pending = false;
+
+		if (-1 != conn->fd && !conn->flushout(conn) && fail)
+			fail(conn);
+	}
 }
 
 /*
@@ -620,19 +899,18 @@ bool net_queueout_default(struct conn_state* self, size_t buf_sz, char* buf)
 bool net_validator_tlv(struct conn_state* self,
 	size_t len, char* buf, size_t* consumed)
 {
-	size_t block = (uint8_t)self->inbuffer[1] |
-		((uint8_t)self->inbuffer[2] << 8);
+	size_t block = (uint8_t)buf[1] | ((uint8_t)buf[2] << 8);
 
-	if (self->inbuffer[0] >= TAG_LAST_VALUE)
+	if ((uint8_t)buf[0] >= TAG_LAST_VALUE)
 		return false;
 
-/* request a larger buffer */
+/* request more data */
 	if (block + FRAME_HEADER_SIZE > len)
 		return true;
 
 	*consumed = block + FRAME_HEADER_SIZE;
 
-	return self->dispatch(self, self->inbuffer[0],
-		block, self->inbuffer + FRAME_HEADER_SIZE);
+	return self->dispatch(self, (uint8_t)buf[0],
+		block, buf + FRAME_HEADER_SIZE);
 }
 
@@ -30,6 +30,8 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <string.h>
+#include <errno.h>
 
 #include <apr_general.h>
 #include <apr_file_io.h>
@@ -40,6 +42,9 @@
 
 #include <arcan_shmif.h>
 
+#include "net_io.h"
+#include "net_delta.h"
+
 #ifndef DEFAULT_CLIENT_TIMEOUT
 #define DEFAULT_CLIENT_TIMEOUT 2000000
 #endif
@@ -48,10 +53,6 @@
 #define CLIENT_DISCOVER_DELAY 10
 #endif
 
-#ifndef OUTBUF_CAP
-#define OUTBUF_CAP 65535
-#endif
-
 enum net_tags {
 	TAG_NETMSG           = 0,
 	TAG_STATE_IMGOBJ     = 1,
@@ -63,14 +64,31 @@ enum net_tags {
 	TAG_NETPING          = 7,
 	TAG_NETPONG          = 8,
 	TAG_STATE_EOB        = 9,
-	TAG_LAST_VALUE       = 10
+	TAG_NETCAPS          = 10,
+	TAG_STATE_CHUNK      = 11,
+	TAG_STATE_CHUNKREF   = 12,
+	TAG_LAST_VALUE       = 13
 };
 
+/* encoding of a TAG_STATE_CHUNK payload */
 enum net_states{
 	STATE_RAWBLOCK = 0,
-	STATE_RLEBLOCK = 1
+	STATE_RLEBLOCK = 1,
+	STATE_LZBLOCK  = 2
+};
+
+/*
+ * advertised in the discover packets and exchanged (TAG_NETCAPS) as the
+ * first message on a new connection, a sender only uses what the peer
+ * has announced
+ */
+enum net_caps {
+	NET_CAP_DELTA = 1,
+	NET_CAP_LZ    = 2
 };
 
+extern uint8_t net_local_caps;
+
 /*
  * IDENTCOOKIENAMEPKEYADDR
  * max addr is ipv6 textual representation + strsep + port.
@@ -82,6 +100,7 @@ enum net_states{
 #define NET_NAME_SIZE 15
 #define NET_KEY_SIZE 32
 #define NET_ADDR_SIZE 45
+#define NET_CAPS_SIZE 1
 #define NET_HEADER_SIZE 128
 
 enum xfer_state {
@@ -109,11 +128,17 @@ struct conn_segcont {
 		enum xfer_state state;
 };
 
+struct net_xfer_stats {
+	uint64_t raw, wire;
+	uint32_t chunks, cached;
+	unsigned long long start;
+};
+
 struct conn_state {
- struct arcan_shmif_cont* shmcont;
-	apr_socket_t* inout;
-	apr_pollset_t* pollset;
-	apr_pollfd_t poll_state;
+	struct arcan_shmif_cont* shmcont;
+	int fd;
+	struct net_evloop* loop;
+	int evmask;
 
 	enum connection_state connstate;
 
@@ -138,14 +163,16 @@ struct conn_state {
 	unsigned long long connect_stamp, last_ping, last_pong;
 	int delay;
 
-/* DEFAULT_OUTBUF_SZ / DEFAULT_INBUF_SZ */
-	char* inbuffer;
-	size_t buf_sz;
-	int buf_ofs;
+/* start at DEFAULT_INBUF_SZ / DEFAULT_OUTBUF_SZ, allocated on connect */
+	struct net_ring in, out;
 
-	char* outbuffer;
-	size_t outbuf_sz;
-	int outbuf_ofs;
+/* queueout links the connection into *flushq (when set) and the session
+ * flushes the whole list once per wakeup, so everything queued to a peer
+ * while processing a batch of events leaves in one sendmsg. These fields
+ * are owned by the session and left untouched by net_setup_cell */
+	struct conn_state** flushq;
+	struct conn_state* flushq_next;
+	bool flushq_pending;
 
 /*
  * There can be one incoming and one outgoing state- transfer
@@ -154,6 +181,15 @@ struct conn_state {
  */
 	struct conn_segcont state_in, state_out;
 	int slot;
+
+/* what the other end announced in TAG_NETCAPS, enum net_caps */
+	uint8_t peer_caps;
+
+/* chunk caches for the outgoing and incoming state transfers, allocated
+ * on first use, and statistics for the transfer in progress */
+	struct net_delta_tx* delta_tx;
+	struct net_delta_rx* delta_rx;
+	struct net_xfer_stats xfer_in, xfer_out;
 };
 
 enum client_modes {
@@ -170,9 +206,9 @@ enum server_modes {
 };
 
 char* net_unpack_discover(char* inb, bool req, char** pk,
-	char** name, char** cookie, char** host, int* port);
-char* net_pack_discover(bool req,
-	char* key, char* name, char* cookie, char* host, int port, size_t* d_sz);
+	char** name, char** cookie, char** host, int* port, uint8_t* caps);
+char* net_pack_discover(bool req, char* key, char* name,
+	char* cookie, char* host, int port, uint8_t caps, size_t* d_sz);
 
 int arcan_net_client_session(
 	struct arcan_shmif_cont* con,
@@ -183,7 +219,18 @@ apr_socket_t* net_prepare_socket(const char* host, apr_sockaddr_t*
 	althost, int* sport, bool tcp, apr_pool_t* mempool);
 
 void net_setup_cell(struct conn_state*,
-	struct arcan_shmif_cont*, apr_pollset_t* pollset);
+	struct arcan_shmif_cont*, struct net_evloop* loop);
+
+/* allocate buffers and register a connected (non-blocking) fd */
+bool net_open_cell(struct conn_state*, int fd);
+
+/* unregister, close and reset to the state of net_setup_cell */
+void net_close_cell(struct conn_state*);
+
+/* flush every connection queued on flushq, fail is invoked on the ones
+ * where the flush failed */
+void net_flush_queued(struct conn_state** flushq,
+	void (*fail)(struct conn_state*));
 
 bool net_validator_tlv(struct conn_state*, size_t, char*, size_t* );
 bool net_dispatch_tlv(struct conn_state*, enum net_tags, size_t, char*);
@@ -198,4 +245,17 @@ enum seg_kinds {
 	SEGMENT_RECEIVE = 1
 };
 void net_newseg(struct conn_state* conn, int kind, char* key);
+
+/* announce net_local_caps to the peer */
+bool net_pack_caps(struct conn_state*);
+
+/*
+ * pack the next part of an outgoing state transfer from buf, as chunk/ref
+ * frames if the peer has NET_CAP_DELTA or plain datablocks otherwise,
+ * returns the number of bytes consumed or -1 on failure
+ */
+ssize_t net_pack_state(struct conn_state*, char* buf, size_t len);
+
+/* emit EVENT_NET_TRANSFER for the finished transfer and reset stats */
+void net_report_xfer(struct conn_state*, bool incoming);
 bool net_hl_decode(struct conn_state* conn, enum net_tags, size_t, char*);
@@ -48,6 +48,9 @@
  * transfers and to initiate streaming sessions.
  */
 
+#include <sys/resource.h>
+#include <arpa/inet.h>
+
 #include "net_shared.h"
 #include "net.h"
 #include "frameserver.h"
@@ -55,14 +58,24 @@
 /*
  * just rand() XoR key for use with higher level API (Arcan scripting),
  * purpose is just to enforce actual tracking in the script and preventing
- * hard-coded values.
+ * hard-coded values. The high bit is always set so that a slot id never
+ * collides with 0 (broadcast) and ids fit the 16-bit event field.
  */
 static int idcookie = 0;
 
+#ifndef NET_EVENT_BATCH
+#define NET_EVENT_BATCH 256
+#endif
+
+/* upper bound for accept() calls per wakeup, the rest stay in the backlog */
+#ifndef NET_ACCEPT_BATCH
+#define NET_ACCEPT_BATCH 64
+#endif
+
 static struct {
 /* SHM-API interface */
 	struct arcan_shmif_cont shmcont;
-	apr_socket_t* evsock;
+	int evfd;
 	uint8_t* vidp, (* audp);
 
 /* for future time-synchronization (ping/pongs interleaved
@@ -71,10 +84,16 @@ static struct {
 	unsigned long long basestamp;
 
 	apr_pool_t* mempool;
-	apr_pollset_t* pollset;
+	struct net_evloop* loop;
 
+/* stack of unused connection slots */
+	int* freelist;
+	size_t n_free;
 	unsigned n_conn;
 
+/* connections with output queued during the current wakeup */
+	struct conn_state* flushq;
+
 	int inport;
 	char lt_keypair_pubkey[NET_KEY_SIZE], lt_keypair_privkey[NET_KEY_SIZE];
 } srvctx = {
@@ -91,15 +110,23 @@ static struct {
 static struct conn_state* init_conn_states(int limit)
 {
 	struct conn_state* active_cons = malloc(sizeof(struct conn_state) * limit);
+	srvctx.freelist = malloc(sizeof(int) * limit);
 
-	if (!active_cons)
+	if (!active_cons || !srvctx.freelist){
+		free(active_cons);
+		free(srvctx.freelist);
 		return NULL;
+	}
 
 	memset(active_cons, '\0', sizeof(struct conn_state) * limit);
 
-	for (int i = 0; i < limit; i++){
-		net_setup_cell( &active_cons[i], &srvctx.shmcont, srvctx.pollset );
-		active_cons->slot = i ^ idcookie;
+/* hand out the lowest slots first */
+	srvctx.n_free = 0;
+	for (int i = limit - 1; i >= 0; i--){
+		net_setup_cell( &active_cons[i], &srvctx.shmcont, srvctx.loop );
+		active_cons[i].slot = (i + 1) ^ idcookie;
+		active_cons[i].flushq = &srvctx.flushq;
+		srvctx.freelist[srvctx.n_free++] = i;
 	}
 
 	return active_cons;
@@ -108,12 +135,19 @@ static struct conn_state* init_conn_states(int limit)
 static inline struct conn_state* lookup_connection(struct conn_state*
 	active_cons, int nconns, int id)
 {
-	for (int i = 0; i < nconns; i++){
-		if (active_cons[i].slot == id)
-			return &active_cons[i];
-	}
+	int ind = (id ^ idcookie) - 1;
+	if (id <= 0 || ind < 0 || ind >= nconns || -1 == active_cons[ind].fd)
+		return NULL;
 
-	return NULL;
+	return &active_cons[ind];
+}
+
+static void release_connection(struct conn_state* active_cons,
+	struct conn_state* state)
+{
+	net_close_cell(state);
+	srvctx.freelist[srvctx.n_free++] = state - active_cons;
+	srvctx.n_conn--;
 }
 
 static void authenticate(struct conn_state* active_cons, int nconns, int slot)
@@ -136,64 +170,63 @@ static void disconnect(struct conn_state* active_cons, int nconns, int slot)
 {
 	if (slot == 0){
 		for (int i = 0; i < nconns; i++)
-			if (active_cons[i].connstate > CONN_OFFLINE){
+			if (-1 != active_cons[i].fd){
 				GRAPH_EVENT("Mass Disconnect (%i:%i)\n", i, active_cons[i].slot);
-				apr_socket_close(active_cons[i].inout);
-				apr_pollset_remove(srvctx.pollset, &active_cons[i].poll_state);
-				net_setup_cell( &active_cons[i], &srvctx.shmcont, srvctx.pollset );
+				release_connection(active_cons, &active_cons[i]);
 			}
 	}
 	else {
 		struct conn_state* target_con = lookup_connection(active_cons,
 			nconns, slot);
-		if (target_con && target_con->connstate > CONN_OFFLINE){
+		if (target_con){
 			GRAPH_EVENT("Disconnecting %d\n", slot);
-			apr_socket_close(target_con->inout);
-			apr_pollset_remove(srvctx.pollset, &target_con->poll_state);
-			net_setup_cell( target_con, &srvctx.shmcont, srvctx.pollset );
+			release_connection(active_cons, target_con);
 		}
 		else
 			LOG("Attempt to disconnect bad or already disconnected slot (%d)\n", slot);
 	}
 }
 
+/* the active connection table, needed by the flush failure callback */
+static struct conn_state* srv_cons;
+
+static void client_socket_close(struct conn_state* state)
+{
+	arcan_event rv = {
+		.category = EVENT_NET,
+		.net.kind = EVENT_NET_DISCONNECTED,
+		.net.connid = state->slot
+	};
+	GRAPH_EVENT("close socket on (%d)\n", state->slot);
+
+	release_connection(srv_cons, state);
+	arcan_shmif_enqueue(&srvctx.shmcont, &rv);
+}
+
 static void server_pack_data(struct conn_state* active_cons,
 	int nconns, int id, enum net_tags tag, size_t buf_sz, char* buf)
 {
-	if (id > nconns || id < 0)
-		return;
-
-/* broadcast */
+/* broadcast, each pack only appends to the ring of the connection and
+ * the actual send happens in the flush after the current batch */
 	if (id == 0){
 		GRAPH_EVENT("broadcast (%zu) bytes\n", buf_sz);
 		for(int i = 0; i < nconns; i++)
-			if (active_cons[i].inout){
+			if (-1 != active_cons[i].fd){
 				if (!active_cons[i].pack(&active_cons[i], tag, buf_sz, buf))
-					disconnect(active_cons, nconns, id);
+					client_socket_close(&active_cons[i]);
 			}
 	}
 
 /* unicast */
-	else if (active_cons[id-1].inout){
+	else {
+		struct conn_state* dst = lookup_connection(active_cons, nconns, id);
+		if (!dst)
+			return;
+
 		GRAPH_EVENT("queue (%zu) bytes to slot (%d)\n", buf_sz, id);
-		if (!active_cons[id-1].pack(&active_cons[id-1], tag, buf_sz, buf))
-			disconnect(active_cons, nconns, id);
+		if (!dst->pack(dst, tag, buf_sz, buf))
+			client_socket_close(dst);
 	}
-	else;
-
-	return;
-}
-
-static void client_socket_close(struct conn_state* state)
-{
-	arcan_event rv = {
-		.category = EVENT_NET,
-		.net.kind = EVENT_NET_DISCONNECTED,
-	};
-	GRAPH_EVENT("close socket on (%d)\n", state->slot);
-
-	net_setup_cell( state, &srvctx.shmcont, srvctx.pollset );
-	arcan_shmif_enqueue(&srvctx.shmcont, &rv);
 }
 
 static bool server_process_inevq(struct conn_state* active_cons, int nconns)
@@ -270,62 +303,65 @@ static bool server_process_inevq(struct conn_state* active_cons, int nconns)
 }
 
 
-static void server_accept_connection(int limit, apr_socket_t* ear_sock,
-	apr_pollset_t* pollset, struct conn_state* active_cons)
+static void server_accept_connection(int limit, int ear_fd,
+	struct conn_state* active_cons)
 {
-	apr_socket_t* newsock;
-	if (apr_socket_accept(&newsock, ear_sock, srvctx.mempool) != APR_SUCCESS)
-		return;
-
-/* find an open spot */
-	int j;
-	for (j = 0; j < limit && active_cons[j].inout != NULL; j++);
+	for (size_t i = 0; i < NET_ACCEPT_BATCH; i++){
+		int newfd = net_socket_accept(ear_fd);
+		if (-1 == newfd)
+			return;
 
 /* house full, ignore and move on */
-	if (active_cons[j].inout != NULL){
-		apr_socket_close(newsock);
-		return;
-	}
+		if (0 == srvctx.n_free){
+			close(newfd);
+			continue;
+		}
+
+		int j = srvctx.freelist[--srvctx.n_free];
+		if (!net_open_cell(&active_cons[j], newfd)){
+			close(newfd);
+			srvctx.freelist[srvctx.n_free++] = j;
+			continue;
+		}
+		srvctx.n_conn++;
 
 /* add and setup real callthroughs */
-	active_cons[j].inout     = newsock;
-	active_cons[j].buffer    = net_buffer_basic;
-	active_cons[j].validator = net_validator_tlv;
-	active_cons[j].dispatch  = net_dispatch_tlv;
-	active_cons[j].flushout  = net_flushout_default;
-	active_cons[j].queueout  = net_queueout_default;
-	active_cons[j].pack      = net_pack_basic;
-	active_cons[j].decode    = net_hl_decode;
-	active_cons[j].connstate = CONN_CONNECTED;
-	active_cons[j].pollset   = srvctx.pollset;
-	active_cons[j].connect_stamp = arcan_timemillis();
-
-	apr_pollfd_t* pfd = &active_cons[j].poll_state;
-
-	pfd->desc.s      = newsock;
-	pfd->desc_type   = APR_POLL_SOCKET;
-	pfd->client_data = &active_cons[j];
-	pfd->reqevents   = APR_POLLHUP | APR_POLLERR | APR_POLLIN;
-	pfd->rtnevents   = 0;
-	pfd->p           = srvctx.mempool;
-
-	apr_pollset_add(pollset, pfd);
+		active_cons[j].buffer    = net_buffer_basic;
+		active_cons[j].validator = net_validator_tlv;
+		active_cons[j].dispatch  = net_dispatch_tlv;
+		active_cons[j].flushout  = net_flushout_default;
+		active_cons[j].queueout  = net_queueout_default;
+		active_cons[j].pack      = net_pack_basic;
+		active_cons[j].decode    = net_hl_decode;
+		active_cons[j].connstate = CONN_CONNECTED;
+		active_cons[j].connect_stamp = arcan_timemillis();
+
+/* goes out with the flush after the current batch */
+		net_pack_caps(&active_cons[j]);
 
 /* figure out source address, add to event and fire */
-	apr_sockaddr_t* addr;
-
-	apr_socket_addr_get(&addr, APR_REMOTE, newsock);
-	arcan_event outev = {
-		.category = EVENT_NET,
-		.net.kind = EVENT_NET_CONNECTED,
-		.net.connid = active_cons[j].slot
-	};
-
-	size_t out_sz = sizeof(outev.net.host.addr) /
-		sizeof(outev.net.host.addr[0]);
-	apr_sockaddr_ip_getbuf(outev.net.host.addr, out_sz, addr);
+		arcan_event outev = {
+			.category = EVENT_NET,
+			.net.kind = EVENT_NET_CONNECTED,
+			.net.connid = active_cons[j].slot
+		};
+
+		struct sockaddr_storage addr;
+		socklen_t addr_sz = sizeof(addr);
+		size_t out_sz = sizeof(outev.net.host.addr) /
+			sizeof(outev.net.host.addr[0]);
+
+		if (0 == getpeername(newfd, (struct sockaddr*) &addr, &addr_sz)){
+			if (addr.ss_family == AF_INET)
+				inet_ntop(AF_INET, &((struct sockaddr_in*) &addr)->sin_addr,
+					outev.net.host.addr, out_sz);
+			else if (addr.ss_family == AF_INET6)
+				inet_ntop(AF_INET6, &((struct sockaddr_in6*) &addr)->sin6_addr,
+					outev.net.host.addr, out_sz);
+		}
 
-	arcan_shmif_enqueue(&srvctx.shmcont, &outev);
+		arcan_shmif_enqueue(&srvctx.shmcont, &outev);
+	}
 }
 
 static char* get_redir(char* pk, char* n,
@@ -368,9 +404,10 @@ static void server_gatekeeper_message(apr_socket_t* gk_sock, char* ident)
 
 	char* pubkey, (* name), (* cookie), (* host);
 	int port;
+	uint8_t caps;
 
 	char* unpack = net_unpack_discover(inbuf, true,
-		&pubkey, &name, &cookie, &host, &port);
+		&pubkey, &name, &cookie, &host, &port, &caps);
 
 	if (!unpack)
 		return;
@@ -387,8 +424,8 @@ static void server_gatekeeper_message(apr_socket_t* gk_sock, char* ident)
 	}
 
 	size_t outsz;
-	char* outbuf = net_pack_discover(false,
-		redir_key, ident, cookie, redir_addr, redir_port, &outsz);
+	char* outbuf = net_pack_discover(false, redir_key,
+		ident, cookie, redir_addr, redir_port, net_local_caps, &outsz);
 	free(unpack);
 
 	if (outbuf){
@@ -407,27 +444,23 @@ static apr_socket_t* server_prepare_gatekeeper(char* host)
 
 static void server_session(const char* host, char* ident, int limit)
 {
-	apr_pollset_t* poll_in;
-	apr_int32_t pnum;
-	const apr_pollfd_t* ret_pfd;
 	struct conn_state* active_cons;
+	struct net_ev evs[NET_EVENT_BATCH];
 
 	host = host ? host : APR_ANYADDR;
 
-	active_cons = init_conn_states(limit);
-	if (!active_cons)
-		return;
-
 /* we need 1 for each connection (limit) one for the
  * gatekeeper and finally one for each IP (multihomed) */
-	int timeout = -1;
-
-	if (apr_pollset_create(&poll_in, limit + 4,
-		srvctx.mempool, 0) != APR_SUCCESS){
-			LOG("(net-srv) -- Couldn't create server pollset, giving up.\n");
-			return;
+	srvctx.loop = net_evloop_create(limit + 4);
+	if (!srvctx.loop){
+		LOG("(net-srv) -- Couldn't create server event loop, giving up.\n");
+		return;
 	}
 
+	active_cons = srv_cons = init_conn_states(limit);
+	if (!active_cons)
+		return;
+
 	int sleeptime = 5 * 1000;
 	int retrycount = 10;
 
@@ -450,56 +483,40 @@ retry:
 	LOG("(net-srv) -- listening interface up on %s:%d\n",
 		host ? host : "(global)", srvctx.inport);
 
-	srvctx.pollset = poll_in;
-
-/* the pollset is created noting that we have the responsibility for
- * assuring that the descriptors involved stay in scope, thus pfd needs to
- * be here or dynamically allocated */
-	apr_pollfd_t pfd = {
-		.p      = srvctx.mempool,
-		.desc.s = ear_sock,
-		.desc_type = APR_POLL_SOCKET,
-		.reqevents = APR_POLLIN | APR_POLLHUP | APR_POLLERR,
-		.rtnevents = 0,
-		.client_data = ear_sock
-	}, gkpfd;
-
-	apr_pollfd_t epfd = {
-		.p      = srvctx.mempool,
-		.desc.s = srvctx.evsock,
-		.desc_type = APR_POLL_SOCKET,
-		.reqevents = APR_POLLIN,
-		.rtnevents = 0,
-		.client_data = srvctx.evsock
-	};
+/* APR is only used to setup the listening and discovery sockets, the
+ * data path works on the native descriptors */
+	int ear_fd;
+	apr_os_sock_get(&ear_fd, ear_sock);
+	net_socket_setup(ear_fd, false);
+	net_evloop_add(srvctx.loop, ear_fd, NET_EV_IN, ear_sock);
+	net_evloop_add(srvctx.loop, srvctx.evfd, NET_EV_IN, &srvctx.evfd);
 
 /* should be solved in a pretty per host etc. manner and for
  * that matter, IPv6 */
 	apr_socket_t* gk_sock = server_prepare_gatekeeper("0.0.0.0");
 	if (gk_sock){
+		int gk_fd;
 		LOG("(net-srv) -- gatekeeper listening on broadcast for %s\n",
 			host ? host : "(global)");
-		gkpfd.p = srvctx.mempool;
-		gkpfd.desc.s = gk_sock;
-		gkpfd.rtnevents = 0;
-		gkpfd.reqevents = APR_POLLIN;
-		gkpfd.desc_type = APR_POLL_SOCKET;
-		gkpfd.client_data = gk_sock;
-		apr_pollset_add(poll_in, &gkpfd);
+		apr_os_sock_get(&gk_fd, gk_sock);
+		net_evloop_add(srvctx.loop, gk_fd, NET_EV_IN, gk_sock);
 	}
 
-	apr_pollset_add(poll_in, &epfd);
-	apr_pollset_add(poll_in, &pfd);
-
 	while (true){
-		apr_pollset_poll(poll_in, timeout, &pnum, &ret_pfd);
+		bool pending_accept = false;
+		int nev = net_evloop_wait(srvctx.loop, evs, NET_EVENT_BATCH, -1);
 
-		for (int i = 0; i < pnum; i++){
-			void* cb = ret_pfd[i].client_data;
-			int evs  = ret_pfd[i].rtnevents;
+		if (-1 == nev){
+			LOG("(net-srv) -- broken event loop, giving up.\n");
+			break;
+		}
+
+		for (int i = 0; i < nev; i++){
+			void* cb = evs[i].tag;
+			int evm  = evs[i].mask;
 
 			if (cb == ear_sock){
-				if ((evs & APR_POLLHUP) > 0 || (evs & APR_POLLERR) > 0){
+				if ((evm & NET_EV_ERR) > 0){
 					arcan_event errc = {
 						.category = EVENT_NET,
 						.net.kind = EVENT_NET_BROKEN
@@ -511,8 +528,10 @@ retry:
 					return;
 				}
 
-				server_accept_connection(limit, ret_pfd[i].desc.s,
-					poll_in, active_cons);
+/* deferred until the batch is done, so that a slot released by one event
+ * can't be reused for a new connection that a later (stale) event in the
+ * same batch would then be applied to */
+				pending_accept = true;
 				continue;
 			}
 			else if (cb == gk_sock){
@@ -520,13 +539,12 @@ retry:
 				continue;
 			}
 /* this socket is used for OOB FD transfers and as a pollable semaphore */
-			else if (cb == srvctx.evsock){
+			else if (cb == &srvctx.evfd){
 				char flushb[256];
-				apr_size_t szv = sizeof(flushb);
+				recv(srvctx.evfd, flushb, sizeof(flushb), MSG_DONTWAIT);
 
-				apr_socket_recv(srvctx.evsock, flushb, &szv);
 				if (!server_process_inevq(active_cons, limit))
-					break;
+					goto out;
 
 				continue;
 			}
@@ -537,36 +555,46 @@ retry:
 			bool res = true;
 			struct conn_state* state = cb;
 
-			if ((evs & APR_POLLIN) > 0)
+/* dropped by an earlier event in this batch */
+			if (-1 == state->fd)
+				continue;
+
+			if ((evm & NET_EV_IN) > 0)
 				res = state->buffer(state);
 
 /* will only be triggered intermittently, as event processing *MAY*
- * queue output to one or several connected clients, and until finally
- * flushed, they'd get APR_POLLOUT enabled */
-			if ((evs & APR_POLLOUT) > 0)
+ * queue more output than the socket accepts, and until finally
+ * flushed, they'd get POLLOUT enabled */
+			if (res && (evm & NET_EV_OUT) > 0)
 				res = state->flushout(state);
 
-			if ( !res || (ret_pfd[i].rtnevents & APR_POLLHUP) > 0 ||
-				(ret_pfd[i].rtnevents & APR_POLLERR) > 0){
+			if (!res || (evm & NET_EV_ERR) > 0){
 				LOG("(net-srv) -- (%s), terminating client connection (%d).\n",
-					res ? "HUP/ERR" : "flush failed", i);
-				apr_socket_close(ret_pfd[i].desc.s);
-				client_socket_close(ret_pfd[i].client_data);
-				apr_pollset_remove(poll_in, &ret_pfd[i]);
+					res ? "HUP/ERR" : "buffer/flush failed", state->slot);
+				client_socket_close(state);
 			}
-			;
 		}
 
+/* one sendmsg per connection that got output queued during the batch */
+		net_flush_queued(&srvctx.flushq, client_socket_close);
+
+		if (pending_accept)
+			server_accept_connection(limit, ear_fd, active_cons);
+
 /* Win32 workaround, the approach of using an OS primitive that blends
  * with a pollset is a bit messy in windows as apparently Semaphores
  * didn't work, Winsock is just terrible and the parent process doesn't
  * link / use APR, so we fall back to an aggressive timeout */
 		if (!server_process_inevq(active_cons, limit))
-            break;
-		;
+			break;
+
+		net_flush_queued(&srvctx.flushq, client_socket_close);
 	}
 
-    LOG("(net-srv) -- shutting down server session.\n");
+out:
+	LOG("(net-srv) -- shutting down server session.\n");
+	disconnect(active_cons, limit, 0);
+	net_evloop_destroy(srvctx.loop);
 	apr_socket_close(ear_sock);
 	return;
 }
@@ -582,6 +610,8 @@ static void dump_help()
 		" port    \t number    \t listen on the specified port\n"
 		" limit   \t n_conn    \t limit number of allowed connections\n"
 		" ident   \t name      \t use this human-readable identity\n"
+		" nodelta \t           \t don't use chunk caching for state transfers\n"
+		" nolz    \t           \t don't compress state transfers\n"
 		"---------\t-----------\t----------------\n"
 	);
 }
@@ -600,12 +630,7 @@ int afsrv_netsrv(struct arcan_shmif_cont* con, struct arg_arr* args)
 	apr_pool_create(&srvctx.mempool, NULL);
 
 /* for win32, we transfer the first one in the HANDLE of the shmpage */
-	int sockin_fd = con->epipe;
-	if (apr_os_sock_put(&srvctx.evsock, &sockin_fd,
-		srvctx.mempool) != APR_SUCCESS){
-		LOG("(net) -- Couldn't convert FD socket to APR, giving up.\n");
-		return EXIT_FAILURE;
-	}
+	srvctx.evfd = con->epipe;
 
 /* make ID slot cookies predictable only in debug,
  * to ensure that the parent process doesn't assume these are
@@ -614,11 +639,11 @@ int afsrv_netsrv(struct arcan_shmif_cont* con, struct arg_arr* args)
 	srand(0xfeedface);
 #endif
 
-	idcookie = rand();
+	idcookie = (rand() & 0x7fff) | 0x8000;
 
-	struct arcan_shmif_cont shmcont = *con;
+	srvctx.shmcont = *con;
 
-	if (!arcan_shmif_resize(&shmcont, gwidth, gheight))
+	if (!arcan_shmif_resize(&srvctx.shmcont, gwidth, gheight))
 		return EXIT_FAILURE;
 
 	char* listenhost = NULL;
@@ -629,6 +654,12 @@ int afsrv_netsrv(struct arcan_shmif_cont* con, struct arg_arr* args)
 	arg_lookup(args, "limit", 0, (const char**) &limstr);
 	arg_lookup(args, "ident", 0, (const char**) &identstr);
 
+	if (arg_lookup(args, "nodelta", 0, NULL))
+		net_local_caps &= ~NET_CAP_DELTA;
+
+	if (arg_lookup(args, "nolz", 0, NULL))
+		net_local_caps &= ~NET_CAP_LZ;
+
 	const char* tmpstr;
 	srvctx.inport = 0;
 	if (arg_lookup(args, "port", 0, &tmpstr)){
@@ -639,10 +670,20 @@ int afsrv_netsrv(struct arcan_shmif_cont* con, struct arg_arr* args)
 	if (limstr)
 		limv = strtol(limstr, NULL, 10);
 
-	if (limv <= 0 || limv > DEFAULT_CONNECTION_CAP)
+	if (limv <= 0 || limv > NET_CONNECTION_LIMIT)
 		limv = DEFAULT_CONNECTION_CAP;
 
+/* one descriptor per connection, and some headroom for the listening,
+ * discovery, event and segment transfer descriptors */
+	struct rlimit rl;
+	if (0 == getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < limv + 64){
+		rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY ||
+			rl.rlim_max > limv + 64) ? limv + 64 : rl.rlim_max;
+		if (0 != setrlimit(RLIMIT_NOFILE, &rl))
+			LOG("(net-srv) -- couldn't raise descriptor limit, "
+				"connections will be capped at the current one\n");
+	}
+
 	server_session(listenhost, identstr, limv);
 	return EXIT_SUCCESS;
 }
-
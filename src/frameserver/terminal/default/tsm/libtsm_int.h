@@ -71,12 +71,20 @@ int tsm_utf8_mach_feed(struct tsm_utf8_mach *mach, char c);
 uint32_t tsm_utf8_mach_get(struct tsm_utf8_mach *mach);
 void tsm_utf8_mach_reset(struct tsm_utf8_mach *mach);
 
+/* true if the machine isn't in the middle of a multi-byte sequence */
+bool tsm_utf8_mach_idle(struct tsm_utf8_mach *mach);
+
 /* TSM screen */
 
 void tsm_screen_set_opts(struct tsm_screen *scr, unsigned int opts);
 void tsm_screen_reset_opts(struct tsm_screen *scr, unsigned int opts);
 unsigned int tsm_screen_get_opts(struct tsm_screen *scr);
 
+/* same as tsm_screen_write for each byte of a run of printable ASCII
+ * (0x20..0x7e), without going through the symbol table for the width */
+void tsm_screen_write_ascii(struct tsm_screen *con, const char *str,
+			    size_t len, const struct tsm_screen_attr *attr);
+
 /* available character sets */
 
 typedef tsm_symbol_t tsm_vte_charset[96];
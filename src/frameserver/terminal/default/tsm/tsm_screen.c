@@ -1259,6 +1259,67 @@ void tsm_screen_write(struct tsm_screen *con, tsm_symbol_t ch,
 	move_cursor(con, con->cursor_x + len, con->cursor_y);
 }
 
+/*
+ * Every character is one cell wide, so the wrap / scroll handling only has
+ * to happen at line boundaries and the rest of the line is filled directly.
+ * Insert mode and out of bounds cursors are rare enough to just take the
+ * normal path.
+ */
+void tsm_screen_write_ascii(struct tsm_screen *con, const char *str,
+			    size_t len, const struct tsm_screen_attr *attr)
+{
+	unsigned int last, i, n;
+	struct line *line;
+
+	if (!con || !len)
+		return;
+
+	inc_age(con);
+
+	while (len) {
+		if ((con->flags & TSM_SCREEN_INSERT_MODE) ||
+		    con->cursor_y >= con->size_y) {
+			for (; len; --len)
+				tsm_screen_write(con, tsm_symbol_make(*str++), attr);
+			return;
+		}
+
+		if (con->cursor_y <= con->margin_bottom)
+			last = con->margin_bottom;
+		else
+			last = con->size_y - 1;
+
+		if (con->cursor_x >= con->size_x) {
+			if (con->flags & TSM_SCREEN_AUTO_WRAP)
+				move_cursor(con, 0, con->cursor_y + 1);
+			else
+				move_cursor(con, con->size_x - 1, con->cursor_y);
+		}
+
+		if (con->cursor_y > last) {
+			move_cursor(con, con->cursor_x, last);
+			screen_scroll_up(con, 1);
+		}
+
+		line = con->lines[con->cursor_y];
+		n = con->size_x - con->cursor_x;
+		if (n > len)
+			n = len;
+
+		for (i = 0; i < n; ++i) {
+			struct cell *cell = &line->cells[con->cursor_x + i];
+			cell->age = con->age_cnt;
+			cell->ch = (unsigned char) str[i];
+			cell->width = 1;
+			memcpy(&cell->attr, attr, sizeof(*attr));
+		}
+
+		move_cursor(con, con->cursor_x + n, con->cursor_y);
+		str += n;
+		len -= n;
+	}
+}
+
 SHL_EXPORT
 void tsm_screen_newline(struct tsm_screen *con)
 {
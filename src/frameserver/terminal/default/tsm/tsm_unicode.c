@@ -579,3 +579,13 @@ void tsm_utf8_mach_reset(struct tsm_utf8_mach *mach)
 
 	mach->state = TSM_UTF8_START;
 }
+
+bool tsm_utf8_mach_idle(struct tsm_utf8_mach *mach)
+{
+	if (!mach)
+		return true;
+
+	return mach->state == TSM_UTF8_START ||
+	       mach->state == TSM_UTF8_ACCEPT ||
+	       mach->state == TSM_UTF8_REJECT;
+}
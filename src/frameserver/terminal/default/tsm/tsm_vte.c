@@ -49,6 +49,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "libtsm.h"
 #include "libtsm_int.h"
 #include "shl_llog.h"
@@ -2378,18 +2381,77 @@ static void parse_data(struct tsm_vte *vte, uint32_t raw)
 	llog_warn(vte, "unhandled input %u in state %d", raw, vte->state);
 }
 
+/* length of the run of printable ASCII (0x20..0x7e) at the start of buf */
+static size_t ascii_run(const char *buf, size_t len)
+{
+	const unsigned char *u8 = (const unsigned char *)buf;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+/* signed compares, so the bytes >= 0x80 fail the lower bound as well */
+	const __m128i lo = _mm_set1_epi8(0x1f);
+	const __m128i hi = _mm_set1_epi8(0x7f);
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&u8[i]);
+		__m128i ok = _mm_and_si128(
+			_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+		unsigned int mask = ~_mm_movemask_epi8(ok) & 0xffff;
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+
+	for (; i < len; ++i)
+		if (u8[i] < 0x20 || u8[i] > 0x7e)
+			break;
+
+	return i;
+}
+
+/*
+ * Plain text in the ground state would just be printed one character at a
+ * time through parse_data, so hand the whole run to the screen at once. The
+ * default G0 set maps printable ASCII to itself, other sets and pending
+ * single shifts take the normal path.
+ */
+static size_t print_run(struct tsm_vte *vte, const char *u8, size_t len)
+{
+	if (vte->state != STATE_GROUND || vte->glt ||
+	    *vte->gl != &tsm_vte_unicode_lower)
+		return 0;
+
+	if (!(vte->flags & (FLAG_7BIT_MODE | FLAG_8BIT_MODE)) &&
+	    !tsm_utf8_mach_idle(vte->mach))
+		return 0;
+
+	len = ascii_run(u8, len);
+	if (len) {
+		to_rgb(vte, &vte->cattr);
+		tsm_screen_write_ascii(vte->con, u8, len, &vte->cattr);
+	}
+
+	return len;
+}
+
 SHL_EXPORT
 void tsm_vte_input(struct tsm_vte *vte, const char *u8, size_t len)
 {
 	int state;
 	uint32_t ucs4;
-	size_t i;
+	size_t i, run;
 
 	if (!vte || !vte->con)
 		return;
 
 	++vte->parse_cnt;
 	for (i = 0; i < len; ++i) {
+		if ((unsigned char)u8[i] >= 0x20 && (unsigned char)u8[i] < 0x7f &&
+		    (run = print_run(vte, &u8[i], len - i))) {
+			i += run - 1;
+			continue;
+		}
+
 		if (vte->flags & FLAG_7BIT_MODE) {
 			if (u8[i] & 0x80)
 				llog_debug(vte, "receiving 8bit character U+%d from pty while in 7bit mode",
@@ -14,6 +14,7 @@
 
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/signal.h>
@@ -101,6 +102,61 @@ static int draw_cb(struct tsm_screen* screen, uint32_t id,
 	return 0;
 }
 
+static int bench_cb(struct tsm_screen* screen, uint32_t id,
+	const uint32_t* ch, size_t len, unsigned w, unsigned x, unsigned y,
+	const struct tsm_screen_attr* attr, tsm_age_t age, void* data)
+{
+	return 0;
+}
+
+/*
+ * tsmdebug file: throughput of the parser and screen, like cat:ing the file
+ * into the terminal. The file is fed in pty- sized chunks, the screen is
+ * drawn every 64k to keep scrollback and ageing in the loop.
+ */
+static int bench(const char* fn)
+{
+	int fd = open(fn, O_RDONLY);
+	struct stat fs;
+	if (-1 == fd || -1 == fstat(fd, &fs) || !fs.st_size){
+		printf("couldn't open %s\n", fn);
+		return EXIT_FAILURE;
+	}
+
+	char* buf = malloc(fs.st_size);
+	size_t len = 0;
+	while (buf && len < fs.st_size){
+		ssize_t nr = read(fd, &buf[len], fs.st_size - len);
+		if (nr <= 0)
+			break;
+		len += nr;
+	}
+	close(fd);
+
+	if (!len){
+		printf("couldn't read %s\n", fn);
+		return EXIT_FAILURE;
+	}
+
+	tsm_screen_resize(term.screen, 80, 25);
+
+	struct timeval start, stop;
+	gettimeofday(&start, NULL);
+	for (size_t ofs = 0; ofs < len; ofs += 4096){
+		tsm_vte_input(term.vte, &buf[ofs], len - ofs > 4096 ? 4096 : len - ofs);
+		if (!(ofs % 65536))
+			tsm_screen_draw(term.screen, bench_cb, NULL);
+	}
+	tsm_screen_draw(term.screen, bench_cb, NULL);
+	gettimeofday(&stop, NULL);
+
+	double s = (stop.tv_sec - start.tv_sec) +
+		(double)(stop.tv_usec - start.tv_usec) / 1000000.0;
+	printf("%zu bytes, %.3f s, %.2f MB/s\n", len, s, (double)len / s / 1000000.0);
+	free(buf);
+	return EXIT_SUCCESS;
+}
+
 int main(int argc, char** argv)
 {
 	const char* val;
@@ -118,6 +174,9 @@ int main(int argc, char** argv)
 
 	tsm_screen_set_max_sb(term.screen, 1000);
 
+	if (argc > 1)
+		return bench(argv[1]);
+
 	setlocale(LC_CTYPE, "C");
 	signal(SIGHUP, SIG_IGN);
 
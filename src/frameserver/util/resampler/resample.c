@@ -96,8 +96,192 @@ static void speex_free (void *ptr) {free(ptr);}
 #define NULL 0
 #endif
 
-#ifdef _USE_SSE
+/*
+ * Inner product kernels, picked at runtime (see select_kernels) and used
+ * through the OVERRIDE_ hooks in the resampler_basic_ functions. The scalar
+ * versions are the reference loops from those functions. Filter lengths are
+ * always a multiple of 4.
+ */
+#ifndef FIXED_POINT
+#include <string.h>
+
+struct resample_kernels {
+   const char *name;
+   float (*inner_single)(const float *a, const float *b, unsigned int len);
+   double (*inner_double)(const float *a, const float *b, unsigned int len);
+   float (*interp_single)(const float *a, const float *b, unsigned int len,
+      const spx_uint32_t oversample, float *frac);
+   double (*interp_double)(const float *a, const float *b, unsigned int len,
+      const spx_uint32_t oversample, float *frac);
+
+/* stereo pair sharing the filter taps, out[0] and out[1] */
+   void (*inner_single2)(const float *a, const float *b0, const float *b1,
+      unsigned int len, float *out);
+   void (*interp_single2)(const float *a0, const float *a1, const float *b,
+      unsigned int len, const spx_uint32_t oversample, float *frac, float *out);
+};
+
+static float inner_product_single_c(const float *a, const float *b, unsigned int len)
+{
+   unsigned int j;
+   float sum = 0;
+   for(j=0;j<len;j++) sum += a[j]*b[j];
+   return sum;
+}
+
+static void inner_product_single2_c(const float *a, const float *b0, const float *b1, unsigned int len, float *out)
+{
+   unsigned int j;
+   float s0 = 0, s1 = 0;
+   for(j=0;j<len;j++) {
+      s0 += a[j]*b0[j];
+      s1 += a[j]*b1[j];
+   }
+   out[0] = s0;
+   out[1] = s1;
+}
+
+static double inner_product_double_c(const float *a, const float *b, unsigned int len)
+{
+   unsigned int j;
+   double accum[4] = {0,0,0,0};
+   for(j=0;j<len;j+=4) {
+      accum[0] += a[j]*b[j];
+      accum[1] += a[j+1]*b[j+1];
+      accum[2] += a[j+2]*b[j+2];
+      accum[3] += a[j+3]*b[j+3];
+   }
+   return accum[0] + accum[1] + accum[2] + accum[3];
+}
+
+static float interpolate_product_single_c(const float *a, const float *b, unsigned int len, const spx_uint32_t oversample, float *frac)
+{
+   unsigned int j;
+   float accum[4] = {0,0,0,0};
+   for(j=0;j<len;j++) {
+      const float curr_in = a[j];
+      accum[0] += curr_in*b[j*oversample];
+      accum[1] += curr_in*b[j*oversample+1];
+      accum[2] += curr_in*b[j*oversample+2];
+      accum[3] += curr_in*b[j*oversample+3];
+   }
+   return frac[0]*accum[0] + frac[1]*accum[1] + frac[2]*accum[2] + frac[3]*accum[3];
+}
+
+static void interpolate_product_single2_c(const float *a0, const float *a1, const float *b, unsigned int len, const spx_uint32_t oversample, float *frac, float *out)
+{
+   out[0] = interpolate_product_single_c(a0, b, len, oversample, frac);
+   out[1] = interpolate_product_single_c(a1, b, len, oversample, frac);
+}
+
+static double interpolate_product_double_c(const float *a, const float *b, unsigned int len, const spx_uint32_t oversample, float *frac)
+{
+   unsigned int j;
+   double accum[4] = {0,0,0,0};
+   for(j=0;j<len;j++) {
+      const float curr_in = a[j];
+      accum[0] += curr_in*b[j*oversample];
+      accum[1] += curr_in*b[j*oversample+1];
+      accum[2] += curr_in*b[j*oversample+2];
+      accum[3] += curr_in*b[j*oversample+3];
+   }
+   return frac[0]*accum[0] + frac[1]*accum[1] + frac[2]*accum[2] + frac[3]*accum[3];
+}
+
+static const struct resample_kernels kernels_c = {
+   .name = "scalar",
+   .inner_single = inner_product_single_c,
+   .inner_double = inner_product_double_c,
+   .interp_single = interpolate_product_single_c,
+   .interp_double = interpolate_product_double_c,
+   .inner_single2 = inner_product_single2_c,
+   .interp_single2 = interpolate_product_single2_c
+};
+
+#if !defined(RESAMPLER_NO_SIMD) && (defined(__x86_64__) || \
+   (defined(__i386__) && defined(__SSE2__)))
 #include "resample_sse.h"
+static const struct resample_kernels kernels_sse2 = {
+   .name = "sse2",
+   .inner_single = inner_product_single_sse2,
+   .inner_double = inner_product_double_sse2,
+   .interp_single = interpolate_product_single_sse2,
+   .interp_double = interpolate_product_double_sse2,
+   .inner_single2 = inner_product_single2_sse2,
+   .interp_single2 = interpolate_product_single2_sse2
+};
+#ifdef RESAMPLER_HAVE_AVX2
+static const struct resample_kernels kernels_avx2 = {
+   .name = "avx2",
+   .inner_single = inner_product_single_avx2,
+   .inner_double = inner_product_double_sse2,
+   .interp_single = interpolate_product_single_avx2,
+   .interp_double = interpolate_product_double_sse2,
+   .inner_single2 = inner_product_single2_avx2,
+   .interp_single2 = interpolate_product_single2_avx2
+};
+#endif
+#define RESAMPLER_HAVE_SSE2
+
+#elif !defined(RESAMPLER_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include "resample_neon.h"
+static const struct resample_kernels kernels_neon = {
+   .name = "neon",
+   .inner_single = inner_product_single_neon,
+   .inner_double = inner_product_double_c,
+   .interp_single = interpolate_product_single_neon,
+   .interp_double = interpolate_product_double_c,
+   .inner_single2 = inner_product_single2_neon,
+   .interp_single2 = interpolate_product_single2_neon
+};
+#define RESAMPLER_HAVE_NEON
+#endif
+
+/*
+ * Pick the best kernel set for the running CPU. RESAMPLER_KERNEL in the
+ * environment (scalar, sse2, avx2, neon) forces a specific set when it is
+ * supported, mainly for benchmarking and verification.
+ */
+static const struct resample_kernels *select_kernels(void)
+{
+   const struct resample_kernels *best = &kernels_c;
+   const struct resample_kernels *avail[4] = {&kernels_c};
+   int n = 1;
+
+#ifdef RESAMPLER_HAVE_SSE2
+   best = avail[n++] = &kernels_sse2;
+#ifdef RESAMPLER_HAVE_AVX2
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      best = avail[n++] = &kernels_avx2;
+#endif
+#endif
+#ifdef RESAMPLER_HAVE_NEON
+   best = avail[n++] = &kernels_neon;
+#endif
+
+   const char *force = getenv("RESAMPLER_KERNEL");
+   if (force)
+   {
+      int i;
+      for (i=0;i<n;i++)
+         if (strcmp(avail[i]->name, force) == 0)
+            return avail[i];
+   }
+
+   return best;
+}
+
+#define OVERRIDE_INNER_PRODUCT_SINGLE
+#define OVERRIDE_INNER_PRODUCT_DOUBLE
+#define OVERRIDE_INTERPOLATE_PRODUCT_SINGLE
+#define OVERRIDE_INTERPOLATE_PRODUCT_DOUBLE
+#define inner_product_single(a, b, n) st->kern->inner_single(a, b, n)
+#define inner_product_double(a, b, n) st->kern->inner_double(a, b, n)
+#define interpolate_product_single(a, b, n, o, f) \
+   st->kern->interp_single(a, b, n, o, f)
+#define interpolate_product_double(a, b, n, o, f) \
+   st->kern->interp_double(a, b, n, o, f)
 #endif
 
 /* Numer of elements to allocate on the stack */
@@ -109,6 +293,9 @@ static void speex_free (void *ptr) {free(ptr);}
 
 typedef int (*resampler_basic_func)(SpeexResamplerState *, spx_uint32_t , const spx_word16_t *, spx_uint32_t *, spx_word16_t *, spx_uint32_t *);
 
+/* processes channel 0 and 1 together into interleaved output */
+typedef int (*resampler_stereo_func)(SpeexResamplerState *, const spx_word16_t *, const spx_word16_t *, spx_uint32_t *, spx_word16_t *, spx_uint32_t *);
+
 struct SpeexResamplerState_ {
    spx_uint32_t in_rate;
    spx_uint32_t out_rate;
@@ -136,6 +323,10 @@ struct SpeexResamplerState_ {
    spx_word16_t *sinc_table;
    spx_uint32_t sinc_table_length;
    resampler_basic_func resampler_ptr;
+   resampler_stereo_func resampler2_ptr;
+#ifndef FIXED_POINT
+   const struct resample_kernels *kern;
+#endif
 
    int    in_stride;
    int    out_stride;
@@ -338,7 +529,9 @@ static int resampler_basic_direct_single(SpeexResamplerState *st, spx_uint32_t c
    const int frac_advance = st->frac_advance;
    const spx_uint32_t den_rate = st->den_rate;
    spx_word32_t sum;
+#ifndef OVERRIDE_INNER_PRODUCT_SINGLE
    int j;
+#endif
 
    while (!(last_sample >= (spx_int32_t)*in_len || out_sample >= (spx_int32_t)*out_len))
    {
@@ -395,7 +588,9 @@ static int resampler_basic_direct_double(SpeexResamplerState *st, spx_uint32_t c
    const int frac_advance = st->frac_advance;
    const spx_uint32_t den_rate = st->den_rate;
    double sum;
+#ifndef OVERRIDE_INNER_PRODUCT_DOUBLE
    int j;
+#endif
 
    while (!(last_sample >= (spx_int32_t)*in_len || out_sample >= (spx_int32_t)*out_len))
    {
@@ -442,7 +637,9 @@ static int resampler_basic_interpolate_single(SpeexResamplerState *st, spx_uint3
    const int int_advance = st->int_advance;
    const int frac_advance = st->frac_advance;
    const spx_uint32_t den_rate = st->den_rate;
+#ifndef OVERRIDE_INTERPOLATE_PRODUCT_SINGLE
    int j;
+#endif
    spx_word32_t sum;
 
    while (!(last_sample >= (spx_int32_t)*in_len || out_sample >= (spx_int32_t)*out_len))
@@ -504,7 +701,9 @@ static int resampler_basic_interpolate_double(SpeexResamplerState *st, spx_uint3
    const int int_advance = st->int_advance;
    const int frac_advance = st->frac_advance;
    const spx_uint32_t den_rate = st->den_rate;
+#ifndef OVERRIDE_INTERPOLATE_PRODUCT_DOUBLE
    int j;
+#endif
    spx_word32_t sum;
 
    while (!(last_sample >= (spx_int32_t)*in_len || out_sample >= (spx_int32_t)*out_len))
@@ -554,12 +753,86 @@ static int resampler_basic_interpolate_double(SpeexResamplerState *st, spx_uint3
 }
 #endif
 
+#ifndef FIXED_POINT
+/*
+ * Stereo versions of the single precision resamplers. Both channels share
+ * last_sample / samp_frac_num (the caller checks that they are in sync) so
+ * the filter phase, table lookup and interpolation coefficients are worked
+ * out once per output frame and the taps are loaded once for both channels.
+ * Output is written interleaved.
+ */
+static int resampler_basic_direct_single2(SpeexResamplerState *st, const spx_word16_t *in0, const spx_word16_t *in1, spx_uint32_t *in_len, spx_word16_t *out, spx_uint32_t *out_len)
+{
+   const int N = st->filt_len;
+   int out_sample = 0;
+   int last_sample = st->last_sample[0];
+   spx_uint32_t samp_frac_num = st->samp_frac_num[0];
+   const spx_word16_t *sinc_table = st->sinc_table;
+   const int int_advance = st->int_advance;
+   const int frac_advance = st->frac_advance;
+   const spx_uint32_t den_rate = st->den_rate;
+
+   while (!(last_sample >= (spx_int32_t)*in_len || out_sample >= (spx_int32_t)*out_len))
+   {
+      const spx_word16_t *sinc = & sinc_table[samp_frac_num*N];
+      st->kern->inner_single2(sinc, &in0[last_sample], &in1[last_sample], N, &out[2 * out_sample++]);
+
+      last_sample += int_advance;
+      samp_frac_num += frac_advance;
+      if (samp_frac_num >= den_rate)
+      {
+         samp_frac_num -= den_rate;
+         last_sample++;
+      }
+   }
+
+   st->last_sample[0] = st->last_sample[1] = last_sample;
+   st->samp_frac_num[0] = st->samp_frac_num[1] = samp_frac_num;
+   return out_sample;
+}
+
+static int resampler_basic_interpolate_single2(SpeexResamplerState *st, const spx_word16_t *in0, const spx_word16_t *in1, spx_uint32_t *in_len, spx_word16_t *out, spx_uint32_t *out_len)
+{
+   const int N = st->filt_len;
+   int out_sample = 0;
+   int last_sample = st->last_sample[0];
+   spx_uint32_t samp_frac_num = st->samp_frac_num[0];
+   const int int_advance = st->int_advance;
+   const int frac_advance = st->frac_advance;
+   const spx_uint32_t den_rate = st->den_rate;
+
+   while (!(last_sample >= (spx_int32_t)*in_len || out_sample >= (spx_int32_t)*out_len))
+   {
+      const int offset = samp_frac_num*st->oversample/st->den_rate;
+      const spx_word16_t frac = ((float)((samp_frac_num*st->oversample) % st->den_rate))/st->den_rate;
+      spx_word16_t interp[4];
+
+      cubic_coef(frac, interp);
+      st->kern->interp_single2(&in0[last_sample], &in1[last_sample],
+         st->sinc_table + st->oversample + 4 - offset - 2, N, st->oversample, interp, &out[2 * out_sample++]);
+
+      last_sample += int_advance;
+      samp_frac_num += frac_advance;
+      if (samp_frac_num >= den_rate)
+      {
+         samp_frac_num -= den_rate;
+         last_sample++;
+      }
+   }
+
+   st->last_sample[0] = st->last_sample[1] = last_sample;
+   st->samp_frac_num[0] = st->samp_frac_num[1] = samp_frac_num;
+   return out_sample;
+}
+#endif
+
 static void update_filter(SpeexResamplerState *st)
 {
    spx_uint32_t old_length;
 
    old_length = st->filt_len;
    st->oversample = quality_map[st->quality].oversample;
+   st->resampler2_ptr = NULL;
    st->filt_len = quality_map[st->quality].base_length;
 
    if (st->num_rate > st->den_rate)
@@ -609,8 +882,10 @@ static void update_filter(SpeexResamplerState *st)
 #else
       if (st->quality>8)
          st->resampler_ptr = resampler_basic_direct_double;
-      else
+      else {
          st->resampler_ptr = resampler_basic_direct_single;
+         st->resampler2_ptr = resampler_basic_direct_single2;
+      }
 #endif
       /*fprintf (stderr, "resampler uses direct sinc table and normalised cutoff %f\n", cutoff);*/
    } else {
@@ -629,8 +904,10 @@ static void update_filter(SpeexResamplerState *st)
 #else
       if (st->quality>8)
          st->resampler_ptr = resampler_basic_interpolate_double;
-      else
+      else {
          st->resampler_ptr = resampler_basic_interpolate_single;
+         st->resampler2_ptr = resampler_basic_interpolate_single2;
+      }
 #endif
       /*fprintf (stderr, "resampler uses interpolated sinc table and normalised cutoff %f\n", cutoff);*/
    }
@@ -750,6 +1027,10 @@ EXPORT SpeexResamplerState *speex_resampler_init_frac(spx_uint32_t nb_channels,
    st->filt_len = 0;
    st->mem = 0;
    st->resampler_ptr = 0;
+   st->resampler2_ptr = 0;
+#ifndef FIXED_POINT
+   st->kern = select_kernels();
+#endif
 
    st->cutoff = 1.f;
    st->nb_channels = nb_channels;
@@ -957,11 +1238,96 @@ EXPORT int speex_resampler_process_int(SpeexResamplerState *st, spx_uint32_t cha
    return RESAMPLER_ERR_SUCCESS;
 }
 
+/*
+ * Interleaved stereo through resampler2_ptr, same chunking and filter
+ * memory handling as process_native / process_int but both channels per
+ * pass. Only valid when the channel states are in sync (stereo_ready).
+ */
+static int stereo_ready(SpeexResamplerState *st)
+{
+   return st->resampler2_ptr && st->nb_channels == 2 &&
+      !st->magic_samples[0] && !st->magic_samples[1] &&
+      st->last_sample[0] == st->last_sample[1] &&
+      st->samp_frac_num[0] == st->samp_frac_num[1];
+}
+
+static void process_stereo(SpeexResamplerState *st, const float *fin, const spx_int16_t *iin, spx_uint32_t *in_len, float *fout, spx_int16_t *iout, spx_uint32_t *out_len)
+{
+   int j;
+   const int N = st->filt_len;
+   spx_uint32_t ilen = *in_len;
+   spx_uint32_t olen = *out_len;
+   spx_word16_t *x0 = st->mem;
+   spx_word16_t *x1 = st->mem + st->mem_alloc_size;
+   const spx_uint32_t xlen = st->mem_alloc_size - (N - 1);
+   spx_word16_t ystack[2 * FIXED_STACK_ALLOC];
+
+   st->started = 1;
+
+   while (ilen && olen) {
+     spx_uint32_t ichunk = (ilen > xlen) ? xlen : ilen;
+     spx_uint32_t ochunk = (olen > FIXED_STACK_ALLOC) ? FIXED_STACK_ALLOC : olen;
+     spx_word16_t *y = fout ? fout : ystack;
+
+     if (fin) {
+       for (j=0;j<ichunk;++j) {
+         x0[j+N-1] = fin[2*j];
+         x1[j+N-1] = fin[2*j+1];
+       }
+     } else if (iin) {
+       for (j=0;j<ichunk;++j) {
+         x0[j+N-1] = iin[2*j];
+         x1[j+N-1] = iin[2*j+1];
+       }
+     } else {
+       for (j=0;j<ichunk;++j)
+         x0[j+N-1] = x1[j+N-1] = 0;
+     }
+
+     ochunk = st->resampler2_ptr(st, x0, x1, &ichunk, y, &ochunk);
+
+     if (st->last_sample[0] < (spx_int32_t)ichunk)
+       ichunk = st->last_sample[0];
+     st->last_sample[0] -= ichunk;
+     st->last_sample[1] = st->last_sample[0];
+
+     for (j=0;j<N-1;++j) {
+       x0[j] = x0[j+ichunk];
+       x1[j] = x1[j+ichunk];
+     }
+
+     if (fout)
+       fout += 2 * ochunk;
+     else {
+       for (j=0;j<2*ochunk;++j)
+         iout[j] = WORD2INT(ystack[j]);
+       iout += 2 * ochunk;
+     }
+
+     ilen -= ichunk;
+     olen -= ochunk;
+     if (fin)
+       fin += 2 * ichunk;
+     else if (iin)
+       iin += 2 * ichunk;
+   }
+
+   *in_len -= ilen;
+   *out_len -= olen;
+}
+
 EXPORT int speex_resampler_process_interleaved_float(SpeexResamplerState *st, const float *in, spx_uint32_t *in_len, float *out, spx_uint32_t *out_len)
 {
    spx_uint32_t i;
    int istride_save, ostride_save;
    spx_uint32_t bak_len = *out_len;
+#ifndef FIXED_POINT
+   if (stereo_ready(st))
+   {
+      process_stereo(st, in, NULL, in_len, out, NULL, out_len);
+      return RESAMPLER_ERR_SUCCESS;
+   }
+#endif
    istride_save = st->in_stride;
    ostride_save = st->out_stride;
    st->in_stride = st->out_stride = st->nb_channels;
@@ -983,6 +1349,13 @@ EXPORT int speex_resampler_process_interleaved_int(SpeexResamplerState *st, cons
    spx_uint32_t i;
    int istride_save, ostride_save;
    spx_uint32_t bak_len = *out_len;
+#ifndef FIXED_POINT
+   if (stereo_ready(st))
+   {
+      process_stereo(st, NULL, in, in_len, NULL, out, out_len);
+      return RESAMPLER_ERR_SUCCESS;
+   }
+#endif
    istride_save = st->in_stride;
    ostride_save = st->out_stride;
    st->in_stride = st->out_stride = st->nb_channels;
@@ -1118,6 +1491,15 @@ EXPORT int speex_resampler_reset_mem(SpeexResamplerState *st)
    return RESAMPLER_ERR_SUCCESS;
 }
 
+EXPORT const char *speex_resampler_get_kernel(SpeexResamplerState *st)
+{
+#ifdef FIXED_POINT
+   return "fixed";
+#else
+   return st->kern->name;
+#endif
+}
+
 EXPORT const char *speex_resampler_strerror(int err)
 {
    switch (err)
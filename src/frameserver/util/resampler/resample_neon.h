@@ -0,0 +1,98 @@
+/* Copyright (C) 2007-2008 Jean-Marc Valin
+ * Copyright (C) 2008 Thorvald Natvig
+ */
+/**
+   @file resample_neon.h
+   @brief Resampler functions (NEON version)
+*/
+/*
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of the Xiph.org Foundation nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * NEON kernels, only built when the compiler targets NEON (always on
+ * AArch64, -mfpu=neon on 32-bit ARM) so there is no runtime probe. Same
+ * contract as the SSE2 versions in resample_sse.h.
+ */
+
+#include <arm_neon.h>
+
+static inline float hsum_ps_neon(float32x4_t v)
+{
+   float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+   return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+
+static float inner_product_single_neon(const float *a, const float *b, unsigned int len)
+{
+   unsigned int i;
+   float32x4_t sum = vdupq_n_f32(0);
+   for (i=0;i<len;i+=4)
+      sum = vmlaq_f32(sum, vld1q_f32(a+i), vld1q_f32(b+i));
+   return hsum_ps_neon(sum);
+}
+
+static void inner_product_single2_neon(const float *a, const float *b0, const float *b1, unsigned int len, float *out)
+{
+   unsigned int i;
+   float32x4_t s0 = vdupq_n_f32(0);
+   float32x4_t s1 = vdupq_n_f32(0);
+   for (i=0;i<len;i+=4)
+   {
+      float32x4_t t = vld1q_f32(a+i);
+      s0 = vmlaq_f32(s0, t, vld1q_f32(b0+i));
+      s1 = vmlaq_f32(s1, t, vld1q_f32(b1+i));
+   }
+   out[0] = hsum_ps_neon(s0);
+   out[1] = hsum_ps_neon(s1);
+}
+
+static float interpolate_product_single_neon(const float *a, const float *b, unsigned int len, const spx_uint32_t oversample, float *frac)
+{
+   unsigned int i;
+   float32x4_t sum = vdupq_n_f32(0);
+   for (i=0;i<len;i++)
+      sum = vmlaq_n_f32(sum, vld1q_f32(b+i*oversample), a[i]);
+   return hsum_ps_neon(vmulq_f32(vld1q_f32(frac), sum));
+}
+
+static void interpolate_product_single2_neon(const float *a0, const float *a1, const float *b, unsigned int len, const spx_uint32_t oversample, float *frac, float *out)
+{
+   unsigned int i;
+   float32x4_t s0 = vdupq_n_f32(0);
+   float32x4_t s1 = vdupq_n_f32(0);
+   for (i=0;i<len;i++)
+   {
+      float32x4_t t = vld1q_f32(b+i*oversample);
+      s0 = vmlaq_n_f32(s0, t, a0[i]);
+      s1 = vmlaq_n_f32(s1, t, a1[i]);
+   }
+   float32x4_t f = vld1q_f32(frac);
+   out[0] = hsum_ps_neon(vmulq_f32(f, s0));
+   out[1] = hsum_ps_neon(vmulq_f32(f, s1));
+}
@@ -0,0 +1,224 @@
+/* Copyright (C) 2007-2008 Jean-Marc Valin
+ * Copyright (C) 2008 Thorvald Natvig
+ */
+/**
+   @file resample_sse.h
+   @brief Resampler functions (SSE2 / AVX2 version)
+*/
+/*
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of the Xiph.org Foundation nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Kernels follow the resample_kernels table in resample.c. SSE2 is part of
+ * the x86-64 baseline, the AVX2/FMA versions are compiled with per-function
+ * target attributes and only picked when the CPU reports support, so the
+ * file itself does not need any -m flags. Filter lengths are always a
+ * multiple of 4 (update_filter rounds down), the 8-wide AVX loops finish
+ * with one 4-wide step.
+ *
+ * The two-channel (*2) versions walk the same filter taps for a stereo pair
+ * in one pass and use the exact same accumulation order as their mono
+ * counterparts, so the stereo fast path is bit-identical to per-channel.
+ */
+
+#include <emmintrin.h>
+
+static inline float hsum_ps_sse(__m128 v)
+{
+   __m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+   s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+   return _mm_cvtss_f32(s);
+}
+
+static float inner_product_single_sse2(const float *a, const float *b, unsigned int len)
+{
+   unsigned int i;
+   __m128 sum = _mm_setzero_ps();
+   for (i=0;i<len;i+=4)
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+   return hsum_ps_sse(sum);
+}
+
+static void inner_product_single2_sse2(const float *a, const float *b0, const float *b1, unsigned int len, float *out)
+{
+   unsigned int i;
+   __m128 s0 = _mm_setzero_ps();
+   __m128 s1 = _mm_setzero_ps();
+   for (i=0;i<len;i+=4)
+   {
+      __m128 t = _mm_loadu_ps(a+i);
+      s0 = _mm_add_ps(s0, _mm_mul_ps(t, _mm_loadu_ps(b0+i)));
+      s1 = _mm_add_ps(s1, _mm_mul_ps(t, _mm_loadu_ps(b1+i)));
+   }
+   out[0] = hsum_ps_sse(s0);
+   out[1] = hsum_ps_sse(s1);
+}
+
+static float interpolate_product_single_sse2(const float *a, const float *b, unsigned int len, const spx_uint32_t oversample, float *frac)
+{
+   unsigned int i;
+   __m128 sum = _mm_setzero_ps();
+   for (i=0;i<len;i++)
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load1_ps(a+i), _mm_loadu_ps(b+i*oversample)));
+   return hsum_ps_sse(_mm_mul_ps(_mm_loadu_ps(frac), sum));
+}
+
+static void interpolate_product_single2_sse2(const float *a0, const float *a1, const float *b, unsigned int len, const spx_uint32_t oversample, float *frac, float *out)
+{
+   unsigned int i;
+   __m128 s0 = _mm_setzero_ps();
+   __m128 s1 = _mm_setzero_ps();
+   for (i=0;i<len;i++)
+   {
+      __m128 t = _mm_loadu_ps(b+i*oversample);
+      s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_load1_ps(a0+i), t));
+      s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_load1_ps(a1+i), t));
+   }
+   __m128 f = _mm_loadu_ps(frac);
+   out[0] = hsum_ps_sse(_mm_mul_ps(f, s0));
+   out[1] = hsum_ps_sse(_mm_mul_ps(f, s1));
+}
+
+static double inner_product_double_sse2(const float *a, const float *b, unsigned int len)
+{
+   unsigned int i;
+   __m128d sum = _mm_setzero_pd();
+   for (i=0;i<len;i+=4)
+   {
+      __m128 t = _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i));
+      sum = _mm_add_pd(sum, _mm_cvtps_pd(t));
+      sum = _mm_add_pd(sum, _mm_cvtps_pd(_mm_movehl_ps(t, t)));
+   }
+   sum = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+   return _mm_cvtsd_f64(sum);
+}
+
+static double interpolate_product_double_sse2(const float *a, const float *b, unsigned int len, const spx_uint32_t oversample, float *frac)
+{
+   unsigned int i;
+   __m128d sum1 = _mm_setzero_pd();
+   __m128d sum2 = _mm_setzero_pd();
+   for (i=0;i<len;i++)
+   {
+      __m128 t = _mm_mul_ps(_mm_load1_ps(a+i), _mm_loadu_ps(b+i*oversample));
+      sum1 = _mm_add_pd(sum1, _mm_cvtps_pd(t));
+      sum2 = _mm_add_pd(sum2, _mm_cvtps_pd(_mm_movehl_ps(t, t)));
+   }
+   __m128 f = _mm_loadu_ps(frac);
+   sum1 = _mm_mul_pd(_mm_cvtps_pd(f), sum1);
+   sum2 = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(f, f)), sum2);
+   sum1 = _mm_add_pd(sum1, sum2);
+   sum1 = _mm_add_sd(sum1, _mm_unpackhi_pd(sum1, sum1));
+   return _mm_cvtsd_f64(sum1);
+}
+
+#if defined(__GNUC__) && !defined(RESAMPLER_NO_AVX2)
+#include <immintrin.h>
+#define RESAMPLER_HAVE_AVX2
+#define AVX2_FN __attribute__((target("avx2,fma")))
+
+AVX2_FN static inline __m128 fold_ps_avx(__m256 v)
+{
+   return _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+}
+
+AVX2_FN static float inner_product_single_avx2(const float *a, const float *b, unsigned int len)
+{
+   unsigned int i;
+   __m256 sum = _mm256_setzero_ps();
+   for (i=0;i+8<=len;i+=8)
+      sum = _mm256_fmadd_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i), sum);
+   __m128 s = fold_ps_avx(sum);
+   if (i < len)
+      s = _mm_fmadd_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i), s);
+   return hsum_ps_sse(s);
+}
+
+AVX2_FN static void inner_product_single2_avx2(const float *a, const float *b0, const float *b1, unsigned int len, float *out)
+{
+   unsigned int i;
+   __m256 s0 = _mm256_setzero_ps();
+   __m256 s1 = _mm256_setzero_ps();
+   for (i=0;i+8<=len;i+=8)
+   {
+      __m256 t = _mm256_loadu_ps(a+i);
+      s0 = _mm256_fmadd_ps(t, _mm256_loadu_ps(b0+i), s0);
+      s1 = _mm256_fmadd_ps(t, _mm256_loadu_ps(b1+i), s1);
+   }
+   __m128 r0 = fold_ps_avx(s0);
+   __m128 r1 = fold_ps_avx(s1);
+   if (i < len)
+   {
+      __m128 t = _mm_loadu_ps(a+i);
+      r0 = _mm_fmadd_ps(t, _mm_loadu_ps(b0+i), r0);
+      r1 = _mm_fmadd_ps(t, _mm_loadu_ps(b1+i), r1);
+   }
+   out[0] = hsum_ps_sse(r0);
+   out[1] = hsum_ps_sse(r1);
+}
+
+/* two taps per iteration, lane half 0 takes tap i and half 1 tap i+1 */
+AVX2_FN static float interpolate_product_single_avx2(const float *a, const float *b, unsigned int len, const spx_uint32_t oversample, float *frac)
+{
+   unsigned int i;
+   __m256 sum = _mm256_setzero_ps();
+   for (i=0;i<len;i+=2)
+   {
+      __m256 t = _mm256_insertf128_ps(_mm256_castps128_ps256(
+         _mm_loadu_ps(b+i*oversample)), _mm_loadu_ps(b+(i+1)*oversample), 1);
+      __m256 c = _mm256_insertf128_ps(_mm256_castps128_ps256(
+         _mm_load1_ps(a+i)), _mm_load1_ps(a+i+1), 1);
+      sum = _mm256_fmadd_ps(c, t, sum);
+   }
+   return hsum_ps_sse(_mm_mul_ps(_mm_loadu_ps(frac), fold_ps_avx(sum)));
+}
+
+AVX2_FN static void interpolate_product_single2_avx2(const float *a0, const float *a1, const float *b, unsigned int len, const spx_uint32_t oversample, float *frac, float *out)
+{
+   unsigned int i;
+   __m256 s0 = _mm256_setzero_ps();
+   __m256 s1 = _mm256_setzero_ps();
+   for (i=0;i<len;i+=2)
+   {
+      __m256 t = _mm256_insertf128_ps(_mm256_castps128_ps256(
+         _mm_loadu_ps(b+i*oversample)), _mm_loadu_ps(b+(i+1)*oversample), 1);
+      __m256 c0 = _mm256_insertf128_ps(_mm256_castps128_ps256(
+         _mm_load1_ps(a0+i)), _mm_load1_ps(a0+i+1), 1);
+      __m256 c1 = _mm256_insertf128_ps(_mm256_castps128_ps256(
+         _mm_load1_ps(a1+i)), _mm_load1_ps(a1+i+1), 1);
+      s0 = _mm256_fmadd_ps(c0, t, s0);
+      s1 = _mm256_fmadd_ps(c1, t, s1);
+   }
+   __m128 f = _mm_loadu_ps(frac);
+   out[0] = hsum_ps_sse(_mm_mul_ps(f, fold_ps_avx(s0)));
+   out[1] = hsum_ps_sse(_mm_mul_ps(f, fold_ps_avx(s1)));
+}
+
+#undef AVX2_FN
+#endif
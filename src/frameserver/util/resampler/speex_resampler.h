@@ -79,6 +79,7 @@
 #define speex_resampler_skip_zeros CAT_PREFIX(RANDOM_PREFIX,_resampler_skip_zeros)
 #define speex_resampler_reset_mem CAT_PREFIX(RANDOM_PREFIX,_resampler_reset_mem)
 #define speex_resampler_strerror CAT_PREFIX(RANDOM_PREFIX,_resampler_strerror)
+#define speex_resampler_get_kernel CAT_PREFIX(RANDOM_PREFIX,_resampler_get_kernel)
 
 #define spx_int16_t short
 #define spx_int32_t int
@@ -340,6 +341,12 @@ int speex_resampler_reset_mem(SpeexResamplerState *st);
  */
 const char *speex_resampler_strerror(int err);
 
+/** Returns the name of the inner product kernel set picked for this CPU
+ * (scalar, sse2, avx2 or neon).
+ * @param st Resampler state
+ */
+const char *speex_resampler_get_kernel(SpeexResamplerState *st);
+
 #ifdef __cplusplus
 }
 #endif
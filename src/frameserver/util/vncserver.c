@@ -161,10 +161,23 @@ void vnc_serv_run(struct arg_arr* args, struct arcan_shmif_cont cont)
 			continue;
 
 		switch(ev.tgt.kind){
-		case TARGET_COMMAND_STEPFRAME:
+/* the event loop thread reads frameBuffer, so move it off the pool before
+ * it is replaced, the old mapping lingers for any update already in flight */
+		case TARGET_COMMAND_MULTICAST:
+			vncctx.server->frameBuffer = (char*) vncctx.shmcont.vidp;
+			arcan_shmif_multicast(&vncctx.shmcont, &ev);
+		break;
+
+/* multicast frames are picked up in place, the slot is only reused
+ * after the other slots in the pool have had their turn */
+		case TARGET_COMMAND_STEPFRAME:{
 			while (!vncctx.shmcont.addr->vready){
 			}
+			shmif_pixel* vframe = arcan_shmif_multicast(&vncctx.shmcont, &ev);
+			if (vframe)
+				vncctx.server->frameBuffer = (char*) vframe;
 			vnc_serv_deltaupd();
+		}
 		break;
 
 		case TARGET_COMMAND_EXIT:
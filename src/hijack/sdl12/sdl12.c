@@ -21,6 +21,10 @@
 #include <signal.h>
 #include <arcan_shmif.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifdef ENABLE_OPENGL
 #define AGP_ENABLE_UNPURE 1
 #include "video_platform.h"
@@ -70,9 +74,22 @@ static struct {
 	SDL_Surface* mainsrfc;
 	SDL_PixelFormat desfmt;
 
+/* when the display surface matches the shmpage, its pixels are redirected
+ * to vidp and the original buffer / flags are kept here for restoring */
+	bool proxied, proxy_prealloc;
+	void* proxy_pixels;
+
+/* accumulated damage since the last synch, x2/y2 are exclusive */
+	bool damaged;
+	struct arcan_shmif_region damage;
+	shmif_pixel palette[256];
+
 #ifdef ENABLE_OPENGL
 	struct agp_rendertarget* rtgt;
 	struct storage_info_t vstore;
+
+/* set when the server or the local EGL setup rejected buffer passing */
+	bool nopass;
 #endif
 
 /* specialized hack for vector graphics, a better approach would be to implement
@@ -184,6 +201,10 @@ SDL_GrabMode ARCAN_SDL_WM_GrabInput(SDL_GrabMode mode)
 	return requested_mode;
 }
 
+static void proxy_attach(SDL_Surface* src);
+static void proxy_detach();
+static bool proxy_suspend();
+
 void ARCAN_target_shmsize(int w, int h, int bpp)
 {
 	trace("ARCAN_target_shmsize(%d, %d, %d)\n", w, h, bpp);
@@ -195,11 +216,14 @@ void ARCAN_target_shmsize(int w, int h, int bpp)
 	global.sourcew = w;
 	global.sourceh = h;
 
+/* the 2D path works against a single buffer, as the proxy surface and the
+ * rect- updates both rely on vidp keeping the previous frame contents */
+	bool proxied = proxy_suspend();
 	if (!	arcan_shmif_resize_ext( &(global.shared), w, h,
 		(struct shmif_resize_ext){
 			.abuf_sz = global.source_abuf_sz,
 			.abuf_cnt = 65536 / global.source_abuf_sz,
-			.vbuf_cnt = 2,
+			.vbuf_cnt = global.glsource ? 2 : 1,
 			.samplerate = global.source_rate
 	}))
 		exit(EXIT_FAILURE);
@@ -209,6 +233,9 @@ void ARCAN_target_shmsize(int w, int h, int bpp)
 	shmif_pixel* vidp = global.shared.vidp;
 	for (int i = 0; i < w * h; i++)
 		*vidp++ = px;
+
+	if (proxied)
+		proxy_attach(global.mainsrfc);
 }
 
 int ARCAN_SDL_OpenAudio(SDL_AudioSpec *desired, SDL_AudioSpec *obtained)
@@ -231,7 +258,8 @@ int ARCAN_SDL_OpenAudio(SDL_AudioSpec *desired, SDL_AudioSpec *obtained)
 	global.source_abuf_sz = obtained->size;
 	global.source_rate = obtained->freq;
 
-	if (global.shared.vidp)
+	if (global.shared.vidp){
+		bool proxied = proxy_suspend();
 		arcan_shmif_resize_ext( &(global.shared),
 			global.shared.w, global.shared.h,
 			(struct shmif_resize_ext){
@@ -241,6 +269,9 @@ int ARCAN_SDL_OpenAudio(SDL_AudioSpec *desired, SDL_AudioSpec *obtained)
 				.vbuf_cnt = -1
 			}
 		);
+		if (proxied)
+			proxy_attach(global.mainsrfc);
+	}
 	return rc;
 }
 
@@ -348,6 +379,79 @@ static int make_current(void* this)
 	return 0;
 }
 
+static void readback_synch()
+{
+	struct storage_info_t store = global.vstore;
+	store.vinf.text.raw = global.shared.vidp;
+	agp_activate_rendertarget(NULL);
+	agp_readback_synchronous(&store);
+	agp_activate_rendertarget(global.rtgt);
+	arcan_shmif_signal(&global.shared, SHMIF_SIGVID);
+}
+
+/*
+ * Present the oldest queued readback if the GPU is done with it, results that
+ * no longer match the segment (resize in between) are just dropped.
+ */
+static void readback_present()
+{
+	struct asynch_readback_meta rb = agp_poll_readback(&global.vstore);
+	if (!rb.ptr)
+		return;
+
+	bool match = rb.w == global.shared.w && rb.h == global.shared.h;
+	if (match){
+		if (global.shared.pitch == rb.w)
+			memcpy(global.shared.vidp, rb.ptr, rb.w * rb.h * sizeof(shmif_pixel));
+		else
+			for (size_t y = 0; y < rb.h; y++)
+				memcpy(&global.shared.vidp[y * global.shared.pitch],
+					&rb.ptr[y * rb.w], rb.w * sizeof(shmif_pixel));
+	}
+
+	rb.release(rb.tag);
+	if (match)
+		arcan_shmif_signal(&global.shared, SHMIF_SIGVID);
+}
+
+/*
+ * Queue a readback of the current frame into the PBO ring and present the
+ * oldest one, so in the steady state swap N delivers frame N-2 and the game
+ * never waits for its own frame to reach the host. Only when the whole ring
+ * is still in flight do we wait for the GPU.
+ */
+static void readback_asynch()
+{
+	if (agp_request_readback(&global.vstore)){
+		readback_present();
+		return;
+	}
+
+/* no asynchronous readback in this AGP, fall back to the old behavior */
+	if (!agp_readback_pending(&global.vstore)){
+		readback_synch();
+		return;
+	}
+
+	glFinish();
+	readback_present();
+	agp_request_readback(&global.vstore);
+}
+
+/* queued frames are older than anything we would pass, discard them */
+static void readback_drain()
+{
+	if (!agp_readback_pending(&global.vstore))
+		return;
+
+	glFinish();
+	while (agp_readback_pending(&global.vstore)){
+		struct asynch_readback_meta rb = agp_poll_readback(&global.vstore);
+		if (rb.ptr)
+			rb.release(rb.tag);
+	}
+}
+
 static void swap_buffers(void* this)
 {
 	trace("glSwapBuffers");
@@ -357,16 +461,18 @@ static void swap_buffers(void* this)
   if (!arcan_shmifext_egl_meta(&global.shared, &display, NULL, NULL))
 		return;
 
-	if (arcan_shmifext_eglsignal(&global.shared, display,
-		SHMIF_SIGVID, global.vstore.vinf.text.glid) >= 0)
-		return;
+	if (!global.nopass){
+		readback_drain();
+		if (arcan_shmifext_eglsignal(&global.shared, display,
+			SHMIF_SIGVID, global.vstore.vinf.text.glid) >= 0)
+			return;
 
-	struct storage_info_t store = global.vstore;
-	store.vinf.text.raw = global.shared.vidp;
-	agp_activate_rendertarget(NULL);
-	agp_readback_synchronous(&store);
+/* local failure (no export, no matching image format), won't get better
+ * until we are given another device */
+		global.nopass = true;
+	}
 
-	arcan_shmif_signal(&global.shared, SHMIF_SIGVID);
+	readback_asynch();
 }
 
 struct sysvideo {
@@ -458,6 +564,8 @@ SDL_Surface* ARCAN_SDL_SetVideoMode(int w, int h, int ncps, Uint32 flags)
 	}
 #endif
 nogl:
+/* SDL may free or reuse the old display surface buffer */
+	proxy_detach();
 	res = forwardtbl.sdl_setvideomode(w, h, ncps, flags);
 	global.doublebuffered = ((flags & SDL_DOUBLEBUF) > 0);
 
@@ -471,6 +579,8 @@ nogl:
 		ARCAN_target_shmsize(w, h, 4);
 
 	global.mainsrfc = res;
+	if (res)
+		proxy_attach(res);
 
 	if (forwardtbl.sdl_iconify)
 		forwardtbl.sdl_iconify();
@@ -575,6 +685,15 @@ void process_targetevent(unsigned kind, arcan_tgtevent* ev)
 				global.point_size = ev->ioevs[0].fv;
 			}
 		break;
+#ifdef ENABLE_OPENGL
+/* switch between buffer passing and readback on the next swap */
+		case TARGET_COMMAND_BUFFER_FAIL:
+			global.nopass = true;
+		break;
+		case TARGET_COMMAND_DEVICE_NODE:
+			global.nopass = false;
+		break;
+#endif
 		case TARGET_COMMAND_EXIT:
 /* FIXME: this should be done way more gracefully */
 			exit(0);
@@ -652,28 +771,271 @@ static bool cmpfmt(SDL_PixelFormat* a, SDL_PixelFormat* b){
 	a->Bmask == b->Bmask);
 }
 
-static void copysurface(SDL_Surface* src){
-	trace("CopySurface(noGL)\n");
-	if (src->w != global.sourcew || src->h != global.sourceh)
+/*
+ * Redirect the pixels of the display surface to the shmpage, possible when
+ * the formats match and the rows line up, then drawing into the surface is
+ * drawing into the segment and a synch is just a signal. SDL_PREALLOC is set
+ * so that SDL won't try to free vidp in the case of a shadow surface.
+ */
+static void proxy_attach(SDL_Surface* src)
+{
+	if (global.glsource || global.proxied || !global.shared.vidp ||
+		!src->pixels || (src->flags & SDL_HWSURFACE) ||
+		!cmpfmt(src->format, &PixelFormat_RGBA888) ||
+		src->w != global.shared.w || src->h != global.shared.h ||
+		src->pitch != global.shared.stride)
+		return;
+
+	trace("ProxySurface(%d, %d)\n", src->w, src->h);
+	memcpy(global.shared.vidp, src->pixels, src->h * src->pitch);
+	global.proxy_pixels = src->pixels;
+	global.proxy_prealloc = (src->flags & SDL_PREALLOC) > 0;
+	src->pixels = global.shared.vidp;
+	src->flags |= SDL_PREALLOC;
+	global.proxied = true;
+}
+
+static void proxy_detach()
+{
+	if (!global.proxied)
+		return;
+
+	global.mainsrfc->pixels = global.proxy_pixels;
+	if (!global.proxy_prealloc)
+		global.mainsrfc->flags &= ~SDL_PREALLOC;
+	global.proxied = false;
+}
+
+/*
+ * A resize can move the segment and with it vidp, so hand the display surface
+ * its own buffer back (with the current contents) until the resize is done.
+ * Returns true if the caller should proxy_attach afterwards.
+ */
+static bool proxy_suspend()
+{
+	if (!global.proxied)
+		return false;
+
+	memcpy(global.proxy_pixels, global.shared.vidp,
+		global.mainsrfc->h * global.mainsrfc->pitch);
+	proxy_detach();
+	return true;
+}
+
+static void add_damage(SDL_Surface* dst, int x, int y, int w, int h)
+{
+	int x2 = clamp(x + w, 0, dst->w);
+	int y2 = clamp(y + h, 0, dst->h);
+	x = clamp(x, 0, dst->w);
+	y = clamp(y, 0, dst->h);
+	if (x2 <= x || y2 <= y)
+		return;
+
+	if (!global.damaged){
+		global.damage = (struct arcan_shmif_region){
+			.x1 = x, .y1 = y, .x2 = x2, .y2 = y2};
+		global.damaged = true;
+		return;
+	}
+
+	if (x < global.damage.x1) global.damage.x1 = x;
+	if (y < global.damage.y1) global.damage.y1 = y;
+	if (x2 > global.damage.x2) global.damage.x2 = x2;
+	if (y2 > global.damage.y2) global.damage.y2 = y2;
+}
+
+/*
+ * Row converters for when the display surface can't be proxied, these write
+ * straight into vidp so there is no intermediate surface. The common formats
+ * for SDL1.2 software surfaces (XRGB8888, RGB565, 8-bit palette) have their
+ * own paths, everything else goes through the masks.
+ */
+typedef void (*row_fn)(const uint8_t*, shmif_pixel*, size_t, SDL_PixelFormat*);
+
+static void row_rgba(const uint8_t* src,
+	shmif_pixel* dst, size_t n, SDL_PixelFormat* fmt)
+{
+	memcpy(dst, src, n * sizeof(shmif_pixel));
+}
+
+static void row_xrgb(const uint8_t* src,
+	shmif_pixel* dst, size_t n, SDL_PixelFormat* fmt)
+{
+	const uint32_t* in = (const uint32_t*) src;
+	uint32_t alpha = fmt->Amask ? 0 : 0xff000000;
+	size_t i = 0;
+
+#ifdef __SSE2__
+	__m128i ag = _mm_set1_epi32((int) 0xff00ff00);
+	__m128i rb = _mm_set1_epi32(0x00ff00ff);
+	__m128i am = _mm_set1_epi32((int) alpha);
+	for (; i + 4 <= n; i += 4){
+		__m128i px = _mm_loadu_si128((const __m128i*) &in[i]);
+		__m128i sw = _mm_and_si128(px, rb);
+		sw = _mm_or_si128(_mm_srli_epi32(sw, 16), _mm_slli_epi32(sw, 16));
+		px = _mm_or_si128(_mm_and_si128(px, ag), sw);
+		_mm_storeu_si128((__m128i*) &dst[i], _mm_or_si128(px, am));
+	}
+#endif
+
+	for (; i < n; i++){
+		uint32_t px = in[i];
+		dst[i] = (px & 0xff00ff00) |
+			((px >> 16) & 0xff) | ((px & 0xff) << 16) | alpha;
+	}
+}
+
+static void row_565(const uint8_t* src,
+	shmif_pixel* dst, size_t n, SDL_PixelFormat* fmt)
+{
+	const uint16_t* in = (const uint16_t*) src;
+	size_t i = 0;
+
+/* expand to 8 bits in 16-bit lanes, pack as RG and BA pairs and interleave */
+#ifdef __SSE2__
+	__m128i m5 = _mm_set1_epi16(0x1f);
+	__m128i m6 = _mm_set1_epi16(0x3f);
+	__m128i am = _mm_set1_epi16((short) 0xff00);
+	for (; i + 8 <= n; i += 8){
+		__m128i px = _mm_loadu_si128((const __m128i*) &in[i]);
+		__m128i r = _mm_srli_epi16(px, 11);
+		__m128i g = _mm_and_si128(_mm_srli_epi16(px, 5), m6);
+		__m128i b = _mm_and_si128(px, m5);
+		r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+		g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+		b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+		__m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+		__m128i ba = _mm_or_si128(b, am);
+		_mm_storeu_si128((__m128i*) &dst[i], _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i*) &dst[i+4], _mm_unpackhi_epi16(rg, ba));
+	}
+#endif
+
+	for (; i < n; i++){
+		uint8_t r = in[i] >> 11;
+		uint8_t g = (in[i] >> 5) & 0x3f;
+		uint8_t b = in[i] & 0x1f;
+		dst[i] = SHMIF_RGBA(
+			(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 0xff);
+	}
+}
+
+static void row_pal8(const uint8_t* src,
+	shmif_pixel* dst, size_t n, SDL_PixelFormat* fmt)
+{
+	for (size_t i = 0; i < n; i++)
+		dst[i] = global.palette[src[i]];
+}
+
+static void row_generic(const uint8_t* src,
+	shmif_pixel* dst, size_t n, SDL_PixelFormat* fmt)
+{
+	size_t bpp = fmt->BytesPerPixel;
+
+	for (size_t i = 0; i < n; i++, src += bpp){
+		uint32_t px;
+		switch (bpp){
+		case 2: px = *(const uint16_t*) src; break;
+		case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+			px = (src[0] << 16) | (src[1] << 8) | src[2];
+#else
+			px = src[0] | (src[1] << 8) | (src[2] << 16);
+#endif
+		break;
+		case 4: px = *(const uint32_t*) src; break;
+		default: px = *src; break;
+		}
+
+		dst[i] = SHMIF_RGBA(
+			((px & fmt->Rmask) >> fmt->Rshift) << fmt->Rloss,
+			((px & fmt->Gmask) >> fmt->Gshift) << fmt->Gloss,
+			((px & fmt->Bmask) >> fmt->Bshift) << fmt->Bloss,
+			fmt->Amask ? ((px & fmt->Amask) >> fmt->Ashift) << fmt->Aloss : 0xff
+		);
+	}
+}
+
+static row_fn pick_row(SDL_PixelFormat* fmt)
+{
+/* palette can change between frames, but it is cheap enough to rebuild */
+	if (fmt->BytesPerPixel == 1 && fmt->palette){
+		int nc = fmt->palette->ncolors > 256 ? 256 : fmt->palette->ncolors;
+		for (int i = 0; i < nc; i++){
+			SDL_Color* col = &fmt->palette->colors[i];
+			global.palette[i] = SHMIF_RGBA(col->r, col->g, col->b, 0xff);
+		}
+		return row_pal8;
+	}
+
+	if (cmpfmt(fmt, &PixelFormat_RGBA888))
+		return row_rgba;
+
+	if (fmt->BytesPerPixel == 4 && fmt->Rmask == 0x00ff0000 &&
+		fmt->Gmask == 0x0000ff00 && fmt->Bmask == 0x000000ff &&
+		(fmt->Amask == 0 || fmt->Amask == 0xff000000))
+		return row_xrgb;
+
+	if (fmt->BytesPerPixel == 2 && fmt->Rmask == 0xf800 &&
+		fmt->Gmask == 0x07e0 && fmt->Bmask == 0x001f)
+		return row_565;
+
+	return row_generic;
+}
+
+/*
+ * Push the accumulated damage, for a proxied surface the contents are already
+ * in place, otherwise only the damaged rows are converted. The server is told
+ * about the region so that it only needs to upload that part.
+ */
+static void synch_surface(SDL_Surface* src)
+{
+	trace("SynchSurface(noGL)\n");
+
+/* the segment was moved behind our back (migration), the old contents are
+ * gone with the old mapping so just follow it and redraw everything */
+	if (global.proxied && global.mainsrfc->pixels != global.shared.vidp){
+		global.mainsrfc->pixels = global.shared.vidp;
+		add_damage(global.mainsrfc, 0, 0,
+			global.mainsrfc->w, global.mainsrfc->h);
+	}
+	if (src->w != global.sourcew || src->h != global.sourceh){
 		ARCAN_target_shmsize(src->w, src->h, 4);
+		add_damage(src, 0, 0, src->w, src->h);
+	}
+
+	if (!global.damaged)
+		return;
 
-	if (cmpfmt(src->format, &PixelFormat_RGBA888)){
+	struct arcan_shmif_region r = global.damage;
+	global.damaged = false;
+	if (r.x2 > global.shared.w)
+		r.x2 = global.shared.w;
+	if (r.y2 > global.shared.h)
+		r.y2 = global.shared.h;
+	if (r.x2 <= r.x1 || r.y2 <= r.y1)
+		return;
+
+	if (!global.proxied || src != global.mainsrfc){
+		row_fn row = pick_row(src->format);
 		SDL_LockSurface(src);
-		memcpy(global.shared.vidp,
-			src->pixels, src->w * src->h * sizeof(int32_t));
+		const uint8_t* in = (const uint8_t*) src->pixels +
+			r.y1 * src->pitch + r.x1 * src->format->BytesPerPixel;
+		shmif_pixel* out = global.shared.vidp +
+			r.y1 * global.shared.pitch + r.x1;
+
+		for (size_t y = r.y1; y < r.y2; y++){
+			row(in, out, r.x2 - r.x1, src->format);
+			in += src->pitch;
+			out += global.shared.pitch;
+		}
 		SDL_UnlockSurface(src);
 	}
-	else {
-		SDL_Surface* surf = SDL_ConvertSurface(src,
-			&PixelFormat_RGBA888, SDL_SWSURFACE);
-		SDL_LockSurface(surf);
-		memcpy(global.shared.vidp,
-			surf->pixels, surf->w * surf->h * sizeof(int32_t));
-		SDL_UnlockSurface(surf);
-		SDL_FreeSurface(surf);
-	}
 
-	global.shared.addr->hints = SHMIF_RHINT_ORIGO_UL;
+	bool full = r.x1 == 0 && r.y1 == 0 &&
+		r.x2 == global.shared.w && r.y2 == global.shared.h;
+	global.shared.hints = full ? SHMIF_RHINT_ORIGO_UL : SHMIF_RHINT_SUBREGION;
+	global.shared.dirty = r;
 	arcan_shmif_signal(&global.shared, SHMIF_SIGVID);
 }
 
@@ -692,10 +1054,11 @@ static void copysurface(SDL_Surface* src){
  * (b) give up and just emit a page every 'n' ticks
  * (c) catch the flip
  *
- * there's possibly a slightly more cool hack, for surfaces that match
- * the shmpage in pixformat, create a proxy SDL_Surface object, replace
- * the low-level buffer object with a pointer to our shmpage, align ->ready
- * to flips (otherwise the app has the possiblity of tearing anyhow so...)
+ * for surfaces that match the shmpage in pixformat, the display surface is
+ * a proxy: the low-level buffer is replaced with a pointer to our shmpage and
+ * the signal is aligned to the flip / update (otherwise the app has the
+ * possiblity of tearing anyhow so...). Other formats are converted, but only
+ * for the rects that were actually updated.
  * -- There's also the SDL_malloc and look for requests that match their
  * w * h * bpp dimensions, and return pointers to locally managed ones ...
  * lots to play with if anyone is interested.
@@ -704,7 +1067,8 @@ static void copysurface(SDL_Surface* src){
  * PollEvent is likely the more "natural" place */
 int ARCAN_SDL_Flip(SDL_Surface* screen)
 {
-	copysurface(screen);
+	add_damage(screen, 0, 0, screen->w, screen->h);
+	synch_surface(screen);
 	return 0;
 }
 
@@ -712,26 +1076,41 @@ void ARCAN_SDL_UpdateRect(SDL_Surface* screen,
 	Sint32 x, Sint32 y, Uint32 w, Uint32 h){
 	forwardtbl.sdl_updaterect(screen, x, y, w, h);
 
-	if (!global.doublebuffered && screen == global.mainsrfc)
-		copysurface(screen);
+	if (!global.doublebuffered && screen == global.mainsrfc){
+/* all zeroes is SDL shorthand for the entire screen */
+		if (x == 0 && y == 0 && w == 0 && h == 0)
+			add_damage(screen, 0, 0, screen->w, screen->h);
+		else
+			add_damage(screen, x, y, w, h);
+		synch_surface(screen);
+	}
 }
 
 void ARCAN_SDL_UpdateRects(SDL_Surface* screen, int numrects, SDL_Rect* rects){
 	forwardtbl.sdl_updaterects(screen, numrects, rects);
 
 	if (!global.doublebuffered &&
-		screen == global.mainsrfc)
-			copysurface(screen);
+		screen == global.mainsrfc){
+			for (int i = 0; i < numrects; i++)
+				add_damage(screen, rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+			synch_surface(screen);
+	}
 }
 
-/* this is the actual SDL1.2 call most blit functions resolve to */
+/* this is the actual SDL1.2 call most blit functions resolve to,
+ * dstrect is updated with the final clipped rectangle on success */
 int ARCAN_SDL_UpperBlit(SDL_Surface* src, const SDL_Rect* srcrect,
 	SDL_Surface *dst, SDL_Rect *dstrect){
 	int rv = forwardtbl.sdl_upperblit(src, srcrect, dst, dstrect);
 
 	if (!global.doublebuffered &&
-		dst == global.mainsrfc)
-			copysurface(dst);
+		dst == global.mainsrfc && rv == 0){
+			if (dstrect)
+				add_damage(dst, dstrect->x, dstrect->y, dstrect->w, dstrect->h);
+			else
+				add_damage(dst, 0, 0, dst->w, dst->h);
+			synch_surface(dst);
+	}
 
 	return rv;
 }
@@ -147,6 +147,8 @@ void agp_readback_synchronous(struct storage_info_t* dst)
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+static void pbo_ring_free(struct agp_pbo_ring* ring);
+
 void agp_drop_vstore(struct storage_info_t* s)
 {
 	if (!s)
@@ -161,108 +163,260 @@ void agp_drop_vstore(struct storage_info_t* s)
 	if (GL_NONE != s->vinf.text.wid)
 		glDeleteBuffers(1, &s->vinf.text.wid);
 
+	pbo_ring_free(s->vinf.text.upload);
+	s->vinf.text.upload = NULL;
+
+	pbo_ring_free(s->vinf.text.readback);
+	s->vinf.text.readback = NULL;
+
 	if (s->vinf.text.tag)
 		platform_video_map_handle(s, -1);
 }
 
-static void pbo_stream(struct storage_info_t* s,
-	av_pixel* buf, struct stream_meta* meta, bool synch)
-{
-	agp_activate_vstore(s);
-	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s->vinf.text.wid);
-	size_t ntc = s->w * s->h;
+/*
+ * Streaming uploads go through a small ring of unpack PBOs per vstore so
+ * that writing the next frame never has to wait for the previous transfer
+ * to complete. Each slot is fenced after its glTexSubImage2D, and a slot
+ * that is still busy when we come around to it again gets orphaned (new
+ * storage from the driver) rather than waited on. Without sync objects or
+ * glMapBufferRange (plain GL2.1 drivers), every map is preceded by an orphan
+ * which gives the same non-blocking behavior at the cost of driver-side
+ * allocations.
+ */
+#ifndef AGP_PBO_RING
+#define AGP_PBO_RING 3
+#endif
 
-	av_pixel* ptr = glMapBuffer(GL_PIXEL_UNPACK_BUFFER,GL_WRITE_ONLY);
+struct agp_pbo_ring {
+	GLuint id[AGP_PBO_RING];
+#ifdef AGP_OPTIONAL_SYNC
+	GLsync fence[AGP_PBO_RING];
+#endif
+	size_t sz;
 
-	if (!ptr)
+/* upload: last used slot,
+ * readback: FIFO of [count] pending slots starting at [ind] */
+	uint8_t ind;
+	uint8_t count;
+	unsigned long long ts[AGP_PBO_RING];
+};
+
+static void pbo_ring_free(struct agp_pbo_ring* ring)
+{
+	if (!ring)
 		return;
 
-	av_pixel* obuf = buf;
+	glDeleteBuffers(AGP_PBO_RING, ring->id);
+#ifdef AGP_OPTIONAL_SYNC
+	for (size_t i = 0; i < AGP_PBO_RING; i++)
+		if (ring->fence[i])
+			glDeleteSync(ring->fence[i]);
+#endif
+	arcan_mem_free(ring);
+}
 
-/* note, explicitly replace with a simd unaligned version */
- 	if ( ((uintptr_t)ptr % 16) == 0 && ((uintptr_t)buf % 16) == 0	)
-		memcpy(ptr, buf, ntc * sizeof(av_pixel));
-	else
-		for (size_t i = 0; i < ntc; i++)
-			*ptr++ = *buf++;
+static struct agp_pbo_ring* pbo_ring_alloc(GLenum target, size_t sz, GLenum use)
+{
+	struct agp_pbo_ring* ring = arcan_alloc_mem(sizeof(struct agp_pbo_ring),
+		ARCAN_MEM_VSTRUCT, ARCAN_MEM_BZERO, ARCAN_MEMALIGN_NATURAL);
+
+	ring->sz = sz;
+	glGenBuffers(AGP_PBO_RING, ring->id);
+	for (size_t i = 0; i < AGP_PBO_RING; i++){
+		glBindBuffer(target, ring->id[i]);
+		glBufferData(target, sz, NULL, use);
+	}
+	glBindBuffer(target, 0);
 
-/* synch :- on-host backing store, one extra copy into local buffer */
-	if (synch){
-		buf = obuf;
-		ptr = s->vinf.text.raw;
-		s->update_ts = arcan_timemillis();
+	return ring;
+}
 
- 		if ( ((uintptr_t)ptr % 16) == 0 && ((uintptr_t)buf % 16) == 0	)
-			memcpy(ptr, buf, ntc * sizeof(av_pixel));
-		else
-			for (size_t i = 0; i < ntc; i++)
-				*ptr++ = *buf++;
+#ifdef AGP_OPTIONAL_SYNC
+/*
+ * The sync and ranged map symbols can resolve even when the context can't
+ * use them (2.1 context on a newer driver), so also require the version or
+ * the extension. Checked once, 0 = unknown, -1 = no, 1 = yes.
+ */
+static int sync_state, maprange_state;
+
+static bool gl_version(int req_major, int req_minor)
+{
+	int major = 0, minor = 0;
+	const char* ver = (const char*) glGetString(GL_VERSION);
+	if (!ver || sscanf(ver, "%d.%d", &major, &minor) != 2)
+		return false;
+
+	return major > req_major || (major == req_major && minor >= req_minor);
+}
+
+static bool gl_extension(const char* name)
+{
+	const char* ext = (const char*) glGetString(GL_EXTENSIONS);
+	size_t len = strlen(name);
+
+	while (ext && (ext = strstr(ext, name))){
+		if (ext[len] == ' ' || ext[len] == '\0')
+			return true;
+		ext += len;
 	}
 
-	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	return false;
+}
 
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, s->w, s->h,
-			GL_PIXEL_FORMAT, GL_UNSIGNED_BYTE, 0);
+static bool sync_supported()
+{
+	if (!sync_state)
+		sync_state = glFenceSync && glClientWaitSync && glDeleteSync &&
+			(gl_version(3, 2) || gl_extension("GL_ARB_sync")) ? 1 : -1;
 
-	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-	agp_deactivate_vstore();
+	return sync_state > 0;
 }
 
-/* positions and offsets in meta have been verified in _frameserver */
-static void pbo_stream_sub(struct storage_info_t* s,
-	av_pixel* buf, struct stream_meta* meta, bool synch)
+static bool maprange_supported()
 {
-	if ( (float)(meta->w * meta->h) / (s->w * s->h) > 0.5)
-		return pbo_stream(s, buf, meta, synch);
+	if (!maprange_state)
+		maprange_state = glMapBufferRange &&
+			(gl_version(3, 0) || gl_extension("GL_ARB_map_buffer_range")) ? 1 : -1;
 
-	agp_activate_vstore(s);
-	size_t row_sz = meta->w * sizeof(av_pixel);
-	set_pixel_store(s->w, *meta);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, meta->x1, meta->y1, meta->w, meta->h,
-		GL_PIXEL_FORMAT, GL_UNSIGNED_BYTE, buf);
-	reset_pixel_store();
-	agp_deactivate_vstore(s);
-
-	if (synch){
-		av_pixel* cpy = s->vinf.text.raw;
-		for (size_t y = meta->y1; y < meta->y1 + meta->h; y++)
-		memcpy(&cpy[y * s->w + meta->x1], &buf[y * s->w + meta->x1], row_sz);
-		s->update_ts = arcan_timemillis();
-	}
+	return maprange_state > 0;
+}
+#endif
 
 /*
- * Currently disabled approach to update subregion using PBO, experienced
- * data corruption / driver bugs on several drivers :'(
+ * Bind and map the next buffer in the ring for writing [nb] bytes.
+ * Returns NULL (and unbinds) if the driver refuses.
  */
+static void* pbo_ring_map(struct agp_pbo_ring* ring, size_t nb)
+{
+	ring->ind = (ring->ind + 1) % AGP_PBO_RING;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->id[ring->ind]);
+	void* ptr = NULL;
+
+#ifdef AGP_OPTIONAL_SYNC
+	if (maprange_supported() && sync_supported()){
+		GLbitfield fl = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+		GLsync* fence = &ring->fence[ring->ind];
+
+/* previous transfer from this slot is done, map without driver synch,
+ * otherwise let invalidate orphan the storage */
+		if (!*fence)
+			fl |= GL_MAP_UNSYNCHRONIZED_BIT;
+		else {
+			GLenum rv = glClientWaitSync(*fence, 0, 0);
+			if (rv == GL_ALREADY_SIGNALED || rv == GL_CONDITION_SATISFIED)
+				fl |= GL_MAP_UNSYNCHRONIZED_BIT;
+			glDeleteSync(*fence);
+			*fence = NULL;
+		}
 
-#if 0
-	av_pixel* ptr = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
-
-glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s->vinf.text.wid);
+		ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, nb, fl);
+	}
+	else
+#endif
+	{
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, ring->sz, NULL, GL_STREAM_DRAW);
+		ptr = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+	}
 
+	if (!ptr)
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 
-/* warning, with the normal copy we check alignment in beforehand as we have
- * had cases where glMapBuffer intermittently returns unaligned pointers AND
- * the compiler has emitted intrinsics that assumed alignment */
-	for (size_t y = meta->y1; y < meta->y1 + meta->h; y++)
-		memcpy(&ptr[y * s->w + meta->x1], &buf[y * s->w + meta->x1], row_sz);
+	return ptr;
+}
 
-		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, meta->x1, meta->y1, meta->w, meta->h,
-		GL_PIXEL_FORMAT, GL_UNSIGNED_BYTE, 0);
-	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+static void pbo_ring_fence(struct agp_pbo_ring* ring)
+{
+#ifdef AGP_OPTIONAL_SYNC
+	if (sync_supported())
+		ring->fence[ring->ind] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 #endif
 }
 
-static inline void setup_unpack_pbo(struct storage_info_t* s, void* buf)
+static struct agp_pbo_ring* get_upload_ring(struct storage_info_t* s)
 {
+	size_t sz = s->w * s->h * sizeof(av_pixel);
+
+	if (s->vinf.text.upload && s->vinf.text.upload->sz != sz){
+		pbo_ring_free(s->vinf.text.upload);
+		s->vinf.text.upload = NULL;
+	}
+
+	if (!s->vinf.text.upload)
+		s->vinf.text.upload = pbo_ring_alloc(
+			GL_PIXEL_UNPACK_BUFFER, sz, GL_STREAM_DRAW);
+
+	return s->vinf.text.upload;
+}
+
+/*
+ * Upload the [x1, y1, w, h] region of [buf] (stride s->w). The region is
+ * packed tightly at the start of the PBO so the transfer needs neither
+ * mapping offsets nor SKIP_ state on the pixel store (the combination that
+ * used to trigger corruption on some drivers), and if [synch] is set the
+ * region is also copied to the on-host backing store.
+ */
+static void pbo_stream_region(struct storage_info_t* s, av_pixel* buf,
+	size_t x1, size_t y1, size_t w, size_t h, bool synch)
+{
+	struct agp_pbo_ring* ring = get_upload_ring(s);
+	size_t row_sz = w * sizeof(av_pixel);
+	bool full = w == s->w;
+
 	agp_activate_vstore(s);
-	glGenBuffers(1, &s->vinf.text.wid);
-	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s->vinf.text.wid);
-		glBufferData(GL_PIXEL_UNPACK_BUFFER,
-			s->w * s->h * sizeof(av_pixel) , buf, GL_STREAM_DRAW);
-	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	av_pixel* ptr = pbo_ring_map(ring, row_sz * h);
+
+/* mapping failed, fall back to letting the driver copy from client memory */
+	if (!ptr){
+		struct stream_meta meta = {.x1 = x1, .y1 = y1};
+		set_pixel_store(s->w, meta);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x1, y1, w, h,
+			GL_PIXEL_FORMAT, GL_UNSIGNED_BYTE, buf);
+		reset_pixel_store();
+	}
+	else {
+		if (full)
+			memcpy(ptr, &buf[y1 * s->w], row_sz * h);
+		else
+			for (size_t y = 0; y < h; y++)
+				memcpy(&ptr[y * w], &buf[(y1 + y) * s->w + x1], row_sz);
+
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x1, y1, w, h,
+			GL_PIXEL_FORMAT, GL_UNSIGNED_BYTE, 0);
+		pbo_ring_fence(ring);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
 	agp_deactivate_vstore();
+
+/* synch :- on-host backing store, one extra copy into local buffer */
+	if (synch && s->vinf.text.raw && s->vinf.text.raw != buf){
+		av_pixel* cpy = s->vinf.text.raw;
+		if (full)
+			memcpy(&cpy[y1 * s->w], &buf[y1 * s->w], row_sz * h);
+		else
+			for (size_t y = y1; y < y1 + h; y++)
+				memcpy(&cpy[y * s->w + x1], &buf[y * s->w + x1], row_sz);
+	}
+
+	if (synch)
+		s->update_ts = arcan_timemillis();
+}
+
+static void pbo_stream(struct storage_info_t* s,
+	av_pixel* buf, struct stream_meta* meta, bool synch)
+{
+	pbo_stream_region(s, buf, 0, 0, s->w, s->h, synch);
+}
+
+/* positions and offsets in meta have been verified in _frameserver */
+static void pbo_stream_sub(struct storage_info_t* s,
+	av_pixel* buf, struct stream_meta* meta, bool synch)
+{
+	if ( (float)(meta->w * meta->h) / (s->w * s->h) > 0.5)
+		return pbo_stream(s, buf, meta, synch);
+
+	pbo_stream_region(s, buf, meta->x1, meta->y1, meta->w, meta->h, synch);
 }
 
 static void alloc_buffer(struct storage_info_t* s)
@@ -288,9 +442,6 @@ struct stream_meta agp_stream_prepare(struct storage_info_t* s,
 
 	switch (type){
 	case STREAM_RAW:
-		if (!s->vinf.text.wid)
-			setup_unpack_pbo(s, NULL);
-
 		alloc_buffer(s);
 
 		res.buf = s->vinf.text.raw;
@@ -301,9 +452,6 @@ struct stream_meta agp_stream_prepare(struct storage_info_t* s,
 		alloc_buffer(s);
 
 	case STREAM_RAW_DIRECT:
-		if (!s->vinf.text.wid)
-			setup_unpack_pbo(s, meta.buf);
-
 		if (meta.dirty)
 			pbo_stream_sub(s, meta.buf, &meta, type == STREAM_RAW_DIRECT_COPY);
 		else
@@ -343,26 +491,12 @@ void agp_stream_release(struct storage_info_t* s, struct stream_meta meta)
 		pbo_stream_sub(s, s->vinf.text.raw, &meta, false);
 	else
 		pbo_stream(s, s->vinf.text.raw, &meta, false);
-	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_NONE);
 }
 
 void agp_stream_commit(struct storage_info_t* s, struct stream_meta meta)
 {
 }
 
-static void pbo_alloc_read(struct storage_info_t* store)
-{
-	GLuint pboid;
-	glGenBuffers(1, &pboid);
-	store->vinf.text.rid = pboid;
-
-	glBindBuffer(GL_PIXEL_PACK_BUFFER, pboid);
-	glBufferData(GL_PIXEL_PACK_BUFFER,
-		store->w * store->h * store->bpp, NULL, GL_STREAM_COPY);
-	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-}
-
 static void pbo_alloc_write(struct storage_info_t* store)
 {
 	GLuint pboid;
@@ -375,15 +509,6 @@ static void pbo_alloc_write(struct storage_info_t* store)
 	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
-static void default_release(void* tag)
-{
-	if (!tag)
-		return;
-
-	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
-	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-}
-
 void agp_resize_vstore(struct storage_info_t* s, size_t w, size_t h)
 {
 	s->w = w;
@@ -397,46 +522,125 @@ void agp_resize_vstore(struct storage_info_t* s, size_t w, size_t h)
 		pbo_alloc_write(s);
 	}
 
-	if (s->vinf.text.rid){
-		glDeleteBuffers(1, &s->vinf.text.rid);
-		pbo_alloc_read(s);
-	}
+/* upload ring is lazily reallocated on the next stream at the new size */
+	pbo_ring_free(s->vinf.text.upload);
+	s->vinf.text.upload = NULL;
+
+/* pending readbacks are for the old dimensions and can be discarded */
+	pbo_ring_free(s->vinf.text.readback);
+	s->vinf.text.readback = NULL;
 
 	agp_update_vstore(s, true);
 }
 
-void agp_request_readback(struct storage_info_t* store)
+/*
+ * Readbacks use the same ring structure as uploads but as a FIFO of pack
+ * PBOs. Each request issues the transfer into the next free buffer and
+ * fences it, polling only maps the oldest buffer once its fence has
+ * signalled so the GPU pipeline is never stalled by a mapping. When all
+ * buffers are in flight the request is dropped, the caller keeps count.
+ */
+bool agp_request_readback(struct storage_info_t* store)
 {
 	if (!store || store->txmapped != TXSTATE_TEX2D)
-		return;
+		return false;
 
-	if (!store->vinf.text.rid)
-		pbo_alloc_read(store);
+	size_t sz = store->w * store->h * sizeof(av_pixel);
+	struct agp_pbo_ring* ring = store->vinf.text.readback;
+
+	if (!ring)
+		ring = store->vinf.text.readback =
+			pbo_ring_alloc(GL_PIXEL_PACK_BUFFER, sz, GL_STREAM_READ);
+
+	if (ring->count == AGP_PBO_RING)
+		return false;
+
+	size_t slot = (ring->ind + ring->count) % AGP_PBO_RING;
 
 	glBindTexture(GL_TEXTURE_2D, store->vinf.text.glid);
-	glBindBuffer(GL_PIXEL_PACK_BUFFER, store->vinf.text.rid);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, ring->id[slot]);
 		glGetTexImage(GL_TEXTURE_2D, 0, GL_PIXEL_FORMAT,
 			GL_UNSIGNED_BYTE, NULL);
 	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 	glBindTexture(GL_TEXTURE_2D, 0);
+
+#ifdef AGP_OPTIONAL_SYNC
+	if (sync_supported())
+		ring->fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+
+	ring->ts[slot] = arcan_timemillis();
+	ring->count++;
+
+	return true;
+}
+
+size_t agp_readback_pending(struct storage_info_t* store)
+{
+	if (!store || store->txmapped != TXSTATE_TEX2D || !store->vinf.text.readback)
+		return 0;
+
+	return store->vinf.text.readback->count;
+}
+
+static void readback_step(struct agp_pbo_ring* ring)
+{
+#ifdef AGP_OPTIONAL_SYNC
+	if (ring->fence[ring->ind]){
+		glDeleteSync(ring->fence[ring->ind]);
+		ring->fence[ring->ind] = NULL;
+	}
+#endif
+
+	ring->ind = (ring->ind + 1) % AGP_PBO_RING;
+	ring->count--;
+}
+
+static void readback_release(void* tag)
+{
+	struct agp_pbo_ring* ring = tag;
+	if (!ring)
+		return;
+
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readback_step(ring);
 }
 
 struct asynch_readback_meta agp_poll_readback(struct storage_info_t* store)
 {
 	struct asynch_readback_meta res = {
-	.release = default_release
+	.release = readback_release
 	};
 
 	if (!store || store->txmapped != TXSTATE_TEX2D ||
-		store->vinf.text.rid == GL_NONE)
+		!store->vinf.text.readback || !store->vinf.text.readback->count)
 		return res;
 
-	glBindBuffer(GL_PIXEL_PACK_BUFFER, store->vinf.text.rid);
+	struct agp_pbo_ring* ring = store->vinf.text.readback;
+
+/* without sync objects, mapping will block until the transfer is done */
+#ifdef AGP_OPTIONAL_SYNC
+	if (sync_supported() && ring->fence[ring->ind] &&
+		glClientWaitSync(ring->fence[ring->ind], 0, 0) == GL_TIMEOUT_EXPIRED)
+		return res;
+#endif
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, ring->id[ring->ind]);
+	res.ptr = (av_pixel*) glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_WRITE);
+
+/* discard rather than retry so one bad buffer doesn't stall the queue */
+	if (!res.ptr){
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		readback_step(ring);
+		return res;
+	}
 
 	res.w = store->w;
 	res.h = store->h;
-	res.tag = (void*) 0xdeadbeef;
-	res.ptr = (av_pixel*) glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_WRITE);
+	res.buf_sz = ring->sz;
+	res.ts = ring->ts[ring->ind];
+	res.tag = ring;
 
 	return res;
 }
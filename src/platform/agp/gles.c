@@ -199,8 +199,14 @@ void agp_readback_synchronous(struct storage_info_t* dst)
 {
 }
 
-void agp_request_readback(struct storage_info_t* store)
+bool agp_request_readback(struct storage_info_t* store)
 {
+	return false;
+}
+
+size_t agp_readback_pending(struct storage_info_t* store)
+{
+	return 0;
 }
 
 struct asynch_readback_meta argp_buffer_readback_asynchronous(
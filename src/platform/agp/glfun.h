@@ -43,9 +43,11 @@ static void glReadBuffer(){}
 #else
 
 #define glActiveTexture glActiveTextureIGNORE
+#define glCompressedTexImage2D glCompressedTexImage2DIGNORE
 #include <GL/gl.h>
 #include "glext.h"
 #undef glActiveTexture
+#undef glCompressedTexImage2D
 #endif
 
 #ifndef MAP_PREFIX
@@ -96,6 +98,27 @@ MAP_PREFIX PFNGLDELETEPROGRAMPROC glDeleteProgram;
 MAP_PREFIX PFNGLCREATESHADERPROC glCreateShader;
 MAP_PREFIX PFNGLACTIVETEXTUREPROC glActiveTexture;
 
+/* optional (GL3.0 / ARB_map_buffer_range, GL3.2 / ARB_sync), these are NULL
+ * when the driver does not provide them and callers must check. Used by
+ * gl21.c for multi-buffered PBO transfers */
+#define AGP_OPTIONAL_SYNC
+MAP_PREFIX PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+MAP_PREFIX PFNGLFENCESYNCPROC glFenceSync;
+MAP_PREFIX PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+MAP_PREFIX PFNGLDELETESYNCPROC glDeleteSync;
+
+/* optional (GL3.1 / ARB_uniform_buffer_object), NULL when not provided, used
+ * by shdrmgmt.c for the shared environment uniform block */
+#define AGP_OPTIONAL_UBO
+MAP_PREFIX PFNGLGETUNIFORMBLOCKINDEXPROC glGetUniformBlockIndex;
+MAP_PREFIX PFNGLUNIFORMBLOCKBINDINGPROC glUniformBlockBinding;
+MAP_PREFIX PFNGLBINDBUFFERBASEPROC glBindBufferBase;
+MAP_PREFIX PFNGLBUFFERSUBDATAPROC glBufferSubData;
+
+/* optional (GL1.3), NULL when not provided, used by glshared.c for
+ * uploading pre-compressed textures */
+MAP_PREFIX PFNGLCOMPRESSEDTEXIMAGE2DPROC glCompressedTexImage2D;
+
 /* part of 1.1 (i.e. all openGL libs), ignored
 MAP_PREFIX PFNGLBINDTEXTUREEXTPROC glBindTexture;
 MAP_PREFIX PFNGLDELETETEXTURESEXTPROC glDeleteTextures;
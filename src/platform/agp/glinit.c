@@ -64,6 +64,15 @@ glGetAttribLocation = MAP("glGetAttribLocation");
 glDeleteProgram = MAP("glDeleteProgram");
 glCreateShader = MAP("glCreateShader");
 glActiveTexture = MAP("glActiveTexture");
+glMapBufferRange = MAP("glMapBufferRange");
+glFenceSync = MAP("glFenceSync");
+glClientWaitSync = MAP("glClientWaitSync");
+glDeleteSync = MAP("glDeleteSync");
+glGetUniformBlockIndex = MAP("glGetUniformBlockIndex");
+glUniformBlockBinding = MAP("glUniformBlockBinding");
+glBindBufferBase = MAP("glBindBufferBase");
+glBufferSubData = MAP("glBufferSubData");
+glCompressedTexImage2D = MAP("glCompressedTexImage2D");
 
 #endif
 #endif
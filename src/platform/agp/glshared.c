@@ -195,9 +195,80 @@ struct agp_rendertarget* agp_setup_rendertarget(struct storage_info_t* vstore,
 
 extern void agp_gl_ext_init();
 
+/* not all GL headers carry the extension tokens */
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_ETC1_RGB8_OES
+#define GL_ETC1_RGB8_OES 0x8D64
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+#endif
+#ifndef GL_COMPRESSED_RGBA8_ETC2_EAC
+#define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+#endif
+
+/*
+ * probed once at init as the loaders ask from other threads, [txcomp_fmt]
+ * is the internal format used for upload (ETC1 goes through ETC2 when only
+ * the latter is available)
+ */
+static bool txcomp_ok[TXCOMP_BC7 + 1];
+static GLenum txcomp_fmt[TXCOMP_BC7 + 1] = {
+	[TXCOMP_ETC1] = GL_ETC1_RGB8_OES,
+	[TXCOMP_ETC2_RGB] = GL_COMPRESSED_RGB8_ETC2,
+	[TXCOMP_ETC2_RGBA] = GL_COMPRESSED_RGBA8_ETC2_EAC,
+	[TXCOMP_BC1] = GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+	[TXCOMP_BC3] = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+	[TXCOMP_BC7] = GL_COMPRESSED_RGBA_BPTC_UNORM
+};
+
+static void probe_txcomp()
+{
+	const char* ext = (const char*) glGetString(GL_EXTENSIONS);
+	if (!ext)
+		ext = "";
+
+#if !defined(GLES2) && !defined(GLES3) && !defined(__APPLE__)
+	if (!glCompressedTexImage2D)
+		return;
+#endif
+
+#ifdef GLES3
+	bool etc2 = true;
+#else
+	bool etc2 = strstr(ext, "GL_ARB_ES3_compatibility") != NULL;
+#endif
+	bool s3tc = strstr(ext, "GL_EXT_texture_compression_s3tc") != NULL;
+
+	txcomp_ok[TXCOMP_ETC2_RGB] = txcomp_ok[TXCOMP_ETC2_RGBA] = etc2;
+	txcomp_ok[TXCOMP_ETC1] =
+		strstr(ext, "GL_OES_compressed_ETC1_RGB8_texture") != NULL || etc2;
+	if (!strstr(ext, "GL_OES_compressed_ETC1_RGB8_texture"))
+		txcomp_fmt[TXCOMP_ETC1] = GL_COMPRESSED_RGB8_ETC2;
+
+	txcomp_ok[TXCOMP_BC1] = txcomp_ok[TXCOMP_BC3] = s3tc;
+	txcomp_ok[TXCOMP_BC7] =
+		strstr(ext, "GL_ARB_texture_compression_bptc") != NULL ||
+		strstr(ext, "GL_EXT_texture_compression_bptc") != NULL;
+}
+
+bool agp_txcomp_supported(enum agp_txcomp fmt)
+{
+	return fmt > TXCOMP_NONE && fmt <= TXCOMP_BC7 && txcomp_ok[fmt];
+}
+
 void agp_init()
 {
 	agp_gl_ext_init();
+	probe_txcomp();
 
 	glEnable(GL_SCISSOR_TEST);
 	glDisable(GL_DEPTH_TEST);
@@ -332,6 +403,38 @@ void agp_activate_vstore_multi(struct storage_info_t** backing, size_t n)
 	glActiveTexture(GL_TEXTURE0);
 }
 
+/*
+ * The compressed levels are uploaded as-is, no CPU copy is kept afterwards
+ * as the engine rebuilds these from their source.
+ */
+static void upload_txcomp(struct storage_info_t* s)
+{
+	uint8_t* buf = (uint8_t*) s->vinf.text.raw;
+	size_t ofs = 0, w = s->w, h = s->h, lvl = 0;
+	GLenum fmt = txcomp_fmt[s->vinf.text.txcomp];
+
+	for (; lvl < s->vinf.text.levels; lvl++){
+		size_t sz = agp_txcomp_size(s->vinf.text.txcomp, w, h);
+		if (ofs + sz > s->vinf.text.s_raw)
+			break;
+
+		glCompressedTexImage2D(GL_TEXTURE_2D, lvl, fmt, w, h, 0, sz, &buf[ofs]);
+		ofs += sz;
+		w = w > 1 ? w >> 1 : 1;
+		h = h > 1 ? h >> 1 : 1;
+	}
+
+#ifdef GL_TEXTURE_MAX_LEVEL
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, lvl ? lvl - 1 : 0);
+#endif
+	s->vinf.text.levels = lvl;
+	s->update_ts = arcan_timemillis();
+
+	arcan_mem_free(s->vinf.text.raw);
+	s->vinf.text.raw = NULL;
+	s->vinf.text.s_raw = 0;
+}
+
 void agp_update_vstore(struct storage_info_t* s, bool copy)
 {
 	if (s->txmapped == TXSTATE_OFF)
@@ -362,8 +465,17 @@ void agp_update_vstore(struct storage_info_t* s, bool copy)
 	bool mipmap = s->filtermode & ARCAN_VFILTER_MIPMAP;
 
 /*
- * Mipmapping still misses the option to manually define mipmap levels
+ * Mipmapping still misses the option to manually define mipmap levels,
+ * except for pre-compressed stores that carry their own chain
  */
+	if (s->vinf.text.txcomp){
+		if (copy && s->vinf.text.raw)
+			upload_txcomp(s);
+		if (s->vinf.text.levels <= 1 && filtermode == ARCAN_VFILTER_TRILINEAR)
+			filtermode = ARCAN_VFILTER_BILINEAR;
+		copy = false;
+	}
+
 	if (copy){
 #ifndef GL_GENERATE_MIPMAP
 		if (mipmap)
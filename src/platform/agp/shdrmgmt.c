@@ -116,6 +116,40 @@ static char* attrsymtbl[4] = {
 	"texcoord"
 };
 
+/*
+ * Shared environment block, shaders that declare
+ *
+ * layout(std140) uniform arcan_env {
+ *  mat4 projection;
+ *  float fract_timestamp;
+ *  int timestamp;
+ * };
+ *
+ * get these values from one uniform buffer that is only updated when they
+ * change, instead of one set of glUniform calls per program. Requires
+ * GLES3 or GL3.1 (ARB_uniform_buffer_object), other shaders are unaffected.
+ */
+#if defined(GLES3) || defined(AGP_OPTIONAL_UBO)
+#define ENV_UBO
+#define ENV_BLOCK_BINDING 0
+#endif
+
+struct env_block {
+	float projection[16];
+	float fract_timestamp;
+	int32_t timestamp;
+	float pad[2];
+};
+
+/* last value uploaded to a uniform location of a program */
+struct ushadow {
+	bool valid;
+	uint8_t data[64];
+};
+
+/* locations above this are uploaded without any caching */
+#define USHADOW_LIMIT 256
+
 /* REFACTOR:
  * representing shader uniform tracking in this way is rather disgusting,
  * parsing the shader and allocating a tightly packed uniform list would
@@ -141,6 +175,13 @@ struct shader_cont {
 /* match attrsymtbl */
 	GLint attributes[4];
 	struct arcan_strarr ugroups;
+
+/* indexed by uniform location, grows on demand */
+	struct ushadow* shadow;
+	size_t n_shadow;
+
+/* program declares the arcan_env block */
+	bool env_block;
 };
 
 static int sizetbl[7] = {
@@ -158,6 +199,16 @@ static struct {
 	size_t ofs;
 	agp_shader_id active_prg;
 	struct shader_envts context;
+
+/* uniform uploads issued / skipped as redundant, see agp_shader_counters */
+	size_t unif_issued;
+	size_t unif_skipped;
+
+/* 0 = unknown, 1 = available, -1 = not supported */
+	int ubo_state;
+	GLuint env_ubo;
+	bool env_dirty;
+	struct env_block env;
 	char guard;
 } shdr_global = {.active_prg = BROKEN_SHADER, .guard = 64};
 
@@ -204,6 +255,169 @@ static void setv(GLint loc, enum shdrutype kind, void* val,
 	}
 }
 
+static bool grow_shadow(struct shader_cont* cur, GLint loc)
+{
+	if (loc >= USHADOW_LIMIT)
+		return false;
+
+	size_t nc = (loc + 16) & ~15;
+	struct ushadow* ns = arcan_alloc_mem(nc * sizeof(struct ushadow),
+		ARCAN_MEM_VSTRUCT, ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL,
+		ARCAN_MEMALIGN_NATURAL);
+
+	if (!ns)
+		return false;
+
+	if (cur->shadow){
+		memcpy(ns, cur->shadow, cur->n_shadow * sizeof(struct ushadow));
+		arcan_mem_free(cur->shadow);
+	}
+
+	cur->shadow = ns;
+	cur->n_shadow = nc;
+	return true;
+}
+
+static void drop_shadow(struct shader_cont* cur)
+{
+	arcan_mem_free(cur->shadow);
+	cur->shadow = NULL;
+	cur->n_shadow = 0;
+}
+
+/*
+ * setv against [cur] (which must be the bound program) that skips the upload
+ * if the location already holds the same value
+ */
+static void setv_cached(struct shader_cont* cur, GLint loc,
+	enum shdrutype kind, void* val, const char* id)
+{
+	if (loc < 0)
+		return;
+
+	if (loc < cur->n_shadow || grow_shadow(cur, loc)){
+		struct ushadow* sh = &cur->shadow[loc];
+		size_t sz = sizetbl[kind];
+
+		if (sh->valid && memcmp(sh->data, val, sz) == 0){
+			shdr_global.unif_skipped++;
+			return;
+		}
+
+		memcpy(sh->data, val, sz);
+		sh->valid = true;
+	}
+
+	setv(loc, kind, val, id, cur->label);
+	shdr_global.unif_issued++;
+}
+
+static bool env_member(enum agp_shader_envts slot)
+{
+	return slot == PROJECTION_MATR ||
+		slot == FRACT_TIMESTAMP_F || slot == TIMESTAMP_D;
+}
+
+#ifdef ENV_UBO
+static bool ubo_supported()
+{
+	if (shdr_global.ubo_state)
+		return shdr_global.ubo_state > 0;
+
+	shdr_global.ubo_state = -1;
+
+#ifndef GLES3
+	if (!glGetUniformBlockIndex || !glUniformBlockBinding ||
+		!glBindBufferBase || !glBufferSubData)
+		return false;
+
+/* the symbols can resolve even if the context can't use them */
+	int major = 0, minor = 0;
+	const char* ver = (const char*) glGetString(GL_VERSION);
+	if (!ver || sscanf(ver, "%d.%d", &major, &minor) != 2 ||
+		major < 3 || (major == 3 && minor < 1))
+		return false;
+#endif
+
+	glGenBuffers(1, &shdr_global.env_ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, shdr_global.env_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(struct env_block),
+		&shdr_global.env, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, ENV_BLOCK_BINDING, shdr_global.env_ubo);
+
+	shdr_global.ubo_state = 1;
+	return true;
+}
+#endif
+
+static void bind_envblock(struct shader_cont* cur)
+{
+	cur->env_block = false;
+
+#ifdef ENV_UBO
+	if (!ubo_supported())
+		return;
+
+	GLuint ind = glGetUniformBlockIndex(cur->prg_container, "arcan_env");
+	if (ind != GL_INVALID_INDEX){
+		glUniformBlockBinding(cur->prg_container, ind, ENV_BLOCK_BINDING);
+		cur->env_block = true;
+	}
+#endif
+}
+
+/*
+ * Upload the environment block if any of its members have changed since
+ * the last upload, called when a program using the block is about to
+ * be used.
+ */
+static void env_sync()
+{
+#ifdef ENV_UBO
+	counttbl[PROJECTION_MATR]++;
+	counttbl[FRACT_TIMESTAMP_F]++;
+	counttbl[TIMESTAMP_D]++;
+
+	if (!shdr_global.env_dirty){
+		shdr_global.unif_skipped++;
+		return;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, shdr_global.env_ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0,
+		sizeof(struct env_block), &shdr_global.env);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	shdr_global.env_dirty = false;
+	shdr_global.unif_issued++;
+#endif
+}
+
+static void env_update(enum agp_shader_envts slot, void* value, size_t size)
+{
+	void* dst = NULL;
+
+	switch (slot){
+	case PROJECTION_MATR:
+		dst = shdr_global.env.projection;
+	break;
+	case FRACT_TIMESTAMP_F:
+		dst = &shdr_global.env.fract_timestamp;
+	break;
+	case TIMESTAMP_D:
+		dst = &shdr_global.env.timestamp;
+	break;
+	default:
+		return;
+	}
+
+	if (memcmp(dst, value, size) != 0){
+		memcpy(dst, value, size);
+		shdr_global.env_dirty = true;
+	}
+}
+
 int agp_shader_activate(agp_shader_id shid)
 {
 	if (!agp_shader_valid(shid))
@@ -222,19 +436,21 @@ int agp_shader_activate(agp_shader_id shid)
 #endif
 
 /*
- * While we chould practically just update the uniforms that has actually
- * changed since the last push as we keep a cache, the incentive is rather
- * small (uniform- set on a bound shader is among the cheaper state changes
- * possible).
+ * Push the environment, but only the values that differ from what this
+ * program last received. Programs tend to be activated once per object with
+ * mostly the same values so this removes the bulk of the uniform calls.
  */
 		for (size_t i = 0; i < sizeof(ofstbl) / sizeof(ofstbl[0]); i++){
 			if (cur->locations[i] >= 0){
-				setv(cur->locations[i], typetbl[i], (char*)(&shdr_global.context)
-					+ ofstbl[i], symtbl[i], cur->label);
+				setv_cached(cur, cur->locations[i], typetbl[i],
+					(char*)(&shdr_global.context) + ofstbl[i], symtbl[i]);
 				counttbl[i]++;
 			}
 		}
 
+		if (cur->env_block)
+			env_sync();
+
 /* activate any persistant values */
 		if (cur->ugroups.count < GROUP_INDEX(shid)){
 			arcan_warning("attempt to activate shader with broken group index\n");
@@ -243,8 +459,8 @@ int agp_shader_activate(agp_shader_id shid)
 
 		struct shaderv* current = cur->ugroups.cdata[GROUP_INDEX(shid)];
 		while (current){
-			setv(current->loc, current->type, (void*) current->data,
-				current->label, cur->label);
+			setv_cached(cur, current->loc, current->type,
+				(void*) current->data, current->label);
 			current = current->next;
 		}
 	}
@@ -350,6 +566,7 @@ agp_shader_id agp_shader_build(const char* tag, const char* geom,
 /* reset everything to NULL */
 		}
 		arcan_mem_free(cur->ugroups.data);
+		drop_shadow(cur);
 		memset(cur, 0, sizeof(struct shader_cont));
 	}
 
@@ -395,6 +612,8 @@ agp_shader_id agp_shader_build(const char* tag, const char* geom,
 #endif
 	}
 
+	bind_envblock(cur);
+
 /* revert to last used program! */
 	if (shdr_global.active_prg != BROKEN_SHADER){
 		glUseProgram(shdr_global.slots[
@@ -418,11 +637,18 @@ int agp_shader_envv(enum agp_shader_envts slot, void* value, size_t size)
 	int rv = counttbl[slot];
 	counttbl[slot] = 0;
 
+	if (env_member(slot))
+		env_update(slot, value, size);
+
 	if (BROKEN_SHADER == shdr_global.active_prg)
 		return rv;
 
-	int glloc = shdr_global.slots[
-		SHADER_INDEX(shdr_global.active_prg)].locations[slot];
+	struct shader_cont* cur =
+		&shdr_global.slots[SHADER_INDEX(shdr_global.active_prg)];
+	int glloc = cur->locations[slot];
+
+	if (cur->env_block && env_member(slot))
+		env_sync();
 
 #ifdef SHADER_TRACE
 	arcan_warning("[shader] global envv global update.\n");
@@ -434,8 +660,7 @@ int agp_shader_envv(enum agp_shader_envts slot, void* value, size_t size)
  */
 	if (glloc != -1){
 		assert(size == sizetbl[ typetbl[slot] ]);
-		setv(glloc, typetbl[slot], value, symtbl[slot],
-			shdr_global.slots[SHADER_INDEX(shdr_global.active_prg)].label );
+		setv_cached(cur, glloc, typetbl[slot], value, symtbl[slot]);
 		counttbl[slot]++;
 
 		return rv;
@@ -444,6 +669,18 @@ int agp_shader_envv(enum agp_shader_envts slot, void* value, size_t size)
 	return rv;
 }
 
+void agp_shader_counters(size_t* issued, size_t* skipped, bool reset)
+{
+	if (issued)
+		*issued = shdr_global.unif_issued;
+
+	if (skipped)
+		*skipped = shdr_global.unif_skipped;
+
+	if (reset)
+		shdr_global.unif_issued = shdr_global.unif_skipped = 0;
+}
+
 agp_shader_id agp_shader_addgroup(agp_shader_id shid)
 {
 	if (!agp_shader_valid(shid))
@@ -515,7 +752,7 @@ void agp_shader_forceunif(const char* label, enum shdrutype type, void* value)
 	memcpy((*current)->data, value, sizetbl[type]);
 
 	if (loc >= 0){
-		setv(loc, type, value, label, slot->label);
+		setv_cached(slot, loc, type, value, label);
 	}
 #ifdef DEBUG
 	else
@@ -647,6 +884,7 @@ void agp_shader_flush()
  * arcan_mem_freearr here as that would be a double-free, just free
  * the array */
 		arcan_mem_free(cur->ugroups.data);
+		drop_shadow(cur);
 		memset(cur, 0, sizeof(struct shader_cont));
 	}
 
@@ -656,6 +894,11 @@ void agp_shader_flush()
 
 void agp_shader_rebuild_all()
 {
+/* new context, the environment buffer needs to be recreated */
+	shdr_global.ubo_state = 0;
+	shdr_global.env_ubo = 0;
+	shdr_global.env_dirty = true;
+
 	for (size_t i = 0; i < sizeof(shdr_global.slots) /
 			sizeof(shdr_global.slots[0]); i++){
 		struct shader_cont* cur = shdr_global.slots + i;
@@ -664,5 +907,12 @@ void agp_shader_rebuild_all()
 
 		build_shader(cur->label, &cur->prg_container, &cur->obj_vertex,
 			&cur->obj_fragment, cur->vertex, cur->fragment);
+
+/* fresh program objects, nothing uploaded yet */
+		drop_shadow(cur);
+		bind_envblock(cur);
 	}
+
+/* force the next activation to push everything */
+	shdr_global.active_prg = BROKEN_SHADER;
 }
@@ -0,0 +1,2074 @@
+/*
+ * Copyright 2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ * Description: CPU-only AGP implementation, selected with -DAGP_PLATFORM=soft
+ * for headless servers, CI and GPU-less clients.
+ *
+ * Structure:
+ *  - backing stores map to entries in a texture table, the glid field is the
+ *    index (+1) just like a GL texture name, so the engine side does not need
+ *    to tell the difference. Rendertargets draw straight into the texture of
+ *    their store and keep optional stencil / depth planes next to it.
+ *  - draw calls are transformed and set up (edges, attribute planes) on the
+ *    calling thread and queued on the active rendertarget. The queue is
+ *    flushed when the rendertarget changes, when a store is modified or when
+ *    pixels are read back. A flush splits the target into tiles that the
+ *    worker threads (and the caller) process in parallel, each tile walking
+ *    the full command list in order so blending and clipping stay correct.
+ *  - the GL rules are followed where it matters to the rest of the engine:
+ *    pixel centers, shared edges do not overlap, row 0 is the bottom row and
+ *    the blend equations match the glBlendFunc setup in glshared.c.
+ *  - there is no shading language, shaders are classified when built as
+ *    either textured (with obj_opacity) or colored (obj_col, obj_opacity),
+ *    which covers the default shaders. Custom programs fall back to one of
+ *    the two.
+ *
+ * Known limitations:
+ *  - no mipmapping, trilinear filtering degrades to bilinear.
+ *  - only the first texture unit of a multitexture frameset is sampled.
+ *  - point clouds are not rasterized and 3D meshes are only clipped against
+ *    the near plane.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../video_platform.h"
+#include PLATFORM_HEADER
+
+#include "arcan_math.h"
+#include "arcan_general.h"
+#include "arcan_video.h"
+#include "arcan_mem.h"
+#include "arcan_videoint.h"
+
+#ifdef HEADLESS_NOARCAN
+#undef FLAG_DIRTY
+#define FLAG_DIRTY()
+#endif
+
+#if defined(ARCAN_AGP_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SOFT_SSE2
+#endif
+
+/* tile edge in pixels, also bounds the per-span scratch buffers */
+#define SOFT_TILE 64
+#define SOFT_MAX_THREADS 16
+
+struct soft_tex {
+	av_pixel* buf;
+	size_t w, h;
+	bool used;
+
+/* readbacks are handed out as a pointer to buf, one at a time */
+	bool rb_pending;
+	unsigned long long rb_ts;
+};
+
+struct agp_rendertarget {
+	enum rendertarget_mode mode;
+	struct storage_info_t* store;
+
+/* allocated on first use, sized after store */
+	uint8_t* stencil;
+	float* depth;
+	size_t aux_w, aux_h;
+};
+
+enum cmd_kind {
+	CMD_CLEAR = 0,
+	CMD_TRI = 1
+};
+
+enum shade_kind {
+	SHADE_TEX = 0,
+	SHADE_COLOR = 1
+};
+
+enum stencil_op {
+	STENCIL_OFF = 0,
+	STENCIL_WRITE = 1,
+	STENCIL_TEST = 2
+};
+
+/* half-open in y: covers pixel centers where y0 <= yc < y1 */
+struct edge {
+	float y0, y1, x0, dxdy;
+};
+
+/* attribute = a * x + b * y + c, in window coordinates */
+struct plane {
+	float a, b, c;
+};
+
+struct soft_cmd {
+	enum cmd_kind kind;
+
+/* bounding box clamped to the target, max is exclusive */
+	int x0, y0, x1, y1;
+
+/* CMD_CLEAR */
+	bool clear_color, clear_depth, clear_stencil;
+
+/* CMD_TRI */
+	struct edge edges[3];
+	struct plane u, v, q, z;
+	bool persp, depth, linear, rep_u, rep_v;
+	enum shade_kind shade;
+	enum stencil_op stencil;
+	enum arcan_blendfunc blend;
+	uint8_t opacity;
+	av_pixel color;
+	const av_pixel* tbuf;
+	int tw, th;
+};
+
+/* post-transform vertex, x/y/z in window space and w as 1/clip.w */
+struct svert {
+	float x, y, z, w;
+	float u, v;
+};
+
+struct surface {
+	av_pixel* buf;
+	size_t w, h;
+	uint8_t* stencil;
+	float* depth;
+};
+
+static struct {
+	struct soft_tex* tex;
+	size_t n_tex;
+
+	struct agp_rendertarget* rt;
+	struct agp_rendertarget out;
+	struct storage_info_t out_store;
+
+	struct storage_info_t* active;
+	enum arcan_blendfunc blend;
+	enum stencil_op stencil;
+	bool depth;
+
+	struct soft_cmd* cmds;
+	size_t n_cmds, cmd_cap;
+} soft = {
+	.blend = BLEND_NORMAL
+};
+
+static struct {
+	pthread_t threads[SOFT_MAX_THREADS];
+	size_t n_threads;
+	bool alive;
+
+	pthread_mutex_t lock;
+	pthread_cond_t wake, done;
+	unsigned gen;
+	size_t busy;
+
+/* current job */
+	struct surface surf;
+	size_t tiles_x, n_tiles;
+	atomic_size_t next;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER
+};
+
+/*
+ * Shader management, the same tag/slot/uniform-group model as shdrmgmt.c
+ * minus the GL objects. Only the environment values that affect the fixed
+ * function shading are kept.
+ */
+struct shaderv {
+	char* label;
+	enum shdrutype type;
+	uint8_t data[64];
+	struct shaderv* next;
+};
+
+struct shader_cont {
+	char* label;
+	char (* vertex), (* fragment);
+	enum shade_kind kind;
+	struct arcan_strarr ugroups;
+};
+
+static struct {
+	struct shader_cont slots[256];
+	size_t ofs;
+	agp_shader_id active_prg;
+
+	float modelview[16];
+	float projection[16];
+	float opacity;
+
+/* no uploads here, changed / unchanged envv values are counted instead */
+	size_t unif_issued;
+	size_t unif_skipped;
+} shdr_global = {
+	.active_prg = BROKEN_SHADER,
+	.opacity = 1.0
+};
+
+static int sizetbl[7] = {
+	sizeof(int),
+	sizeof(int),
+	sizeof(float),
+	sizeof(float) * 2,
+	sizeof(float) * 3,
+	sizeof(float) * 4,
+	sizeof(float) * 16
+};
+
+#define TBLSIZE (1 + TIMESTAMP_D - MODELVIEW_MATR)
+static char* symtbl[TBLSIZE] = {
+	"modelview",
+	"projection",
+	"texturem",
+	"obj_opacity",
+	"trans_move",
+	"trans_scale",
+	"trans_rotate",
+	"obj_input_sz",
+	"obj_output_sz",
+	"obj_storage_sz",
+	"fract_timestamp",
+	"timestamp"
+};
+
+static float ident[] =
+ {1.0, 0.0, 0.0, 0.0,
+  0.0, 1.0, 0.0, 0.0,
+  0.0, 0.0, 1.0, 0.0,
+  0.0, 0.0, 0.0, 1.0};
+
+/*
+ * the default shaders are kept in GLSL form so scripts that query or copy
+ * them still get something meaningful, only the tags matter here
+ */
+static const char* defvprg =
+"uniform mat4 modelview;\n"
+"uniform mat4 projection;\n"
+"attribute vec2 texcoord;\n"
+"varying vec2 texco;\n"
+"attribute vec4 vertex;\n"
+"void main(){\n"
+"	gl_Position = (projection * modelview) * vertex;\n"
+"	texco = texcoord;\n"
+"}";
+
+static const char* deffprg =
+"uniform sampler2D map_diffuse;\n"
+"varying vec2 texco;\n"
+"uniform float obj_opacity;\n"
+"void main(){\n"
+"	vec4 col = texture2D(map_diffuse, texco);\n"
+"	col.a = col.a * obj_opacity;\n"
+"	gl_FragColor = col;\n"
+"}";
+
+static const char* defcvprg =
+"uniform mat4 modelview;\n"
+"uniform mat4 projection;\n"
+"attribute vec4 vertex;\n"
+"void main(){\n"
+"	gl_Position = (projection * modelview) * vertex;\n"
+"}";
+
+static const char* defcfprg =
+"uniform vec3 obj_col;\n"
+"uniform float obj_opacity;\n"
+"void main(){\n"
+"	gl_FragColor = vec4(obj_col.rgb, obj_opacity);\n"
+"}";
+
+static void flush();
+
+/*
+ * Texture table
+ */
+static struct soft_tex* store_tex(struct storage_info_t* s)
+{
+	if (!s || s->txmapped == TXSTATE_OFF ||
+		s->vinf.text.glid == 0 || s->vinf.text.glid > soft.n_tex)
+		return NULL;
+
+	struct soft_tex* t = &soft.tex[s->vinf.text.glid - 1];
+	return t->used ? t : NULL;
+}
+
+static void free_tex(struct storage_info_t* s)
+{
+	struct soft_tex* t = store_tex(s);
+	if (t){
+		arcan_mem_free(t->buf);
+		memset(t, '\0', sizeof(struct soft_tex));
+	}
+	s->vinf.text.glid = 0;
+}
+
+static unsigned alloc_texid()
+{
+	for (size_t i = 0; i < soft.n_tex; i++)
+		if (!soft.tex[i].used)
+			return i + 1;
+
+	size_t nc = soft.n_tex ? soft.n_tex * 2 : 64;
+	struct soft_tex* nt = arcan_alloc_mem(nc * sizeof(struct soft_tex),
+		ARCAN_MEM_VSTRUCT, ARCAN_MEM_BZERO, ARCAN_MEMALIGN_NATURAL);
+
+	if (soft.tex){
+		memcpy(nt, soft.tex, soft.n_tex * sizeof(struct soft_tex));
+		arcan_mem_free(soft.tex);
+	}
+
+	unsigned res = soft.n_tex + 1;
+	soft.tex = nt;
+	soft.n_tex = nc;
+	return res;
+}
+
+/*
+ * make sure [s] has a texture matching its dimensions, contents are
+ * preserved if they already matched and cleared otherwise
+ */
+static struct soft_tex* tex_ensure(struct storage_info_t* s)
+{
+	struct soft_tex* t = store_tex(s);
+	if (t && t->w == s->w && t->h == s->h)
+		return t;
+
+	size_t nb = (s->w ? s->w : 1) * (s->h ? s->h : 1) * sizeof(av_pixel);
+	av_pixel* buf = arcan_alloc_mem(nb, ARCAN_MEM_VBUFFER,
+		ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_SIMD);
+
+	if (!buf){
+		arcan_warning("agp(soft): couldn't allocate %zu*%zu store\n", s->w, s->h);
+		return t;
+	}
+
+	if (t)
+		arcan_mem_free(t->buf);
+	else {
+		s->vinf.text.glid = alloc_texid();
+		t = &soft.tex[s->vinf.text.glid - 1];
+		t->used = true;
+	}
+
+	t->buf = buf;
+	t->w = s->w;
+	t->h = s->h;
+	return t;
+}
+
+static void rt_aux(struct agp_rendertarget* rt, bool stencil, bool depth)
+{
+	size_t w = rt->store->w, h = rt->store->h;
+
+	if (rt->aux_w != w || rt->aux_h != h){
+		arcan_mem_free(rt->stencil);
+		arcan_mem_free(rt->depth);
+		rt->stencil = NULL;
+		rt->depth = NULL;
+		rt->aux_w = w;
+		rt->aux_h = h;
+	}
+
+	if (!w || !h)
+		return;
+
+	if (stencil && !rt->stencil)
+		rt->stencil = arcan_alloc_mem(w * h, ARCAN_MEM_VBUFFER,
+			ARCAN_MEM_BZERO | ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_SIMD);
+
+	if (depth && !rt->depth){
+		rt->depth = arcan_alloc_mem(w * h * sizeof(float), ARCAN_MEM_VBUFFER,
+			ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_SIMD);
+		if (rt->depth)
+			for (size_t i = 0; i < w * h; i++)
+				rt->depth[i] = 1.0;
+	}
+}
+
+/*
+ * Pixel operations, av_pixel is RGBA with alpha in the top byte
+ */
+static inline uint32_t mul255(uint32_t a, uint32_t b)
+{
+	uint32_t t = a * b + 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+static inline av_pixel lerp_px(av_pixel a, av_pixel b, uint32_t w)
+{
+	uint32_t rb = (((a & 0x00ff00ff) * (256 - w) +
+		(b & 0x00ff00ff) * w) >> 8) & 0x00ff00ff;
+	uint32_t ag = (((a >> 8) & 0x00ff00ff) * (256 - w) +
+		((b >> 8) & 0x00ff00ff) * w) & 0xff00ff00;
+	return rb | ag;
+}
+
+/* GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, applied to all four channels */
+static inline av_pixel blend_normal(av_pixel s, av_pixel d)
+{
+	uint32_t a = s >> 24;
+	if (a == 255)
+		return s;
+	if (a == 0)
+		return d;
+
+	av_pixel res = 0;
+	for (size_t i = 0; i < 32; i += 8){
+		uint32_t t = ((s >> i) & 0xff) * a + ((d >> i) & 0xff) * (255 - a) + 128;
+		res |= (((t + (t >> 8)) >> 8) & 0xff) << i;
+	}
+	return res;
+}
+
+/* GL_DST_COLOR, GL_ONE_MINUS_SRC_ALPHA */
+static inline av_pixel blend_mult(av_pixel s, av_pixel d)
+{
+	uint32_t a = s >> 24;
+	av_pixel res = 0;
+	for (size_t i = 0; i < 32; i += 8){
+		uint32_t dc = (d >> i) & 0xff;
+		uint32_t v = mul255((s >> i) & 0xff, dc) + mul255(dc, 255 - a);
+		res |= (v > 255 ? 255 : v) << i;
+	}
+	return res;
+}
+
+/* GL_ONE, GL_ONE */
+static inline av_pixel blend_add(av_pixel s, av_pixel d)
+{
+	av_pixel res = 0;
+	for (size_t i = 0; i < 32; i += 8){
+		uint32_t v = ((s >> i) & 0xff) + ((d >> i) & 0xff);
+		res |= (v > 255 ? 255 : v) << i;
+	}
+	return res;
+}
+
+static void blend_span(av_pixel* dst,
+	const av_pixel* src, size_t n, enum arcan_blendfunc mode)
+{
+	size_t i = 0;
+
+	switch (mode){
+	case BLEND_NONE:
+		memcpy(dst, src, n * sizeof(av_pixel));
+	break;
+
+	case BLEND_ADD:
+#ifdef SOFT_SSE2
+		for (; i + 4 <= n; i += 4){
+			__m128i s = _mm_loadu_si128((const __m128i*)&src[i]);
+			__m128i d = _mm_loadu_si128((const __m128i*)&dst[i]);
+			_mm_storeu_si128((__m128i*)&dst[i], _mm_adds_epu8(s, d));
+		}
+#endif
+		for (; i < n; i++)
+			dst[i] = blend_add(src[i], dst[i]);
+	break;
+
+	case BLEND_MULTIPLY:
+#ifdef SOFT_SSE2
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i c255 = _mm_set1_epi16(255);
+		const __m128i c128 = _mm_set1_epi16(128);
+
+/* s * d / 255 + d * (255 - a) / 255, with both products rounded like mul255 */
+		for (; i + 4 <= n; i += 4){
+			__m128i s = _mm_loadu_si128((const __m128i*)&src[i]);
+			__m128i d = _mm_loadu_si128((const __m128i*)&dst[i]);
+			__m128i res[2];
+
+			for (size_t j = 0; j < 2; j++){
+				__m128i sw = j ? _mm_unpackhi_epi8(s, zero) : _mm_unpacklo_epi8(s, zero);
+				__m128i dw = j ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+				__m128i ia = _mm_sub_epi16(c255,
+					_mm_shufflehi_epi16(_mm_shufflelo_epi16(sw, 0xff), 0xff));
+				__m128i t1 = _mm_add_epi16(_mm_mullo_epi16(sw, dw), c128);
+				__m128i t2 = _mm_add_epi16(_mm_mullo_epi16(dw, ia), c128);
+				t1 = _mm_srli_epi16(_mm_add_epi16(t1, _mm_srli_epi16(t1, 8)), 8);
+				t2 = _mm_srli_epi16(_mm_add_epi16(t2, _mm_srli_epi16(t2, 8)), 8);
+				res[j] = _mm_add_epi16(t1, t2);
+			}
+
+			_mm_storeu_si128((__m128i*)&dst[i], _mm_packus_epi16(res[0], res[1]));
+		}
+	}
+#endif
+		for (; i < n; i++)
+			dst[i] = blend_mult(src[i], dst[i]);
+	break;
+
+	case BLEND_NORMAL:
+	case BLEND_FORCE:
+	default:
+#ifdef SOFT_SSE2
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i amask = _mm_set1_epi32(0xff000000);
+		const __m128i c255 = _mm_set1_epi16(255);
+		const __m128i c128 = _mm_set1_epi16(128);
+
+		for (; i + 4 <= n; i += 4){
+			__m128i s = _mm_loadu_si128((const __m128i*)&src[i]);
+			__m128i a = _mm_and_si128(s, amask);
+
+/* fully opaque or fully transparent groups are common and cheap */
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, amask)) == 0xffff){
+				_mm_storeu_si128((__m128i*)&dst[i], s);
+				continue;
+			}
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, zero)) == 0xffff)
+				continue;
+
+			__m128i d = _mm_loadu_si128((const __m128i*)&dst[i]);
+			__m128i sl = _mm_unpacklo_epi8(s, zero);
+			__m128i sh = _mm_unpackhi_epi8(s, zero);
+			__m128i dl = _mm_unpacklo_epi8(d, zero);
+			__m128i dh = _mm_unpackhi_epi8(d, zero);
+			__m128i al = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sl, 0xff), 0xff);
+			__m128i ah = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sh, 0xff), 0xff);
+
+			__m128i tl = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(sl, al),
+				_mm_mullo_epi16(dl, _mm_sub_epi16(c255, al))), c128);
+			__m128i th = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(sh, ah),
+				_mm_mullo_epi16(dh, _mm_sub_epi16(c255, ah))), c128);
+			tl = _mm_srli_epi16(_mm_add_epi16(tl, _mm_srli_epi16(tl, 8)), 8);
+			th = _mm_srli_epi16(_mm_add_epi16(th, _mm_srli_epi16(th, 8)), 8);
+
+			_mm_storeu_si128((__m128i*)&dst[i], _mm_packus_epi16(tl, th));
+		}
+	}
+#endif
+		for (; i < n; i++)
+			dst[i] = blend_normal(src[i], dst[i]);
+	break;
+	}
+}
+
+/*
+ * Sampling
+ */
+static inline int wrap(int v, int n, bool rep)
+{
+	if (rep){
+		v %= n;
+		return v < 0 ? v + n : v;
+	}
+	return v < 0 ? 0 : (v >= n ? n - 1 : v);
+}
+
+static inline av_pixel texel(const struct soft_cmd* c, int x, int y)
+{
+	return c->tbuf[wrap(y, c->th, c->rep_v) * c->tw + wrap(x, c->tw, c->rep_u)];
+}
+
+static inline av_pixel sample_linear(const struct soft_cmd* c, float u, float v)
+{
+	float fu = u - 0.5f, fv = v - 0.5f;
+	float xf = floorf(fu), yf = floorf(fv);
+	int x = xf, y = yf;
+	uint32_t wx = (fu - xf) * 256.0f;
+	uint32_t wy = (fv - yf) * 256.0f;
+
+	return lerp_px(
+		lerp_px(texel(c, x, y), texel(c, x + 1, y), wx),
+		lerp_px(texel(c, x, y + 1), texel(c, x + 1, y + 1), wx), wy
+	);
+}
+
+/*
+ * Scaled / rotated spans in 16.16 fixed point, texels are fetched directly
+ * when the footprint is inside the texture and through the wrap rules
+ * otherwise. The caller makes sure coordinates stay within range.
+ */
+static void affine_span(const struct soft_cmd* c,
+	float u, float v, float du, float dv, size_t n, av_pixel* out)
+{
+	const int tw = c->tw, th = c->th;
+
+	if (!c->linear){
+		int32_t fu = u * 65536.0f, fv = v * 65536.0f;
+		int32_t dfu = du * 65536.0f, dfv = dv * 65536.0f;
+
+		for (size_t i = 0; i < n; i++, fu += dfu, fv += dfv){
+			int x = fu >> 16, y = fv >> 16;
+			out[i] = ((unsigned)x < tw && (unsigned)y < th) ?
+				c->tbuf[y * tw + x] : texel(c, x, y);
+		}
+		return;
+	}
+
+	int32_t fu = (u - 0.5f) * 65536.0f, fv = (v - 0.5f) * 65536.0f;
+	int32_t dfu = du * 65536.0f, dfv = dv * 65536.0f;
+
+	for (size_t i = 0; i < n; i++, fu += dfu, fv += dfv){
+		int x = fu >> 16, y = fv >> 16;
+		uint32_t wx = (fu >> 8) & 0xff, wy = (fv >> 8) & 0xff;
+		av_pixel p00, p01, p10, p11;
+
+		if ((unsigned)x < tw - 1 && (unsigned)y < th - 1){
+			const av_pixel* row = &c->tbuf[y * tw + x];
+			p00 = row[0];
+			p01 = row[1];
+			p10 = row[tw];
+			p11 = row[tw + 1];
+		}
+		else {
+			p00 = texel(c, x, y);
+			p01 = texel(c, x + 1, y);
+			p10 = texel(c, x, y + 1);
+			p11 = texel(c, x + 1, y + 1);
+		}
+
+		out[i] = lerp_px(lerp_px(p00, p01, wx), lerp_px(p10, p11, wx), wy);
+	}
+}
+
+static inline bool center_aligned(float v)
+{
+	return fabsf(v - floorf(v) - 0.5f) < 0.001f;
+}
+
+/*
+ * Produce [n] shaded source pixels for a span starting at pixel [x, y].
+ * The returned pointer either aliases the texture (1:1 mapped spans) or
+ * [out] and should be treated as read-only.
+ */
+static const av_pixel* shade_span(const struct soft_cmd* c,
+	int x, int y, size_t n, av_pixel* out)
+{
+	const av_pixel* res = out;
+	float px = x + 0.5f, py = y + 0.5f;
+
+	if (c->shade == SHADE_COLOR){
+		for (size_t i = 0; i < n; i++)
+			out[i] = c->color;
+		return out;
+	}
+
+	if (c->persp){
+		float uq = c->u.a * px + c->u.b * py + c->u.c;
+		float vq = c->v.a * px + c->v.b * py + c->v.c;
+		float q = c->q.a * px + c->q.b * py + c->q.c;
+
+		for (size_t i = 0; i < n; i++){
+			float iq = q != 0.0f ? 1.0f / q : 0.0f;
+			float u = uq * iq, v = vq * iq;
+			out[i] = c->linear ? sample_linear(c, u, v) :
+				texel(c, floorf(u), floorf(v));
+			uq += c->u.a;
+			vq += c->v.a;
+			q += c->q.a;
+		}
+	}
+	else {
+		float u = c->u.a * px + c->u.b * py + c->u.c;
+		float v = c->v.a * px + c->v.b * py + c->v.c;
+		float du = c->u.a, dv = c->v.a;
+
+/* 1:1 mapping along the span, by far the most common case for 2D */
+		if (fabsf(du - 1.0f) < 0.0001f && fabsf(dv) < 0.0001f &&
+			(!c->linear || (center_aligned(u) && center_aligned(v)))){
+			const av_pixel* row =
+				&c->tbuf[wrap(floorf(v), c->th, c->rep_v) * c->tw];
+			int col = floorf(u);
+
+			if (col >= 0 && col + n <= c->tw)
+				res = &row[col];
+			else
+				for (size_t i = 0; i < n; i++)
+					out[i] = row[wrap(col + i, c->tw, c->rep_u)];
+		}
+		else if (fabsf(u) < 32000.0f && fabsf(v) < 32000.0f &&
+			fabsf(u + du * n) < 32000.0f && fabsf(v + dv * n) < 32000.0f)
+			affine_span(c, u, v, du, dv, n, out);
+
+		else if (!c->linear){
+			for (size_t i = 0; i < n; i++, u += du, v += dv)
+				out[i] = texel(c, floorf(u), floorf(v));
+		}
+		else {
+			for (size_t i = 0; i < n; i++, u += du, v += dv)
+				out[i] = sample_linear(c, u, v);
+		}
+	}
+
+/* obj_opacity only modulates alpha, like the default fragment shader */
+	if (c->opacity < 255){
+		for (size_t i = 0; i < n; i++)
+			out[i] = (res[i] & 0x00ffffff) |
+				(mul255(res[i] >> 24, c->opacity) << 24);
+		res = out;
+	}
+
+	return res;
+}
+
+/*
+ * Rasterization
+ */
+static void raster_span(struct surface* s,
+	const struct soft_cmd* c, int x, size_t n, int y)
+{
+	size_t ofs = y * s->w + x;
+	uint8_t cov[SOFT_TILE];
+	bool use_cov = false;
+
+	if (c->stencil == STENCIL_WRITE){
+		if (s->stencil)
+			memset(&s->stencil[ofs], 1, n);
+		return;
+	}
+
+	if (c->stencil == STENCIL_TEST && s->stencil){
+		memcpy(cov, &s->stencil[ofs], n);
+		use_cov = true;
+	}
+
+	if (c->depth && s->depth){
+		float* zb = &s->depth[ofs];
+		float z = c->z.a * (x + 0.5f) + c->z.b * (y + 0.5f) + c->z.c;
+
+		for (size_t i = 0; i < n; i++, z += c->z.a){
+			bool pass = (!use_cov || cov[i]) && z < zb[i];
+			if (pass)
+				zb[i] = z;
+			cov[i] = pass;
+		}
+		use_cov = true;
+	}
+
+	av_pixel scratch[SOFT_TILE];
+	const av_pixel* src = shade_span(c, x, y, n, scratch);
+	av_pixel* dst = &s->buf[ofs];
+
+	if (!use_cov){
+		blend_span(dst, src, n, c->blend);
+		return;
+	}
+
+/* split into runs of covered pixels to keep the vector path */
+	size_t i = 0;
+	while (i < n){
+		while (i < n && !cov[i])
+			i++;
+		size_t start = i;
+		while (i < n && cov[i])
+			i++;
+		if (i > start)
+			blend_span(&dst[start], &src[start], i - start, c->blend);
+	}
+}
+
+static void raster_tri(struct surface* s,
+	const struct soft_cmd* c, int x0, int y0, int x1, int y1)
+{
+	for (int y = y0; y < y1; y++){
+		float yc = y + 0.5f;
+		float xs[2];
+		size_t hits = 0;
+
+		for (size_t i = 0; i < 3 && hits < 2; i++){
+			const struct edge* e = &c->edges[i];
+			if (yc >= e->y0 && yc < e->y1)
+				xs[hits++] = e->x0 + (yc - e->y0) * e->dxdy;
+		}
+
+		if (hits < 2)
+			continue;
+
+/* pixel centers in [left, right), matches the top-left rule for shared
+ * edges as both triangles compute the exact same edge value */
+		float l = xs[0] < xs[1] ? xs[0] : xs[1];
+		float r = xs[0] < xs[1] ? xs[1] : xs[0];
+		int cx0 = ceilf(l - 0.5f);
+		int cx1 = ceilf(r - 0.5f);
+
+		if (cx0 < x0)
+			cx0 = x0;
+		if (cx1 > x1)
+			cx1 = x1;
+
+		if (cx0 < cx1)
+			raster_span(s, c, cx0, cx1 - cx0, y);
+	}
+}
+
+static void clear_rect(struct surface* s,
+	const struct soft_cmd* c, int x0, int y0, int x1, int y1)
+{
+	size_t n = x1 - x0;
+
+	for (int y = y0; y < y1; y++){
+		size_t ofs = y * s->w + x0;
+
+		if (c->clear_color)
+			for (size_t i = 0; i < n; i++)
+				s->buf[ofs + i] = c->color;
+
+		if (c->clear_stencil && s->stencil)
+			memset(&s->stencil[ofs], 0, n);
+
+		if (c->clear_depth && s->depth)
+			for (size_t i = 0; i < n; i++)
+				s->depth[ofs + i] = 1.0;
+	}
+}
+
+static void run_tile(size_t tile)
+{
+	struct surface* s = &pool.surf;
+	int tx0 = (tile % pool.tiles_x) * SOFT_TILE;
+	int ty0 = (tile / pool.tiles_x) * SOFT_TILE;
+	int tx1 = tx0 + SOFT_TILE > s->w ? s->w : tx0 + SOFT_TILE;
+	int ty1 = ty0 + SOFT_TILE > s->h ? s->h : ty0 + SOFT_TILE;
+
+	for (size_t i = 0; i < soft.n_cmds; i++){
+		const struct soft_cmd* c = &soft.cmds[i];
+		int x0 = c->x0 > tx0 ? c->x0 : tx0;
+		int y0 = c->y0 > ty0 ? c->y0 : ty0;
+		int x1 = c->x1 < tx1 ? c->x1 : tx1;
+		int y1 = c->y1 < ty1 ? c->y1 : ty1;
+
+		if (x0 >= x1 || y0 >= y1)
+			continue;
+
+		if (c->kind == CMD_CLEAR)
+			clear_rect(s, c, x0, y0, x1, y1);
+		else
+			raster_tri(s, c, x0, y0, x1, y1);
+	}
+}
+
+static void run_tiles()
+{
+	size_t tile;
+	while ((tile = atomic_fetch_add(&pool.next, 1)) < pool.n_tiles)
+		run_tile(tile);
+}
+
+static void* worker(void* arg)
+{
+	unsigned seen = 0;
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.alive){
+		if (pool.gen == seen){
+			pthread_cond_wait(&pool.wake, &pool.lock);
+			continue;
+		}
+		seen = pool.gen;
+		pthread_mutex_unlock(&pool.lock);
+
+		run_tiles();
+
+		pthread_mutex_lock(&pool.lock);
+		if (--pool.busy == 0)
+			pthread_cond_signal(&pool.done);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	return NULL;
+}
+
+/*
+ * Execute all queued commands against the active rendertarget
+ */
+static void flush()
+{
+	if (!soft.n_cmds)
+		return;
+
+	struct soft_tex* t = soft.rt ? store_tex(soft.rt->store) : NULL;
+	if (!t || !t->w || !t->h){
+		soft.n_cmds = 0;
+		return;
+	}
+
+	bool aux = soft.rt->aux_w == t->w && soft.rt->aux_h == t->h;
+	pool.surf = (struct surface){
+		.buf = t->buf,
+		.w = t->w,
+		.h = t->h,
+		.stencil = aux ? soft.rt->stencil : NULL,
+		.depth = aux ? soft.rt->depth : NULL
+	};
+	pool.tiles_x = (t->w + SOFT_TILE - 1) / SOFT_TILE;
+	pool.n_tiles = pool.tiles_x * ((t->h + SOFT_TILE - 1) / SOFT_TILE);
+	atomic_store(&pool.next, 0);
+
+/* small jobs are not worth the wakeup */
+	if (pool.n_threads == 0 || pool.n_tiles < 4){
+		run_tiles();
+		soft.n_cmds = 0;
+		return;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	pool.busy = pool.n_threads;
+	pool.gen++;
+	pthread_cond_broadcast(&pool.wake);
+	pthread_mutex_unlock(&pool.lock);
+
+	run_tiles();
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.busy)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+
+	soft.n_cmds = 0;
+}
+
+static struct soft_cmd* alloc_cmd()
+{
+	if (soft.n_cmds == soft.cmd_cap){
+		size_t nc = soft.cmd_cap ? soft.cmd_cap * 2 : 256;
+		struct soft_cmd* cmds = arcan_alloc_mem(nc * sizeof(struct soft_cmd),
+			ARCAN_MEM_VSTRUCT, ARCAN_MEM_NONFATAL, ARCAN_MEMALIGN_NATURAL);
+
+/* out of memory, drain the queue and reuse it */
+		if (!cmds){
+			flush();
+			return soft.cmd_cap ? &soft.cmds[soft.n_cmds++] : NULL;
+		}
+
+		if (soft.cmds){
+			memcpy(cmds, soft.cmds, soft.n_cmds * sizeof(struct soft_cmd));
+			arcan_mem_free(soft.cmds);
+		}
+		soft.cmds = cmds;
+		soft.cmd_cap = nc;
+	}
+
+	struct soft_cmd* res = &soft.cmds[soft.n_cmds++];
+	memset(res, '\0', sizeof(struct soft_cmd));
+	return res;
+}
+
+static void queue_clear(bool color, bool depth, bool stencil)
+{
+	if (!soft.rt || !soft.rt->store->w || !soft.rt->store->h)
+		return;
+
+	struct soft_cmd* c = alloc_cmd();
+	if (!c)
+		return;
+
+	c->kind = CMD_CLEAR;
+	c->x1 = soft.rt->store->w;
+	c->y1 = soft.rt->store->h;
+	c->color = RGBA(0, 0, 0, 255);
+	c->clear_color = color;
+	c->clear_depth = depth;
+	c->clear_stencil = stencil;
+}
+
+static void set_edge(struct edge* e, const struct svert* a, const struct svert* b)
+{
+/* canonical order so that a shared edge yields identical values */
+	if (a->y > b->y || (a->y == b->y && a->x > b->x)){
+		const struct svert* t = a;
+		a = b;
+		b = t;
+	}
+
+	e->y0 = a->y;
+	e->y1 = b->y;
+	e->x0 = a->x;
+	e->dxdy = a->y == b->y ? 0 : (b->x - a->x) / (b->y - a->y);
+}
+
+static void set_plane(struct plane* p, const struct svert* v[3],
+	float a0, float a1, float a2, float det)
+{
+	float dx1 = v[1]->x - v[0]->x, dy1 = v[1]->y - v[0]->y;
+	float dx2 = v[2]->x - v[0]->x, dy2 = v[2]->y - v[0]->y;
+
+	p->a = ((a1 - a0) * dy2 - (a2 - a0) * dy1) / det;
+	p->b = ((a2 - a0) * dx1 - (a1 - a0) * dx2) / det;
+	p->c = a0 - p->a * v[0]->x - p->b * v[0]->y;
+}
+
+static inline float clampf(float v, float lo, float hi)
+{
+	return v < lo ? lo : (v > hi ? hi : v);
+}
+
+/*
+ * Resolve the state that applies to the next draw calls, returns false
+ * if nothing would be drawn.
+ */
+static bool draw_state(struct soft_cmd* c, bool txcos)
+{
+	struct shader_cont* shdr = agp_shader_valid(shdr_global.active_prg) ?
+		&shdr_global.slots[SHADER_INDEX(shdr_global.active_prg)] : NULL;
+	float opa = clampf(shdr_global.opacity, 0.0, 1.0);
+
+	c->kind = CMD_TRI;
+	c->stencil = soft.stencil;
+	c->blend = soft.blend;
+	c->depth = soft.depth && soft.rt->depth;
+	c->opacity = opa * 255.0f + 0.5f;
+
+	if (c->stencil == STENCIL_WRITE)
+		return true;
+
+	struct soft_tex* t = store_tex(soft.active);
+	if (shdr && shdr->kind == SHADE_TEX && txcos && t && t->w && t->h){
+		c->shade = SHADE_TEX;
+		c->tbuf = t->buf;
+		c->tw = t->w;
+		c->th = t->h;
+		c->rep_u = soft.active->txu == ARCAN_VTEX_REPEAT;
+		c->rep_v = soft.active->txv == ARCAN_VTEX_REPEAT;
+		c->linear =
+			(soft.active->filtermode & ~ARCAN_VFILTER_MIPMAP) != ARCAN_VFILTER_NONE;
+		return true;
+	}
+
+/* color shading, obj_col from the active uniform group */
+	float col[3] = {1.0, 1.0, 1.0};
+	if (shdr && GROUP_INDEX(shdr_global.active_prg) < shdr->ugroups.count){
+		struct shaderv* cur =
+			shdr->ugroups.cdata[GROUP_INDEX(shdr_global.active_prg)];
+		for (; cur; cur = cur->next)
+			if (cur->type == shdrvec3 && strcmp(cur->label, "obj_col") == 0){
+				memcpy(col, cur->data, sizeof(float) * 3);
+				break;
+			}
+	}
+
+	c->shade = SHADE_COLOR;
+	c->color = RGBA(
+		(uint8_t)(clampf(col[0], 0.0, 1.0) * 255.0f + 0.5f),
+		(uint8_t)(clampf(col[1], 0.0, 1.0) * 255.0f + 0.5f),
+		(uint8_t)(clampf(col[2], 0.0, 1.0) * 255.0f + 0.5f),
+		c->opacity
+	);
+
+	return true;
+}
+
+/*
+ * Queue one window space triangle using [tmpl] for state, the caller
+ * has already done culling.
+ */
+static void emit_tri(const struct soft_cmd* tmpl,
+	const struct svert* a, const struct svert* b, const struct svert* c)
+{
+	const struct svert* v[3] = {a, b, c};
+	float det = (b->x - a->x) * (c->y - a->y) - (c->x - a->x) * (b->y - a->y);
+	if (fabsf(det) < 1e-6f)
+		return;
+
+	float w = soft.rt->store->w, h = soft.rt->store->h;
+	float minx = fminf(a->x, fminf(b->x, c->x));
+	float maxx = fmaxf(a->x, fmaxf(b->x, c->x));
+	float miny = fminf(a->y, fminf(b->y, c->y));
+	float maxy = fmaxf(a->y, fmaxf(b->y, c->y));
+
+	int x0 = floorf(clampf(minx, 0, w));
+	int x1 = ceilf(clampf(maxx, 0, w));
+	int y0 = floorf(clampf(miny, 0, h));
+	int y1 = ceilf(clampf(maxy, 0, h));
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	struct soft_cmd* cmd = alloc_cmd();
+	if (!cmd)
+		return;
+
+	*cmd = *tmpl;
+	cmd->x0 = x0;
+	cmd->y0 = y0;
+	cmd->x1 = x1;
+	cmd->y1 = y1;
+
+	set_edge(&cmd->edges[0], a, b);
+	set_edge(&cmd->edges[1], b, c);
+	set_edge(&cmd->edges[2], c, a);
+
+	cmd->persp = !(a->w == b->w && b->w == c->w);
+	if (cmd->persp){
+		set_plane(&cmd->u, v, a->u * a->w, b->u * b->w, c->u * c->w, det);
+		set_plane(&cmd->v, v, a->v * a->w, b->v * b->w, c->v * c->w, det);
+		set_plane(&cmd->q, v, a->w, b->w, c->w, det);
+	}
+	else {
+		set_plane(&cmd->u, v, a->u, b->u, c->u, det);
+		set_plane(&cmd->v, v, a->v, b->v, c->v, det);
+	}
+
+	if (cmd->depth)
+		set_plane(&cmd->z, v, a->z, b->z, c->z, det);
+}
+
+static void transform(const float* mvp,
+	float x, float y, float z, float* out)
+{
+	for (size_t i = 0; i < 4; i++)
+		out[i] = mvp[i] * x + mvp[4 + i] * y + mvp[8 + i] * z + mvp[12 + i];
+}
+
+static void to_window(const float* clip, float u, float v,
+	const struct soft_cmd* tmpl, struct svert* out)
+{
+	float iw = clip[3] != 0.0f ? 1.0f / clip[3] : 1.0f;
+	out->x = (clip[0] * iw + 1.0f) * 0.5f * soft.rt->store->w;
+	out->y = (clip[1] * iw + 1.0f) * 0.5f * soft.rt->store->h;
+	out->z = (clip[2] * iw + 1.0f) * 0.5f;
+	out->w = iw;
+
+/* texture coordinates are kept in texel units */
+	out->u = u * tmpl->tw;
+	out->v = v * tmpl->th;
+}
+
+static void current_mvp(float* mvp)
+{
+	_Alignas(16) float proj[16];
+	_Alignas(16) float mv[16];
+	memcpy(proj, shdr_global.projection, sizeof(proj));
+	memcpy(mv, shdr_global.modelview, sizeof(mv));
+
+/* local version of multiply_matrix as the frameservers that link the AGP
+ * layer (HEADLESS_NOARCAN) don't have arcan_math */
+	for (int i = 0; i < 16; i += 4)
+		for (int j = 0; j < 4; j++)
+			mvp[i+j] = mv[i] * proj[j] + mv[i+1] * proj[j+4] +
+				mv[i+2] * proj[j+8] + mv[i+3] * proj[j+12];
+}
+
+void agp_draw_vobj(float x1, float y1, float x2, float y2,
+	const float* txcos, const float* model)
+{
+	agp_shader_envv(MODELVIEW_MATR,
+		model ? (void*) model : ident, sizeof(float) * 16);
+
+	if (!soft.rt)
+		return;
+
+	struct soft_cmd tmpl = {0};
+	if (!draw_state(&tmpl, txcos != NULL))
+		return;
+
+	_Alignas(16) float mvp[16];
+	current_mvp(mvp);
+
+	float verts[4][2] = {{x1, y1}, {x2, y1}, {x2, y2}, {x1, y2}};
+	struct svert v[4];
+
+	for (size_t i = 0; i < 4; i++){
+		float clip[4];
+		transform(mvp, verts[i][0], verts[i][1], 0.0, clip);
+		to_window(clip, txcos ? txcos[i * 2] : 0, txcos ? txcos[i * 2 + 1] : 0,
+			&tmpl, &v[i]);
+	}
+
+/* same split as the GL_TRIANGLE_FAN used by glshared.c */
+	emit_tri(&tmpl, &v[0], &v[1], &v[2]);
+	emit_tri(&tmpl, &v[0], &v[2], &v[3]);
+}
+
+/*
+ * clip a triangle (clip space + texture coordinates) against the near plane
+ * (z >= -w), emits 0..2 window space triangles
+ */
+static void clip_emit(const struct soft_cmd* tmpl,
+	float in[3][6], enum agp_mesh_flags fl)
+{
+	float poly[4][6];
+	size_t np = 0;
+
+	for (size_t i = 0; i < 3; i++){
+		float* a = in[i];
+		float* b = in[(i + 1) % 3];
+		float da = a[2] + a[3], db = b[2] + b[3];
+
+		if (da >= 0)
+			memcpy(poly[np++], a, sizeof(float) * 6);
+
+		if ((da >= 0) != (db >= 0)){
+			float t = da / (da - db);
+			for (size_t j = 0; j < 6; j++)
+				poly[np][j] = a[j] + (b[j] - a[j]) * t;
+			np++;
+		}
+	}
+
+	if (np < 3)
+		return;
+
+	struct svert v[4];
+	for (size_t i = 0; i < np; i++)
+		to_window(poly[i], poly[i][4], poly[i][5], tmpl, &v[i]);
+
+/* glFrontFace(GL_CW): clockwise in window space is front facing */
+	float det = (v[1].x - v[0].x) * (v[2].y - v[0].y) -
+		(v[2].x - v[0].x) * (v[1].y - v[0].y);
+	bool front = det < 0;
+
+	if ((fl & MESH_FACING_BOTH) == MESH_FACING_FRONT && !front)
+		return;
+	if ((fl & MESH_FACING_BOTH) == MESH_FACING_BACK && front)
+		return;
+
+	emit_tri(tmpl, &v[0], &v[1], &v[2]);
+	if (np == 4)
+		emit_tri(tmpl, &v[0], &v[2], &v[3]);
+}
+
+void agp_submit_mesh(struct mesh_storage_t* base, enum agp_mesh_flags fl)
+{
+	if (!soft.rt || !base->verts || base->type != AGP_MESH_TRISOUP)
+		return;
+
+	struct soft_cmd tmpl = {0};
+	if (!draw_state(&tmpl, base->txcos != NULL))
+		return;
+
+	_Alignas(16) float mvp[16];
+	current_mvp(mvp);
+
+	size_t n = base->indices ? base->n_indices : base->n_vertices;
+
+	for (size_t i = 0; i + 2 < n; i += 3){
+		float tri[3][6];
+		bool ok = true;
+
+		for (size_t j = 0; j < 3 && ok; j++){
+			size_t ind = base->indices ? base->indices[i + j] : i + j;
+			if (ind >= base->n_vertices){
+				ok = false;
+				break;
+			}
+
+			float* pos = &base->verts[ind * 3];
+			transform(mvp, pos[0], pos[1], pos[2], tri[j]);
+			tri[j][4] = base->txcos ? base->txcos[ind * 2] : 0;
+			tri[j][5] = base->txcos ? base->txcos[ind * 2 + 1] : 0;
+		}
+
+		if (ok)
+			clip_emit(&tmpl, tri, fl);
+	}
+}
+
+void agp_invalidate_mesh(struct mesh_storage_t* base)
+{
+}
+
+/*
+ * Stores
+ */
+static void alloc_buffer(struct storage_info_t* s)
+{
+	if (s->vinf.text.s_raw != s->w * s->h * sizeof(av_pixel)){
+		arcan_mem_free(s->vinf.text.raw);
+		s->vinf.text.raw = NULL;
+	}
+
+	if (!s->vinf.text.raw){
+		s->vinf.text.s_raw = s->w * s->h * sizeof(av_pixel);
+		s->vinf.text.raw = arcan_alloc_mem(s->vinf.text.s_raw,
+			ARCAN_MEM_VBUFFER, ARCAN_MEM_BZERO, ARCAN_MEMALIGN_PAGE);
+	}
+}
+
+/*
+ * same source layout as the GL unpack setup in gl21.c, [buf] is a full
+ * store sized buffer and [meta] (if dirty) selects the region to copy
+ */
+static void upload_region(struct storage_info_t* s,
+	const av_pixel* buf, struct stream_meta* meta)
+{
+	if (!buf)
+		return;
+
+	flush();
+	struct soft_tex* t = tex_ensure(s);
+	if (!t)
+		return;
+
+	if (!meta || !meta->dirty){
+		memcpy(t->buf, buf, t->w * t->h * sizeof(av_pixel));
+		return;
+	}
+
+	size_t x1 = meta->x1 < t->w ? meta->x1 : t->w;
+	size_t y1 = meta->y1 < t->h ? meta->y1 : t->h;
+	size_t w = x1 + meta->w > t->w ? t->w - x1 : meta->w;
+	size_t h = y1 + meta->h > t->h ? t->h - y1 : meta->h;
+
+	for (size_t y = y1; y < y1 + h; y++)
+		memcpy(&t->buf[y * t->w + x1], &buf[y * s->w + x1], w * sizeof(av_pixel));
+}
+
+void agp_empty_vstore(struct storage_info_t* vs, size_t w, size_t h)
+{
+	flush();
+	vs->w = w;
+	vs->h = h;
+	vs->bpp = sizeof(av_pixel);
+	vs->txmapped = TXSTATE_TEX2D;
+
+	struct soft_tex* t = tex_ensure(vs);
+	if (t)
+		memset(t->buf, '\0', t->w * t->h * sizeof(av_pixel));
+
+	if (vs->refcount == 0)
+		vs->refcount = 1;
+
+	FLAG_DIRTY();
+}
+
+void agp_empty_vstoreext(struct storage_info_t* vs,
+	size_t w, size_t h, enum vstore_hint hint)
+{
+	agp_empty_vstore(vs, w, h);
+}
+
+void agp_update_vstore(struct storage_info_t* s, bool copy)
+{
+	if (s->txmapped == TXSTATE_OFF)
+		return;
+
+	FLAG_DIRTY();
+
+/* filtering and wrapping are read from the store when drawing */
+	if (!copy)
+		return;
+
+	if (s->refcount == 0)
+		s->refcount = 1;
+
+	flush();
+	struct soft_tex* t = tex_ensure(s);
+	if (!t)
+		return;
+
+	if (s->vinf.text.raw &&
+		s->vinf.text.s_raw >= t->w * t->h * sizeof(av_pixel))
+		memcpy(t->buf, s->vinf.text.raw, t->w * t->h * sizeof(av_pixel));
+
+	s->update_ts = arcan_timemillis();
+
+#ifndef HEADLESS_NOARCAN
+	if (arcan_video_display.conservative){
+		arcan_mem_free(s->vinf.text.raw);
+		s->vinf.text.raw = NULL;
+		s->vinf.text.s_raw = 0;
+	}
+#endif
+}
+
+/* the rasterizer only samples RGBA, compressed sources are decoded instead */
+bool agp_txcomp_supported(enum agp_txcomp fmt)
+{
+	return false;
+}
+
+void agp_null_vstore(struct storage_info_t* store)
+{
+	if (!store || store->txmapped != TXSTATE_TEX2D)
+		return;
+
+	flush();
+	free_tex(store);
+}
+
+void agp_drop_vstore(struct storage_info_t* s)
+{
+	if (!s)
+		return;
+
+	flush();
+	free_tex(s);
+}
+
+void agp_resize_vstore(struct storage_info_t* s, size_t w, size_t h)
+{
+	s->w = w;
+	s->h = h;
+	s->bpp = sizeof(av_pixel);
+
+	alloc_buffer(s);
+	agp_update_vstore(s, true);
+}
+
+void agp_activate_vstore(struct storage_info_t* s)
+{
+	soft.active = s;
+}
+
+void agp_deactivate_vstore()
+{
+	soft.active = NULL;
+}
+
+/* there is only one sampler, use the first (current) frame */
+void agp_activate_vstore_multi(struct storage_info_t** backing, size_t n)
+{
+	soft.active = n > 0 ? backing[0] : NULL;
+}
+
+struct stream_meta agp_stream_prepare(struct storage_info_t* s,
+		struct stream_meta meta, enum stream_type type)
+{
+	struct stream_meta res = meta;
+	res.state = true;
+	res.type = type;
+
+	switch (type){
+	case STREAM_RAW:
+		alloc_buffer(s);
+		res.buf = s->vinf.text.raw;
+		res.state = res.buf != NULL;
+	break;
+
+	case STREAM_RAW_DIRECT_COPY:
+		alloc_buffer(s);
+		if (s->vinf.text.raw && meta.buf)
+			memcpy(s->vinf.text.raw, meta.buf, s->vinf.text.s_raw);
+
+	case STREAM_RAW_DIRECT:
+	case STREAM_RAW_DIRECT_SYNCHRONOUS:
+		upload_region(s, meta.buf, &meta);
+	break;
+
+	case STREAM_HANDLE:
+		res.state = platform_video_map_handle(s, meta.handle);
+	break;
+	}
+
+	return res;
+}
+
+void agp_stream_release(struct storage_info_t* s, struct stream_meta meta)
+{
+	upload_region(s, s->vinf.text.raw, &meta);
+}
+
+void agp_stream_commit(struct storage_info_t* s, struct stream_meta meta)
+{
+}
+
+/*
+ * Readback, the store is already in host memory so this is a copy for
+ * the synchronous version and a pointer handoff for the asynchronous one
+ */
+void agp_readback_synchronous(struct storage_info_t* dst)
+{
+	if (dst->txmapped != TXSTATE_TEX2D || !dst->vinf.text.raw)
+		return;
+
+	flush();
+	struct soft_tex* t = store_tex(dst);
+	if (!t)
+		return;
+
+	size_t nb = t->w * t->h * sizeof(av_pixel);
+	memcpy(dst->vinf.text.raw, t->buf,
+		nb < dst->vinf.text.s_raw ? nb : dst->vinf.text.s_raw);
+}
+
+bool agp_request_readback(struct storage_info_t* store)
+{
+	struct soft_tex* t = store_tex(store);
+	if (!t || t->rb_pending)
+		return false;
+
+	t->rb_pending = true;
+	t->rb_ts = arcan_timemillis();
+	return true;
+}
+
+size_t agp_readback_pending(struct storage_info_t* store)
+{
+	struct soft_tex* t = store_tex(store);
+	return t && t->rb_pending ? 1 : 0;
+}
+
+static void readback_release(void* tag)
+{
+	uintptr_t id = (uintptr_t) tag;
+	if (id && id <= soft.n_tex)
+		soft.tex[id - 1].rb_pending = false;
+}
+
+struct asynch_readback_meta agp_poll_readback(struct storage_info_t* store)
+{
+	struct asynch_readback_meta res = {0};
+	struct soft_tex* t = store_tex(store);
+	if (!t || !t->rb_pending)
+		return res;
+
+	flush();
+	res.ptr = t->buf;
+	res.w = t->w;
+	res.h = t->h;
+	res.stride = t->w * sizeof(av_pixel);
+	res.buf_sz = t->w * t->h * sizeof(av_pixel);
+	res.ts = t->rb_ts;
+	res.release = readback_release;
+	res.tag = (void*)(uintptr_t) store->vinf.text.glid;
+
+	return res;
+}
+
+/*
+ * Rendertargets
+ */
+struct agp_rendertarget* agp_setup_rendertarget(
+	struct storage_info_t* vstore, enum rendertarget_mode m)
+{
+	struct agp_rendertarget* r = arcan_alloc_mem(
+		sizeof(struct agp_rendertarget),
+		ARCAN_MEM_VSTRUCT, ARCAN_MEM_BZERO, ARCAN_MEMALIGN_NATURAL);
+
+	r->store = vstore;
+	r->mode = m;
+	tex_ensure(vstore);
+
+	return r;
+}
+
+void agp_rendertarget_ids(struct agp_rendertarget* rtgt, uintptr_t* tgt,
+	uintptr_t* col, uintptr_t* depth)
+{
+	if (tgt)
+		*tgt = 0;
+	if (col)
+		*col = rtgt->store->vinf.text.glid;
+	if (depth)
+		*depth = 0;
+}
+
+void agp_drop_rendertarget(struct agp_rendertarget* tgt)
+{
+	if (!tgt)
+		return;
+
+	if (soft.rt == tgt){
+		flush();
+		soft.rt = NULL;
+	}
+
+	arcan_mem_free(tgt->stencil);
+	arcan_mem_free(tgt->depth);
+	arcan_mem_free(tgt);
+}
+
+void agp_resize_rendertarget(
+	struct agp_rendertarget* tgt, size_t neww, size_t newh)
+{
+	if (!tgt || !tgt->store){
+		arcan_warning("attempted resize on broken rendertarget\n");
+		return;
+	}
+
+	if (tgt->store->w == neww && tgt->store->h == newh)
+		return;
+
+	flush();
+	struct storage_info_t* os = tgt->store;
+	arcan_mem_free(os->vinf.text.raw);
+	os->vinf.text.raw = NULL;
+	os->vinf.text.s_raw = 0;
+	agp_empty_vstore(os, neww, newh);
+	rt_aux(tgt, false, false);
+}
+
+/* the default output is a rendertarget of its own, sized after the display */
+static struct agp_rendertarget* output_rt()
+{
+	struct monitor_mode mode = platform_video_dimensions();
+	struct storage_info_t* s = &soft.out_store;
+
+	if (!soft.out.store){
+		s->txmapped = TXSTATE_TEX2D;
+		s->refcount = 1;
+		soft.out.store = s;
+		soft.out.mode = RENDERTARGET_COLOR_DEPTH_STENCIL;
+	}
+
+	if (s->w != mode.width || s->h != mode.height || !store_tex(s)){
+		s->w = mode.width;
+		s->h = mode.height;
+		tex_ensure(s);
+	}
+
+	return &soft.out;
+}
+
+void agp_activate_rendertarget(struct agp_rendertarget* tgt)
+{
+	struct agp_rendertarget* nrt = tgt ? tgt : output_rt();
+	if (nrt != soft.rt)
+		flush();
+
+	soft.rt = nrt;
+	tex_ensure(nrt->store);
+}
+
+void agp_rendertarget_clear()
+{
+	if (!soft.rt)
+		return;
+
+	bool depth = soft.rt->mode > RENDERTARGET_COLOR;
+	if (depth)
+		rt_aux(soft.rt, false, true);
+
+	queue_clear(true, depth, false);
+}
+
+void agp_pipeline_hint(enum pipeline_mode mode)
+{
+	switch (mode){
+	case PIPELINE_2D:
+		soft.depth = false;
+	break;
+
+	case PIPELINE_3D:
+		if (soft.rt && soft.rt->mode != RENDERTARGET_COLOR){
+			rt_aux(soft.rt, false, true);
+			soft.depth = true;
+			queue_clear(false, true, false);
+		}
+	break;
+	}
+}
+
+void agp_prepare_stencil()
+{
+	if (!soft.rt)
+		return;
+
+	rt_aux(soft.rt, true, false);
+	queue_clear(false, false, true);
+	soft.stencil = STENCIL_WRITE;
+}
+
+void agp_activate_stencil()
+{
+	soft.stencil = STENCIL_TEST;
+}
+
+void agp_disable_stencil()
+{
+	soft.stencil = STENCIL_OFF;
+}
+
+void agp_blendstate(enum arcan_blendfunc mode)
+{
+	soft.blend = mode;
+}
+
+void agp_save_output(size_t w, size_t h, av_pixel* dst, size_t dsz)
+{
+	struct agp_rendertarget* rt = soft.rt;
+	agp_activate_rendertarget(NULL);
+	flush();
+
+	struct soft_tex* t = store_tex(soft.out.store);
+	if (!t)
+		return;
+
+	size_t cw = w < t->w ? w : t->w;
+	for (size_t y = 0; y < h && y < t->h && (y + 1) * w * sizeof(av_pixel) <= dsz; y++)
+		memcpy(&dst[y * w], &t->buf[y * t->w], cw * sizeof(av_pixel));
+
+	if (rt)
+		soft.rt = rt;
+}
+
+/*
+ * Initialization
+ */
+const char* agp_ident()
+{
+	return "SOFT";
+}
+
+const char* agp_shader_language()
+{
+	return "NONE";
+}
+
+const char** agp_envopts()
+{
+	static const char* env[] = {
+		"ARCAN_AGP_THREADS=n", "number of rasterizer threads (0, single)",
+		NULL
+	};
+	return env;
+}
+
+void agp_init()
+{
+	if (pool.alive)
+		return;
+
+	long nt = sysconf(_SC_NPROCESSORS_ONLN);
+	const char* env = getenv("ARCAN_AGP_THREADS");
+	if (env)
+		nt = strtol(env, NULL, 10);
+
+/* the flushing thread participates, so one less worker */
+	if (nt > SOFT_MAX_THREADS)
+		nt = SOFT_MAX_THREADS;
+	nt = nt > 1 ? nt - 1 : 0;
+
+	pool.alive = true;
+	for (size_t i = 0; i < nt; i++){
+		if (0 != pthread_create(&pool.threads[pool.n_threads], NULL, worker, NULL))
+			break;
+		pool.n_threads++;
+	}
+
+	arcan_warning("agp(soft): %zu rasterizer threads, %s blending\n",
+		pool.n_threads + 1,
+#ifdef SOFT_SSE2
+		"SSE2"
+#else
+		"scalar"
+#endif
+	);
+}
+
+/*
+ * Shaders
+ */
+static enum shade_kind classify(const char* frag)
+{
+	if (!frag)
+		return SHADE_TEX;
+
+	if (strstr(frag, "texture") == NULL && strstr(frag, "obj_col") != NULL)
+		return SHADE_COLOR;
+
+	return SHADE_TEX;
+}
+
+agp_shader_id agp_default_shader(enum SHADER_TYPES type)
+{
+	static agp_shader_id shids[SHADER_TYPE_ENDM];
+	static bool defshdr_build;
+
+	if (type >= SHADER_TYPE_ENDM)
+		return BROKEN_SHADER;
+
+	if (!defshdr_build){
+		shids[BASIC_2D] = agp_shader_build("DEFAULT", NULL, defvprg, deffprg);
+		shids[COLOR_2D] = agp_shader_build(
+			"DEFAULT_COLOR", NULL, defcvprg, defcfprg);
+		shids[BASIC_3D] = shids[BASIC_2D];
+		defshdr_build = true;
+	}
+
+	return shids[type];
+}
+
+void agp_shader_source(enum SHADER_TYPES type,
+	const char** vert, const char** frag)
+{
+	switch(type){
+	case BASIC_2D:
+	case BASIC_3D:
+		*vert = defvprg;
+		*frag = deffprg;
+	break;
+
+	case COLOR_2D:
+		*vert = defcvprg;
+		*frag = defcfprg;
+	break;
+
+	default:
+		*vert = NULL;
+		*frag = NULL;
+	break;
+	}
+}
+
+int agp_shader_activate(agp_shader_id shid)
+{
+	if (!agp_shader_valid(shid))
+		return ARCAN_ERRC_NO_SUCH_OBJECT;
+
+	struct shader_cont* cur = &shdr_global.slots[SHADER_INDEX(shid)];
+	if (GROUP_INDEX(shid) >= cur->ugroups.count){
+		arcan_warning("attempt to activate shader with broken group index\n");
+		return -1;
+	}
+
+	shdr_global.active_prg = shid;
+	return ARCAN_OK;
+}
+
+agp_shader_id agp_shader_lookup(const char* tag)
+{
+	for (size_t i = 0; i < sizeof(shdr_global.slots) /
+		sizeof(shdr_global.slots[0]); i++){
+		if (shdr_global.slots[i].label &&
+			strcmp(tag, shdr_global.slots[i].label) == 0)
+			return i;
+	}
+
+	return BROKEN_SHADER;
+}
+
+const char* agp_shader_lookuptag(agp_shader_id id)
+{
+	if (!agp_shader_valid(id))
+		return NULL;
+
+	return shdr_global.slots[SHADER_INDEX(id)].label;
+}
+
+bool agp_shader_lookupprgs(agp_shader_id id,
+	const char** vert, const char** frag)
+{
+	if (!agp_shader_valid(id))
+		return false;
+
+	if (vert)
+		*vert = shdr_global.slots[SHADER_INDEX(id)].vertex;
+
+	if (frag)
+		*frag = shdr_global.slots[SHADER_INDEX(id)].fragment;
+
+	return true;
+}
+
+bool agp_shader_valid(agp_shader_id id)
+{
+	return (id != BROKEN_SHADER && SHADER_INDEX(id) <
+		sizeof(shdr_global.slots) / sizeof(shdr_global.slots[0]) &&
+		shdr_global.slots[SHADER_INDEX(id)].label != NULL
+	);
+}
+
+static void drop_groups(struct shader_cont* cur)
+{
+	for (size_t i = 0; i < cur->ugroups.count; i++){
+		struct shaderv* first = cur->ugroups.cdata[i];
+		while (first){
+			struct shaderv* last = first;
+			free(first->label);
+			first = first->next;
+			arcan_mem_free(last);
+		}
+	}
+
+	arcan_mem_free(cur->ugroups.data);
+}
+
+agp_shader_id agp_shader_build(const char* tag, const char* geom,
+	const char* vert, const char* frag)
+{
+	int slot_lim = sizeof(shdr_global.slots) / sizeof(shdr_global.slots[0]);
+	int dstind = -1;
+
+	if (!tag || !vert || !frag)
+		return BROKEN_SHADER;
+
+/* replace a preexisting tag, otherwise find a free slot */
+	for (size_t i = 0; i < slot_lim; i++)
+		if (shdr_global.slots[i].label &&
+			strcmp(shdr_global.slots[i].label, tag) == 0){
+			dstind = i;
+			break;
+		}
+
+	if (dstind != -1){
+		struct shader_cont* cur = &shdr_global.slots[dstind];
+		drop_groups(cur);
+		free(cur->vertex);
+		free(cur->fragment);
+		free(cur->label);
+		memset(cur, '\0', sizeof(struct shader_cont));
+	}
+	else {
+		shdr_global.ofs = (shdr_global.ofs + 1) % slot_lim;
+		if (!shdr_global.slots[shdr_global.ofs].label)
+			dstind = shdr_global.ofs;
+		else
+			for (size_t i = 0; i < slot_lim; i++)
+				if (!shdr_global.slots[i].label){
+					dstind = i;
+					break;
+				}
+	}
+
+	if (dstind == -1)
+		return BROKEN_SHADER;
+
+	struct shader_cont* cur = &shdr_global.slots[dstind];
+	cur->label = strdup(tag);
+	cur->vertex = strdup(vert);
+	cur->fragment = strdup(frag);
+	cur->kind = classify(frag);
+
+	arcan_mem_growarr(&cur->ugroups);
+	cur->ugroups.count = 1;
+
+	return (uint32_t)dstind;
+}
+
+agp_shader_id agp_shader_addgroup(agp_shader_id shid)
+{
+	if (!agp_shader_valid(shid))
+		return BROKEN_SHADER;
+
+	struct shader_cont* cur = &shdr_global.slots[SHADER_INDEX(shid)];
+	if (cur->ugroups.limit - cur->ugroups.count == 0)
+		arcan_mem_growarr(&cur->ugroups);
+
+	uint16_t group_ind = cur->ugroups.count++;
+	struct shaderv** chain = (struct shaderv**) &cur->ugroups.cdata[group_ind];
+
+/* duplicate the chain from the source group */
+	struct shaderv* mgroup = cur->ugroups.cdata[GROUP_INDEX(shid)];
+	while (mgroup){
+		*chain = arcan_alloc_mem(sizeof(struct shaderv),
+			ARCAN_MEM_VSTRUCT, ARCAN_MEM_BZERO, ARCAN_MEMALIGN_NATURAL);
+		memcpy(*chain, mgroup, sizeof(struct shaderv));
+		(*chain)->label = strdup(mgroup->label);
+		(*chain)->next = NULL;
+		chain = &((*chain)->next);
+		mgroup = mgroup->next;
+	}
+
+	return SHADER_ID(SHADER_INDEX(shid), group_ind);
+}
+
+int agp_shader_vattribute_loc(enum shader_vertex_attributes attr)
+{
+	return (attr == ATTRIBUTE_VERTEX || attr == ATTRIBUTE_TEXCORD) ? attr : -1;
+}
+
+int agp_shader_envv(enum agp_shader_envts slot, void* value, size_t size)
+{
+	void* dst = NULL;
+	size_t dsz = 0;
+
+	switch (slot){
+	case MODELVIEW_MATR:
+		dst = shdr_global.modelview;
+		dsz = sizeof(float) * 16;
+	break;
+	case PROJECTION_MATR:
+		dst = shdr_global.projection;
+		dsz = sizeof(float) * 16;
+	break;
+	case OBJ_OPACITY:
+		dst = &shdr_global.opacity;
+		dsz = sizeof(float);
+	break;
+	default:
+		return 0;
+	break;
+	}
+
+	if (memcmp(dst, value, dsz) == 0)
+		shdr_global.unif_skipped++;
+	else {
+		memcpy(dst, value, dsz);
+		shdr_global.unif_issued++;
+	}
+
+	return 0;
+}
+
+void agp_shader_counters(size_t* issued, size_t* skipped, bool reset)
+{
+	if (issued)
+		*issued = shdr_global.unif_issued;
+
+	if (skipped)
+		*skipped = shdr_global.unif_skipped;
+
+	if (reset)
+		shdr_global.unif_issued = shdr_global.unif_skipped = 0;
+}
+
+const char* agp_shader_symtype(enum agp_shader_envts env)
+{
+	return symtbl[env];
+}
+
+void agp_shader_forceunif(const char* label, enum shdrutype type, void* value)
+{
+	if (!agp_shader_valid(shdr_global.active_prg))
+		return;
+
+	struct shader_cont* slot =
+		&shdr_global.slots[SHADER_INDEX(shdr_global.active_prg)];
+	FLAG_DIRTY();
+
+	struct shaderv** current = (struct shaderv**) &(
+		slot->ugroups.cdata[GROUP_INDEX(shdr_global.active_prg)]);
+	for (; *current; current = &(*current)->next)
+		if (strcmp((*current)->label, label) == 0)
+			break;
+
+	if (*current){
+		if ((*current)->type != type){
+			arcan_warning("agp_shader_forceunif(), type mismatch for "
+				"persistant shader uniform (%s=>%i), ignored.\n", label, type);
+			return;
+		}
+	}
+	else {
+		*current = arcan_alloc_mem(sizeof(struct shaderv),
+			ARCAN_MEM_VSTRUCT, ARCAN_MEM_BZERO, ARCAN_MEMALIGN_NATURAL);
+		(*current)->label = strdup(label);
+		(*current)->type = type;
+		(*current)->next = NULL;
+	}
+
+	memcpy((*current)->data, value, sizetbl[type]);
+}
+
+void agp_shader_flush()
+{
+	for (size_t i = 0; i < sizeof(shdr_global.slots) /
+		sizeof(shdr_global.slots[0]); i++){
+		struct shader_cont* cur = &shdr_global.slots[i];
+		if (!cur->label)
+			continue;
+
+		free(cur->label);
+		free(cur->vertex);
+		free(cur->fragment);
+		drop_groups(cur);
+		memset(cur, '\0', sizeof(struct shader_cont));
+	}
+
+	shdr_global.ofs = 0;
+	shdr_global.active_prg = BROKEN_SHADER;
+}
+
+/* no context to lose */
+void agp_shader_rebuild_all()
+{
+}
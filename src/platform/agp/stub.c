@@ -39,6 +39,15 @@ int agp_shader_envv(enum arcan_shader_envts slot, void* value, size_t size)
 	return 1;
 }
 
+void agp_shader_counters(size_t* issued, size_t* skipped, bool reset)
+{
+	if (issued)
+		*issued = 0;
+
+	if (skipped)
+		*skipped = 0;
+}
+
 agp_shader_id arcan_shader_lookup(const char* tag)
 {
 	return 1;
@@ -84,8 +93,14 @@ void agp_resize_vstore(struct storage_info_t* s, size_t w, size_t h)
 {
 }
 
-void agp_request_readback(struct storage_info_t* s)
+bool agp_request_readback(struct storage_info_t* s)
+{
+	return false;
+}
+
+size_t agp_readback_pending(struct storage_info_t* s)
 {
+	return 0;
 }
 
 struct asynch_readback_meta agp_poll_readback(struct storage_info_t* t)
@@ -146,6 +161,11 @@ void agp_update_vstore(struct storage_info_t* s, bool copy)
 	FLAG_DIRTY();
 }
 
+bool agp_txcomp_supported(enum agp_txcomp fmt)
+{
+	return false;
+}
+
 void agp_prepare_stencil()
 {
 }
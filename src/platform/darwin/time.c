@@ -16,9 +16,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-long long int arcan_timemillis()
+static double timebase_sf()
 {
-	uint64_t time = mach_absolute_time();
 	static double sf;
 
 	if (!sf){
@@ -30,7 +29,20 @@ long long int arcan_timemillis()
 			sf = 1.0;
 		}
 	}
-	return ( (double)time * sf) / 1000000;
+
+	return sf;
+}
+
+long long int arcan_timemillis()
+{
+	uint64_t time = mach_absolute_time();
+	return ( (double)time * timebase_sf()) / 1000000;
+}
+
+long long int arcan_timemicros()
+{
+	uint64_t time = mach_absolute_time();
+	return ( (double)time * timebase_sf()) / 1000;
 }
 
 void arcan_timesleep(unsigned long val)
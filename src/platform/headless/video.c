@@ -0,0 +1,304 @@
+/*
+ * Copyright 2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ * Description: Video platform without any display, the output is composited
+ * into the default rendertarget of the AGP implementation and simply kept
+ * there (for readback, recording or screenshots). Intended to be paired
+ * with the software AGP (AGP_PLATFORM=soft) for servers and CI.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "arcan_math.h"
+#include "arcan_general.h"
+#include "arcan_video.h"
+#include "arcan_videoint.h"
+#include "arcan_shmif.h"
+#include "arcan_event.h"
+
+static struct {
+	size_t canvasw, canvash;
+	size_t draww, drawh, drawx, drawy;
+	arcan_vobj_id vid;
+	size_t blackframes;
+	uint64_t last;
+	float txcos[8];
+} headless;
+
+static char* synchopts[] = {
+	"vsync", "pace output to a simulated 60Hz display",
+	"processing", "no pacing, render as fast as possible",
+	NULL
+};
+
+static char* envopts[] = {
+	NULL
+};
+
+static enum {
+	VSYNC = 0,
+	PROCESSING = 1,
+	ENDMARKER
+} synchopt;
+
+void platform_video_shutdown()
+{
+}
+
+void platform_video_prepare_external()
+{
+}
+
+void platform_video_restore_external()
+{
+}
+
+int platform_video_cardhandle(int cardn)
+{
+	return -1;
+}
+
+void* platform_video_gfxsym(const char* sym)
+{
+	return NULL;
+}
+
+void platform_video_minimize()
+{
+}
+
+int64_t platform_video_output_handle(struct storage_info_t* store,
+	enum status_handle* status)
+{
+	*status = ERROR_UNSUPPORTED;
+	return -1;
+}
+
+void platform_video_synch(uint64_t tick_count, float fract,
+	video_synchevent pre, video_synchevent post)
+{
+	if (pre)
+		pre();
+
+	arcan_vobject* vobj = arcan_video_getobject(headless.vid);
+	if (!vobj){
+		headless.vid = ARCAN_VIDEO_WORLDID;
+		vobj = arcan_video_getobject(ARCAN_VIDEO_WORLDID);
+	}
+
+	size_t nd;
+	arcan_bench_register_cost( arcan_vint_refresh(fract, &nd) );
+
+	agp_activate_rendertarget(NULL);
+	if (headless.blackframes){
+		agp_rendertarget_clear();
+		headless.blackframes--;
+	}
+
+	agp_shader_id shid = agp_default_shader(BASIC_2D);
+	if (vobj->program > 0)
+		shid = vobj->program;
+
+	agp_activate_vstore(headless.vid == ARCAN_VIDEO_WORLDID ?
+		arcan_vint_world() : vobj->vstore);
+	agp_shader_activate(shid);
+	agp_shader_envv(PROJECTION_MATR,
+		arcan_video_display.window_projection, sizeof(float)*16);
+	agp_blendstate(BLEND_NONE);
+
+	agp_draw_vobj(headless.drawx, headless.drawy,
+		headless.draww, headless.drawh, headless.txcos, NULL);
+	arcan_vint_drawcursor(false);
+
+/* nothing to wait for, pretend there's a display refreshing at 60Hz */
+	int delta = arcan_frametime() - headless.last;
+	if (synchopt == VSYNC && delta >= 0 && delta < 16)
+		arcan_timesleep(16 - delta);
+
+	headless.last = arcan_frametime();
+	if (post)
+		post();
+}
+
+const char** platform_video_synchopts()
+{
+	return (const char**) synchopts;
+}
+
+const char** platform_video_envopts()
+{
+	return (const char**) envopts;
+}
+
+void platform_video_setsynch(const char* arg)
+{
+	int ind = 0;
+
+	while(synchopts[ind]){
+		if (strcmp(synchopts[ind], arg) == 0){
+			synchopt = (ind > 0 ? ind / 2 : ind);
+			arcan_warning("synchronisation strategy set to (%s)\n", synchopts[ind]);
+			break;
+		}
+
+		ind += 2;
+	}
+}
+
+enum dpms_state platform_video_dpms(
+	platform_display_id disp, enum dpms_state state)
+{
+	return ADPMS_ON;
+}
+
+bool platform_video_map_handle(struct storage_info_t* dst, int64_t handle)
+{
+	return false;
+}
+
+void platform_video_query_displays()
+{
+}
+
+void platform_video_recovery()
+{
+}
+
+bool platform_video_display_edid(platform_display_id did,
+	char** out, size_t* sz)
+{
+	*out = NULL;
+	*sz = 0;
+	return false;
+}
+
+bool platform_video_set_display_gamma(platform_display_id did,
+	size_t n_ramps, uint16_t* r, uint16_t* g, uint16_t* b)
+{
+	return false;
+}
+
+bool platform_video_get_display_gamma(platform_display_id did,
+	size_t* n_ramps, uint16_t** outb)
+{
+	return false;
+}
+
+bool platform_video_specify_mode(platform_display_id disp,
+	struct monitor_mode mode)
+{
+	return false;
+}
+
+bool platform_video_set_mode(platform_display_id disp, platform_mode_id mode)
+{
+	return disp == 0 && mode == 0;
+}
+
+struct monitor_mode* platform_video_query_modes(
+	platform_display_id id, size_t* count)
+{
+	static struct monitor_mode mode = {};
+
+	mode.width  = headless.canvasw;
+	mode.height = headless.canvash;
+	mode.depth  = sizeof(av_pixel) * 8;
+	mode.refresh = 60;
+
+	*count = 1;
+	return &mode;
+}
+
+struct monitor_mode platform_video_dimensions()
+{
+	struct monitor_mode res = {
+		.width = headless.canvasw,
+		.height = headless.canvash,
+	};
+
+	res.phy_width = (float) res.width / ARCAN_SHMPAGE_DEFAULT_PPCM * 10.0;
+	res.phy_height = (float) res.height / ARCAN_SHMPAGE_DEFAULT_PPCM * 10.0;
+
+	return res;
+}
+
+bool platform_video_map_display(arcan_vobj_id id, platform_display_id disp,
+	enum blitting_hint hint)
+{
+	if (disp != 0)
+		return false;
+
+	arcan_vobject* vobj = arcan_video_getobject(id);
+	if (!vobj)
+		return false;
+
+	if (vobj->vstore->txmapped != TXSTATE_TEX2D){
+		arcan_warning("platform_video_map_display(), attempted to map a "
+			"video object with an invalid backing store");
+		return false;
+	}
+
+/* same orientation rules as the sdl platform */
+	if (arcan_vint_findrt(vobj) != NULL){
+		arcan_vint_applyhint(vobj, hint, vobj->txcos ? vobj->txcos :
+			arcan_video_display.mirror_txcos, headless.txcos,
+			&headless.drawx, &headless.drawy,
+			&headless.draww, &headless.drawh,
+			&headless.blackframes);
+	}
+	else {
+		arcan_vint_applyhint(vobj,
+		(hint & HINT_YFLIP) ? (hint & (~HINT_YFLIP)) : (hint | HINT_YFLIP),
+		vobj->txcos ? vobj->txcos : arcan_video_display.default_txcos,
+		headless.txcos,
+		&headless.drawx, &headless.drawy,
+		&headless.draww, &headless.drawh,
+		&headless.blackframes);
+	}
+
+	headless.vid = id;
+	return true;
+}
+
+bool platform_video_display_id(platform_display_id id,
+	platform_mode_id mode_id, struct monitor_mode mode)
+{
+	return false;
+}
+
+const char* platform_video_capstr()
+{
+	static char capstr[128];
+
+	if (!capstr[0])
+		snprintf(capstr, sizeof(capstr), "Video Platform (HEADLESS)\n"
+			"Graphics Platform: %s\nShading Language: %s\n",
+			agp_ident(), agp_shader_language());
+
+	return capstr;
+}
+
+bool platform_video_init(uint16_t width, uint16_t height, uint8_t bpp,
+	bool fs, bool frames, const char* capt)
+{
+	headless.canvasw = width ? width : 640;
+	headless.canvash = height ? height : 480;
+	headless.draww = headless.canvasw;
+	headless.drawh = headless.canvash;
+
+	arcan_warning("Notice: [HEADLESS] %zu*%zu output, %s rendering\n",
+		headless.canvasw, headless.canvash, agp_ident());
+
+	arcan_video_display.fullscreen = fs;
+	headless.vid = ARCAN_VIDEO_WORLDID;
+	memcpy(headless.txcos, arcan_video_display.mirror_txcos, sizeof(float) * 8);
+
+	headless.last = arcan_frametime();
+	return true;
+}
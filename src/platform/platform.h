@@ -24,7 +24,14 @@
 typedef int pipe_handle;
 typedef int file_handle;
 typedef pid_t process_handle;
+
+/* on linux, semaphores are futex words, see posix/sem.c */
+#ifdef __linux__
+#include <stdatomic.h>
+typedef _Atomic uint32_t* sem_handle;
+#else
 typedef sem_t* sem_handle;
+#endif
 
 int arcan_sem_post(sem_handle sem);
 int arcan_sem_unlink(sem_handle sem, char* key);
@@ -38,6 +45,10 @@ typedef int arcan_aobj_id;
 
 unsigned long long arcan_timemillis();
 
+/* monotonic, microsecond resolution, intended for short intervals
+ * (frame budgets, benchmarking) rather than as a logical clock */
+unsigned long long arcan_timemicros();
+
 /*
  * Both these functions expect [argv / envv] to be modifiable and their
  * internal contents dynamically allocated (hence will possible replace / free
@@ -25,11 +25,17 @@ static size_t appl_len = 0;
 static char* g_appl_id = "#appl not initialized";
 static char* appl_script = NULL;
 
+static bool packed_suffix(const char* name)
+{
+	size_t len = strlen(name);
+	return len > 4 && strcmp(&name[len - 4], ".fap") == 0;
+}
+
 /*
- * This is also planned as an entry point for implementing the
- * APF mapping, possibly with the chainloader setting envvars
- * for how the namespace is made, and if not (.apf extension in appl_id)
- * setup the context and functions required to do data lookups.
+ * An appl is either a directory or a packed archive (appl.fap, see
+ * tools/arcan_applpack.README). Archives are mounted by the namespace
+ * layer, so from here on the only difference is that the appl namespace
+ * is read-only.
  */
 bool arcan_verifyload_appl(const char* appl_id, const char** errc)
 {
@@ -40,10 +46,6 @@ bool arcan_verifyload_appl(const char* appl_id, const char** errc)
 		return false;
 	}
 
-/*
- * NOTE: here is the place to check for .fap extension,
- * and if found, take a separate route for setting up.
- */
 	char* base = strdup(appl_id);
 	bool expand = true;
 
@@ -63,9 +65,13 @@ bool arcan_verifyload_appl(const char* appl_id, const char** errc)
 		base = strdup( basename(work) );
 		free(work);
 
+		bool packed = packed_suffix(base);
+		if (packed)
+			base[strlen(base) - 4] = '\0';
+
 		arcan_override_namespace(appl_id, RESOURCE_APPL);
 
-		arcan_softoverride_namespace(appl_id, RESOURCE_APPL_TEMP);
+		arcan_softoverride_namespace(packed ? dir : appl_id, RESOURCE_APPL_TEMP);
 		arcan_softoverride_namespace(dir, RESOURCE_SYS_APPLBASE);
 		arcan_softoverride_namespace(dir, RESOURCE_SYS_APPLSTORE);
 
@@ -91,6 +97,21 @@ bool arcan_verifyload_appl(const char* appl_id, const char** errc)
 			free(base);
 			return false;
 		}
+
+/* no directory with the name, but maybe a packed version */
+		if (!arcan_isdir(dir)){
+			size_t len = strlen(dir) + sizeof(".fap");
+			char* packed = malloc(len);
+			if (packed){
+				snprintf(packed, len, "%s.fap", dir);
+				if (arcan_isfile(packed)){
+					arcan_mem_free(dir);
+					dir = packed;
+				}
+				else
+					free(packed);
+			}
+		}
 		arcan_override_namespace(dir, RESOURCE_APPL);
 		arcan_mem_free(dir);
 
@@ -126,10 +147,9 @@ bool arcan_verifyload_appl(const char* appl_id, const char** errc)
 	char wbuf[ app_len + sizeof(".lua")];
 	snprintf(wbuf, sizeof(wbuf), "%s.lua", base);
 
-	char* script_path = arcan_expand_resource(wbuf, RESOURCE_APPL);
-	if (!script_path || !arcan_isfile(script_path)){
+	char* script_path = arcan_find_resource(wbuf, RESOURCE_APPL, ARES_FILE);
+	if (!script_path){
 		*errc = "missing script matching appl_id (see appname/appname.lua)";
-		arcan_mem_free(script_path);
 		return false;
 	}
 
@@ -138,10 +158,9 @@ bool arcan_verifyload_appl(const char* appl_id, const char** errc)
  * namespace pollution. Specific settings can still pin the namespace to
  * prevent this action.
  */
-	char* font_path = arcan_expand_resource("/fonts", RESOURCE_APPL);
+	char* font_path = arcan_find_resource("fonts", RESOURCE_APPL, ARES_FOLDER);
 	if (font_path){
-		if (arcan_isdir(font_path))
-			arcan_override_namespace(font_path, RESOURCE_SYS_FONT);
+		arcan_override_namespace(font_path, RESOURCE_SYS_FONT);
 		free(font_path);
 	}
 
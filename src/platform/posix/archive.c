@@ -0,0 +1,611 @@
+/*
+ * Copyright 2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ */
+
+/*
+ * Reader for packed appl archives (.fap, see tools/arcan_applpack.README).
+ * An archive is mounted when a namespace is set to point to it (or to a
+ * directory inside it), after that the paths returned by arcan_find_resource
+ * look like /some/where/myappl.fap/images/bg.png and resource_io /
+ * map_resource forward such paths here.
+ *
+ * The whole file is mapped read-only once, lookups are a binary search in
+ * the sorted index and maps of uncompressed entries are handed out as
+ * pointers into the shared mapping. Every mount and every such map hold a
+ * reference, the archive is unmapped when the last one goes.
+ *
+ * Layout, all integers little-endian:
+ *  header: [magic, 8b "ARCANFAP"][u32 version][u32 n_entries]
+ *          [u64 index offset][u32 name table size][u32 reserved]
+ *  data:   entries, each followed by at least one zero byte. Small ones are
+ *          packed together to share pages, the writer aligns those that
+ *          are larger than a page to a page boundary.
+ *  index:  n_entries * [u64 offset][u64 size][u64 unpacked size]
+ *          [u32 name offset][u16 name length][u8 type][u8 compression]
+ *  names:  paths relative to the archive root, no leading / or terminator.
+ *
+ * The index covers both files and directories and is sorted (bytewise) on
+ * name. Compression is either none or a zlib stream.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <arcan_math.h>
+#include <arcan_general.h>
+
+#define FAP_MAGIC "ARCANFAP"
+#define FAP_VERSION 1
+#define FAP_HEADER_SZ 32
+#define FAP_ENTRY_SZ 32
+
+enum fap_type {
+	FAP_FILE = 1,
+	FAP_DIR = 2
+};
+
+enum fap_compression {
+	FAP_RAW = 0,
+	FAP_ZLIB = 1
+};
+
+struct fap_ent {
+	const char* name;
+	size_t name_len;
+	uint64_t ofs;
+	uint64_t size;
+	uint64_t raw;
+	uint8_t type;
+	uint8_t comp;
+};
+
+struct arcan_archive {
+	char* path;
+	size_t path_len;
+	int fd;
+
+	uint8_t* base;
+	size_t size;
+
+	struct fap_ent* ents;
+	size_t count;
+
+	size_t refs;
+	struct arcan_archive* next;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	struct arcan_archive* list;
+} archives = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+/* returned by resolve for the archive root itself */
+static struct fap_ent root_ent = {
+	.name = "",
+	.type = FAP_DIR
+};
+
+static uint16_t le16(const uint8_t* buf)
+{
+	return (uint16_t)buf[0] | ((uint16_t)buf[1] << 8);
+}
+
+static uint32_t le32(const uint8_t* buf)
+{
+	return (uint32_t)le16(buf) | ((uint32_t)le16(&buf[2]) << 16);
+}
+
+static uint64_t le64(const uint8_t* buf)
+{
+	return (uint64_t)le32(buf) | ((uint64_t)le32(&buf[4]) << 32);
+}
+
+static int namecmp(const char* a, size_t a_len, const char* b, size_t b_len)
+{
+	int rv = memcmp(a, b, a_len < b_len ? a_len : b_len);
+	if (rv)
+		return rv;
+
+	return a_len < b_len ? -1 : a_len > b_len;
+}
+
+/* index of the first entry that sorts at or after <name> */
+static size_t lower_bound(struct arcan_archive* arc, const char* name, size_t len)
+{
+	size_t lo = 0, hi = arc->count;
+
+	while (lo < hi){
+		size_t mid = lo + (hi - lo) / 2;
+		if (namecmp(arc->ents[mid].name, arc->ents[mid].name_len, name, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static struct fap_ent* find_ent(
+	struct arcan_archive* arc, const char* name, size_t len)
+{
+	if (!len)
+		return &root_ent;
+
+	size_t ind = lower_bound(arc, name, len);
+	if (ind < arc->count &&
+		namecmp(arc->ents[ind].name, arc->ents[ind].name_len, name, len) == 0)
+		return &arc->ents[ind];
+
+	return NULL;
+}
+
+/*
+ * Convert <path> (relative to the archive root) to the form used in the
+ * index, skipping empty and . components. [dst] should fit strlen(path)+1,
+ * returns the length or -1 if .. would step outside of the archive.
+ */
+static ssize_t build_name(char* dst, const char* path)
+{
+	size_t len = 0;
+
+	while (*path){
+		if (*path == '/'){
+			path++;
+			continue;
+		}
+
+		size_t clen = strcspn(path, "/");
+		if (clen == 1 && path[0] == '.')
+			;
+		else if (clen == 2 && path[0] == '.' && path[1] == '.'){
+			if (!len)
+				return -1;
+
+			while (len > 0 && dst[len-1] != '/')
+				len--;
+			if (len)
+				len--;
+		}
+		else {
+			if (len)
+				dst[len++] = '/';
+			memmove(&dst[len], path, clen);
+			len += clen;
+		}
+
+		path += clen;
+	}
+
+	dst[len] = '\0';
+	return len;
+}
+
+static void drop_archive(struct arcan_archive* arc)
+{
+	if (arc->base)
+		munmap(arc->base, arc->size);
+
+	if (-1 != arc->fd)
+		close(arc->fd);
+
+	free(arc->ents);
+	free(arc->path);
+	free(arc);
+}
+
+static const char* validate(struct arcan_archive* arc)
+{
+	const uint8_t* buf = arc->base;
+
+	if (arc->size < FAP_HEADER_SZ || memcmp(buf, FAP_MAGIC, 8) != 0)
+		return "not an appl archive";
+
+	if (le32(&buf[8]) != FAP_VERSION)
+		return "unsupported archive version";
+
+	uint64_t count = le32(&buf[12]);
+	uint64_t index = le64(&buf[16]);
+	uint64_t names = le32(&buf[24]);
+
+	if (index < FAP_HEADER_SZ || index > arc->size ||
+		count > (arc->size - index) / FAP_ENTRY_SZ ||
+		names > arc->size - index - count * FAP_ENTRY_SZ)
+		return "index outside of file";
+
+	const char* ntbl = (const char*) &buf[index + count * FAP_ENTRY_SZ];
+
+	arc->ents = malloc(sizeof(struct fap_ent) * (count ? count : 1));
+	if (!arc->ents)
+		return "out of memory";
+
+	for (size_t i = 0; i < count; i++){
+		const uint8_t* ent = &buf[index + i * FAP_ENTRY_SZ];
+		struct fap_ent* dst = &arc->ents[i];
+		uint32_t name_ofs = le32(&ent[24]);
+
+		*dst = (struct fap_ent){
+			.ofs = le64(ent),
+			.size = le64(&ent[8]),
+			.raw = le64(&ent[16]),
+			.name_len = le16(&ent[28]),
+			.type = ent[30],
+			.comp = ent[31]
+		};
+
+		if (!dst->name_len || name_ofs > names || dst->name_len > names - name_ofs)
+			return "broken name table";
+
+		dst->name = &ntbl[name_ofs];
+		if (memchr(dst->name, '\0', dst->name_len) ||
+			dst->name[0] == '/' || dst->name[dst->name_len-1] == '/')
+			return "broken entry name";
+
+		char tmp[dst->name_len + 1];
+		memcpy(tmp, dst->name, dst->name_len);
+		tmp[dst->name_len] = '\0';
+		if (build_name(tmp, tmp) != dst->name_len)
+			return "entry name is not normalized";
+
+		if (i && namecmp(arc->ents[i-1].name,
+			arc->ents[i-1].name_len, dst->name, dst->name_len) >= 0)
+			return "index is not sorted";
+
+		if (dst->type == FAP_DIR)
+			continue;
+
+		if (dst->type != FAP_FILE || dst->comp > FAP_ZLIB ||
+			(dst->comp == FAP_RAW && dst->raw != dst->size))
+			return "unknown entry type";
+
+		if (dst->ofs < FAP_HEADER_SZ ||
+			dst->ofs > index || dst->size > index - dst->ofs)
+			return "entry data outside of file";
+	}
+
+	arc->count = count;
+
+/* the index is what will be paged in anyhow, data is accessed at random */
+	posix_madvise(arc->base, arc->size, POSIX_MADV_RANDOM);
+
+	return NULL;
+}
+
+static struct arcan_archive* open_archive(const char* path)
+{
+	struct stat buf;
+	struct arcan_archive* arc = malloc(sizeof(struct arcan_archive));
+	if (!arc)
+		return NULL;
+
+	*arc = (struct arcan_archive){
+		.fd = open(path, O_RDONLY | O_CLOEXEC),
+		.path = strdup(path),
+		.path_len = strlen(path),
+		.refs = 1
+	};
+
+	if (-1 == arc->fd || !arc->path || -1 == fstat(arc->fd, &buf)){
+		arcan_warning("archive(%s), couldn't open: %s\n", path, strerror(errno));
+		drop_archive(arc);
+		return NULL;
+	}
+
+	arc->size = buf.st_size;
+	if (arc->size)
+		arc->base = mmap(NULL, arc->size, PROT_READ, MAP_PRIVATE, arc->fd, 0);
+
+	if (arc->base == MAP_FAILED){
+		arcan_warning("archive(%s), couldn't map: %s\n", path, strerror(errno));
+		arc->base = NULL;
+		drop_archive(arc);
+		return NULL;
+	}
+
+	const char* err = validate(arc);
+	if (err){
+		arcan_warning("archive(%s), %s\n", path, err);
+		drop_archive(arc);
+		return NULL;
+	}
+
+	return arc;
+}
+
+static void unref(struct arcan_archive* arc)
+{
+	if (--arc->refs)
+		return;
+
+	for (struct arcan_archive** cur = &archives.list; *cur; cur = &(*cur)->next)
+		if (*cur == arc){
+			*cur = arc->next;
+			break;
+		}
+
+	drop_archive(arc);
+}
+
+/*
+ * Find the open archive that covers <path>, with [ent] set to the matching
+ * entry or NULL if the archive doesn't have it. Call with the lock held.
+ */
+static struct arcan_archive* resolve(const char* path, struct fap_ent** ent)
+{
+	for (struct arcan_archive* arc = archives.list; arc; arc = arc->next){
+		if (strncmp(path, arc->path, arc->path_len) != 0 ||
+			(path[arc->path_len] != '/' && path[arc->path_len] != '\0'))
+			continue;
+
+		const char* rel = &path[arc->path_len];
+		char name[strlen(rel) + 1];
+		ssize_t len = build_name(name, rel);
+		*ent = len < 0 ? NULL : find_ent(arc, name, len);
+		return arc;
+	}
+
+	return NULL;
+}
+
+struct arcan_archive* arcan_archive_mount(const char* path)
+{
+	struct fap_ent* ent;
+	struct arcan_archive* arc;
+
+	if (!path)
+		return NULL;
+
+	pthread_mutex_lock(&archives.lock);
+
+/* the namespace can also point to a directory inside an open archive */
+	if ((arc = resolve(path, &ent))){
+		if (ent && ent->type == FAP_DIR)
+			arc->refs++;
+		else
+			arc = NULL;
+
+		pthread_mutex_unlock(&archives.lock);
+		return arc;
+	}
+
+	size_t len = strlen(path);
+	if (len > 4 && strcmp(&path[len - 4], ".fap") == 0 && arcan_isfile(path)){
+		if ((arc = open_archive(path))){
+			arc->next = archives.list;
+			archives.list = arc;
+		}
+	}
+
+	pthread_mutex_unlock(&archives.lock);
+	return arc;
+}
+
+void arcan_archive_unmount(struct arcan_archive* arc)
+{
+	if (!arc)
+		return;
+
+	pthread_mutex_lock(&archives.lock);
+	unref(arc);
+	pthread_mutex_unlock(&archives.lock);
+}
+
+int arcan_archive_lookup(const char* path)
+{
+	struct fap_ent* ent;
+	int rv = -1;
+
+	pthread_mutex_lock(&archives.lock);
+	if (resolve(path, &ent))
+		rv = !ent ? 0 : (ent->type == FAP_DIR ? ARES_FOLDER : ARES_FILE);
+	pthread_mutex_unlock(&archives.lock);
+
+	return rv;
+}
+
+static bool has_wildcard(const char* str, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		if (str[i] == '*' || str[i] == '?' || str[i] == '[')
+			return true;
+	return false;
+}
+
+static int glob_archive(struct arcan_archive* arc, const char* pattern,
+	void (*cb)(char*, void*), void* tag)
+{
+	char name[strlen(pattern) + 1];
+	ssize_t len = build_name(name, pattern);
+	if (len <= 0)
+		return 0;
+
+	char* leaf = strrchr(name, '/');
+	size_t dlen = leaf ? leaf - name : 0;
+	leaf = leaf ? leaf + 1 : name;
+	int count = 0;
+
+/* wildcards in the directory part, match the whole path against each entry */
+	if (has_wildcard(name, dlen)){
+		for (size_t i = 0; i < arc->count; i++){
+			struct fap_ent* ent = &arc->ents[i];
+			char cur[ent->name_len + 1];
+			memcpy(cur, ent->name, ent->name_len);
+			cur[ent->name_len] = '\0';
+
+			if (fnmatch(name, cur, FNM_PATHNAME | FNM_PERIOD) == 0){
+				char* base = strrchr(cur, '/');
+				cb(base ? base + 1 : cur, tag);
+				count++;
+			}
+		}
+		return count;
+	}
+
+/* otherwise the children of the directory are a contiguous range, this
+ * includes grandchildren that are skipped as glob only matches one level */
+	size_t plen = 0;
+	if (dlen){
+		name[dlen] = '/';
+		plen = dlen + 1;
+	}
+
+	for (size_t i = lower_bound(arc, name, plen); i < arc->count; i++){
+		struct fap_ent* ent = &arc->ents[i];
+		if (ent->name_len < plen || memcmp(ent->name, name, plen) != 0)
+			break;
+
+		size_t llen = ent->name_len - plen;
+		if (memchr(&ent->name[plen], '/', llen))
+			continue;
+
+		char cur[llen + 1];
+		memcpy(cur, &ent->name[plen], llen);
+		cur[llen] = '\0';
+
+		if (fnmatch(leaf, cur, FNM_PERIOD) == 0){
+			cb(cur, tag);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+int arcan_archive_glob(const char* pattern,
+	void (*cb)(char*, void*), void* tag)
+{
+	struct arcan_archive* arc = NULL;
+	if (!pattern)
+		return -1;
+
+	pthread_mutex_lock(&archives.lock);
+	for (arc = archives.list; arc; arc = arc->next)
+		if (strncmp(pattern, arc->path, arc->path_len) == 0 &&
+			pattern[arc->path_len] == '/')
+			break;
+
+	if (!arc){
+		pthread_mutex_unlock(&archives.lock);
+		return -1;
+	}
+
+/* the callback may well do resource lookups of its own */
+	arc->refs++;
+	pthread_mutex_unlock(&archives.lock);
+
+	int rv = glob_archive(arc, &pattern[arc->path_len], cb, tag);
+	arcan_archive_unmount(arc);
+
+	return rv;
+}
+
+bool arcan_archive_open(const char* path, data_source* dst)
+{
+	struct fap_ent* ent;
+
+	pthread_mutex_lock(&archives.lock);
+	struct arcan_archive* arc = resolve(path, &ent);
+	if (!arc){
+		pthread_mutex_unlock(&archives.lock);
+		return false;
+	}
+
+	if (ent && ent->type == FAP_FILE){
+		dst->fd = fcntl(arc->fd, F_DUPFD_CLOEXEC, 0);
+		dst->start = ent->ofs;
+		dst->len = ent->size;
+	}
+	pthread_mutex_unlock(&archives.lock);
+
+	if (BADFD != dst->fd)
+		dst->source = strdup(path);
+
+	return true;
+}
+
+bool arcan_archive_map(data_source* src, bool wr, map_region* dst)
+{
+	struct fap_ent* ent;
+
+	if (!src->source)
+		return false;
+
+	pthread_mutex_lock(&archives.lock);
+	struct arcan_archive* arc = resolve(src->source, &ent);
+	if (!arc){
+		pthread_mutex_unlock(&archives.lock);
+		return false;
+	}
+
+	if (!ent || ent->type != FAP_FILE || !ent->raw){
+		pthread_mutex_unlock(&archives.lock);
+		return true;
+	}
+
+	arc->refs++;
+	pthread_mutex_unlock(&archives.lock);
+
+	const char* data = (const char*) &arc->base[ent->ofs];
+
+/* the common case, keep the reference until the map is released */
+	if (ent->comp == FAP_RAW && !wr){
+		dst->ptr = (char*) data;
+		dst->sz = ent->size;
+		dst->shared = true;
+		return true;
+	}
+
+/* private copy, terminated like the padding after a shared one */
+	char* buf = malloc(ent->raw + 1);
+	if (buf){
+		if (ent->comp == FAP_ZLIB){
+			if (arcan_zlib_inflate(buf, ent->raw, data, ent->size) != (ssize_t)ent->raw){
+				arcan_warning("archive(%s), corrupt entry\n", src->source);
+				free(buf);
+				buf = NULL;
+			}
+		}
+		else
+			memcpy(buf, data, ent->raw);
+	}
+
+	if (buf){
+		buf[ent->raw] = '\0';
+		dst->ptr = buf;
+		dst->sz = ent->raw;
+	}
+
+	arcan_archive_unmount(arc);
+	return true;
+}
+
+bool arcan_archive_release(map_region* region)
+{
+	bool found = false;
+	uint8_t* ptr = (uint8_t*) region->ptr;
+
+	pthread_mutex_lock(&archives.lock);
+	for (struct arcan_archive* arc = archives.list; arc; arc = arc->next)
+		if (ptr >= arc->base && ptr < arc->base + arc->size){
+			unref(arc);
+			found = true;
+			break;
+		}
+	pthread_mutex_unlock(&archives.lock);
+
+	return found;
+}
@@ -122,6 +122,38 @@ static bool fd_avail(int fd, bool* term)
 	return false;
 }
 
+#ifdef __linux__
+/*
+ * The semaphores are futex words inside the page itself, so they need to be
+ * re-pointed whenever the mapping moves.
+ */
+static void map_futex(arcan_frameserver* ctx)
+{
+	struct arcan_shmif_page* page = ctx->shm.ptr;
+	ctx->vsync = &page->futex[0];
+	ctx->async = &page->futex[1];
+	ctx->esync = &page->futex[2];
+}
+#endif
+
+static bool memfd_key(const char* key)
+{
+	return strncmp(key, ARCAN_SHMIF_MEMFD_PREFIX,
+		sizeof(ARCAN_SHMIF_MEMFD_PREFIX) - 1) == 0;
+}
+
+/*
+ * Anonymous segments can't be found through the key, the descriptor follows
+ * on the socket right after the key has been provided
+ */
+static bool push_segment(arcan_frameserver* ctx, int sock)
+{
+	if (!ctx->shm.key || !memfd_key(ctx->shm.key))
+		return true;
+
+	return arcan_pushhandle(ctx->shm.handle, sock);
+}
+
 void arcan_frameserver_dropshared(arcan_frameserver* src)
 {
 	if (!src)
@@ -139,9 +171,11 @@ void arcan_frameserver_dropshared(arcan_frameserver* src)
 			strerror(errno));
 
 	if (src->shm.key){
-		shm_unlink( src->shm.key );
+		if (!memfd_key(src->shm.key))
+			shm_unlink( src->shm.key );
 
-/* step 2, semaphore handles */
+/* step 2, semaphore handles, on linux these are part of the page */
+#ifndef __linux__
 		size_t slen = strlen(src->shm.key) + 1;
 		if (slen > 1){
 			char work[slen];
@@ -153,8 +187,10 @@ void arcan_frameserver_dropshared(arcan_frameserver* src)
 			sem_unlink(work); sem_close(src->async);
 			work[slen] = 'e';
 			sem_unlink(work); sem_close(src->esync);
-			arcan_mem_free(src->shm.key);
 		}
+#endif
+		arcan_mem_free(src->shm.key);
+		src->shm.key = NULL;
 	}
 	if (-1 != src->shm.handle)
 		close(src->shm.handle);
@@ -283,6 +319,19 @@ static bool findshmkey(arcan_frameserver* ctx, int* dfd){
 
 	char playbuf[sizeof(pattern) + 8];
 
+/*
+ * Anonymous segment, nothing to collide with or clean up after and the
+ * descriptor is passed over the dpipe. The name is only for /proc/pid/fd.
+ */
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING)
+	snprintf(playbuf, sizeof(playbuf), "arcan_%i", selfpid % 1000);
+	*dfd = memfd_create(playbuf, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (-1 != *dfd){
+		ctx->shm.key = strdup(ARCAN_SHMIF_MEMFD_PREFIX "arcan");
+		return true;
+	}
+#endif
+
 	while (retrycount){
 /* not a security mechanism, just light "avoid stepping on my own toes" */
 		snprintf(playbuf, sizeof(playbuf), pattern, selfpid % 1000, rand() % 1000);
@@ -307,6 +356,8 @@ static bool findshmkey(arcan_frameserver* ctx, int* dfd){
 			continue;
 		}
 
+/* on linux, the futex words in the page are setup in shmalloc */
+#ifndef __linux__
 		playbuf[pb_ofs] = 'v';
 		ctx->vsync = sem_open(playbuf, O_CREAT | O_EXCL, 0700, 0);
 
@@ -341,6 +392,7 @@ static bool findshmkey(arcan_frameserver* ctx, int* dfd){
 			errmsg = "couldn't create (e) semaphore\n";
 			continue;
 		}
+#endif
 
 		break;
 	}
@@ -355,6 +407,53 @@ static bool findshmkey(arcan_frameserver* ctx, int* dfd){
 	return false;
 }
 
+file_handle arcan_frameserver_sharedbuf(size_t sz, void** dst)
+{
+	int fd = -1;
+	*dst = NULL;
+
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING)
+	fd = memfd_create("arcan_mcast", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+
+/* unlinked right away, only reachable through the descriptor */
+	if (-1 == fd){
+		char playbuf[32];
+		for (size_t i = 0; i < 10 && -1 == fd; i++){
+			snprintf(playbuf, sizeof(playbuf),
+				"/arcan_mc_%i_%i", (int)getpid() % 1000, rand() % 1000);
+			fd = shm_open(playbuf, O_CREAT | O_RDWR | O_EXCL, 0700);
+		}
+		if (-1 == fd)
+			return BADFD;
+		shm_unlink(playbuf);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	}
+
+	if (-1 == ftruncate(fd, sz)){
+		close(fd);
+		return BADFD;
+	}
+
+	*dst = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == *dst){
+		*dst = NULL;
+		close(fd);
+		return BADFD;
+	}
+
+/* receivers only ever get to read, and can't pull the pages from under us */
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING)
+	int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+#ifdef F_SEAL_FUTURE_WRITE
+	seals |= F_SEAL_FUTURE_WRITE;
+#endif
+	fcntl(fd, F_ADD_SEALS, seals);
+#endif
+
+	return fd;
+}
+
 static bool sockpair_alloc(int* dst, size_t n, bool cloexec)
 {
 	bool res = false;
@@ -499,6 +598,12 @@ static bool shmalloc(arcan_frameserver* ctx,
 		goto fail;
 	}
 
+/* the client maps the segment as well, never let it shrink from under it */
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING)
+	if (memfd_key(ctx->shm.key))
+		fcntl(shmfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL);
+#endif
+
 	ctx->shm.handle = shmfd;
 	shmpage = (void*) mmap(
 		NULL, ctx->shm.shmsize, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
@@ -528,6 +633,10 @@ fail:
 		shmpage->vpending = 1;
 		shmpage->apending = 1;
 		ctx->shm.ptr = shmpage;
+#ifdef __linux__
+		shmpage->futex[2] = 1;
+		map_futex(ctx);
+#endif
 	arcan_frameserver_leave(ctx);
 
 	return true;
@@ -674,6 +783,7 @@ arcan_frameserver* arcan_frameserver_spawn_subsegment(
  */
 	newseg->dpipe = sockp[0];
 	arcan_pushhandle(sockp[1], ctx->dpipe);
+	push_segment(newseg, newseg->dpipe);
 
 	arcan_event keyev = {
 		.category = EVENT_TARGET, .tgt.kind = TARGET_COMMAND_NEWSEGMENT
@@ -812,7 +922,7 @@ send_key:
 		}
 	}
 
-	if (rtc <= 0){
+	if (rtc <= 0 || !push_segment(tgt, tgt->dpipe)){
 		arcan_frameserver_free(tgt);
 		return FRV_NOFRAME;
 	}
@@ -920,6 +1030,7 @@ static void append_env(struct arcan_strarr* darr,
 		getenv("ARCAN_FRAMESERVER_DEBUGSTALL"),
 		getenv("ARCAN_RENDER_NODE"),
 		getenv("ARCAN_VIDEO_NO_FDPASS"),
+		getenv("ARCAN_SHMIF_TRACE"),
 		arcan_fetch_namespace(RESOURCE_APPL),
 		arcan_fetch_namespace(RESOURCE_APPL_TEMP),
 		arcan_fetch_namespace(RESOURCE_APPL_STATE),
@@ -944,6 +1055,7 @@ static void append_env(struct arcan_strarr* darr,
 		"ARCAN_FRAMESERVER_DEBUGSTALL",
 		"ARCAN_RENDER_NODE",
 		"ARCAN_VIDEO_NO_FDPASS",
+		"ARCAN_SHMIF_TRACE",
 		"ARCAN_APPLPATH",
 		"ARCAN_APPLTEMPPATH",
 		"ARCAN_STATEPATH",
@@ -1071,6 +1183,10 @@ bool arcan_frameserver_resize(struct arcan_frameserver* s)
 /* no remapping required, resize effect is insignificant or impossible */
 	bool rmap = (shmsz > src->shmsize || shmsz < (float) src->shmsize * 0.8);
 
+/* sealed anonymous segments only grow, the tail just goes unused */
+	if (memfd_key(src->key))
+		rmap = shmsz > src->shmsize;
+
 /* special case, no remap supported */
 #ifdef ARCAN_SHMIF_OVERCOMMIT
 	rmap = false;
@@ -1087,8 +1203,9 @@ bool arcan_frameserver_resize(struct arcan_frameserver* s)
 /* other option here would be to set up a new subsegment, make the process
  * asynchronous and push a MIGRATE event, but the gains seem rather pointless */
 #if defined(_GNU_SOURCE) && !defined(__APPLE__) && !defined(__BSD)
-	struct arcan_shmif_page* newp = mremap(src->ptr,
-		src->shmsize, shmsz, MREMAP_MAYMOVE, NULL);
+	struct arcan_shmif_page* newp = mremap(src->ptr, src->shmsize, shmsz, 0);
+	if (MAP_FAILED == newp)
+		newp = mremap(src->ptr, src->shmsize, shmsz, MREMAP_MAYMOVE, NULL);
 	if (MAP_FAILED == newp){
 		if (-1 == ftruncate(src->handle, src->shmsize))
 			arcan_warning("_resize, truncate reset on resize fail fail\n");
@@ -1112,11 +1229,14 @@ bool arcan_frameserver_resize(struct arcan_frameserver* s)
 		arcan_warning("frameserver_resize() failed, reason: %s\n", strerror(errno));
   	goto fail;
 	}
+#endif
+	src->shmsize = shmsz;
+#ifdef __linux__
+	map_futex(s);
 #endif
 	}
 
 	shmpage = src->ptr;
-	src->shmsize = shmsz;
 
 /* commit to local tracking */
 	atomic_store(&shmpage->w, w);
@@ -1155,12 +1275,325 @@ done:
 	return state;
 }
 
+/*
+ * parent- side of a spawn, shared between cold launches and pool handouts
+ */
+static void spawn_parent(arcan_frameserver* ctx, struct frameserver_envp* setup)
+{
+	img_cons cons = {
+		.w = setup->init_w,
+		.h = setup->init_h,
+		.bpp = 4
+	};
+	vfunc_state state = {
+		.tag = ARCAN_TAG_FRAMESERV,
+		.ptr = ctx
+	};
+
+	ctx->source = strdup(setup->args.builtin.resource);
+
+	if (!ctx->vid)
+		ctx->vid = arcan_video_addfobject(FFUNC_NULLFRAME, state, cons, 0);
+
+	ctx->aid = ARCAN_EID;
+
+#ifdef __APPLE__
+	int val = 1;
+	setsockopt(ctx->dpipe, SOL_SOCKET, SO_NOSIGPIPE, &val, sizeof(int));
+#endif
+	fcntl(ctx->dpipe, F_SETFD, FD_CLOEXEC);
+
+	arcan_frameserver_configure(ctx, *setup);
+}
+
+/*
+ * child- side of a builtin spawn, the control socket goes to a fixed
+ * descriptor (3) and everything else is closed before exec
+ */
+static void spawn_builtin(int sock, const char* mode, char** envv)
+{
+	close(STDERR_FILENO+1);
+/* will also strip CLOEXEC */
+	dup2(sock, STDERR_FILENO+1);
+	arcan_closefrom(STDERR_FILENO+2);
+
+/*
+ * we need to mask this signal as when debugging parent process, GDB pushes
+ * SIGINT to children, killing them and changing the behavior in the core
+ * process
+ */
+	sigaction(SIGPIPE, &(struct sigaction){
+		.sa_handler = SIG_IGN}, NULL);
+
+	char* argv[] = {
+		arcan_fetch_namespace(RESOURCE_SYS_BINS),
+		(char*) mode,
+		NULL
+	};
+
+	execve(argv[0], argv, envv);
+	arcan_warning("arcan_frameserver_spawn_server() failed: %s, %s\n",
+		strerror(errno), argv[0]);
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * Prespawn pool, the entries are regular frameserver structures that have
+ * gone through shmalloc and fork/exec but are not bound to a vid. The child
+ * is started with ARCAN_FRAMESERVER_POOLED set and no ARCAN_ARG, and waits
+ * for [uint32_t length][arguments] on the control socket before it maps the
+ * segment (see frameserver/frameserver.c). The exec, dynamic linking and
+ * library setup in the child and the shm/semaphore allocation here is what
+ * we save on handout.
+ */
+static struct fsrv_pool {
+	char* mode;
+	size_t size, ready, fails;
+	arcan_frameserver* slots[FSRV_POOL_MAXSZ];
+	struct arcan_frameserver_poolstat stat;
+} fsrv_pool[FSRV_POOL_LIMIT];
+
+static int pool_find(const char* mode)
+{
+	for (size_t i = 0; i < FSRV_POOL_LIMIT; i++)
+		if (fsrv_pool[i].mode && strcmp(fsrv_pool[i].mode, mode) == 0)
+			return i;
+
+	return -1;
+}
+
+static void pool_drop(arcan_frameserver* ent)
+{
+/* closing the socket is enough for the child to exit, killchild reaps */
+	arcan_frameserver_dropshared(ent);
+	arcan_frameserver_killchild(ent);
+	arcan_mem_free(ent);
+}
+
+static arcan_frameserver* pool_spawn(const char* mode)
+{
+	int sockp[2] = {-1, -1};
+	if (!sockpair_alloc(sockp, 1, false))
+		return NULL;
+
+	arcan_frameserver* res = arcan_frameserver_alloc();
+	if (!shmalloc(res, false, NULL, -1)){
+		close(sockp[0]);
+		close(sockp[1]);
+		arcan_mem_free(res);
+		return NULL;
+	}
+
+	struct arcan_strarr arr = {0};
+	append_env(&arr, NULL, "3", res->shm.key);
+	if (arr.count + 2 > arr.limit)
+		arcan_mem_growarr(&arr);
+	arr.data[arr.count++] = strdup("ARCAN_FRAMESERVER_POOLED=1");
+	arr.data[arr.count] = NULL;
+
+	pid_t child = fork();
+	if (child == 0)
+		spawn_builtin(sockp[1], mode, arr.data);
+	else if (-1 == child)
+		arcan_fatal("fork() failed, check ulimit or similar configuration issue.");
+
+	close(sockp[1]);
+	res->dpipe = sockp[0];
+	res->child = child;
+	arcan_mem_freearr(&arr);
+
+	return res;
+}
+
+static bool pool_sendarg(int fd, const char* arg)
+{
+	uint32_t len = arg ? strlen(arg) : 0;
+	size_t ntot = sizeof(len) + len;
+	char buf[ntot];
+	memcpy(buf, &len, sizeof(len));
+	if (len)
+		memcpy(&buf[sizeof(len)], arg, len);
+
+/* the socket is fresh and the message small, anything but a full write
+ * means that the entry is unusable and we go for a cold launch instead */
+	ssize_t nw;
+	while (-1 == (nw = write(fd, buf, ntot)) && errno == EINTR){}
+
+	return nw == ntot;
+}
+
+static bool pool_handout(int slot,
+	arcan_frameserver* ctx, struct frameserver_envp* setup)
+{
+	struct fsrv_pool* pool = &fsrv_pool[slot];
+
+/* the arguments should fit in the socket buffer in one go */
+	const char* arg = setup->args.builtin.resource;
+	if (arg && strlen(arg) > 65536)
+		return false;
+
+	while (pool->ready){
+		arcan_frameserver* ent = pool->slots[--pool->ready];
+		pool->slots[pool->ready] = NULL;
+
+		if (!arcan_frameserver_validchild(ent) ||
+			!pool_sendarg(ent->dpipe, arg) || !push_segment(ent, ent->dpipe)){
+			pool_drop(ent);
+
+/* repeated failure likely means that the binary is broken or missing,
+ * don't keep on forking in the background */
+			if (++pool->fails > pool->size * 2){
+				arcan_warning("frameserver_pool(%s), too many failed entries, "
+					"disabling prespawn\n", pool->mode);
+				pool->size = 0;
+			}
+			continue;
+		}
+
+		ctx->shm = ent->shm;
+		ctx->vsync = ent->vsync;
+		ctx->async = ent->async;
+		ctx->esync = ent->esync;
+		ctx->dpipe = ent->dpipe;
+		ctx->child = ent->child;
+		pool->fails = 0;
+		arcan_mem_free(ent);
+
+		return true;
+	}
+
+	return false;
+}
+
+/* atypes is a space separated list, 'dec' should not match 'decode' */
+static bool valid_atype(const char* mode)
+{
+	const char* atypes = arcan_frameserver_atypes();
+	size_t len = strlen(mode);
+
+	for (const char* cur = atypes; (cur = strstr(cur, mode)); cur += len){
+		if ((cur == atypes || cur[-1] == ' ') &&
+			(cur[len] == ' ' || cur[len] == '\0'))
+			return true;
+	}
+
+	return false;
+}
+
+bool arcan_frameserver_pool(const char* mode, size_t size)
+{
+	if (!mode || !mode[0] || strchr(mode, ' ') || !valid_atype(mode))
+		return false;
+
+	size = size > FSRV_POOL_MAXSZ ? FSRV_POOL_MAXSZ : size;
+
+	int slot = pool_find(mode);
+	if (-1 == slot){
+		for (size_t i = 0; i < FSRV_POOL_LIMIT && -1 == slot; i++)
+			if (!fsrv_pool[i].mode)
+				slot = i;
+
+		if (-1 == slot)
+			return false;
+
+		fsrv_pool[slot].mode = strdup(mode);
+	}
+
+	struct fsrv_pool* pool = &fsrv_pool[slot];
+	while (pool->ready > size){
+		pool_drop(pool->slots[--pool->ready]);
+		pool->slots[pool->ready] = NULL;
+	}
+
+	pool->size = size;
+	pool->fails = 0;
+	return true;
+}
+
+void arcan_frameserver_pool_step()
+{
+	for (size_t i = 0; i < FSRV_POOL_LIMIT; i++){
+		struct fsrv_pool* pool = &fsrv_pool[i];
+		if (!pool->mode || pool->ready >= pool->size)
+			continue;
+
+		arcan_frameserver* ent = pool_spawn(pool->mode);
+		if (ent)
+			pool->slots[pool->ready++] = ent;
+		else
+			pool->size = pool->ready;
+
+		return;
+	}
+}
+
+void arcan_frameserver_pool_flush(bool reset)
+{
+	for (size_t i = 0; i < FSRV_POOL_LIMIT; i++){
+		struct fsrv_pool* pool = &fsrv_pool[i];
+
+		while (pool->ready){
+			pool_drop(pool->slots[--pool->ready]);
+			pool->slots[pool->ready] = NULL;
+		}
+
+		if (reset){
+			free(pool->mode);
+			*pool = (struct fsrv_pool){0};
+		}
+	}
+}
+
+bool arcan_frameserver_pool_stat(
+	const char* mode, struct arcan_frameserver_poolstat* dst)
+{
+	int slot = mode ? pool_find(mode) : -1;
+	if (-1 == slot)
+		return false;
+
+	*dst = fsrv_pool[slot].stat;
+	dst->size = fsrv_pool[slot].size;
+	dst->ready = fsrv_pool[slot].ready;
+	return true;
+}
+
+void arcan_frameserver_pool_firstframe(arcan_frameserver* ctx)
+{
+	if (!ctx->launch.archetype || ctx->launch.archetype > FSRV_POOL_LIMIT)
+		return;
+
+	struct arcan_frameserver_poolstat* stat =
+		&fsrv_pool[ctx->launch.archetype - 1].stat;
+	unsigned long long elapsed = arcan_timemillis() - ctx->launchedtime;
+
+	if (ctx->launch.warm){
+		stat->warm++;
+		stat->warm_ms += elapsed;
+	}
+	else {
+		stat->cold++;
+		stat->cold_ms += elapsed;
+	}
+
+	ctx->launch.archetype = 0;
+}
+
 arcan_errc arcan_frameserver_spawn_server(arcan_frameserver* ctx,
 	struct frameserver_envp* setup)
 {
 	if (ctx == NULL)
 		return ARCAN_ERRC_BAD_ARGUMENT;
 
+	int slot = setup->use_builtin ? pool_find(setup->args.builtin.mode) : -1;
+	ctx->launchedtime = arcan_timemillis();
+	ctx->launch.archetype = slot + 1;
+
+	if (-1 != slot && pool_handout(slot, ctx, setup)){
+		ctx->launch.warm = true;
+		spawn_parent(ctx, setup);
+		return ARCAN_OK;
+	}
+
 	int sockp[2] = {-1, -1};
 
 	if (!sockpair_alloc(sockp, 1, false)){
@@ -1174,7 +1607,6 @@ arcan_errc arcan_frameserver_spawn_server(arcan_frameserver* ctx,
 		close(sockp[1]);
 		return ARCAN_ERRC_UNACCEPTED_STATE;
 	}
-	ctx->launchedtime = arcan_frametime();
 
 /*
  * this warrants explaining - to avoid dynamic allocations in the asynch unsafe
@@ -1183,7 +1615,6 @@ arcan_errc arcan_frameserver_spawn_server(arcan_frameserver* ctx,
  * is inherited and duped to a fix position and possible leaked fds are closed.
  */
 	struct arcan_strarr arr = {0};
-	const char* source;
 	if (setup->use_builtin)
 		append_env(&arr,
 			(char*) setup->args.builtin.resource, "3", ctx->shm.key);
@@ -1193,68 +1624,25 @@ arcan_errc arcan_frameserver_spawn_server(arcan_frameserver* ctx,
 	pid_t child = fork();
 	if (child) {
 		close(sockp[1]);
-
-		img_cons cons = {
-			.w = setup->init_w,
-			.h = setup->init_h,
-			.bpp = 4
-		};
-		vfunc_state state = {
-			.tag = ARCAN_TAG_FRAMESERV,
-			.ptr = ctx
-		};
-
-		ctx->source = strdup(setup->args.builtin.resource);
-
-		if (!ctx->vid)
-			ctx->vid = arcan_video_addfobject(FFUNC_NULLFRAME, state, cons, 0);
-
-		ctx->aid = ARCAN_EID;
-
-#ifdef __APPLE__
-		int val = 1;
-		setsockopt(sockp[0], SOL_SOCKET, SO_NOSIGPIPE, &val, sizeof(int));
-#endif
-		fcntl(sockp[0], F_SETFD, FD_CLOEXEC);
-
 		ctx->dpipe = sockp[0];
 		ctx->child = child;
-
-		arcan_frameserver_configure(ctx, *setup);
+		push_segment(ctx, ctx->dpipe);
+		spawn_parent(ctx, setup);
 	}
 	else if (child == 0){
+		if (setup->use_builtin)
+			spawn_builtin(sockp[1], setup->args.builtin.mode, arr.data);
+
+/* non-frameserver executions (hijack libs, ...) */
 		close(STDERR_FILENO+1);
-/* will also strip CLOEXEC */
 		dup2(sockp[1], STDERR_FILENO+1);
 		arcan_closefrom(STDERR_FILENO+2);
-
-/*
- * we need to mask this signal as when debugging parent process, GDB pushes
- * SIGINT to children, killing them and changing the behavior in the core
- * process
- */
 		sigaction(SIGPIPE, &(struct sigaction){
 			.sa_handler = SIG_IGN}, NULL);
 
-		if (setup->use_builtin){
-			char* argv[] = {
-				arcan_fetch_namespace(RESOURCE_SYS_BINS),
-				(char*) setup->args.builtin.mode,
-				NULL
-			};
-
-			execve(argv[0], argv, arr.data);
-			arcan_warning("arcan_frameserver_spawn_server() failed: %s, %s\n",
-				strerror(errno), argv[0]);
-				;
-			exit(EXIT_FAILURE);
-		}
-/* non-frameserver executions (hijack libs, ...) */
-		else {
-			execve(setup->args.external.fname,
-				setup->args.external.argv->data, setup->args.external.envv->data);
-			exit(EXIT_FAILURE);
-		}
+		execve(setup->args.external.fname,
+			setup->args.external.argv->data, setup->args.external.envv->data);
+		exit(EXIT_FAILURE);
 	}
 	else /* -1 */
 		arcan_fatal("fork() failed, check ulimit or similar configuration issue.");
@@ -57,6 +57,14 @@ unsigned arcan_glob(char* basename, enum arcan_namespaces space,
 
 		globslots[ofs++] = path;
 
+		int nres = arcan_archive_glob(path, cb, tag);
+		if (nres < 0)
+			nres = arcan_rescache_glob(i, basename, cb, tag);
+		if (nres >= 0){
+			count += nres;
+			continue;
+		}
+
 		if ( glob(path, 0, NULL, &res) == 0 ){
 			char** beg = res.gl_pathv;
 
@@ -163,7 +163,7 @@ arcan_frameserver* arcan_target_launch_internal(const char* fname,
 
 	if (
 		arcan_frameserver_spawn_server(res, &args) != ARCAN_OK) {
-		free(res);
+		arcan_mem_free(res);
 		res = NULL;
 	}
 
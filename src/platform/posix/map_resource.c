@@ -59,6 +59,12 @@ map_region arcan_map_resource(data_source* source, bool allowwrite)
 	map_region rv = {0};
 	struct stat sbuf;
 
+/* archives are an engine feature, frameservers reuse this file without */
+#ifdef ARCAN_ARCHIVE
+	if (arcan_archive_map(source, allowwrite, &rv))
+		return rv;
+#endif
+
 /*
  * if additional properties (size, ...) has not yet been resolved,
  * try and figure things out manually
@@ -117,7 +123,7 @@ memread:
  * then we automatically convert seeking to "skipping"
  */
 		bool rstatus = true;
-		if (source->start > 0 && -1 == lseek(source->fd, SEEK_SET, source->start)){
+		if (source->start > 0 && -1 == lseek(source->fd, source->start, SEEK_SET)){
 			rstatus = read_safe(source->fd, source->start, 8192, NULL);
 		}
 
@@ -138,6 +144,11 @@ bool arcan_release_map(map_region region)
 {
 	int rv = -1;
 
+#ifdef ARCAN_ARCHIVE
+	if (region.shared)
+		return arcan_archive_release(&region);
+#endif
+
 	if (region.sz > 0 && region.ptr)
 		rv = region.mmap ? munmap(region.ptr, region.sz) : (free(region.ptr), 0);
 
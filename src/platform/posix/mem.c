@@ -5,9 +5,8 @@
  */
 
 /*
- * This is mostly a stub implementation still, serious attempts
- * at getting a strong and efficient implementation is slated for
- * 0.8-0.9.
+ * Typed allocation with slab, arena and huge page pools, the guard-
+ * and integrity- parts outlined below are still missing.
  */
 
 #include <stdlib.h>
@@ -17,9 +16,15 @@
 #include <stdbool.h>
 #include <signal.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
 
 #include <sys/mman.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "arcan_math.h"
 #include "arcan_general.h"
 #include "arcan_video.h"
@@ -107,6 +112,410 @@ struct mempool_meta {
 
 int system_page_size = 4096;
 
+/*
+ * Small, fixed-size VSTRUCT/VTAG/ATAG objects come from per-type slab pools,
+ * small TEMPORARY- hinted allocations from a bump arena that is recycled at
+ * arcan_mem_tick and large VBUFFERs get their own (transparent huge page
+ * hinted) mappings. Everything else goes to malloc but is still tracked so
+ * that per-type usage can be queried with arcan_mem_stats.
+ *
+ * Pools are only activated by arcan_mem_init, other users of this
+ * translation unit (hijack libraries, frameservers) get the plain malloc
+ * behavior. arcan_mem_free accepts pointers that did not come from
+ * arcan_alloc_mem, but pooled memory must never be passed to free().
+ */
+#ifndef SLAB_CHUNK_SZ
+#define SLAB_CHUNK_SZ (64 * 1024)
+#endif
+
+#ifndef ARENA_MAX_ALLOC
+#define ARENA_MAX_ALLOC (4 * 1024)
+#endif
+
+#ifndef HUGE_THRESHOLD
+#define HUGE_THRESHOLD (2 * 1024 * 1024)
+#endif
+
+#define ARENA_HDR_SZ 16
+
+static const size_t slab_classes[] = {16, 32, 48, 64, 96, 128, 192, 256};
+#define SLAB_N_CLASSES (sizeof(slab_classes) / sizeof(slab_classes[0]))
+
+enum chunk_kind {
+	CHUNK_SLAB = 1,
+	CHUNK_ARENA = 2
+};
+
+enum block_kind {
+	BLOCK_MALLOC = 1,
+	BLOCK_HUGE = 2
+};
+
+struct chunk {
+	enum chunk_kind kind;
+	uint8_t type;
+	uint8_t cls;
+
+/* arena only: bump offset, number of live allocations and if the chunk has
+ * been retired (live allocations at a tick point) */
+	size_t ofs;
+	size_t live;
+	bool retired;
+
+	uint8_t* base;
+	struct chunk* next;
+};
+
+struct slab_pool {
+	void* freelist;
+	uint8_t* bump;
+	uint8_t* bump_end;
+};
+
+/* open-addressed uintptr_t keyed table, used both for looking up the chunk
+ * that owns a pooled allocation and for non-pooled block sizes */
+struct track_ent {
+	uintptr_t key;
+	size_t size;
+	uint8_t type;
+	uint8_t kind;
+	struct chunk* chunk;
+};
+
+struct track_tbl {
+	struct track_ent* ent;
+	size_t cap;
+	size_t used;
+};
+
+#define TRACK_TOMB ((uintptr_t) 1)
+
+static struct {
+	bool active;
+	pthread_mutex_t lock;
+
+	struct slab_pool slabs[ARCAN_MEM_ENDMARKER][SLAB_N_CLASSES];
+
+	struct chunk* arena;
+	struct chunk* arena_free;
+
+	struct track_tbl chunks;
+	struct track_tbl blocks;
+
+	struct arcan_memstats stats[ARCAN_MEM_ENDMARKER];
+	size_t temp_live[ARCAN_MEM_ENDMARKER];
+} mem = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static inline size_t track_hash(uintptr_t key, size_t cap)
+{
+	return (size_t)((key >> 4) * 0x9E3779B97F4A7C15ull) & (cap - 1);
+}
+
+static struct track_ent* track_find(struct track_tbl* tbl, uintptr_t key)
+{
+	if (!tbl->cap)
+		return NULL;
+
+	size_t i = track_hash(key, tbl->cap);
+	while (tbl->ent[i].key){
+		if (tbl->ent[i].key == key)
+			return &tbl->ent[i];
+		i = (i + 1) & (tbl->cap - 1);
+	}
+
+	return NULL;
+}
+
+static bool track_insert(struct track_tbl* tbl, struct track_ent* ent)
+{
+/* keep the load (including tombstones) below 50% */
+	if ((tbl->used + 1) * 2 > tbl->cap){
+		size_t ncap = tbl->cap ? tbl->cap * 2 : 1024;
+		struct track_ent* nent = calloc(ncap, sizeof(struct track_ent));
+		if (!nent)
+			return false;
+
+		size_t used = 0;
+		for (size_t i = 0; i < tbl->cap; i++){
+			if (tbl->ent[i].key <= TRACK_TOMB)
+				continue;
+			size_t j = track_hash(tbl->ent[i].key, ncap);
+			while (nent[j].key)
+				j = (j + 1) & (ncap - 1);
+			nent[j] = tbl->ent[i];
+			used++;
+		}
+
+		free(tbl->ent);
+		tbl->ent = nent;
+		tbl->cap = ncap;
+		tbl->used = used;
+	}
+
+/* a stale entry (block released with free() rather than arcan_mem_free)
+ * might still be around for this address, just replace it. For the pooled
+ * tags that is a bug (the same call on a smaller one corrupts the heap) so
+ * make it loud in debug builds */
+	struct track_ent* cur = track_find(tbl, ent->key);
+	if (cur){
+#ifdef _DEBUG
+		assert(cur->type != ARCAN_MEM_VSTRUCT &&
+			cur->type != ARCAN_MEM_VTAG && cur->type != ARCAN_MEM_ATAG);
+#endif
+		*cur = *ent;
+		return true;
+	}
+
+	size_t i = track_hash(ent->key, tbl->cap);
+	while (tbl->ent[i].key > TRACK_TOMB)
+		i = (i + 1) & (tbl->cap - 1);
+
+	if (!tbl->ent[i].key)
+		tbl->used++;
+	tbl->ent[i] = *ent;
+	return true;
+}
+
+static void track_remove(struct track_ent* ent)
+{
+	*ent = (struct track_ent){.key = TRACK_TOMB};
+}
+
+static void account_alloc(enum arcan_memtypes type, size_t nb)
+{
+	struct arcan_memstats* st = &mem.stats[type];
+	st->alloc_cnt++;
+	st->in_use += nb;
+	if (st->in_use > st->high_water)
+		st->high_water = st->in_use;
+}
+
+static void account_free(enum arcan_memtypes type, size_t nb)
+{
+	struct arcan_memstats* st = &mem.stats[type];
+	st->free_cnt++;
+	st->in_use = st->in_use > nb ? st->in_use - nb : 0;
+}
+
+/* size- aligned mapping, so that the owning chunk of any pooled pointer can
+ * be found by masking the address */
+static uint8_t* map_aligned(size_t sz, size_t align)
+{
+	uint8_t* base = mmap(NULL, sz + align,
+		PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	uintptr_t ofs = ((uintptr_t)base + align - 1) & ~(uintptr_t)(align - 1);
+	uint8_t* res = (uint8_t*) ofs;
+
+	if (res != base)
+		munmap(base, res - base);
+
+	size_t tail = (base + sz + align) - (res + sz);
+	if (tail)
+		munmap(res + sz, tail);
+
+	return res;
+}
+
+static struct chunk* chunk_alloc(enum chunk_kind kind, uint8_t type, uint8_t cls)
+{
+	struct chunk* res = malloc(sizeof(struct chunk));
+	if (!res)
+		return NULL;
+
+	res->base = map_aligned(SLAB_CHUNK_SZ, SLAB_CHUNK_SZ);
+	if (!res->base){
+		free(res);
+		return NULL;
+	}
+
+	if (!track_insert(&mem.chunks, &(struct track_ent){
+		.key = (uintptr_t) res->base, .chunk = res})){
+		munmap(res->base, SLAB_CHUNK_SZ);
+		free(res);
+		return NULL;
+	}
+
+	res->kind = kind;
+	res->type = type;
+	res->cls = cls;
+	res->ofs = 0;
+	res->live = 0;
+	res->retired = false;
+	res->next = NULL;
+
+	if (kind == CHUNK_SLAB)
+		mem.stats[type].reserved += SLAB_CHUNK_SZ;
+
+	return res;
+}
+
+static bool slab_eligible(enum arcan_memtypes type,
+	size_t nb, enum arcan_memalign align, size_t* cls)
+{
+	if (type != ARCAN_MEM_VSTRUCT && type != ARCAN_MEM_VTAG &&
+		type != ARCAN_MEM_ATAG)
+		return false;
+
+	if (align == ARCAN_MEMALIGN_PAGE || nb > slab_classes[SLAB_N_CLASSES-1])
+		return false;
+
+	for (size_t i = 0; i < SLAB_N_CLASSES; i++)
+		if (nb <= slab_classes[i]){
+			*cls = i;
+			return true;
+		}
+
+	return false;
+}
+
+static void* slab_alloc(enum arcan_memtypes type, size_t cls)
+{
+	struct slab_pool* pool = &mem.slabs[type][cls];
+	size_t sz = slab_classes[cls];
+
+	if (pool->freelist){
+		void* res = pool->freelist;
+		pool->freelist = *(void**) res;
+		return res;
+	}
+
+	if (!pool->bump || pool->bump + sz > pool->bump_end){
+		struct chunk* ch = chunk_alloc(CHUNK_SLAB, type, cls);
+		if (!ch)
+			return NULL;
+		pool->bump = ch->base;
+		pool->bump_end = ch->base + SLAB_CHUNK_SZ;
+	}
+
+	void* res = pool->bump;
+	pool->bump += sz;
+	return res;
+}
+
+static void slab_free(struct chunk* ch, void* ptr)
+{
+	struct slab_pool* pool = &mem.slabs[ch->type][ch->cls];
+#ifdef _DEBUG
+	assert(((uint8_t*) ptr - ch->base) % slab_classes[ch->cls] == 0);
+#endif
+	*(void**) ptr = pool->freelist;
+	pool->freelist = ptr;
+	account_free(ch->type, slab_classes[ch->cls]);
+}
+
+static void* arena_alloc(enum arcan_memtypes type, size_t nb)
+{
+	size_t need = ARENA_HDR_SZ + ((nb + 15) & ~(size_t)15);
+
+	if (mem.arena && mem.arena->ofs + need > SLAB_CHUNK_SZ){
+		if (mem.arena->live)
+			mem.arena->retired = true;
+		else{
+			mem.arena->next = mem.arena_free;
+			mem.arena_free = mem.arena;
+		}
+		mem.arena = NULL;
+	}
+
+	if (!mem.arena){
+		if (mem.arena_free){
+			mem.arena = mem.arena_free;
+			mem.arena_free = mem.arena->next;
+		}
+		else if (!(mem.arena = chunk_alloc(CHUNK_ARENA, 0, 0)))
+			return NULL;
+
+		mem.arena->ofs = 0;
+		mem.arena->live = 0;
+		mem.arena->retired = false;
+		mem.arena->next = NULL;
+	}
+
+	uint8_t* hdr = mem.arena->base + mem.arena->ofs;
+	mem.arena->ofs += need;
+	mem.arena->live++;
+	*(uint32_t*) hdr = nb;
+	hdr[4] = type;
+	mem.temp_live[type]++;
+
+	return hdr + ARENA_HDR_SZ;
+}
+
+static void arena_free(struct chunk* ch, void* ptr)
+{
+	uint8_t* hdr = (uint8_t*) ptr - ARENA_HDR_SZ;
+	enum arcan_memtypes type = hdr[4];
+
+	account_free(type, *(uint32_t*) hdr);
+	if (mem.temp_live[type])
+		mem.temp_live[type]--;
+
+/* retired chunks are recycled when the last allocation goes away */
+	if (--ch->live == 0 && ch->retired){
+		ch->retired = false;
+		ch->ofs = 0;
+		ch->next = mem.arena_free;
+		mem.arena_free = ch;
+	}
+}
+
+static void* huge_alloc(size_t nb, size_t* mapped)
+{
+	size_t align = HUGE_THRESHOLD;
+	size_t sz = (nb + align - 1) & ~(align - 1);
+
+	uint8_t* res = map_aligned(sz, align);
+	if (!res)
+		return NULL;
+
+#ifdef MADV_HUGEPAGE
+	madvise(res, sz, MADV_HUGEPAGE);
+#endif
+
+	*mapped = sz;
+	return res;
+}
+
+/*
+ * MEM_VBUFFER + BZERO is used for 'black' canvases, fill with the
+ * platform pixel packing rather than zero.
+ */
+static void fill_vbuffer(av_pixel* buf, size_t nb)
+{
+	size_t count = nb / sizeof(av_pixel);
+	av_pixel val = RGBA(0, 0, 0, 255);
+
+#if defined(__SSE2__)
+	if (sizeof(av_pixel) == 4){
+		while (count && ((uintptr_t)buf & 15)){
+			*buf++ = val;
+			count--;
+		}
+
+		__m128i vv = _mm_set1_epi32(val);
+		__m128i* vbuf = (__m128i*) buf;
+		for (; count >= 16; count -= 16, vbuf += 4){
+			_mm_store_si128(&vbuf[0], vv);
+			_mm_store_si128(&vbuf[1], vv);
+			_mm_store_si128(&vbuf[2], vv);
+			_mm_store_si128(&vbuf[3], vv);
+		}
+		for (; count >= 4; count -= 4)
+			_mm_store_si128(vbuf++, vv);
+
+		buf = (av_pixel*) vbuf;
+	}
+#endif
+
+	while (count--)
+		*buf++ = val;
+}
+
 /*
  * map initial pools, pre-fill some video buffers,
  * get limits and assert that our build-time minimal
@@ -114,16 +523,47 @@ int system_page_size = 4096;
  */
 void arcan_mem_init()
 {
-
+	pthread_mutex_lock(&mem.lock);
+	mem.active = true;
+	pthread_mutex_unlock(&mem.lock);
 }
 
 /*
- * there should essentially be NO memory blocks marked
- * TEMPORARY or SENSITIVE (NON VIDEO/AUDIO) alive at this
- * point, use the tick point to check and trap as leaks.
+ * there should essentially be NO memory blocks marked TEMPORARY alive at
+ * this point, those that are get counted as overdue and pin their arena
+ * chunk until they are released.
  */
 void arcan_mem_tick()
 {
+	if (!mem.active)
+		return;
+
+	pthread_mutex_lock(&mem.lock);
+	for (size_t i = 0; i < ARCAN_MEM_ENDMARKER; i++)
+		mem.stats[i].temp_overdue += mem.temp_live[i];
+
+	if (mem.arena){
+		if (mem.arena->live){
+			mem.arena->retired = true;
+			mem.arena = NULL;
+		}
+		else
+			mem.arena->ofs = 0;
+	}
+	pthread_mutex_unlock(&mem.lock);
+}
+
+bool arcan_mem_stats(enum arcan_memtypes type, struct arcan_memstats* out)
+{
+	if (!out || type <= 0 || type >= ARCAN_MEM_ENDMARKER || !mem.active)
+		return false;
+
+	pthread_mutex_lock(&mem.lock);
+	*out = mem.stats[type];
+	out->temp_live = mem.temp_live[type];
+	pthread_mutex_unlock(&mem.lock);
+
+	return true;
 }
 
 /*static void sigsegv_hand(int sig, siginfo_t* si, void* unused)
@@ -146,6 +586,45 @@ void arcan_mem_tick()
 	struct sigaction sa;
  */
 
+static void* pool_alloc(size_t nb,
+	enum arcan_memtypes type, enum arcan_memhint hint, enum arcan_memalign align)
+{
+	void* rptr = NULL;
+	size_t cls;
+
+	if (hint & ARCAN_MEM_SENSITIVE)
+		return NULL;
+
+	pthread_mutex_lock(&mem.lock);
+	if (slab_eligible(type, nb, align, &cls)){
+		if ((rptr = slab_alloc(type, cls)))
+			account_alloc(type, slab_classes[cls]);
+	}
+	else if ((hint & ARCAN_MEM_TEMPORARY) &&
+		nb <= ARENA_MAX_ALLOC && align != ARCAN_MEMALIGN_PAGE){
+		if ((rptr = arena_alloc(type, nb)))
+			account_alloc(type, nb);
+	}
+	else if (type == ARCAN_MEM_VBUFFER && nb >= HUGE_THRESHOLD){
+		size_t mapped;
+		if ((rptr = huge_alloc(nb, &mapped))){
+			if (track_insert(&mem.blocks, &(struct track_ent){
+				.key = (uintptr_t) rptr, .size = mapped,
+				.type = type, .kind = BLOCK_HUGE})){
+				account_alloc(type, mapped);
+				mem.stats[type].reserved += mapped;
+			}
+			else{
+				munmap(rptr, mapped);
+				rptr = NULL;
+			}
+		}
+	}
+	pthread_mutex_unlock(&mem.lock);
+
+	return rptr;
+}
+
 void* arcan_alloc_mem(size_t nb,
 	enum arcan_memtypes type, enum arcan_memhint hint, enum arcan_memalign align)
 {
@@ -154,41 +633,33 @@ void* arcan_alloc_mem(size_t nb,
 	size_t footer_sz = 0;
 	size_t padding_sz = 0;
 	size_t total;
+	bool pooled = false;
 
-	switch (type){
-	case ARCAN_MEM_BINDING:
-	case ARCAN_MEM_THREADCTX:
-	case ARCAN_MEM_VBUFFER:
-	case ARCAN_MEM_ABUFFER:
-	case ARCAN_MEM_MODELDATA:
-	case ARCAN_MEM_VSTRUCT:
-	case ARCAN_MEM_EXTSTRUCT:
-	case ARCAN_MEM_STRINGBUF:
-	case ARCAN_MEM_VTAG:
-	case ARCAN_MEM_ATAG:
+	if (type <= 0 || type >= ARCAN_MEM_ENDMARKER)
+		abort();
 
-		total = header_sz + footer_sz + padding_sz + nb;
+	if (!nb)
+		nb = 1;
 
-		switch(align){
-		case ARCAN_MEMALIGN_NATURAL:
-			rptr = malloc(total);
-		break;
+	total = header_sz + footer_sz + padding_sz + nb;
 
-		case ARCAN_MEMALIGN_PAGE:
-			if (-1 == posix_memalign(&rptr, system_page_size, total))
-				rptr = NULL;
-		break;
+	if (mem.active && (rptr = pool_alloc(nb, type, hint, align)))
+		pooled = true;
 
-		case ARCAN_MEMALIGN_SIMD:
-			if (-1 == posix_memalign(&rptr, 16, total))
-				rptr = NULL;
-		break;
-		}
+	else switch(align){
+	case ARCAN_MEMALIGN_NATURAL:
+		rptr = malloc(total);
 	break;
 
-	case ARCAN_MEM_ENDMARKER:
-	default:
-			abort();
+	case ARCAN_MEMALIGN_PAGE:
+		if (0 != posix_memalign(&rptr, system_page_size, total))
+			rptr = NULL;
+	break;
+
+	case ARCAN_MEMALIGN_SIMD:
+		if (0 != posix_memalign(&rptr, 16, total))
+			rptr = NULL;
+	break;
 	}
 
 	if (!rptr){
@@ -197,6 +668,15 @@ void* arcan_alloc_mem(size_t nb,
 		return NULL;
 	}
 
+	if (mem.active && !pooled){
+		pthread_mutex_lock(&mem.lock);
+		if (track_insert(&mem.blocks, &(struct track_ent){
+			.key = (uintptr_t) rptr, .size = total,
+			.type = type, .kind = BLOCK_MALLOC}))
+			account_alloc(type, total);
+		pthread_mutex_unlock(&mem.lock);
+	}
+
 /*
  * Post-alloc hooks
  */
@@ -220,18 +700,77 @@ void* arcan_alloc_mem(size_t nb,
 		madvise(rptr, total, madvflag);
 
 	if (hint & ARCAN_MEM_BZERO){
-		if (type == ARCAN_MEM_VBUFFER){
-			av_pixel* buf = (av_pixel*) rptr;
-			for (size_t i = 0; i < nb; i += sizeof(av_pixel))
-				*buf++ = RGBA(0, 0, 0, 255);
-		}
+		if (type == ARCAN_MEM_VBUFFER)
+			fill_vbuffer((av_pixel*) rptr, nb);
 		else
-			memset(rptr, '\0', total);
+			memset(rptr, '\0', nb);
 	}
 
 	return rptr;
 }
 
+void* arcan_mem_grow(void* src, size_t nz, size_t nb, enum arcan_memhint hint)
+{
+	if (!src)
+		return nb ? malloc(nb) : NULL;
+
+	if (mem.active){
+		pthread_mutex_lock(&mem.lock);
+		struct track_ent* ent = track_find(&mem.chunks,
+			(uintptr_t) src & ~(uintptr_t)(SLAB_CHUNK_SZ - 1));
+		uint8_t type = 0;
+
+/* pooled, need to allocate a new block and move */
+		if (ent)
+			type = ent->chunk->kind == CHUNK_SLAB ? ent->chunk->type :
+				((uint8_t*) src - ARENA_HDR_SZ)[4];
+		else if ((ent = track_find(&mem.blocks, (uintptr_t) src)) &&
+			ent->kind == BLOCK_HUGE){
+			type = ent->type;
+		}
+/* malloc- backed, realloc and retrack */
+		else if (ent){
+			type = ent->type;
+			void* res = realloc(src, nb);
+			if (res){
+				account_free(type, ent->size);
+				track_remove(ent);
+				if (track_insert(&mem.blocks, &(struct track_ent){
+					.key = (uintptr_t) res, .size = nb,
+					.type = type, .kind = BLOCK_MALLOC}))
+					account_alloc(type, nb);
+			}
+			pthread_mutex_unlock(&mem.lock);
+			if (!res && (hint & ARCAN_MEM_NONFATAL) == 0)
+				arcan_fatal("arcan_mem_grow(), out of memory.\n");
+			if (res && (hint & ARCAN_MEM_BZERO) && nb > nz)
+				memset((uint8_t*)res + nz, '\0', nb - nz);
+			return res;
+		}
+		pthread_mutex_unlock(&mem.lock);
+
+		if (type){
+			void* res = arcan_alloc_mem(nb, type,
+				hint & ~ARCAN_MEM_TEMPORARY, ARCAN_MEMALIGN_NATURAL);
+			if (!res)
+				return NULL;
+			memcpy(res, src, nz < nb ? nz : nb);
+			if ((hint & ARCAN_MEM_BZERO) && nb > nz)
+				memset((uint8_t*)res + nz, '\0', nb - nz);
+			arcan_mem_free(src);
+			return res;
+		}
+	}
+
+/* not one of ours */
+	void* res = realloc(src, nb);
+	if (!res && (hint & ARCAN_MEM_NONFATAL) == 0)
+		arcan_fatal("arcan_mem_grow(), out of memory.\n");
+	if (res && (hint & ARCAN_MEM_BZERO) && nb > nz)
+		memset((uint8_t*)res + nz, '\0', nb - nz);
+	return res;
+}
+
 void arcan_mem_growarr(struct arcan_strarr* res)
 {
 /* _alloc functions lacks a grow at the moment,
@@ -283,13 +822,42 @@ void* arcan_alloc_fillmem(const void* data,
 
 void arcan_mem_free(void* inptr)
 {
-/* lock then free */
-/* depending on type and flag, verify integrity,
- * then cleanup. VBUFFER for instance doesn't
- * automatically shrink, but rather reset and flag
- * as unused */
+	if (!inptr)
+		return;
+
+	if (!mem.active){
+		free(inptr);
+		return;
+	}
+
+	pthread_mutex_lock(&mem.lock);
+	struct track_ent* ent = track_find(&mem.chunks,
+		(uintptr_t) inptr & ~(uintptr_t)(SLAB_CHUNK_SZ - 1));
 
+	if (ent){
+		if (ent->chunk->kind == CHUNK_SLAB)
+			slab_free(ent->chunk, inptr);
+		else
+			arena_free(ent->chunk, inptr);
+		pthread_mutex_unlock(&mem.lock);
+		return;
+	}
+
+	ent = track_find(&mem.blocks, (uintptr_t) inptr);
+	if (ent){
+		account_free(ent->type, ent->size);
+		if (ent->kind == BLOCK_HUGE){
+			mem.stats[ent->type].reserved -= ent->size;
+			munmap(inptr, ent->size);
+			track_remove(ent);
+			pthread_mutex_unlock(&mem.lock);
+			return;
+		}
+		track_remove(ent);
+	}
+	pthread_mutex_unlock(&mem.lock);
 
+/* either tracked malloc or from a library/strdup etc. */
 	free(inptr);
 }
 
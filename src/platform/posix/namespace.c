@@ -42,6 +42,9 @@ static struct {
 	int flags[11];
 	int lenv[11];
 
+/* set if the path points to (or into) a packed appl */
+	struct arcan_archive* archive[11];
+
 } namespaces = {0};
 
 static const char* lbls[] = {
@@ -83,7 +86,12 @@ char* arcan_find_resource(const char* label,
 			namespaces.paths[j], label
 		);
 
-		if (
+		int type = namespaces.archive[j] ?
+			arcan_archive_lookup(scratch) : arcan_rescache_lookup(i, label);
+		if (0 == type || (type > 0 && !(type & ares)))
+			continue;
+
+		if (type > 0 ||
 			((ares & ARES_FILE) && arcan_isfile(scratch)) ||
 			((ares & ARES_FOLDER) && arcan_isdir(scratch))
 		)
@@ -272,5 +280,11 @@ void arcan_override_namespace(const char* path, enum arcan_namespaces space)
 
 	namespaces.paths[space_ind] = strdup(path);
 	namespaces.lenv[space_ind] = strlen(namespaces.paths[space_ind]);
+
+/* mount first, the new path might be inside the archive we replace */
+	struct arcan_archive* old = namespaces.archive[space_ind];
+	namespaces.archive[space_ind] = arcan_archive_mount(path);
+	arcan_archive_unmount(old);
+	arcan_rescache_flush(space);
 }
 
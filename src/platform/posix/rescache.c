@@ -0,0 +1,522 @@
+/*
+ * Copyright 2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ */
+
+/*
+ * In-memory index of the namespace directory trees, used by namespace.c and
+ * glob.c to avoid a stat() per namespace per lookup. Directories are listed
+ * the first time a lookup passes through them and the listing is kept until
+ * the directory changes (inotify), then it is dropped and re-read on the next
+ * lookup. Without a way to get change notifications, the index is disabled
+ * and all queries fall back to the filesystem.
+ *
+ * Known blind spot: a symlink that is retargeted to something of a different
+ * type without the link itself being replaced, rescan_resources() covers that.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __LINUX
+#include <sys/inotify.h>
+#endif
+
+#include <arcan_math.h>
+#include <arcan_general.h>
+
+struct rc_dir;
+
+struct rc_ent {
+	char* name;
+	int type;
+	struct rc_dir* dir;
+};
+
+struct rc_dir {
+	char* path;
+	int wd;
+	bool listed;
+
+	struct rc_ent* ents;
+	size_t n_ents;
+
+	struct rc_dir* next_watch;
+};
+
+static struct {
+	bool init, disabled;
+	int fd;
+	pthread_mutex_t lock;
+
+	struct rc_dir* roots[11];
+	struct rc_dir* watches;
+
+	struct arcan_rescache_stat stat;
+} rcache = {
+	.fd = -1,
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static unsigned i_log2(uint32_t n)
+{
+	unsigned res = 0;
+	while (n >>= 1) res++;
+	return res;
+}
+
+static bool rc_init()
+{
+	if (rcache.init)
+		return !rcache.disabled;
+
+	rcache.init = true;
+#ifdef __LINUX
+	rcache.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	rcache.disabled = rcache.fd == -1;
+
+	if (rcache.disabled)
+		arcan_warning("resource cache: no change notification, "
+			"lookups will use the filesystem\n");
+
+	return !rcache.disabled;
+}
+
+static void rc_unwatch(struct rc_dir* dir)
+{
+	if (-1 == dir->wd)
+		return;
+
+	struct rc_dir** cur = &rcache.watches;
+	while (*cur && *cur != dir)
+		cur = &(*cur)->next_watch;
+	if (*cur)
+		*cur = dir->next_watch;
+
+#ifdef __LINUX
+	inotify_rm_watch(rcache.fd, dir->wd);
+#endif
+	dir->wd = -1;
+	dir->next_watch = NULL;
+}
+
+static void rc_freedir(struct rc_dir* dir);
+static void rc_flush(unsigned spaces);
+
+/* forget the listing (and everything below) but keep the node itself */
+static void rc_invalidate(struct rc_dir* dir)
+{
+	rc_unwatch(dir);
+
+	for (size_t i = 0; i < dir->n_ents; i++){
+		if (dir->ents[i].dir)
+			rc_freedir(dir->ents[i].dir);
+		free(dir->ents[i].name);
+	}
+
+	free(dir->ents);
+	dir->ents = NULL;
+	dir->n_ents = 0;
+	dir->listed = false;
+}
+
+static void rc_freedir(struct rc_dir* dir)
+{
+	rc_invalidate(dir);
+	free(dir->path);
+	free(dir);
+}
+
+static struct rc_dir* rc_newdir(const char* path)
+{
+	struct rc_dir* res = malloc(sizeof(struct rc_dir));
+	if (!res)
+		return NULL;
+
+	*res = (struct rc_dir){
+		.path = strdup(path),
+		.wd = -1
+	};
+
+	if (!res->path){
+		free(res);
+		return NULL;
+	}
+
+	return res;
+}
+
+/* apply pending change notifications, any change to a directory drops it */
+static void rc_drain()
+{
+#ifdef __LINUX
+	char buf[4096]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	for(;;){
+		ssize_t nr = read(rcache.fd, buf, sizeof(buf));
+		if (nr <= 0)
+			break;
+
+		for (char* cur = buf; cur < buf + nr;){
+			struct inotify_event* ev = (struct inotify_event*) cur;
+			cur += sizeof(struct inotify_event) + ev->len;
+
+/* queue overflow means we lost track, start over */
+			if (ev->mask & IN_Q_OVERFLOW){
+				rc_flush(RESOURCE_SYS_ENDM * 2 - 1);
+				continue;
+			}
+
+			for (struct rc_dir* dir = rcache.watches; dir; dir = dir->next_watch)
+				if (dir->wd == ev->wd){
+					rc_invalidate(dir);
+					break;
+				}
+		}
+	}
+#endif
+}
+
+static int rc_entcmp(const void* a, const void* b)
+{
+	return strcmp(((struct rc_ent*)a)->name, ((struct rc_ent*)b)->name);
+}
+
+static int rc_type(int dfd, struct dirent* ent)
+{
+	switch (ent->d_type){
+	case DT_REG:
+	case DT_FIFO:
+		return ARES_FILE;
+	case DT_DIR:
+		return ARES_FOLDER;
+	case DT_LNK:
+	case DT_UNKNOWN:{
+		struct stat buf;
+		if (-1 == fstatat(dfd, ent->d_name, &buf, 0))
+			return 0;
+		if (S_ISREG(buf.st_mode) || S_ISFIFO(buf.st_mode))
+			return ARES_FILE;
+		if (S_ISDIR(buf.st_mode))
+			return ARES_FOLDER;
+		return 0;
+	}
+	default:
+		return 0;
+	}
+}
+
+/*
+ * The watch is added before reading the directory so that nothing can change
+ * in between without us knowing, a failed watch (out of watches, permission)
+ * leaves the directory unlisted and the lookup falls back.
+ */
+static bool rc_list(struct rc_dir* dir)
+{
+	if (dir->listed)
+		return true;
+
+#ifdef __LINUX
+	dir->wd = inotify_add_watch(rcache.fd, dir->path,
+		IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+		IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+#endif
+	if (-1 == dir->wd)
+		return false;
+
+	dir->next_watch = rcache.watches;
+	rcache.watches = dir;
+
+	DIR* dh = opendir(dir->path);
+	if (!dh){
+		rc_unwatch(dir);
+		return false;
+	}
+
+	size_t cap = 0;
+	struct dirent* ent;
+	while ((ent = readdir(dh))){
+		if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+			continue;
+
+		if (dir->n_ents == cap){
+			size_t ncap = cap ? cap * 2 : 16;
+			struct rc_ent* nents = realloc(dir->ents, ncap * sizeof(struct rc_ent));
+			if (!nents)
+				goto fail;
+			dir->ents = nents;
+			cap = ncap;
+		}
+
+		char* name = strdup(ent->d_name);
+		if (!name)
+			goto fail;
+
+		dir->ents[dir->n_ents++] = (struct rc_ent){
+			.name = name,
+			.type = rc_type(dirfd(dh), ent)
+		};
+	}
+
+	closedir(dh);
+	qsort(dir->ents, dir->n_ents, sizeof(struct rc_ent), rc_entcmp);
+	dir->listed = true;
+	rcache.stat.dirs++;
+	return true;
+
+fail:
+	closedir(dh);
+	rc_invalidate(dir);
+	return false;
+}
+
+static struct rc_ent* rc_find(struct rc_dir* dir, const char* name)
+{
+	struct rc_ent key = {.name = (char*) name};
+	return bsearch(&key, dir->ents, dir->n_ents, sizeof(struct rc_ent), rc_entcmp);
+}
+
+static struct rc_dir* rc_root(enum arcan_namespaces space)
+{
+	int ind = i_log2(space);
+	if (rcache.roots[ind])
+		return rcache.roots[ind];
+
+	char* path = arcan_fetch_namespace(space);
+	if (!path)
+		return NULL;
+
+	return (rcache.roots[ind] = rc_newdir(path));
+}
+
+/*
+ * Walk [label] from the namespace root, listing directories as needed. Sets
+ * [dst] to the last directory and [last] to the final path component (NULL if
+ * the label ends in a directory, e.g. 'a/b/.'). Returns 1 on success, 0 if
+ * some part of the path is known not to exist and -1 if the index can't be
+ * used for this label.
+ */
+static int rc_walk(enum arcan_namespaces space, const char* label,
+	struct rc_dir** dst, char** last, bool* listed)
+{
+	struct rc_dir* dir = rc_root(space);
+	if (!dir)
+		return -1;
+
+	size_t len = strlen(label);
+	char work[len + 1];
+	memcpy(work, label, len + 1);
+
+	char* tokctx;
+	char* tok = strtok_r(work, "/", &tokctx);
+	*last = NULL;
+
+	while (tok){
+		char* next = strtok_r(NULL, "/", &tokctx);
+
+		if (strcmp(tok, ".") == 0){
+			tok = next;
+			continue;
+		}
+
+		if (strcmp(tok, "..") == 0)
+			return -1;
+
+		if (!dir->listed){
+			if (!rc_list(dir))
+				return -1;
+			*listed = true;
+		}
+
+/* final component, hand back relative to the caller buffer */
+		if (!next){
+			*dst = dir;
+			*last = (char*) label + (tok - work);
+			return 1;
+		}
+
+		struct rc_ent* ent = rc_find(dir, tok);
+		if (!ent || ent->type != ARES_FOLDER)
+			return 0;
+
+		if (!ent->dir){
+			size_t plen = strlen(dir->path) + strlen(tok) + 2;
+			char path[plen];
+			snprintf(path, plen, "%s/%s", dir->path, tok);
+			if (!(ent->dir = rc_newdir(path)))
+				return -1;
+		}
+
+		dir = ent->dir;
+		tok = next;
+	}
+
+	*dst = dir;
+	return 1;
+}
+
+int arcan_rescache_lookup(enum arcan_namespaces space, const char* label)
+{
+	int rv = -1;
+	pthread_mutex_lock(&rcache.lock);
+	if (!rc_init())
+		goto out;
+
+	rc_drain();
+
+	struct rc_dir* dir;
+	char* last;
+	bool listed = false;
+
+	rv = rc_walk(space, label, &dir, &last, &listed);
+
+/* the root itself or a trailing slash, let the filesystem answer */
+	if (1 == rv){
+		if (!last){
+			rv = -1;
+			goto out;
+		}
+
+		if (!dir->listed){
+			if (!rc_list(dir)){
+				rv = -1;
+				goto out;
+			}
+			listed = true;
+		}
+
+		struct rc_ent* ent = rc_find(dir, last);
+		rv = ent ? ent->type : 0;
+	}
+
+	if (-1 == rv)
+		rcache.stat.uncached++;
+	else if (listed)
+		rcache.stat.misses++;
+	else
+		rcache.stat.hits++;
+
+out:
+	pthread_mutex_unlock(&rcache.lock);
+	return rv;
+}
+
+int arcan_rescache_glob(enum arcan_namespaces space, const char* pattern,
+	void (*cb)(char*, void*), void* tag)
+{
+	int rv = -1;
+	const char* fname = strrchr(pattern, '/');
+	size_t dlen = fname ? fname - pattern : 0;
+	fname = fname ? fname + 1 : pattern;
+
+/* wildcards in the directory part aren't worth it, glob(3) does that */
+	if (!fname[0] || strcspn(pattern, "*?[\\") < dlen)
+		return -1;
+
+	pthread_mutex_lock(&rcache.lock);
+	if (!rc_init()){
+		pthread_mutex_unlock(&rcache.lock);
+		return -1;
+	}
+
+	rc_drain();
+
+	struct rc_dir* dir = NULL;
+	char* last = NULL;
+	bool listed = false;
+
+/* the trailing '.' makes the walk treat every component as a directory */
+	char work[dlen + 3];
+	memcpy(work, pattern, dlen);
+	memcpy(&work[dlen], "/.", 3);
+	rv = rc_walk(space, work, &dir, &last, &listed);
+
+	if (1 == rv && !dir->listed){
+		if (!rc_list(dir))
+			rv = -1;
+		else
+			listed = true;
+	}
+
+	if (-1 == rv){
+		rcache.stat.uncached++;
+		goto out;
+	}
+
+	if (listed)
+		rcache.stat.misses++;
+	else
+		rcache.stat.hits++;
+
+	if (0 == rv)
+		goto out;
+
+/* entries are sorted, matching the default glob order, copy the names as the
+ * callback is free to trigger lookups that may invalidate the listing */
+	size_t count = 0;
+	char** match = malloc(sizeof(char*) * (dir->n_ents + 1));
+	if (!match){
+		rv = -1;
+		goto out;
+	}
+
+	for (size_t i = 0; i < dir->n_ents; i++)
+		if (0 == fnmatch(fname, dir->ents[i].name, FNM_PERIOD))
+			match[count++] = strdup(dir->ents[i].name);
+	pthread_mutex_unlock(&rcache.lock);
+
+	rv = 0;
+	for (size_t i = 0; i < count; i++){
+		if (match[i]){
+			cb(match[i], tag);
+			free(match[i]);
+			rv++;
+		}
+	}
+
+	free(match);
+	return rv;
+
+out:
+	pthread_mutex_unlock(&rcache.lock);
+	return rv;
+}
+
+static void rc_flush(unsigned spaces)
+{
+	for (size_t i = 0; i < sizeof(rcache.roots) / sizeof(rcache.roots[0]); i++){
+		if (!(spaces & (1 << i)) || !rcache.roots[i])
+			continue;
+
+		rc_freedir(rcache.roots[i]);
+		rcache.roots[i] = NULL;
+	}
+}
+
+void arcan_rescache_flush(enum arcan_namespaces spaces)
+{
+	pthread_mutex_lock(&rcache.lock);
+	rc_flush(spaces);
+	pthread_mutex_unlock(&rcache.lock);
+}
+
+void arcan_rescache_stat(struct arcan_rescache_stat* dst)
+{
+	pthread_mutex_lock(&rcache.lock);
+	*dst = rcache.stat;
+	pthread_mutex_unlock(&rcache.lock);
+}
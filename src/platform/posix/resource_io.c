@@ -18,6 +18,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <time.h>
+#include <sys/mman.h>
 
 #include <arcan_math.h>
 #include <arcan_general.h>
@@ -53,6 +54,12 @@ data_source arcan_open_resource(const char* url)
 	if (!url)
 		return res;
 
+/* entries in a packed appl are an offset + length into the archive */
+#ifdef ARCAN_ARCHIVE
+	if (arcan_archive_open(url, &res))
+		return res;
+#endif
+
 	res.fd = open(url, O_RDONLY);
 	if (res.fd != -1){
 		res.start  = 0;
@@ -63,3 +70,57 @@ data_source arcan_open_resource(const char* url)
 
 	return res;
 }
+
+file_handle arcan_resource_fd(const char* name)
+{
+	data_source src = arcan_open_resource(name);
+	if (BADFD == src.fd)
+		return BADFD;
+
+/* plain file, just hand over the descriptor */
+	if (0 == src.start && 0 == src.len){
+		file_handle fd = src.fd;
+		src.fd = BADFD;
+		arcan_release_resource(&src);
+		return fd;
+	}
+
+	map_region map = arcan_map_resource(&src, false);
+	arcan_release_resource(&src);
+	if (!map.ptr)
+		return BADFD;
+
+	int fd = -1;
+#if defined(__LINUX) && defined(MFD_CLOEXEC)
+	fd = memfd_create("arcan_resource", MFD_CLOEXEC);
+#endif
+
+	if (-1 == fd){
+		char tmpl[] = "/tmp/arcan_resXXXXXX";
+		fd = mkstemp(tmpl);
+		if (-1 != fd){
+			unlink(tmpl);
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+		}
+	}
+
+	size_t ofs = 0;
+	while (-1 != fd && ofs < map.sz){
+		ssize_t nw = write(fd, &map.ptr[ofs], map.sz - ofs);
+		if (nw > 0)
+			ofs += nw;
+		else if (-1 == nw && errno == EINTR)
+			;
+		else {
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	arcan_release_map(map);
+
+	if (-1 != fd)
+		lseek(fd, 0, SEEK_SET);
+
+	return fd;
+}
@@ -15,6 +15,93 @@
 #include PLATFORM_HEADER
 #endif
 
+#ifdef __linux__
+#include <limits.h>
+#include <stdatomic.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/*
+ * On linux, the semaphores are plain futex words that live inside the shared
+ * memory page (see the futex field in struct arcan_shmif_page) or, for
+ * process-local use, in the heap. The low bits hold the count and the top bit
+ * marks that someone might be sleeping so post can skip the syscall when not.
+ */
+#define FUTEX_WAITERS 0x80000000
+
+static int futex_op(sem_handle sem, int op, uint32_t val)
+{
+	return syscall(SYS_futex, (uint32_t*) sem, op, val, NULL, NULL, 0);
+}
+
+int arcan_sem_post(sem_handle sem)
+{
+	uint32_t val = atomic_fetch_add(sem, 1);
+	if (val & FUTEX_WAITERS){
+		atomic_fetch_and(sem, ~FUTEX_WAITERS);
+		futex_op(sem, FUTEX_WAKE, INT_MAX);
+	}
+	return 0;
+}
+
+int arcan_sem_unlink(sem_handle sem, char* key)
+{
+	return 0;
+}
+
+int arcan_sem_trywait(sem_handle sem)
+{
+	uint32_t val = atomic_load(sem);
+	while (val & ~FUTEX_WAITERS){
+		if (atomic_compare_exchange_weak(sem, &val, val - 1))
+			return 0;
+	}
+
+	errno = EAGAIN;
+	return -1;
+}
+
+int arcan_sem_wait(sem_handle sem)
+{
+	for(;;){
+		if (0 == arcan_sem_trywait(sem))
+			return 0;
+
+/* flag that we're going to sleep, then only sleep if nothing has been posted
+ * in between, the kernel re-checks the value so no wakeup can get lost */
+		uint32_t val = atomic_fetch_or(sem, FUTEX_WAITERS) | FUTEX_WAITERS;
+		if (val != FUTEX_WAITERS)
+			continue;
+
+		if (-1 == futex_op(sem, FUTEX_WAIT, val) &&
+			errno != EAGAIN && errno != EINTR)
+			return -1;
+	}
+}
+
+int arcan_sem_init(sem_handle* sem, unsigned val)
+{
+	if (*sem == NULL){
+		*sem = malloc(sizeof(**sem));
+		if (!*sem)
+			return -1;
+	}
+	atomic_store(*sem, val);
+	return 0;
+}
+
+/* only for process-local words from arcan_sem_init, the ones in the shared
+ * page go away with the mapping */
+int arcan_sem_destroy(sem_handle sem)
+{
+	if (!sem)
+		return -1;
+
+	free((void*) sem);
+	return 0;
+}
+
+#else
 int arcan_sem_post(sem_handle sem)
 {
 	return sem_post(sem);
@@ -47,3 +134,4 @@ int arcan_sem_destroy(sem_handle sem)
 {
 	return sem_destroy(sem);
 }
+#endif
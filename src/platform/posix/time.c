@@ -16,6 +16,13 @@ long long int arcan_timemillis()
 	return (tp.tv_sec * 1000) + (tp.tv_nsec / 1000000);
 }
 
+long long int arcan_timemicros()
+{
+	struct timespec tp;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
+	return (tp.tv_sec * 1000000) + (tp.tv_nsec / 1000);
+}
+
 void arcan_timesleep(unsigned long val)
 {
 	struct timespec req, rem;
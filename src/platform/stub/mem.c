@@ -30,10 +30,32 @@ void* arcan_alloc_mem(size_t nb,
 	return buf;
 }
 
+void arcan_mem_init()
+{
+}
+
 void arcan_mem_tick()
 {
 }
 
+bool arcan_mem_stats(enum arcan_memtypes type, struct arcan_memstats* out)
+{
+	return false;
+}
+
+void* arcan_mem_grow(void* src, size_t nz, size_t nb, enum arcan_memhint hint)
+{
+	void* res = realloc(src, nb);
+
+	if (!res && (hint & ARCAN_MEM_NONFATAL) == 0)
+		arcan_fatal("arcan_mem_grow(), out of memory.\n");
+
+	if (res && (hint & ARCAN_MEM_BZERO) && nb > nz)
+		memset((uint8_t*)res + nz, '\0', nb - nz);
+
+	return res;
+}
+
 void arcan_mem_growarr(struct arcan_strarr* res)
 {
 /* _alloc functions lacks a grow at the moment,
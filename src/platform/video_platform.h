@@ -129,6 +129,28 @@ enum txstate {
 	TXSTATE_DEPTH = 2
 };
 
+/*
+ * GPU-native compressed formats, all in 4x4 texel blocks. ETC2_RGB is a
+ * superset of ETC1 and can be used for both.
+ */
+enum agp_txcomp {
+	TXCOMP_NONE = 0,
+	TXCOMP_ETC1,
+	TXCOMP_ETC2_RGB,
+	TXCOMP_ETC2_RGBA,
+	TXCOMP_BC1,
+	TXCOMP_BC3,
+	TXCOMP_BC7
+};
+
+/* size in bytes of one [w]x[h] level in format [fmt] */
+static inline size_t agp_txcomp_size(enum agp_txcomp fmt, size_t w, size_t h)
+{
+	size_t bsz = (fmt == TXCOMP_ETC1 || fmt == TXCOMP_ETC2_RGB ||
+		fmt == TXCOMP_BC1) ? 8 : 16;
+	return ((w + 3) / 4) * ((h + 3) / 4) * bsz;
+}
+
 enum storage_source {
 	STORAGE_IMAGE_URI,
 	STORAGE_TEXT,
@@ -145,13 +167,19 @@ struct storage_info_t {
 			unsigned glid;
 			uint64_t glformat;
 
-/* used for PBO transfers */
+/* used for PBO transfers, [upload] and [readback] are optional AGP-
+ * specific multi-buffered alternatives to [wid] and [rid] */
 			unsigned rid, wid;
+			struct agp_pbo_ring* upload, (* readback);
 
 /* intermediate storage for reconstructing lost context */
 			uint32_t s_raw;
 			av_pixel*  raw;
 
+/* if set, [raw] holds [levels] pre-compressed mip levels back to back and is
+ * dropped after upload, the contents are rebuilt from [source] instead */
+			uint8_t txcomp, levels;
+
 /* may need to propagate vpts state */
 			uint64_t vpts;
 
@@ -491,10 +519,10 @@ const char* agp_shader_language();
 
 /*
  * Identification string for the underlying graphics API as such, typical ones
- * would be 'GLES3' and 'OPENGL21'. For pixman revisions, we'll likely add
- * special 'common effects that can efficiently be implemented in software' for
- * low-power optimizations, either as part of the ident or as part of the
- * shader language.
+ * would be 'GLES3', 'OPENGL21' and 'SOFT'. For the software rasterizer, we'll
+ * likely add special 'common effects that can efficiently be implemented in
+ * software' for low-power optimizations, either as part of the ident or as
+ * part of the shader language.
  */
 const char* agp_backend_ident();
 
@@ -625,6 +653,13 @@ void agp_stream_release(struct storage_info_t*, struct stream_meta);
  */
 void agp_update_vstore(struct storage_info_t*, bool copy);
 
+/*
+ * Check if the implementation can upload a store with [txcomp] set to [fmt]
+ * natively. Callers are expected to fall back to decoding the original
+ * source otherwise.
+ */
+bool agp_txcomp_supported(enum agp_txcomp fmt);
+
 enum pipeline_mode {
 	PIPELINE_2D,
 	PIPELINE_3D
@@ -649,22 +684,33 @@ struct asynch_readback_meta {
 	size_t h;
 	size_t stride;
 
+/* arcan_timemillis() at the time of the request */
+	unsigned long long ts;
+
 	void (*release)(void* tag);
 	void* tag;
 };
 
 /*
- * Check if a pending readback request has been completed.
+ * Check if the oldest pending readback request has been completed.
  * In that case, [meta.ptr] will be !NULL and the caller is expected to:
  * meta.release(meta.tag); when finished using the contents of [meta.ptr]
+ * Readbacks are returned in the order they were requested, one per call.
  */
 struct asynch_readback_meta agp_poll_readback(struct storage_info_t*);
 
 /*
- * Initiate a new asynchronous readback.
- * if one is already pending, this is a no-operation.
+ * Initiate a new asynchronous readback. Implementations may queue a
+ * limited number of readbacks, if that limit has been reached the request
+ * is ignored and false is returned.
+ */
+bool agp_request_readback(struct storage_info_t*);
+
+/*
+ * Number of requested readbacks that have not yet been returned through
+ * agp_poll_readback.
  */
-void agp_request_readback(struct storage_info_t*);
+size_t agp_readback_pending(struct storage_info_t*);
 
 /*
  * For clipping and similar operations where we want to
@@ -874,6 +920,14 @@ agp_shader_id agp_shader_addgroup(agp_shader_id shid);
  */
 int agp_shader_envv(enum agp_shader_envts slot, void* value, size_t size);
 
+/*
+ * Retrieve the number of uniform uploads that have been issued to the
+ * graphics layer and the number that were skipped because the program
+ * already held the same value, optionally resetting both counters.
+ * Intended for benchmarking.
+ */
+void agp_shader_counters(size_t* issued, size_t* skipped, bool reset);
+
 /*
  * Get a string representation for the specific environment slot, this is
  * primarily for debugging / tracing purposes.
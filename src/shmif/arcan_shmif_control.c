@@ -33,6 +33,7 @@
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <poll.h>
 
 /*
  * a bit clunky, but some scenarios that we want debug-builds but without the
@@ -95,10 +96,12 @@ static const char* tgt_cmd_xlt[] = {
 	"MESSAGE",
 	"FONTHINT",
 	"GEOHINT",
+	"OUTPUTHINT",
 	"VECTOR_LINEWIDTH",
 	"VECTOR_POINTSIZE",
 	"NTSCFILTER",
-	"NTSCFILTER_ARGS"
+	"NTSCFILTER_ARGS",
+	"MULTICAST"
 };
 
 static const char* ext_cmd_xlt[] = {
@@ -247,6 +250,16 @@ struct shmif_hidden {
 		char key[256];
 	} pseg;
 
+/* read-only mapping of the multicast pool (if subscribed), and the one it
+ * replaced, kept until the next announce as the caller (or a thread of its)
+ * may still be reading from a frame in it */
+	struct {
+		uint8_t* base;
+		size_t sz, slot_sz, n_slots;
+		uint8_t* old_base;
+		size_t old_sz;
+	} mcast;
+
 /* guard thread checks DMS and a parent PID, then tries to pull synch
  * handles and/or run an @exit function */
 	struct {
@@ -268,6 +281,99 @@ static struct {
 	struct arcan_shmif_cont* input, (* output);
 } primary;
 
+/*
+ * Client side of synchronization tracing, enabled with ARCAN_SHMIF_TRACE=pfx
+ * and written as pfx.pid.json when a segment is dropped. The format and clock
+ * (CLOCK_MONOTONIC) match the engine side (engine/arcan_trace.c), so the two
+ * can be merged by concatenating their traceEvents.
+ */
+#define SHMIF_TRACE_RING 16384
+
+struct trace_entry {
+	const char* zone;
+	unsigned tid;
+	uint64_t start, end;
+};
+
+static struct {
+	char* prefix;
+	_Atomic uint64_t head;
+	_Atomic unsigned tids;
+	struct trace_entry* ents;
+} shmif_trace;
+
+static __thread unsigned trace_tid;
+
+static uint64_t trace_now()
+{
+	if (!shmif_trace.ents)
+		return 0;
+
+	struct timespec tp;
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (uint64_t) tp.tv_sec * 1000000000ull + tp.tv_nsec;
+}
+
+static void trace_zone(const char* zone, uint64_t start)
+{
+	if (!start)
+		return;
+
+	if (!trace_tid)
+		trace_tid = atomic_fetch_add(&shmif_trace.tids, 1) + 1;
+
+	uint64_t ind = atomic_fetch_add(&shmif_trace.head, 1);
+	shmif_trace.ents[ind % SHMIF_TRACE_RING] = (struct trace_entry){
+		.zone = zone, .tid = trace_tid, .start = start, .end = trace_now()
+	};
+}
+
+static void trace_setup()
+{
+	const char* pfx = getenv("ARCAN_SHMIF_TRACE");
+	if (!pfx || shmif_trace.prefix)
+		return;
+
+	shmif_trace.ents = calloc(SHMIF_TRACE_RING, sizeof(struct trace_entry));
+	if (shmif_trace.ents)
+		shmif_trace.prefix = strdup(pfx);
+}
+
+static void trace_write()
+{
+	if (!shmif_trace.prefix)
+		return;
+
+	char fn[strlen(shmif_trace.prefix) + sizeof(".4294967295.json")];
+	snprintf(fn, sizeof(fn), "%s.%d.json", shmif_trace.prefix, (int) getpid());
+	FILE* fout = fopen(fn, "w");
+	if (!fout){
+		LOG("(arcan_shmif) couldn't write trace to (%s)\n", fn);
+		return;
+	}
+
+	int pid = getpid();
+	fprintf(fout, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+		"\"args\":{\"name\":\"shmif\"}}", pid);
+
+	uint64_t head = atomic_load(&shmif_trace.head);
+	for (uint64_t i = head > SHMIF_TRACE_RING ?
+		head - SHMIF_TRACE_RING : 0; i < head; i++){
+		struct trace_entry* ent = &shmif_trace.ents[i % SHMIF_TRACE_RING];
+		if (!ent->zone || ent->end < ent->start)
+			continue;
+
+		fprintf(fout, ",\n{\"name\":\"%s\",\"cat\":\"shmif\",\"ph\":\"X\","
+			"\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+			ent->zone, (double) ent->start / 1000.0,
+			(double)(ent->end - ent->start) / 1000.0, pid, ent->tid);
+	}
+
+	fprintf(fout, "\n]}\n");
+	fclose(fout);
+}
+
 static void* guard_thread(void* gstruct);
 
 static inline bool parent_alive(struct shmif_hidden* gs)
@@ -666,6 +772,7 @@ checkfd:
 			case TARGET_COMMAND_BCHUNK_IN:
 			case TARGET_COMMAND_BCHUNK_OUT:
 			case TARGET_COMMAND_NEWSEGMENT:
+			case TARGET_COMMAND_MULTICAST:
 				LOG("(shmif) got descriptor transfer related event\n");
 				priv->pev.gotev = true;
 				goto checkfd;
@@ -701,7 +808,10 @@ int arcan_shmif_poll(struct arcan_shmif_cont* c, struct arcan_event* dst)
 
 int arcan_shmif_wait(struct arcan_shmif_cont* c, struct arcan_event* dst)
 {
-	return process_events(c, dst, true, false) > 0;
+	uint64_t ts = trace_now();
+	int rv = process_events(c, dst, true, false) > 0;
+	trace_zone("wait", ts);
+	return rv;
 }
 
 int arcan_shmif_enqueue(struct arcan_shmif_cont* c,
@@ -777,14 +887,43 @@ int arcan_shmif_tryenqueue(
 	return arcan_shmif_enqueue(c, src);
 }
 
-static void map_shared(const char* shmkey, char force_unlink,
+#ifdef __linux__
+/* semaphores are futex words in the page, re-point whenever the page moves */
+static void map_futex(struct arcan_shmif_cont* dst)
+{
+	dst->vsem = &dst->addr->futex[0];
+	dst->asem = &dst->addr->futex[1];
+	dst->esem = &dst->addr->futex[2];
+}
+#endif
+
+/*
+ * Anonymous segments (memfd) have no name to open, the descriptor is sent on
+ * the socket that delivered the key.
+ */
+static bool memfd_key(const char* shmkey)
+{
+	return strncmp(shmkey, ARCAN_SHMIF_MEMFD_PREFIX,
+		sizeof(ARCAN_SHMIF_MEMFD_PREFIX) - 1) == 0;
+}
+
+static void map_shared(const char* shmkey, int sock, char force_unlink,
 	struct arcan_shmif_cont* dst)
 {
 	assert(shmkey);
 	assert(strlen(shmkey) > 0);
 
 	int fd = -1;
-	fd = shm_open(shmkey, O_RDWR, 0700);
+	if (memfd_key(shmkey)){
+/* the socket may well be non-blocking and the descriptor still in flight */
+		struct pollfd pfd = {.fd = sock, .events = POLLIN};
+		while (-1 == poll(&pfd, 1, 5000) && errno == EINTR)
+			;
+		fd = arcan_fetchhandle(sock, true);
+		force_unlink = false;
+	}
+	else
+		fd = shm_open(shmkey, O_RDWR, 0700);
 
 	if (-1 == fd){
 		LOG("arcan_frameserver(getshm) -- couldn't open "
@@ -821,6 +960,9 @@ map_fail:
 		" \n", (uintptr_t) dst->addr);
 
 /* step 2, semaphore handles */
+#ifdef __linux__
+	map_futex(dst);
+#else
 	size_t slen = strlen(shmkey) + 1;
 	if (slen > 1){
 		char work[slen];
@@ -849,6 +991,7 @@ map_fail:
 		dst->addr = NULL;
 		return;
 	}
+#endif
 }
 
 /* the rules for resolving the connection socket namespace are somewhat
@@ -1009,11 +1152,9 @@ static void setup_avbuf(struct arcan_shmif_cont* res)
 /* using a base address where the meta structure will reside, allocate n- audio
  * and n- video slots and populate vbuf/abuf with matching / aligned pointers
  * and return the total size */
-struct arcan_shmif_cont arcan_shmif_acquire(
-	struct arcan_shmif_cont* parent,
-	const char* shmkey,
-	enum ARCAN_SEGID type,
-	enum ARCAN_FLAGS flags, ...)
+static struct arcan_shmif_cont shmif_acquire_int(
+	struct arcan_shmif_cont* parent, const char* shmkey, int sock,
+	enum ARCAN_SEGID type, enum ARCAN_FLAGS flags, void (*exitf)(int))
 {
 	struct arcan_shmif_cont res = {
 		.vidp = NULL
@@ -1028,7 +1169,7 @@ struct arcan_shmif_cont arcan_shmif_acquire(
  * from a _connect (via _open) call */
 	if (!shmkey){
 		struct shmif_hidden* gs = parent->priv;
-		map_shared(gs->pseg.key, !(flags & SHMIF_DONT_UNLINK), &res);
+		map_shared(gs->pseg.key, sock, !(flags & SHMIF_DONT_UNLINK), &res);
 		if (!res.addr){
 			close(gs->pseg.epipe);
 			gs->pseg.epipe = BADFD;
@@ -1036,7 +1177,7 @@ struct arcan_shmif_cont arcan_shmif_acquire(
 		privps = true; /* can't set d/e fields yet */
 	}
 	else
-		map_shared(shmkey, !(flags & SHMIF_DONT_UNLINK), &res);
+		map_shared(shmkey, sock, !(flags & SHMIF_DONT_UNLINK), &res);
 
 	if (!res.addr){
 		LOG("(arcan_shmif) Couldn't acquire connection through (%s)\n", shmkey);
@@ -1047,14 +1188,7 @@ struct arcan_shmif_cont arcan_shmif_acquire(
 			return res;
 	}
 
-	void (*exitf)(int) = shmif_exit;
-	if (flags & SHMIF_FATALFAIL_FUNC){
-		va_list funarg;
-
-		va_start(funarg, flags);
-			exitf = va_arg(funarg, void(*)(int));
-		va_end(funarg);
-	}
+	trace_setup();
 
 	struct shmif_hidden gs = {
 		.guard = {
@@ -1126,6 +1260,29 @@ struct arcan_shmif_cont arcan_shmif_acquire(
 	return res;
 }
 
+struct arcan_shmif_cont arcan_shmif_acquire(
+	struct arcan_shmif_cont* parent,
+	const char* shmkey,
+	enum ARCAN_SEGID type,
+	enum ARCAN_FLAGS flags, ...)
+{
+	void (*exitf)(int) = shmif_exit;
+	if (flags & SHMIF_FATALFAIL_FUNC){
+		va_list funarg;
+
+		va_start(funarg, flags);
+			exitf = va_arg(funarg, void(*)(int));
+		va_end(funarg);
+	}
+
+/* segments from a NEWSEGMENT event come with their own descriptor channel */
+	int sock = BADFD;
+	if (parent && parent->priv)
+		sock = parent->priv->pseg.epipe;
+
+	return shmif_acquire_int(parent, shmkey, sock, type, flags, exitf);
+}
+
 /* this act as our safeword (or well safebyte), if either party
  * for _any_reason decides that it is not worth going - the dms
  * (dead man's switch) is pulled. */
@@ -1161,6 +1318,105 @@ done:
 	return NULL;
 }
 
+shmif_pixel* arcan_shmif_multicast(
+	struct arcan_shmif_cont* c, struct arcan_event* ev)
+{
+	if (!c || !c->priv || !ev || ev->category != EVENT_TARGET)
+		return NULL;
+
+	struct shmif_hidden* priv = c->priv;
+
+	if (ev->tgt.kind == TARGET_COMMAND_MULTICAST){
+		int fd = ev->tgt.ioevs[0].iv;
+		size_t n_slots = ev->tgt.ioevs[1].iv;
+		size_t slot_sz = ev->tgt.ioevs[2].iv;
+		size_t w = ev->tgt.ioevs[3].iv;
+		size_t h = ev->tgt.ioevs[4].iv;
+
+/* frames already handed out live in the current mapping, retire it rather
+ * than unmapping so they stay readable until the announce after this one */
+		if (priv->mcast.old_base)
+			munmap(priv->mcast.old_base, priv->mcast.old_sz);
+		priv->mcast.old_base = priv->mcast.base;
+		priv->mcast.old_sz = priv->mcast.sz;
+		priv->mcast.base = NULL;
+		priv->mcast.sz = priv->mcast.slot_sz = priv->mcast.n_slots = 0;
+
+		if (BADFD == fd || !n_slots || w > PP_SHMPAGE_MAXW ||
+			h > PP_SHMPAGE_MAXH || slot_sz < w * h * sizeof(shmif_pixel))
+			return NULL;
+
+		void* base = mmap(NULL, n_slots * slot_sz, PROT_READ, MAP_SHARED, fd, 0);
+		if (MAP_FAILED == base){
+			LOG("(shmif) couldn't map multicast pool: %s\n", strerror(errno));
+			return NULL;
+		}
+
+		priv->mcast.base = base;
+		priv->mcast.sz = n_slots * slot_sz;
+		priv->mcast.slot_sz = slot_sz;
+		priv->mcast.n_slots = n_slots;
+		return base;
+	}
+
+	if (ev->tgt.kind != TARGET_COMMAND_STEPFRAME)
+		return NULL;
+
+	int slot = ev->tgt.ioevs[2].iv;
+	if (0 == slot)
+		return c->vidp;
+
+	if (!priv->mcast.base || slot < 0 || slot > priv->mcast.n_slots)
+		return NULL;
+
+	return (shmif_pixel*)(priv->mcast.base + (slot - 1) * priv->mcast.slot_sz);
+}
+
+bool arcan_shmif_timing(
+	struct arcan_shmif_cont* c, struct arcan_shmif_timing* dst)
+{
+	if (!c || !c->addr || !dst)
+		return false;
+
+	struct arcan_shmif_page* page = c->addr;
+	uint64_t vsynch, present, vpts, presented;
+	uint32_t interval, seq;
+
+/* seqlock, the parent never holds it for more than a handful of stores */
+	do {
+		while ((seq = atomic_load_explicit(
+			&page->timing.seq, memory_order_acquire)) & 1){}
+
+		interval = page->timing.interval;
+		vsynch = page->timing.vsynch;
+		present = page->timing.present;
+		vpts = page->timing.present_vpts;
+		presented = page->timing.presented;
+		atomic_thread_fence(memory_order_acquire);
+	} while (seq != atomic_load_explicit(&page->timing.seq, memory_order_relaxed));
+
+	if (!vsynch || !interval)
+		return false;
+
+/* extrapolate from the last synch, the engine may be busy elsewhere for a
+ * few frames without that affecting the display rate itself */
+	uint64_t now = arcan_timemicros();
+	uint64_t next = vsynch + interval;
+	if (now >= next)
+		next += ((now - next) / interval + 1) * interval;
+
+	*dst = (struct arcan_shmif_timing){
+		.deadline = next,
+		.present = next + interval,
+		.interval = interval,
+		.last_present = present,
+		.last_vpts = vpts,
+		.presented = presented
+	};
+
+	return true;
+}
+
 bool arcan_shmif_integrity_check(struct arcan_shmif_cont* cont)
 {
 	struct arcan_shmif_page* shmp = cont->addr;
@@ -1330,6 +1586,7 @@ unsigned arcan_shmif_signal(struct arcan_shmif_cont* ctx,
 		mask = priv->audio_hook(ctx);
 
 	if ( mask & SHMIF_SIGAUD ){
+		uint64_t ts = trace_now();
 		bool lock = step_a(ctx);
 
 /* guard-thread will pull the sems for us on dms */
@@ -1337,14 +1594,17 @@ unsigned arcan_shmif_signal(struct arcan_shmif_cont* ctx,
 			arcan_sem_wait(ctx->asem);
 		else
 			arcan_sem_trywait(ctx->asem);
+		trace_zone("signal_audio", ts);
 	}
 	if (mask & SHMIF_SIGVID){
+		uint64_t ts = trace_now();
 		bool lock = step_v(ctx);
 
 		if (lock && !(mask & SHMIF_SIGBLK_NONE))
 			arcan_sem_wait(ctx->vsem);
 		else
 			arcan_sem_trywait(ctx->vsem);
+		trace_zone("signal_video", ts);
 	}
 
 	return arcan_timemillis() - startt;
@@ -1359,13 +1619,17 @@ void arcan_shmif_drop(struct arcan_shmif_cont* inctx)
 		inctx->addr->dms = false;
 
 	struct shmif_hidden* gstr = inctx->priv;
+	trace_write();
 
 	close(inctx->epipe);
 	close(inctx->shmh);
 
+/* on linux, the semaphores go with the mapping */
+#ifndef __linux__
 	sem_close(inctx->asem);
 	sem_close(inctx->esem);
 	sem_close(inctx->vsem);
+#endif
 
 /* guard thread will clean up on its own */
 	free(inctx->priv->alt_conn);
@@ -1377,6 +1641,11 @@ void arcan_shmif_drop(struct arcan_shmif_cont* inctx)
 	if (inctx->privext->pending_fd != -1)
 		close(inctx->privext->pending_fd);
 
+	if (gstr->mcast.base)
+		munmap(gstr->mcast.base, gstr->mcast.sz);
+	if (gstr->mcast.old_base)
+		munmap(gstr->mcast.old_base, gstr->mcast.old_sz);
+
 	if (gstr->guard.active){
 		gstr->guard.active = false;
 	}
@@ -1474,16 +1743,31 @@ static bool shmif_resize(struct arcan_shmif_cont* arg,
 		struct shmif_hidden* gs = arg->priv;
 		pthread_mutex_lock(&gs->guard.synch);
 
+/* try to grow or shrink in place first, the segment itself only grows */
+#ifdef __linux__
+		void* newp = mremap(arg->addr, arg->shmsize, new_sz, 0);
+		if (MAP_FAILED == newp)
+			newp = mremap(arg->addr, arg->shmsize, new_sz, MREMAP_MAYMOVE);
+		arg->shmsize = new_sz;
+		arg->addr = MAP_FAILED == newp ? NULL : newp;
+#else
 		munmap(arg->addr, arg->shmsize);
 		arg->shmsize = new_sz;
 		arg->addr = mmap(NULL, arg->shmsize,
 			PROT_READ | PROT_WRITE, MAP_SHARED, arg->shmh, 0);
+#endif
 		if (!arg->addr){
 			DLOG("arcan_shmif_resize() failed on segment remapping.\n");
 			return false;
 		}
 
 		gs->guard.dms = &arg->addr->dms;
+#ifdef __linux__
+		map_futex(arg);
+		gs->guard.semset[0] = arg->asem;
+		gs->guard.semset[1] = arg->vsem;
+		gs->guard.semset[2] = arg->esem;
+#endif
 		pthread_mutex_unlock(&gs->guard.synch);
 	}
 
@@ -1688,8 +1972,8 @@ enum shmif_migrate_status arcan_shmif_migrate(
 
 /* re-use tracked "old" credentials" */
 	fcntl(dpipe, F_SETFD, FD_CLOEXEC);
-	struct arcan_shmif_cont ret =
-		arcan_shmif_acquire(NULL, keyfile, cont->priv->type, cont->priv->flags);
+	struct arcan_shmif_cont ret = shmif_acquire_int(NULL,
+		keyfile, dpipe, cont->priv->type, cont->priv->flags, shmif_exit);
 	ret.epipe = dpipe;
 
 	if (!ret.addr){
@@ -1746,6 +2030,12 @@ enum shmif_migrate_status arcan_shmif_migrate(
 		munmap(ret.addr, ret.shmsize);
 		ret.addr = alias;
 		ret.priv->guard.dms = &ret.addr->dms;
+#ifdef __linux__
+		map_futex(&ret);
+		ret.priv->guard.semset[0] = ret.asem;
+		ret.priv->guard.semset[1] = ret.vsem;
+		ret.priv->guard.semset[2] = ret.esem;
+#endif
 
 /* need to recalculate the buffer pointers */
 		arcan_shmif_mapav(ret.addr, ret.priv->vbuf, ret.priv->vbuf_cnt,
@@ -1805,7 +2095,7 @@ struct arcan_shmif_cont arcan_shmif_open(
 	}
 
 	fcntl(dpipe, F_SETFD, FD_CLOEXEC);
-	ret = arcan_shmif_acquire(NULL, keyfile, type, flags);
+	ret = shmif_acquire_int(NULL, keyfile, dpipe, type, flags, shmif_exit);
 	if (outarg){
 		if (resource)
 			*outarg = arg_unpack(resource);
@@ -64,6 +64,15 @@
 #endif
 #endif
 
+/*
+ * Segments that are not reachable through a name (memfd on linux) get a key
+ * with this prefix, the descriptor itself follows on the socket that the key
+ * was delivered over, see platform/posix/frameserver.c:findshmkey.
+ */
+#ifndef ARCAN_SHMIF_MEMFD_PREFIX
+#define ARCAN_SHMIF_MEMFD_PREFIX "memfd:"
+#endif
+
 /*
  * Default permissions / mask that listening sockets will be created under
  */
@@ -475,6 +484,40 @@ void arcan_shmif_setprimary( enum arcan_shmif_type, struct arcan_shmif_cont*);
 void arcan_shmif_resetfunc(struct arcan_shmif_cont*,
 	void (*resetf)(struct arcan_shmif_cont*));
 
+/*
+ * Presentation timing as seen by the parent. [deadline] is the predicted
+ * time by which a frame has to be signalled to be picked up at the next
+ * synch, and [present] when such a frame is expected to go on screen.
+ * [last_present] and [last_vpts] report the actual present time and vpts
+ * of the most recently presented frame, [presented] increments with each.
+ * Returns false (and leaves dst untouched) if the parent hasn't published
+ * any timing, e.g. for old servers or before the first synch.
+ */
+struct arcan_shmif_timing {
+	uint64_t deadline;
+	uint64_t present;
+	uint32_t interval;
+
+	uint64_t last_present;
+	uint64_t last_vpts;
+	uint64_t presented;
+};
+bool arcan_shmif_timing(struct arcan_shmif_cont*, struct arcan_shmif_timing*);
+
+/*
+ * Output segments that are subscribed to a multicast group get their frames
+ * in a pool that is shared read-only between all subscribers, rather than in
+ * vidp. Call with the TARGET_COMMAND_MULTICAST event to (re-)map the pool,
+ * and with each STEPFRAME to get the buffer that the frame is in: vidp for
+ * ordinary frames, the slot in the pool for multicast ones or NULL if the
+ * slot is unknown. The frame is acknowledged by releasing vready as usual.
+ * On a re-announce, frames from the previous pool stay mapped until the
+ * announce after that, but callers that read frames from other threads
+ * should switch those over to vidp before passing the event on.
+ */
+shmif_pixel* arcan_shmif_multicast(
+	struct arcan_shmif_cont*, struct arcan_event*);
+
 /*
  * This should be called periodically to prevent more subtle bugs from
  * cascading and be caught at an earlier stage, it checks the shared memory
@@ -724,5 +767,31 @@ struct arcan_shmif_page {
  * Can also be updated in relation to a RESET event.
  */
 	process_handle parent;
+
+/*
+ * [PRIVATE]
+ * Signalling words for video, audio and event queue, used instead of the
+ * named semaphores on platforms where sem_handle is a futex (linux). The
+ * vsem, asem and esem members of the context point here.
+ */
+	_Atomic uint32_t futex[3];
+
+/*
+ * [ARCAN-SET, FSRV-CHECK]
+ * Presentation timing feedback, read through arcan_shmif_timing rather than
+ * directly. All timestamps are in the arcan_timemicros timebase. [seq] is odd
+ * while the block is being updated (seqlock), [vsynch] is the last display
+ * synch and [interval] the estimated time between two, [present] is when the
+ * last delivered frame (tagged [present_vpts]) went on screen and [presented]
+ * counts such frames.
+ */
+	struct {
+		_Atomic uint32_t seq;
+		volatile uint32_t interval;
+		volatile uint64_t vsynch;
+		volatile uint64_t present;
+		volatile uint64_t present_vpts;
+		volatile uint64_t presented;
+	} timing;
 };
 #endif
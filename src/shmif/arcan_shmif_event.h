@@ -214,6 +214,8 @@ enum ARCAN_TARGET_COMMAND {
  * a relative amount of frames to process or rollback
  * ioevs[0].iv represents the number of frames,
  * ioevs[1].iv can contain an ID (see CLOCKREQ)
+ * ioevs[2].iv for output segments, 0 if the frame is in vidp or slot + 1 in
+ *             the pool of the multicast group (see MULTICAST)
  */
 	TARGET_COMMAND_STEPFRAME,
 
@@ -484,6 +486,21 @@ enum ARCAN_TARGET_COMMAND {
 	TARGET_COMMAND_VECTOR_POINTSIZE,
 	TARGET_COMMAND_NTSCFILTER,
 	TARGET_COMMAND_NTSCFILTER_ARGS,
+
+/*
+ * [DESCRIPTOR_PASSING]
+ * The (output) segment has been subscribed to a multicast group, frames are
+ * shared read-only between all the subscribers through a pool of slots
+ * rather than copied into vidp. Map with arcan_shmif_multicast and resolve
+ * the frame of each STEPFRAME through the same function. Acknowledge frames
+ * by releasing vready as normal. Sent again whenever the pool changes.
+ * ioevs[0].iv = pool descriptor
+ * ioevs[1].iv = number of slots
+ * ioevs[2].iv = slot size (bytes)
+ * ioevs[3].iv = width
+ * ioevs[4].iv = height
+ */
+	TARGET_COMMAND_MULTICAST,
 	TARGET_COMMAND_LIMIT = INT_MAX
 };
 
@@ -759,6 +776,9 @@ enum ARCAN_EVENT_NET {
 	EVENT_NET_CUSTOMMSG,
 	EVENT_NET_INPUTEVENT,
 	EVENT_NET_STATEREQ,
+
+/* from frameserver, statistics for a completed state transfer */
+	EVENT_NET_TRANSFER,
 	EVENT_NET_ULIM = INT_MAX
 };
 
@@ -995,11 +1015,23 @@ typedef struct arcan_netevent{
 			char addr[45];
 		} host;
 
-/* match size of host as we'd pad otherwise */
-		char message[93];
+/* EVENT_NET_TRANSFER, raw is the size of the state, wire what was
+ * actually sent/received for it, cached the number of chunks that were
+ * referenced rather than sent. Sizes saturate at UINT32_MAX, 64-bit
+ * counters would grow the event past its 120b */
+		struct {
+			uint32_t raw, wire;
+			uint32_t chunks, cached;
+			uint32_t ms;
+			uint8_t incoming;
+		} xfer;
+
+/* 92 rather than 93 as the xfer counters make the union 4b aligned,
+ * together with connid this keeps the event at 120b */
+		char message[92];
 	};
 
-	uint8_t connid;
+	uint16_t connid;
 } arcan_netevent;
 
 typedef struct arcan_tgtevent {
@@ -41,7 +41,7 @@
  * during _integrity_check
  */
 #define ASHMIF_VERSION_MAJOR 0
-#define ASHMIF_VERSION_MINOR 7
+#define ASHMIF_VERSION_MINOR 9
 
 #ifndef LOG
 #define LOG(...) (fprintf(stderr, __VA_ARGS__))
@@ -61,9 +61,16 @@
 #include <semaphore.h>
 	typedef int file_handle;
 	typedef pid_t process_handle;
+#ifdef __linux__
+#include <stdint.h>
+#include <stdatomic.h>
+	typedef _Atomic uint32_t* sem_handle;
+#else
 	typedef sem_t* sem_handle;
+#endif
 
 long long int arcan_timemillis(void);
+long long int arcan_timemicros(void);
 int arcan_sem_post(sem_handle sem);
 file_handle arcan_fetchhandle(int insock, bool block);
 bool arcan_pushhandle(int fd, int channel);
@@ -0,0 +1,416 @@
+/*
+ * Copyright 2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ * Description: Packs an appl directory into a single archive (.fap) that the
+ * engine can use in place of the directory, see arcan_applpack.README. The
+ * format is described in platform/posix/archive.c which is also the reader.
+ */
+
+/* for nftw */
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <ftw.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "external/stb_image_write.h"
+
+#define FAP_MAGIC "ARCANFAP"
+#define FAP_VERSION 1
+#define FAP_HEADER_SZ 32
+#define FAP_ENTRY_SZ 32
+#define FAP_ALIGN 4096
+#define FAP_PACK 16
+
+/* compressed entries need to be copied out when they are used, so only
+ * bother if it saves a fair bit */
+#define COMPRESS_THRESHOLD 0.75
+
+struct entry {
+	char* name;
+	char* path;
+	uint8_t type;
+	uint8_t comp;
+	uint64_t ofs, size, raw;
+};
+
+static struct {
+	bool compress;
+	bool verbose;
+	size_t root_len;
+
+	struct entry* ents;
+	size_t count, limit;
+	bool fail;
+} opts;
+
+static void usage()
+{
+	printf("usage: arcan_applpack [-z] [-v] [-o out.fap] appl_dir\n"
+	"       arcan_applpack -l file.fap\n\n"
+	"Packs the contents of appl_dir into an archive that can be used\n"
+	"instead of the directory, by default written to appl_dir.fap\n\n"
+	"  -o file\twrite the archive to file\n"
+	"  -z     \tcompress entries where it saves at least 25%%\n"
+	"  -v     \tverbose, print each entry added\n"
+	"  -l file\tlist the contents of an existing archive\n"
+	);
+}
+
+static void put16(uint8_t* buf, uint16_t v)
+{
+	buf[0] = v & 0xff;
+	buf[1] = v >> 8;
+}
+
+static void put32(uint8_t* buf, uint32_t v)
+{
+	put16(buf, v & 0xffff);
+	put16(&buf[2], v >> 16);
+}
+
+static void put64(uint8_t* buf, uint64_t v)
+{
+	put32(buf, v & 0xffffffff);
+	put32(&buf[4], v >> 32);
+}
+
+static uint64_t get64(const uint8_t* buf)
+{
+	uint64_t res = 0;
+	for (size_t i = 0; i < 8; i++)
+		res |= (uint64_t)buf[i] << (i * 8);
+	return res;
+}
+
+static int process(const char* path,
+	const struct stat* sbuf, int type, struct FTW* ftw)
+{
+	if (ftw->level == 0)
+		return 0;
+
+	const char* name = &path[opts.root_len];
+	while (*name == '/')
+		name++;
+
+/* the engine can't use pre-transcoded textures from inside an archive */
+	if (strncmp(name, ".txcache", 8) == 0 || strstr(name, "/.txcache"))
+		return 0;
+
+	struct stat lbuf;
+	if (type == FTW_SL){
+		if (-1 == stat(path, &lbuf)){
+			fprintf(stderr, "%s: dangling link, skipped\n", name);
+			return 0;
+		}
+		sbuf = &lbuf;
+		if (S_ISDIR(sbuf->st_mode)){
+			fprintf(stderr, "%s: linked directory, skipped\n", name);
+			return 0;
+		}
+	}
+
+	uint8_t etype;
+	if (S_ISDIR(sbuf->st_mode))
+		etype = 2;
+	else if (S_ISREG(sbuf->st_mode))
+		etype = 1;
+	else
+		return 0;
+
+	if (strlen(name) > UINT16_MAX){
+		fprintf(stderr, "%s: name too long\n", name);
+		opts.fail = true;
+		return 1;
+	}
+
+	if (opts.count == opts.limit){
+		opts.limit = opts.limit ? opts.limit * 2 : 256;
+		opts.ents = realloc(opts.ents, sizeof(struct entry) * opts.limit);
+		if (!opts.ents){
+			fprintf(stderr, "out of memory\n");
+			opts.fail = true;
+			return 1;
+		}
+	}
+
+	opts.ents[opts.count++] = (struct entry){
+		.name = strdup(name),
+		.path = strdup(path),
+		.type = etype
+	};
+
+	return 0;
+}
+
+static int entcmp(const void* a, const void* b)
+{
+	return strcmp(((struct entry*)a)->name, ((struct entry*)b)->name);
+}
+
+static uint8_t* read_file(const char* path, size_t* sz)
+{
+	FILE* fpek = fopen(path, "r");
+	if (!fpek)
+		return NULL;
+
+	uint8_t* buf = NULL;
+	size_t cap = 0;
+	*sz = 0;
+
+	for(;;){
+		if (*sz == cap){
+			cap = cap ? cap * 2 : 65536;
+			uint8_t* nbuf = realloc(buf, cap);
+			if (!nbuf){
+				free(buf);
+				buf = NULL;
+				break;
+			}
+			buf = nbuf;
+		}
+
+		size_t nr = fread(&buf[*sz], 1, cap - *sz, fpek);
+		*sz += nr;
+		if (nr == 0){
+			if (ferror(fpek)){
+				free(buf);
+				buf = NULL;
+			}
+			break;
+		}
+	}
+
+	fclose(fpek);
+	return buf ? buf : (*sz == 0 ? malloc(1) : NULL);
+}
+
+static bool write_at(FILE* fout, uint64_t ofs, const void* buf, size_t sz)
+{
+	return fseeko(fout, ofs, SEEK_SET) == 0 && fwrite(buf, 1, sz, fout) == sz;
+}
+
+static bool write_entry(FILE* fout, struct entry* ent, uint64_t* pos)
+{
+	size_t sz;
+	uint8_t* data = read_file(ent->path, &sz);
+	if (!data){
+		fprintf(stderr, "%s: %s\n", ent->path, strerror(errno));
+		return false;
+	}
+
+	ent->raw = ent->size = sz;
+	uint8_t* out = data;
+
+	if (opts.compress && sz > 0 && sz <= INT_MAX){
+		int clen = 0;
+		uint8_t* cbuf = stbi_zlib_compress(data, sz, &clen, 8);
+		if (cbuf && clen > 0 && clen <= sz * COMPRESS_THRESHOLD){
+			out = cbuf;
+			ent->size = clen;
+			ent->comp = 1;
+		}
+		else
+			free(cbuf);
+	}
+
+/* pack small entries densely so that a page read serves several of them,
+ * larger ones start at a page so they don't straddle more pages than needed */
+	uint64_t align = ent->size >= FAP_ALIGN ? FAP_ALIGN : FAP_PACK;
+	ent->ofs = (*pos + align - 1) & ~(align - 1);
+
+	bool rv = write_at(fout, ent->ofs, out, ent->size);
+
+/* the reader guarantees a terminating zero after each entry */
+	*pos = ent->ofs + ent->size + 1;
+
+	if (opts.verbose)
+		printf("%s: %"PRIu64" bytes%s\n", ent->name, ent->raw,
+			ent->comp ? " (compressed)" : "");
+
+	if (out != data)
+		free(out);
+	free(data);
+
+	return rv;
+}
+
+static bool pack(const char* dir, const char* dst)
+{
+	opts.root_len = strlen(dir);
+	if (-1 == nftw(dir, process, 16, FTW_PHYS) || opts.fail){
+		fprintf(stderr, "couldn't scan %s\n", dir);
+		return false;
+	}
+
+	qsort(opts.ents, opts.count, sizeof(struct entry), entcmp);
+
+	size_t tmp_len = strlen(dst) + sizeof(".tmp");
+	char tmp[tmp_len];
+	snprintf(tmp, tmp_len, "%s.tmp", dst);
+
+	FILE* fout = fopen(tmp, "w+");
+	if (!fout){
+		fprintf(stderr, "couldn't create %s: %s\n", tmp, strerror(errno));
+		return false;
+	}
+
+	uint64_t pos = FAP_HEADER_SZ;
+	bool ok = true;
+	size_t n_files = 0, n_comp = 0;
+
+	for (size_t i = 0; i < opts.count && ok; i++){
+		if (opts.ents[i].type != 1)
+			continue;
+
+		ok = write_entry(fout, &opts.ents[i], &pos);
+		n_files++;
+		n_comp += opts.ents[i].comp;
+	}
+
+/* index, then the name table */
+	uint64_t index = (pos + 7) & ~(uint64_t)7;
+	uint64_t names = 0;
+
+	for (size_t i = 0; i < opts.count && ok; i++){
+		struct entry* ent = &opts.ents[i];
+		uint8_t buf[FAP_ENTRY_SZ];
+		size_t len = strlen(ent->name);
+
+		put64(buf, ent->ofs);
+		put64(&buf[8], ent->size);
+		put64(&buf[16], ent->raw);
+		put32(&buf[24], names);
+		put16(&buf[28], len);
+		buf[30] = ent->type;
+		buf[31] = ent->comp;
+
+		ok = write_at(fout, index + i * FAP_ENTRY_SZ, buf, FAP_ENTRY_SZ) &&
+			write_at(fout, index + opts.count * FAP_ENTRY_SZ + names, ent->name, len);
+		names += len;
+	}
+
+	if (names > UINT32_MAX){
+		fprintf(stderr, "name table too large\n");
+		ok = false;
+	}
+
+	uint8_t hdr[FAP_HEADER_SZ] = {0};
+	memcpy(hdr, FAP_MAGIC, 8);
+	put32(&hdr[8], FAP_VERSION);
+	put32(&hdr[12], opts.count);
+	put64(&hdr[16], index);
+	put32(&hdr[24], names);
+	ok = ok && write_at(fout, 0, hdr, FAP_HEADER_SZ);
+
+/* replace rather than overwrite, the engine might have the old one mapped */
+	if (0 != fclose(fout) || !ok || -1 == rename(tmp, dst)){
+		fprintf(stderr, "couldn't write %s\n", dst);
+		unlink(tmp);
+		return false;
+	}
+
+	printf("%s: %zu files (%zu compressed), %zu directories\n",
+		dst, n_files, n_comp, opts.count - n_files);
+	return true;
+}
+
+static bool list(const char* src)
+{
+	size_t sz;
+	uint8_t* buf = read_file(src, &sz);
+	if (!buf || sz < FAP_HEADER_SZ || memcmp(buf, FAP_MAGIC, 8) != 0){
+		fprintf(stderr, "%s: not an appl archive\n", src);
+		free(buf);
+		return false;
+	}
+
+	uint64_t count = buf[12] | buf[13] << 8 | buf[14] << 16 | (uint64_t)buf[15] << 24;
+	uint64_t index = get64(&buf[16]);
+
+	if (index > sz || count > (sz - index) / FAP_ENTRY_SZ){
+		fprintf(stderr, "%s: broken index\n", src);
+		free(buf);
+		return false;
+	}
+
+	uint8_t* ntbl = &buf[index + count * FAP_ENTRY_SZ];
+	size_t nlen = sz - index - count * FAP_ENTRY_SZ;
+
+	for (size_t i = 0; i < count; i++){
+		uint8_t* ent = &buf[index + i * FAP_ENTRY_SZ];
+		uint32_t name_ofs = ent[24] | ent[25] << 8 | ent[26] << 16 | (uint32_t)ent[27] << 24;
+		uint16_t name_len = ent[28] | ent[29] << 8;
+
+		if (name_ofs > nlen || name_len > nlen - name_ofs)
+			continue;
+
+		if (ent[30] == 2)
+			printf("%.*s/\n", (int) name_len, (char*) &ntbl[name_ofs]);
+		else
+			printf("%.*s\t%"PRIu64"\t%"PRIu64"%s\n", (int) name_len,
+				(char*) &ntbl[name_ofs], get64(&ent[16]), get64(&ent[8]),
+				ent[31] ? "\tzlib" : "");
+	}
+
+	free(buf);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const char* out = NULL;
+	const char* lst = NULL;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "zvo:l:h")) != -1){
+		switch (ch){
+		case 'z': opts.compress = true; break;
+		case 'v': opts.verbose = true; break;
+		case 'o': out = optarg; break;
+		case 'l': lst = optarg; break;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (lst)
+		return list(lst) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if (optind != argc - 1){
+		usage();
+		return EXIT_FAILURE;
+	}
+
+/* strip trailing separators so that appl/ -> appl.fap */
+	char* dir = strdup(argv[optind]);
+	size_t len = strlen(dir);
+	while (len > 1 && dir[len-1] == '/')
+		dir[--len] = '\0';
+
+	char* dst = NULL;
+	if (!out){
+		dst = malloc(len + sizeof(".fap"));
+		snprintf(dst, len + sizeof(".fap"), "%s.fap", dir);
+		out = dst;
+	}
+
+	bool rv = pack(dir, out);
+	free(dst);
+	free(dir);
+
+	return rv ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,593 @@
+/*
+ * Copyright 2016, Björn Ståhl
+ * License: 3-Clause BSD, see COPYING file in arcan source repository.
+ * Reference: http://arcan-fe.com
+ * Description: Offline transcoder from PNG/JPG appl resources to GPU-native
+ * compressed textures. Outputs are KTX (v1) files in a .txcache directory
+ * next to each source, which is where arcan_vint_getimage looks first. The
+ * encoders are simple and fast (bounding box endpoints, individual ETC mode),
+ * good enough for backgrounds and theme images rather than archival quality.
+ */
+
+/* for nftw */
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <errno.h>
+#include <ftw.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#define STBI_NO_FAILURE_STRINGS
+#define STB_IMAGE_IMPLEMENTATION
+#include "external/stb_image.h"
+
+enum txfmt {
+	FMT_AUTO = 0,
+	FMT_BC1,
+	FMT_BC3,
+	FMT_ETC2,
+	FMT_ETC2A
+};
+
+static const struct {
+	const char* name;
+	uint32_t glfmt, glbase;
+	size_t blocksz;
+} formats[] = {
+	[FMT_BC1] = {"bc1", 0x83f0, 0x1907, 8},
+	[FMT_BC3] = {"bc3", 0x83f3, 0x1908, 16},
+	[FMT_ETC2] = {"etc2", 0x9274, 0x1907, 8},
+	[FMT_ETC2A] = {"etc2a", 0x9278, 0x1908, 16}
+};
+
+static struct {
+	enum txfmt fmt;
+	bool etc;
+	bool mipmap;
+	bool force;
+	bool verbose;
+	size_t count, fail;
+} opts;
+
+static void usage()
+{
+	printf("usage: arcan_txconv [-f fmt] [-m] [-F] [-v] path1 path2 ...\n\n"
+	"Transcodes .png/.jpg files (recursively for directories) into\n"
+	"path/.txcache/name.ext.ktx, skipping up-to-date outputs.\n\n"
+	"  -f fmt\tbc (default, bc1 if opaque, else bc3), etc (etc2 / etc2a),\n"
+	"        \tor one of bc1, bc3, etc2, etc2a to force a specific format\n"
+	"  -m    \tstore a full mipmap chain\n"
+	"  -F    \tregenerate even if the output is newer than the source\n"
+	"  -v    \tverbose, print each file processed\n"
+	);
+}
+
+static inline int clamp8(int v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static inline int dist3(const int* a, const uint8_t* b)
+{
+	int dr = a[0] - b[0], dg = a[1] - b[1], db = a[2] - b[2];
+	return dr * dr + dg * dg + db * db;
+}
+
+/*
+ * BC1/BC3 (S3TC)
+ */
+static uint16_t pack565(const int* c)
+{
+	return ((c[0] * 31 + 127) / 255) << 11 |
+		((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255);
+}
+
+static void unpack565(uint16_t v, int* c)
+{
+	int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+static void enc_bc1(const uint8_t px[16][4], uint8_t* out)
+{
+	int mn[3] = {255, 255, 255}, mx[3] = {0, 0, 0}, mean[3] = {0, 0, 0};
+	for (size_t i = 0; i < 16; i++)
+		for (size_t c = 0; c < 3; c++){
+			mn[c] = px[i][c] < mn[c] ? px[i][c] : mn[c];
+			mx[c] = px[i][c] > mx[c] ? px[i][c] : mx[c];
+			mean[c] += px[i][c];
+		}
+
+/* pick the bounding box diagonal that follows the color spread */
+	int cov_rg = 0, cov_bg = 0;
+	for (size_t i = 0; i < 16; i++){
+		int g = px[i][1] * 16 - mean[1];
+		cov_rg += (px[i][0] * 16 - mean[0]) * g;
+		cov_bg += (px[i][2] * 16 - mean[2]) * g;
+	}
+
+	int e0[3], e1[3];
+	for (size_t c = 0; c < 3; c++){
+		int inset = (mx[c] - mn[c]) / 16;
+		e0[c] = mx[c] - inset;
+		e1[c] = mn[c] + inset;
+	}
+	if (cov_rg < 0){
+		int t = e0[0]; e0[0] = e1[0]; e1[0] = t;
+	}
+	if (cov_bg < 0){
+		int t = e0[2]; e0[2] = e1[2]; e1[2] = t;
+	}
+
+	uint16_t c0 = pack565(e0), c1 = pack565(e1);
+	if (c0 < c1){
+		uint16_t t = c0; c0 = c1; c1 = t;
+	}
+
+	uint32_t ind = 0;
+	if (c0 != c1){
+		int pal[4][3];
+		unpack565(c0, pal[0]);
+		unpack565(c1, pal[1]);
+		for (size_t c = 0; c < 3; c++){
+			pal[2][c] = (2 * pal[0][c] + pal[1][c]) / 3;
+			pal[3][c] = (pal[0][c] + 2 * pal[1][c]) / 3;
+		}
+
+		for (size_t i = 0; i < 16; i++){
+			int best = 0, besterr = INT_MAX;
+			for (size_t j = 0; j < 4; j++){
+				int err = dist3(pal[j], px[i]);
+				if (err < besterr){
+					besterr = err;
+					best = j;
+				}
+			}
+			ind |= (uint32_t) best << (i * 2);
+		}
+	}
+
+	out[0] = c0 & 0xff; out[1] = c0 >> 8;
+	out[2] = c1 & 0xff; out[3] = c1 >> 8;
+	for (size_t i = 0; i < 4; i++)
+		out[4 + i] = (ind >> (i * 8)) & 0xff;
+}
+
+static void enc_bc3_alpha(const uint8_t px[16][4], uint8_t* out)
+{
+	int a0 = 0, a1 = 255;
+	for (size_t i = 0; i < 16; i++){
+		a0 = px[i][3] > a0 ? px[i][3] : a0;
+		a1 = px[i][3] < a1 ? px[i][3] : a1;
+	}
+
+	uint64_t ind = 0;
+	if (a0 != a1){
+		int pal[8] = {a0, a1};
+		for (size_t j = 1; j < 7; j++)
+			pal[j + 1] = ((7 - j) * a0 + j * a1) / 7;
+
+		for (size_t i = 0; i < 16; i++){
+			int best = 0, besterr = INT_MAX;
+			for (size_t j = 0; j < 8; j++){
+				int err = abs(pal[j] - px[i][3]);
+				if (err < besterr){
+					besterr = err;
+					best = j;
+				}
+			}
+			ind |= (uint64_t) best << (i * 3);
+		}
+	}
+
+	out[0] = a0;
+	out[1] = a1;
+	for (size_t i = 0; i < 6; i++)
+		out[2 + i] = (ind >> (i * 8)) & 0xff;
+}
+
+/*
+ * ETC2 (individual mode, which is identical to ETC1) and EAC alpha
+ */
+static const int etc_mod[8][4] = {
+	{2, 8, -2, -8}, {5, 17, -5, -17}, {9, 29, -9, -29}, {13, 42, -13, -42},
+	{18, 60, -18, -60}, {24, 80, -24, -80}, {33, 106, -33, -106},
+	{47, 183, -47, -183}
+};
+
+static const int eac_mod[16][8] = {
+	{-3, -6, -9, -15, 2, 5, 8, 14}, {-3, -7, -10, -13, 2, 6, 9, 12},
+	{-2, -5, -8, -13, 1, 4, 7, 12}, {-2, -4, -6, -13, 1, 3, 5, 12},
+	{-3, -6, -8, -12, 2, 5, 7, 11}, {-3, -7, -9, -11, 2, 6, 8, 10},
+	{-4, -7, -8, -11, 3, 6, 7, 10}, {-3, -5, -8, -11, 2, 4, 7, 10},
+	{-2, -6, -8, -10, 1, 5, 7, 9}, {-2, -5, -8, -10, 1, 4, 7, 9},
+	{-2, -4, -8, -10, 1, 3, 7, 9}, {-2, -5, -7, -10, 1, 4, 6, 9},
+	{-3, -4, -7, -10, 2, 3, 6, 9}, {-1, -2, -3, -10, 0, 1, 2, 9},
+	{-4, -6, -8, -9, 3, 5, 7, 8}, {-3, -5, -7, -9, 2, 4, 6, 8}
+};
+
+/* pixels are indexed column-major (x * 4 + y) in ETC */
+static inline bool etc_insub(size_t x, size_t y, bool flip, int sub)
+{
+	return (flip ? y >= 2 : x >= 2) == (sub == 1);
+}
+
+static int etc_subblock(const uint8_t px[16][4],
+	bool flip, int sub, int* base, int* table, uint32_t* ind)
+{
+	int avg[3] = {0, 0, 0};
+	for (size_t x = 0; x < 4; x++)
+		for (size_t y = 0; y < 4; y++)
+			if (etc_insub(x, y, flip, sub))
+				for (size_t c = 0; c < 3; c++)
+					avg[c] += px[y * 4 + x][c];
+
+	int col[3];
+	for (size_t c = 0; c < 3; c++){
+		base[c] = (avg[c] / 8 * 15 + 127) / 255;
+		col[c] = (base[c] << 4) | base[c];
+	}
+
+	int besterr = INT_MAX;
+	for (size_t t = 0; t < 8; t++){
+		int err = 0;
+		uint32_t tind = 0;
+		for (size_t x = 0; x < 4; x++)
+			for (size_t y = 0; y < 4; y++){
+				if (!etc_insub(x, y, flip, sub))
+					continue;
+
+				int best = 0, bd = INT_MAX;
+				for (size_t m = 0; m < 4; m++){
+					int cand[3] = {
+						clamp8(col[0] + etc_mod[t][m]),
+						clamp8(col[1] + etc_mod[t][m]),
+						clamp8(col[2] + etc_mod[t][m])
+					};
+					int d = dist3(cand, px[y * 4 + x]);
+					if (d < bd){
+						bd = d;
+						best = m;
+					}
+				}
+				err += bd;
+				size_t bit = x * 4 + y;
+				tind |= ((uint32_t)(best >> 1) << (bit + 16)) |
+					((uint32_t)(best & 1) << bit);
+			}
+
+		if (err < besterr){
+			besterr = err;
+			*table = t;
+			*ind = tind;
+		}
+	}
+
+	return besterr;
+}
+
+static void enc_etc2(const uint8_t px[16][4], uint8_t* out)
+{
+	uint64_t best = 0;
+	int besterr = INT_MAX;
+
+	for (int flip = 0; flip < 2; flip++){
+		int b0[3], b1[3], t0, t1;
+		uint32_t i0, i1;
+		int err = etc_subblock(px, flip, 0, b0, &t0, &i0) +
+			etc_subblock(px, flip, 1, b1, &t1, &i1);
+		if (err >= besterr)
+			continue;
+
+		besterr = err;
+		best = (uint64_t) b0[0] << 60 | (uint64_t) b1[0] << 56 |
+			(uint64_t) b0[1] << 52 | (uint64_t) b1[1] << 48 |
+			(uint64_t) b0[2] << 44 | (uint64_t) b1[2] << 40 |
+			(uint64_t) t0 << 37 | (uint64_t) t1 << 34 |
+			(uint64_t) flip << 32 | (i0 | i1);
+	}
+
+	for (size_t i = 0; i < 8; i++)
+		out[i] = (best >> (56 - i * 8)) & 0xff;
+}
+
+static void enc_eac(const uint8_t px[16][4], uint8_t* out)
+{
+	int amin = 255, amax = 0;
+	for (size_t i = 0; i < 16; i++){
+		amin = px[i][3] < amin ? px[i][3] : amin;
+		amax = px[i][3] > amax ? px[i][3] : amax;
+	}
+
+	int base = (amin + amax + 1) / 2;
+	uint64_t best = 0;
+	int besterr = INT_MAX;
+
+	for (size_t t = 0; t < 16 && besterr; t++){
+		int range = eac_mod[t][7] - eac_mod[t][3];
+		int mult = (amax - amin + range / 2) / range;
+
+		for (int m = mult - 1; m <= mult + 1; m++){
+			if (m < 1 || m > 15)
+				continue;
+
+			int err = 0;
+			uint64_t ind = 0;
+			for (size_t x = 0; x < 4; x++)
+				for (size_t y = 0; y < 4; y++){
+					int a = px[y * 4 + x][3], bi = 0, bd = INT_MAX;
+					for (size_t j = 0; j < 8; j++){
+						int d = abs(clamp8(base + eac_mod[t][j] * m) - a);
+						if (d < bd){
+							bd = d;
+							bi = j;
+						}
+					}
+					err += bd * bd;
+					ind |= (uint64_t) bi << (45 - (x * 4 + y) * 3);
+				}
+
+			if (err < besterr){
+				besterr = err;
+				best = (uint64_t) base << 56 | (uint64_t) m << 52 |
+					(uint64_t) t << 48 | ind;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < 8; i++)
+		out[i] = (best >> (56 - i * 8)) & 0xff;
+}
+
+static size_t encode_level(const uint8_t* img,
+	size_t w, size_t h, enum txfmt fmt, uint8_t* out)
+{
+	uint8_t* dst = out;
+
+	for (size_t by = 0; by < h; by += 4)
+		for (size_t bx = 0; bx < w; bx += 4){
+			uint8_t px[16][4];
+
+/* replicate edges for partial blocks */
+			for (size_t y = 0; y < 4; y++)
+				for (size_t x = 0; x < 4; x++){
+					size_t sx = bx + x < w ? bx + x : w - 1;
+					size_t sy = by + y < h ? by + y : h - 1;
+					memcpy(px[y * 4 + x], &img[(sy * w + sx) * 4], 4);
+				}
+
+			switch (fmt){
+			case FMT_BC1:
+				enc_bc1(px, dst);
+			break;
+			case FMT_BC3:
+				enc_bc3_alpha(px, dst);
+				enc_bc1(px, dst + 8);
+			break;
+			case FMT_ETC2:
+				enc_etc2(px, dst);
+			break;
+			case FMT_ETC2A:
+				enc_eac(px, dst);
+				enc_etc2(px, dst + 8);
+			break;
+			default:
+			break;
+			}
+			dst += formats[fmt].blocksz;
+		}
+
+	return dst - out;
+}
+
+/* 2x2 box filter, odd edges are clamped */
+static uint8_t* downsample(const uint8_t* img, size_t w, size_t h,
+	size_t* nw, size_t* nh)
+{
+	*nw = w > 1 ? w >> 1 : 1;
+	*nh = h > 1 ? h >> 1 : 1;
+	uint8_t* res = malloc(*nw * *nh * 4);
+	if (!res)
+		return NULL;
+
+	for (size_t y = 0; y < *nh; y++)
+		for (size_t x = 0; x < *nw; x++){
+			size_t x0 = x * 2, y0 = y * 2;
+			size_t x1 = x0 + 1 < w ? x0 + 1 : x0, y1 = y0 + 1 < h ? y0 + 1 : y0;
+			for (size_t c = 0; c < 4; c++)
+				res[(y * *nw + x) * 4 + c] = (
+					img[(y0 * w + x0) * 4 + c] + img[(y0 * w + x1) * 4 + c] +
+					img[(y1 * w + x0) * 4 + c] + img[(y1 * w + x1) * 4 + c] + 2) / 4;
+		}
+
+	return res;
+}
+
+static bool write_u32(FILE* fout, uint32_t v)
+{
+	return fwrite(&v, sizeof(uint32_t), 1, fout) == 1;
+}
+
+static bool transcode(const char* src, const char* dst)
+{
+	int w, h, n;
+	uint8_t* img = stbi_load(src, &w, &h, &n, 4);
+	if (!img){
+		fprintf(stderr, "couldn't decode (%s)\n", src);
+		return false;
+	}
+
+	bool alpha = false;
+	for (size_t i = 0; i < (size_t) w * h && !alpha; i++)
+		alpha = img[i * 4 + 3] != 255;
+
+	enum txfmt fmt = opts.fmt;
+	if (fmt == FMT_AUTO)
+		fmt = opts.etc ? (alpha ? FMT_ETC2A : FMT_ETC2) : (alpha ? FMT_BC3 : FMT_BC1);
+
+	size_t levels = 1;
+	if (opts.mipmap)
+		for (size_t lw = w, lh = h; lw > 1 || lh > 1; levels++){
+			lw = lw > 1 ? lw >> 1 : 1;
+			lh = lh > 1 ? lh >> 1 : 1;
+		}
+
+	char tmp[PATH_MAX];
+	FILE* fout = NULL;
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", dst) < (int) sizeof(tmp))
+		fout = fopen(tmp, "w");
+	if (!fout){
+		fprintf(stderr, "couldn't open (%s) for writing\n", tmp);
+		stbi_image_free(img);
+		return false;
+	}
+
+	static const uint8_t ident[12] = {
+		0xab, 'K', 'T', 'X', ' ', '1', '1', 0xbb, '\r', '\n', 0x1a, '\n'
+	};
+	uint32_t hdr[13] = {
+		0x04030201, 0, 1, 0, formats[fmt].glfmt, formats[fmt].glbase,
+		w, h, 0, 0, 1, levels, 0
+	};
+	bool ok = fwrite(ident, sizeof(ident), 1, fout) == 1 &&
+		fwrite(hdr, sizeof(hdr), 1, fout) == 1;
+
+	size_t lw = w, lh = h;
+	uint8_t* level = img;
+	uint8_t* blocks = malloc(((lw + 3) / 4) * ((lh + 3) / 4) * 16);
+	ok = ok && blocks;
+
+	for (size_t i = 0; i < levels && ok; i++){
+		size_t sz = encode_level(level, lw, lh, fmt, blocks);
+		ok = write_u32(fout, sz) && fwrite(blocks, sz, 1, fout) == 1;
+
+		if (i + 1 < levels){
+			size_t nw, nh;
+			uint8_t* next = downsample(level, lw, lh, &nw, &nh);
+			if (level != img)
+				free(level);
+			level = next;
+			lw = nw;
+			lh = nh;
+			ok = ok && level;
+		}
+	}
+
+	if (level != img)
+		free(level);
+	free(blocks);
+	stbi_image_free(img);
+
+	ok = fclose(fout) == 0 && ok;
+	if (ok && rename(tmp, dst) == 0){
+		if (opts.verbose)
+			printf("%s -> %s (%s, %dx%d, %zu levels)\n",
+				src, dst, formats[fmt].name, w, h, levels);
+		return true;
+	}
+
+	fprintf(stderr, "couldn't write (%s)\n", dst);
+	unlink(tmp);
+	return false;
+}
+
+static bool is_image(const char* name)
+{
+	const char* ext = strrchr(name, '.');
+	return ext && (strcasecmp(ext, ".png") == 0 ||
+		strcasecmp(ext, ".jpg") == 0 || strcasecmp(ext, ".jpeg") == 0);
+}
+
+static int process(const char* path,
+	const struct stat* st, int flag, struct FTW* ftw)
+{
+	if (flag != FTW_F || !is_image(path) || strstr(path, "/.txcache/"))
+		return 0;
+
+	const char* base = strrchr(path, '/');
+	int dlen = base ? base - path + 1 : 0;
+	base = base ? base + 1 : path;
+
+	char dir[PATH_MAX], dst[PATH_MAX];
+	if (snprintf(dir, sizeof(dir), "%.*s.txcache", dlen, path) >=
+		(int) sizeof(dir) ||
+		snprintf(dst, sizeof(dst), "%s/%s.ktx", dir, base) >= (int) sizeof(dst)){
+		fprintf(stderr, "path too long (%s)\n", path);
+		opts.fail++;
+		return 0;
+	}
+
+	struct stat dst_st;
+	if (!opts.force && stat(dst, &dst_st) == 0 && dst_st.st_mtime >= st->st_mtime)
+		return 0;
+
+	if (mkdir(dir, 0755) == -1 && errno != EEXIST){
+		fprintf(stderr, "couldn't create (%s)\n", dir);
+		opts.fail++;
+		return 0;
+	}
+
+	if (transcode(path, dst))
+		opts.count++;
+	else
+		opts.fail++;
+
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	int ch;
+	while ((ch = getopt(argc, argv, "f:mFvh")) != -1){
+		switch (ch){
+		case 'f':
+			if (strcmp(optarg, "bc") == 0)
+				opts.fmt = FMT_AUTO;
+			else if (strcmp(optarg, "etc") == 0){
+				opts.fmt = FMT_AUTO;
+				opts.etc = true;
+			}
+			else {
+				opts.fmt = FMT_AUTO;
+				for (size_t i = FMT_BC1; i <= FMT_ETC2A; i++)
+					if (strcmp(optarg, formats[i].name) == 0)
+						opts.fmt = i;
+				if (opts.fmt == FMT_AUTO){
+					fprintf(stderr, "unknown format (%s)\n", optarg);
+					return EXIT_FAILURE;
+				}
+			}
+		break;
+		case 'm': opts.mipmap = true; break;
+		case 'F': opts.force = true; break;
+		case 'v': opts.verbose = true; break;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc){
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	for (int i = optind; i < argc; i++)
+		nftw(argv[i], process, 16, 0);
+
+	printf("%zu transcoded, %zu failed\n", opts.count, opts.fail);
+	return opts.fail ? EXIT_FAILURE : EXIT_SUCCESS;
+}
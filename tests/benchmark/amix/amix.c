@@ -0,0 +1,188 @@
+/*
+ * No copyright claimed, Public Domain
+ *
+ * Micro-benchmark for the frameserver audio mixer, compares the previous
+ * scalar convert/mix/memmove loop with the arcan_audio_mix.c core that
+ * replaced it. Output follows the other benchmarks,
+ * name:sources:ns_per_sample_ref:ns_per_sample_new:maxdiff
+ *
+ * Build with -DENABLE_SIMD=OFF to compare against the scalar fallbacks.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "arcan_audio_mix.h"
+
+#define N_SOURCES 16
+#define BUF_SAMPLES 1024
+#define ITERATIONS 2000
+#define OUT_SZ (N_SOURCES * BUF_SAMPLES * 2 * sizeof(int16_t))
+
+struct ref_src {
+	float inbuf[4096];
+	off_t inofs;
+	float l_gain, r_gain;
+};
+
+/* copy of the original feed_amixer loop, sans frameserver state and with
+ * the left/right gain order corrected so the outputs can be compared */
+static size_t ref_feed(struct ref_src* srcs, int n_srcs, int srcind,
+	int16_t* buf, int nsamples, uint8_t* audb, size_t* ofs_audb, size_t sz_audb)
+{
+	size_t minv = INT_MAX;
+
+	for (int i = 0; i < n_srcs; i++){
+		struct ref_src* cur = srcs + i;
+
+		if (i == srcind){
+			int ulim = sizeof(cur->inbuf) / sizeof(float);
+			int count = 0;
+			int ns = nsamples;
+			int16_t* wbuf = buf;
+
+			while (ns-- && cur->inofs < ulim){
+				float val = *wbuf++;
+				cur->inbuf[cur->inofs++] =
+					(count++ % 2 ? cur->r_gain : cur->l_gain) * (val / 32767.0f);
+			}
+		}
+
+		if (cur->inofs < minv)
+			minv = cur->inofs;
+	}
+
+	if (minv != INT_MAX && minv > 512 && sz_audb - *ofs_audb > 0){
+		if (*ofs_audb + minv * sizeof(uint16_t) > sz_audb)
+			minv = (sz_audb - *ofs_audb) / sizeof(uint16_t);
+
+		for (int sc = 0; sc < minv; sc++){
+			float work_sample = 0;
+
+			for (int i = 0; i < n_srcs; i++){
+				work_sample += srcs[i].inbuf[sc] - (work_sample * srcs[i].inbuf[sc]);
+			}
+
+			int16_t sample_conv = work_sample >= 1.0 ? 32767.0 :
+				(work_sample < -1.0 ? -32768 : work_sample * 32767);
+			memcpy(&audb[*ofs_audb], &sample_conv, sizeof(int16_t));
+			*ofs_audb += sizeof(int16_t);
+		}
+
+		for (int j = 0; j < n_srcs; j++){
+			struct ref_src* cur = srcs + j;
+			if (cur->inofs > minv){
+				memmove(cur->inbuf, &cur->inbuf[minv], (cur->inofs - minv) *
+					sizeof(float));
+				cur->inofs -= minv;
+			}
+			else
+				cur->inofs = 0;
+		}
+	}
+
+	return minv;
+}
+
+static void new_feed(struct arcan_amix_ring* rings, int n_srcs, int srcind,
+	int16_t* buf, int nsamples, uint8_t* audb, size_t* ofs_audb, size_t sz_audb)
+{
+	size_t minv = INT_MAX;
+
+	for (int i = 0; i < n_srcs; i++){
+		if (i == srcind)
+			arcan_amix_ring_push(&rings[i], buf, nsamples, 0.8, 0.6);
+
+		if (rings[i].count < minv)
+			minv = rings[i].count;
+	}
+
+	if (minv == INT_MAX || minv <= 512 || sz_audb <= *ofs_audb)
+		return;
+
+	if (*ofs_audb + minv * sizeof(int16_t) > sz_audb)
+		minv = (sz_audb - *ofs_audb) / sizeof(int16_t);
+	minv &= ~(size_t)1;
+
+	float work[512];
+	while (minv){
+		size_t nw = minv > 512 ? 512 : minv;
+		for (int i = 0; i < n_srcs; i++)
+			arcan_amix_ring_pop(&rings[i], work, nw, i == 0);
+		arcan_amix_ftos16(work, (int16_t*) &audb[*ofs_audb], nw);
+		*ofs_audb += nw * sizeof(int16_t);
+		minv -= nw;
+	}
+}
+
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(int argc, char** argv)
+{
+	int16_t* input[N_SOURCES];
+	srand(0xfeed);
+
+	for (size_t i = 0; i < N_SOURCES; i++){
+		input[i] = malloc(BUF_SAMPLES * sizeof(int16_t));
+		for (size_t j = 0; j < BUF_SAMPLES; j++)
+			input[i][j] = (rand() % 65536) - 32768;
+	}
+
+	struct ref_src* ref = calloc(N_SOURCES, sizeof(struct ref_src));
+	struct arcan_amix_ring* rings = calloc(N_SOURCES, sizeof(struct arcan_amix_ring));
+	uint8_t* out_ref = malloc(OUT_SZ);
+	uint8_t* out_new = malloc(OUT_SZ);
+
+	for (int nsrc = 1; nsrc <= N_SOURCES; nsrc *= 2){
+		unsigned long long ref_ns = 0, new_ns = 0;
+		size_t total = 0;
+		int maxdiff = 0;
+
+		for (size_t i = 0; i < nsrc; i++){
+			ref[i].inofs = 0;
+			ref[i].l_gain = 0.8;
+			ref[i].r_gain = 0.6;
+			rings[i].ofs = rings[i].count = 0;
+		}
+
+		for (size_t it = 0; it < ITERATIONS; it++){
+			size_t ofs_ref = 0, ofs_new = 0;
+
+			unsigned long long ts = now_ns();
+			for (int i = 0; i < nsrc; i++)
+				ref_feed(ref, nsrc, i, input[i], BUF_SAMPLES, out_ref, &ofs_ref, OUT_SZ);
+			ref_ns += now_ns() - ts;
+
+			ts = now_ns();
+			for (int i = 0; i < nsrc; i++)
+				new_feed(rings, nsrc, i, input[i], BUF_SAMPLES, out_new, &ofs_new, OUT_SZ);
+			new_ns += now_ns() - ts;
+
+			size_t ns = (ofs_ref < ofs_new ? ofs_ref : ofs_new) / sizeof(int16_t);
+			for (size_t j = 0; j < ns; j++){
+				int16_t a, b;
+				memcpy(&a, &out_ref[j * 2], 2);
+				memcpy(&b, &out_new[j * 2], 2);
+				if (abs(a - b) > maxdiff)
+					maxdiff = abs(a - b);
+			}
+			total += ofs_new / sizeof(int16_t);
+		}
+
+		printf("amix:%d:%.3f:%.3f:%d\n", nsrc,
+			(double) ref_ns / (total ? total : 1),
+			(double) new_ns / (total ? total : 1), maxdiff);
+	}
+
+	return EXIT_SUCCESS;
+}
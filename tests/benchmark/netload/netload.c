@@ -0,0 +1,294 @@
+/*
+ * No copyright claimed, Public Domain
+ *
+ * Loopback load test for the receive path of the net frameserver. A writer
+ * thread plays a number of simulated clients, each with its own TCP
+ * connection, and pushes bursts of TLV frames (tag, 16-bit LE length,
+ * value) to a window of them that slides over the whole set. The receiving
+ * side is either a copy of the previous approach (poll over every
+ * connection, recv into a linear buffer and memmove the remainder after
+ * each frame) or the net_io.c event loop with ring buffers. Output follows the other benchmarks,
+ * name:connections:frames:ms_ref:ms_new
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "net_io.h"
+
+#define HDR_SZ 3
+#define REF_BUF_SZ 65536
+#define TOTAL_FRAMES 400000
+#define BURST_FRAMES 16
+#define ACTIVE_CONNS 32
+
+static int conn_counts[] = {16, 256, 1024, 4096};
+
+struct run {
+	int n;
+	int* cl;
+	int* srv;
+	unsigned long long frames, bytes;
+};
+
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* mostly short messages with the occasional state block */
+static size_t frame_size(unsigned* seed)
+{
+	return (rand_r(seed) % 64) ? 16 + rand_r(seed) % 112 : 4096;
+}
+
+/*
+ * Most of the connections idle at any one time, a window of ACTIVE_CONNS
+ * talks and slides over the whole set, and each write carries a burst of
+ * frames for one connection like a client flushing its queue would.
+ */
+static void* writer(void* tag)
+{
+	struct run* run = tag;
+	unsigned seed = 0xfeedface;
+	static char burst[BURST_FRAMES * (HDR_SZ + 4096)];
+
+	for (size_t i = 0; i < TOTAL_FRAMES; i += BURST_FRAMES){
+		size_t len = 0;
+
+		for (size_t j = 0; j < BURST_FRAMES; j++){
+			size_t sz = frame_size(&seed);
+			burst[len + 0] = 0;
+			burst[len + 1] = (uint8_t) sz;
+			burst[len + 2] = (uint8_t) (sz >> 8);
+			memset(&burst[len + HDR_SZ], i + j, sz);
+			len += HDR_SZ + sz;
+		}
+
+		size_t base = (i / (BURST_FRAMES * 64)) * ACTIVE_CONNS;
+		int fd = run->cl[(base + rand_r(&seed) % ACTIVE_CONNS) % run->n];
+
+		size_t ofs = 0;
+		while (ofs < len){
+			ssize_t nw = write(fd, &burst[ofs], len - ofs);
+			if (-1 == nw){
+				if (errno == EINTR)
+					continue;
+				return NULL;
+			}
+			ofs += nw;
+		}
+	}
+
+	return NULL;
+}
+
+static bool setup(struct run* run, int n)
+{
+	run->n = n;
+	run->cl = malloc(sizeof(int) * n);
+	run->srv = malloc(sizeof(int) * n);
+
+	int lfd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+	};
+	socklen_t addr_sz = sizeof(addr);
+
+	if (-1 == lfd || bind(lfd, (struct sockaddr*) &addr, sizeof(addr)) ||
+		listen(lfd, SOMAXCONN) ||
+		getsockname(lfd, (struct sockaddr*) &addr, &addr_sz))
+		return false;
+
+	for (int i = 0; i < n; i++){
+		run->cl[i] = socket(AF_INET, SOCK_STREAM, 0);
+		if (-1 == run->cl[i] ||
+			connect(run->cl[i], (struct sockaddr*) &addr, sizeof(addr)))
+			return false;
+
+		run->srv[i] = accept(lfd, NULL, NULL);
+		if (-1 == run->srv[i])
+			return false;
+		net_socket_setup(run->srv[i], true);
+	}
+
+	close(lfd);
+	return true;
+}
+
+static void teardown(struct run* run)
+{
+	for (int i = 0; i < run->n; i++){
+		close(run->cl[i]);
+		close(run->srv[i]);
+	}
+	free(run->cl);
+	free(run->srv);
+}
+
+struct ref_conn {
+	char buf[REF_BUF_SZ + HDR_SZ];
+	size_t ofs;
+};
+
+static double run_ref(struct run* run)
+{
+	struct pollfd* fds = malloc(sizeof(struct pollfd) * run->n);
+	struct ref_conn* conns = malloc(sizeof(struct ref_conn) * run->n);
+	pthread_t pth;
+
+	for (int i = 0; i < run->n; i++){
+		fds[i] = (struct pollfd){.fd = run->srv[i], .events = POLLIN};
+		conns[i].ofs = 0;
+	}
+
+	unsigned long long start = now_ns();
+	pthread_create(&pth, NULL, writer, run);
+
+	while (run->frames < TOTAL_FRAMES){
+		if (poll(fds, run->n, -1) <= 0)
+			continue;
+
+		for (int i = 0; i < run->n; i++){
+			if (!(fds[i].revents & POLLIN))
+				continue;
+
+			struct ref_conn* c = &conns[i];
+			ssize_t nr = recv(fds[i].fd, &c->buf[c->ofs], sizeof(c->buf) - c->ofs, 0);
+			if (nr <= 0)
+				continue;
+			c->ofs += nr;
+
+			while (c->ofs >= HDR_SZ){
+				size_t block = (uint8_t)c->buf[1] | ((uint8_t)c->buf[2] << 8);
+				if (block + HDR_SZ > c->ofs)
+					break;
+
+				run->frames++;
+				run->bytes += (uint8_t) c->buf[HDR_SZ] + block;
+				memmove(c->buf, &c->buf[block + HDR_SZ], c->ofs - block - HDR_SZ);
+				c->ofs -= block + HDR_SZ;
+			}
+		}
+	}
+
+	pthread_join(pth, NULL);
+	free(fds);
+	free(conns);
+	return (double)(now_ns() - start) / 1000000.0;
+}
+
+static bool count_frame(void* tag, size_t len, char* buf, size_t* consumed)
+{
+	struct run* run = tag;
+	size_t block = (uint8_t)buf[1] | ((uint8_t)buf[2] << 8);
+	if (block + HDR_SZ > len)
+		return true;
+
+	*consumed = block + HDR_SZ;
+	run->frames++;
+	run->bytes += (uint8_t) buf[HDR_SZ] + block;
+	return true;
+}
+
+static double run_new(struct run* run)
+{
+	struct net_evloop* loop = net_evloop_create(run->n);
+	struct net_ring* rings = malloc(sizeof(struct net_ring) * run->n);
+	struct net_ev evs[256];
+	pthread_t pth;
+
+	for (int i = 0; i < run->n; i++){
+		net_ring_alloc(&rings[i], 8192);
+		net_evloop_add(loop, run->srv[i], NET_EV_IN, &rings[i]);
+	}
+
+	unsigned long long start = now_ns();
+	pthread_create(&pth, NULL, writer, run);
+
+	while (run->frames < TOTAL_FRAMES){
+		int nev = net_evloop_wait(loop, evs, 256, -1);
+
+		for (int i = 0; i < nev; i++){
+			struct net_ring* ring = evs[i].tag;
+			int fd = run->srv[ring - rings];
+
+			for (size_t j = 0; j < 8; j++){
+				bool again, starved;
+				if (0 == net_ring_recv(ring, fd, &again))
+					break;
+
+				net_ring_frames(ring, HDR_SZ, count_frame, run, &starved);
+				if (starved)
+					net_ring_grow(ring, 2 * 65536);
+				else if (again)
+					break;
+			}
+		}
+	}
+
+	pthread_join(pth, NULL);
+	for (int i = 0; i < run->n; i++)
+		net_ring_free(&rings[i]);
+	free(rings);
+	net_evloop_destroy(loop);
+	return (double)(now_ns() - start) / 1000000.0;
+}
+
+int main(int argc, char** argv)
+{
+	struct rlimit rl;
+	if (0 == getrlimit(RLIMIT_NOFILE, &rl)){
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+		getrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	for (size_t i = 0; i < sizeof(conn_counts) / sizeof(conn_counts[0]); i++){
+		int n = conn_counts[i];
+		if (rl.rlim_cur != RLIM_INFINITY && n * 2 + 16 > rl.rlim_cur){
+			fprintf(stderr, "skipping %d connections, descriptor limit\n", n);
+			continue;
+		}
+
+		struct run ref = {0}, new = {0};
+		if (!setup(&ref, n)){
+			fprintf(stderr, "couldn't setup %d connections\n", n);
+			return EXIT_FAILURE;
+		}
+		double ms_ref = run_ref(&ref);
+		teardown(&ref);
+
+		if (!setup(&new, n)){
+			fprintf(stderr, "couldn't setup %d connections\n", n);
+			return EXIT_FAILURE;
+		}
+		double ms_new = run_new(&new);
+		teardown(&new);
+
+		if (ref.frames != new.frames || ref.bytes != new.bytes){
+			fprintf(stderr, "mismatch at %d connections\n", n);
+			return EXIT_FAILURE;
+		}
+
+		printf("netload:%d:%d:%.3f:%.3f\n", n, TOTAL_FRAMES, ms_ref, ms_new);
+	}
+
+	return EXIT_SUCCESS;
+}
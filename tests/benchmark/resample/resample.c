@@ -0,0 +1,123 @@
+/*
+ * No copyright claimed, Public Domain
+ *
+ * Micro-benchmark for the speex resampler kernels in
+ * frameserver/util/resampler. For each available kernel set and quality
+ * level, stereo s16 input at a few typical source rates is converted to
+ * 48kHz, both through the old per-channel strided path and the interleaved
+ * stereo path. Output follows the other benchmarks,
+ *
+ * resample:kernel:in_rate:quality:ns_per_frame_perch:ns_per_frame_stereo:maxdiff
+ *
+ * maxdiff is the largest difference (in LSB) against the scalar kernels
+ * through the per-channel path, i.e. the original behavior.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "util/resampler/speex_resampler.h"
+
+#define OUT_RATE 48000
+#define IN_FRAMES 4096
+#define ITERATIONS 100
+
+static const unsigned rates[] = {32040, 44100, 96000};
+static const char* kernels[] = {"scalar", "sse2", "avx2", "neon"};
+
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* mimics the previous process_interleaved_int, one strided pass per channel */
+static void perch_int(SpeexResamplerState* st, const int16_t* in,
+	spx_uint32_t* in_len, int16_t* out, spx_uint32_t* out_len)
+{
+	spx_uint32_t bak = *out_len;
+	speex_resampler_set_input_stride(st, 2);
+	speex_resampler_set_output_stride(st, 2);
+
+	for (size_t i = 0; i < 2; i++){
+		*out_len = bak;
+		speex_resampler_process_int(st, i, in + i, in_len, out + i, out_len);
+	}
+
+	speex_resampler_set_input_stride(st, 1);
+	speex_resampler_set_output_stride(st, 1);
+}
+
+/* run ITERATIONS blocks through a fresh resampler, returns ns and the
+ * number of produced frames */
+static unsigned long long run(const char* kernel, bool stereo, unsigned rate,
+	int quality, const int16_t* in, int16_t* out, size_t* nout, bool* ok)
+{
+	setenv("RESAMPLER_KERNEL", kernel, 1);
+	SpeexResamplerState* st = speex_resampler_init(2, rate, OUT_RATE, quality, NULL);
+	*ok = strcmp(speex_resampler_get_kernel(st), kernel) == 0;
+
+	size_t ofs = 0;
+	unsigned long long ts = now_ns();
+	for (size_t i = 0; i < ITERATIONS; i++){
+		spx_uint32_t in_len = IN_FRAMES;
+		spx_uint32_t out_len = IN_FRAMES * 4;
+		if (stereo)
+			speex_resampler_process_interleaved_int(st,
+				&in[i * IN_FRAMES * 2], &in_len, &out[ofs * 2], &out_len);
+		else
+			perch_int(st, &in[i * IN_FRAMES * 2], &in_len, &out[ofs * 2], &out_len);
+		ofs += out_len;
+	}
+	ts = now_ns() - ts;
+
+	speex_resampler_destroy(st);
+	*nout = ofs;
+	return ts;
+}
+
+int main(int argc, char** argv)
+{
+	size_t in_sz = ITERATIONS * IN_FRAMES * 2;
+	size_t out_sz = in_sz * 4;
+	int16_t* in = malloc(in_sz * sizeof(int16_t));
+	int16_t* ref = malloc(out_sz * sizeof(int16_t));
+	int16_t* out = malloc(out_sz * sizeof(int16_t));
+
+/* two tones and some noise, different per channel */
+	srand(0xfeed);
+	for (size_t i = 0; i < in_sz / 2; i++){
+		in[i*2+0] = 12000.0 * sin(i * 0.031) + (rand() % 2048) - 1024;
+		in[i*2+1] = 9000.0 * sin(i * 0.17) + (rand() % 2048) - 1024;
+	}
+
+	for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+		for (int q = 0; q <= 10; q++){
+			size_t nref, n1, n2;
+			bool ok;
+			run("scalar", false, rates[r], q, in, ref, &nref, &ok);
+
+			for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++){
+				unsigned long long t1 = run(kernels[k], false, rates[r], q, in, out, &n1, &ok);
+				if (!ok)
+					continue;
+
+				unsigned long long t2 = run(kernels[k], true, rates[r], q, in, out, &n2, &ok);
+				int maxdiff = n2 == nref ? 0 : 65536;
+				for (size_t i = 0; i < n2 * 2 && i < nref * 2; i++)
+					if (abs(out[i] - ref[i]) > maxdiff)
+						maxdiff = abs(out[i] - ref[i]);
+
+				printf("resample:%s:%u:%d:%.3f:%.3f:%d\n", kernels[k], rates[r], q,
+					(double) t1 / (n1 ? n1 : 1), (double) t2 / (n2 ? n2 : 1), maxdiff);
+			}
+		}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+/*
+ * No copyright claimed, Public Domain
+ *
+ * Micro-benchmark for the software AGP (platform/agp/soft.c), composites a
+ * 1080p frame from an increasing number of full-screen layers, similar to a
+ * desktop with overlapping windows, and reads it back like the headless
+ * platform would. Each run covers the blend modes with both 1:1 (window
+ * content) and scaled, bilinear-filtered (thumbnails, effects) layers.
+ * Set ARCAN_AGP_THREADS to control the number of rasterizer threads.
+ * Output follows the other benchmarks,
+ *
+ * softagp:threads:layers:blend:mapping:ms_per_frame
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "video_platform.h"
+#include PLATFORM_HEADER
+
+#include "arcan_math.h"
+#include "arcan_general.h"
+#include "arcan_video.h"
+#include "arcan_mem.h"
+#include "arcan_videoint.h"
+
+#define OUT_W 1920
+#define OUT_H 1080
+#define FRAMES 30
+
+/* the parts of the engine the AGP implementation depends on */
+struct arcan_video_display arcan_video_display;
+
+void* arcan_alloc_mem(size_t nb, enum arcan_memtypes type,
+	enum arcan_memhint hint, enum arcan_memalign align)
+{
+	void* res = aligned_alloc(64, (nb + 63) & ~63);
+	if (res && (hint & ARCAN_MEM_BZERO))
+		memset(res, '\0', nb);
+	return res;
+}
+
+void arcan_mem_free(void* ptr)
+{
+	free(ptr);
+}
+
+void arcan_mem_growarr(struct arcan_strarr* arr)
+{
+	arr->data = realloc(arr->data, (arr->limit + 8) * sizeof(void*));
+	memset(&arr->data[arr->limit], '\0', 8 * sizeof(void*));
+	arr->limit += 8;
+}
+
+void arcan_warning(const char* msg, ...)
+{
+}
+
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+unsigned long long arcan_timemillis()
+{
+	return now_ns() / 1000000;
+}
+
+struct monitor_mode platform_video_dimensions()
+{
+	struct monitor_mode res = {.width = OUT_W, .height = OUT_H};
+	return res;
+}
+
+bool platform_video_map_handle(struct storage_info_t* dst, int64_t handle)
+{
+	return false;
+}
+
+void multiply_matrix(float* restrict dst,
+	const float* restrict a, const float* restrict b)
+{
+	for (size_t i = 0; i < 4; i++)
+		for (size_t j = 0; j < 4; j++){
+			float sum = 0;
+			for (size_t k = 0; k < 4; k++)
+				sum += a[k * 4 + j] * b[i * 4 + k];
+			dst[i * 4 + j] = sum;
+		}
+}
+
+static const char* blendstr[] = {
+	"none", "normal", "force", "add", "multiply"
+};
+
+int main(int argc, char** argv)
+{
+	agp_init();
+	const char* threads = getenv("ARCAN_AGP_THREADS");
+
+	float proj[16] = {
+		2.0 / OUT_W, 0, 0, 0,
+		0, -2.0 / OUT_H, 0, 0,
+		0, 0, -1, 0,
+		-1, 1, 0, 1
+	};
+	float txcos[8] = {0, 0, 1, 0, 1, 1, 0, 1};
+	float opacity = 1.0;
+
+/* semi-transparent content so blending can't take the opaque shortcut */
+	struct storage_info_t layer = {
+		.w = OUT_W, .h = OUT_H,
+		.txmapped = TXSTATE_TEX2D,
+		.txu = ARCAN_VTEX_CLAMP, .txv = ARCAN_VTEX_CLAMP,
+		.filtermode = ARCAN_VFILTER_BILINEAR
+	};
+	layer.vinf.text.s_raw = OUT_W * OUT_H * sizeof(av_pixel);
+	layer.vinf.text.raw = malloc(layer.vinf.text.s_raw);
+	for (size_t i = 0; i < OUT_W * OUT_H; i++)
+		layer.vinf.text.raw[i] = RGBA(i & 0xff, (i >> 8) & 0xff, i % 251, 192);
+	agp_update_vstore(&layer, true);
+
+	av_pixel* out = malloc(OUT_W * OUT_H * sizeof(av_pixel));
+
+	for (size_t layers = 1; layers <= 8; layers *= 2)
+		for (size_t blend = 0; blend <= BLEND_MULTIPLY; blend++)
+			for (size_t scaled = 0; scaled <= 1; scaled++){
+				unsigned long long ts = now_ns();
+
+				for (size_t i = 0; i < FRAMES; i++){
+					agp_activate_rendertarget(NULL);
+					agp_rendertarget_clear();
+					agp_pipeline_hint(PIPELINE_2D);
+					agp_shader_activate(agp_default_shader(BASIC_2D));
+					agp_shader_envv(PROJECTION_MATR, proj, sizeof(float) * 16);
+					agp_shader_envv(OBJ_OPACITY, &opacity, sizeof(float));
+					agp_activate_vstore(&layer);
+					agp_blendstate(blend);
+
+/* offset each layer a bit, scaled ones also shrink by 10% */
+					for (size_t j = 0; j < layers; j++){
+						float hw = OUT_W * (scaled ? 0.45 : 0.5);
+						float hh = OUT_H * (scaled ? 0.45 : 0.5);
+						float mv[16] = {
+							1, 0, 0, 0,
+							0, 1, 0, 0,
+							0, 0, 1, 0,
+							OUT_W * 0.5 + j * 8, OUT_H * 0.5 + j * 8, 0, 1
+						};
+						agp_draw_vobj(-hw, -hh, hw, hh, txcos, mv);
+					}
+
+					agp_save_output(OUT_W, OUT_H, out, OUT_W * OUT_H * sizeof(av_pixel));
+				}
+
+				ts = now_ns() - ts;
+				printf("softagp:%s:%zu:%s:%s:%.3f\n", threads ? threads : "auto",
+					layers, blendstr[blend], scaled ? "scaled" : "direct",
+					(double) ts / FRAMES / 1000000.0);
+			}
+
+	return EXIT_SUCCESS;
+}